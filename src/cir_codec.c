@@ -0,0 +1,226 @@
+/*
+ * cir_codec.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+
+#include "cir_codec.h"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#define CIR_CODEC_DELTA_FLAG	(0x80)
+#define CIR_CODEC_WIDTH_MASK	(0x1F)
+
+// Zigzag codes of a block in both forms and their bitwise OR, from the values at v, with the two before at v - 2
+typedef void (*residuals_fn)(const int16 *v, uint16 *zr, uint16 *zd, uint16 *or_r, uint16 *or_d);
+
+int cir_codec_parse(const char *name)
+{
+	if(strcmp(name, "none") == 0)
+		return CIR_CODEC_NONE;
+	if(strcmp(name, "delta") == 0)
+		return CIR_CODEC_DELTA;
+	return -1;
+}
+
+static inline uint16 zigzag(int16 x)
+{
+	return (uint16)(((uint16)x << 1) ^ (uint16)(x >> 15));
+}
+
+static inline int16 unzigzag(uint16 z)
+{
+	return (int16)((z >> 1) ^ -(int)(z & 1));
+}
+
+static inline uint32 width(uint16 bits)
+{
+	return bits ? 32 - __builtin_clz(bits) : 0;
+}
+
+static void residuals_scalar(const int16 *v, uint16 *zr, uint16 *zd, uint16 *or_r, uint16 *or_d)
+{
+	uint16 r = 0, d = 0;
+	int k;
+
+	for(k = 0; k < CIR_CODEC_BLOCK; k++)
+	{
+		zr[k] = zigzag(v[k]);
+		zd[k] = zigzag((int16)(uint16)(v[k] - v[k - 2]));
+		r |= zr[k];
+		d |= zd[k];
+	}
+
+	*or_r = r;
+	*or_d = d;
+}
+
+#ifdef __ARM_NEON
+static inline uint16x8_t zigzag_neon(int16x8_t x)
+{
+	return vreinterpretq_u16_s16(veorq_s16(vshlq_n_s16(x, 1), vshrq_n_s16(x, 15)));
+}
+
+static inline uint16 or_lanes(uint16x8_t x)
+{
+	uint16x4_t h = vorr_u16(vget_low_u16(x), vget_high_u16(x));
+
+	return vget_lane_u16(h, 0) | vget_lane_u16(h, 1) | vget_lane_u16(h, 2) | vget_lane_u16(h, 3);
+}
+
+static void residuals_neon(const int16 *v, uint16 *zr, uint16 *zd, uint16 *or_r, uint16 *or_d)
+{
+	int16x8_t a0 = vld1q_s16(v), a1 = vld1q_s16(v + 8);
+	uint16x8_t r0 = zigzag_neon(a0), r1 = zigzag_neon(a1);
+	uint16x8_t d0 = zigzag_neon(vsubq_s16(a0, vld1q_s16(v - 2)));
+	uint16x8_t d1 = zigzag_neon(vsubq_s16(a1, vld1q_s16(v + 6)));
+
+	vst1q_u16(zr, r0);
+	vst1q_u16(zr + 8, r1);
+	vst1q_u16(zd, d0);
+	vst1q_u16(zd + 8, d1);
+	*or_r = or_lanes(vorrq_u16(r0, r1));
+	*or_d = or_lanes(vorrq_u16(d0, d1));
+}
+#endif
+
+static uint32 pack_block(uint8 *out, const uint16 *z, uint32 w, uint8 flags)
+{
+	uint64_t acc = 0;
+	uint32 bits = 0, len = 1;
+	int k;
+
+	out[0] = flags | w;
+	for(k = 0; k < CIR_CODEC_BLOCK; k++)
+	{
+		acc |= (uint64_t)z[k] << bits;
+		bits += w;
+		for(; bits >= 8; bits -= 8)
+		{
+			out[len++] = (uint8)acc;
+			acc >>= 8;
+		}
+	}
+
+	// 16 values always fill whole bytes
+	return len;
+}
+
+static uint32 encode(const int16 *iq, uint16 num_taps, uint8 *out, residuals_fn residuals)
+{
+	int16 blk[2 + CIR_CODEC_BLOCK];
+	uint16 zr[CIR_CODEC_BLOCK], zd[CIR_CODEC_BLOCK];
+	uint16 or_r, or_d;
+	uint32 n = 2 * (uint32)num_taps;
+	uint32 b, count, wr, wd, len = 0;
+
+	for(b = 0; b < n; b += CIR_CODEC_BLOCK)
+	{
+		count = (n - b < CIR_CODEC_BLOCK) ? n - b : CIR_CODEC_BLOCK;
+
+		if(b >= 2 && count == CIR_CODEC_BLOCK)
+			residuals(iq + b, zr, zd, &or_r, &or_d);
+		else
+		{
+			// First block (no previous tap, the difference is with 0) or last one, padded with zero codes
+			memset(blk, 0, sizeof(blk));
+			if(b >= 2)
+				memcpy(blk, iq + b - 2, 2 * sizeof(int16));
+			memcpy(blk + 2, iq + b, count * sizeof(int16));
+			residuals(blk + 2, zr, zd, &or_r, &or_d);
+			// The padding is zero as is, but not its differences
+			if(count < CIR_CODEC_BLOCK)
+			{
+				memset(zd + count, 0, (CIR_CODEC_BLOCK - count) * sizeof(uint16));
+				for(or_d = 0; count > 0; count--)
+					or_d |= zd[count - 1];
+			}
+		}
+
+		wr = width(or_r);
+		wd = width(or_d);
+		if(wd < wr)
+			len += pack_block(out + len, zd, wd, CIR_CODEC_DELTA_FLAG);
+		else
+			len += pack_block(out + len, zr, wr, 0);
+	}
+
+	return len;
+}
+
+uint32 cir_codec_encode_scalar(const int16 *iq, uint16 num_taps, uint8 *out)
+{
+	return encode(iq, num_taps, out, residuals_scalar);
+}
+
+#ifdef __ARM_NEON
+uint32 cir_codec_encode_neon(const int16 *iq, uint16 num_taps, uint8 *out)
+{
+	return encode(iq, num_taps, out, residuals_neon);
+}
+
+uint32 cir_codec_encode(const int16 *iq, uint16 num_taps, uint8 *out)
+{
+	return encode(iq, num_taps, out, residuals_neon);
+}
+#else
+uint32 cir_codec_encode(const int16 *iq, uint16 num_taps, uint8 *out)
+{
+	return encode(iq, num_taps, out, residuals_scalar);
+}
+#endif /* __ARM_NEON */
+
+int cir_codec_decode(const uint8 *in, uint32 len, int16 *iq, uint16 num_taps)
+{
+	uint32 n = 2 * (uint32)num_taps;
+	uint32 b, k, count, w, pos = 0, next, bits;
+	uint64_t acc;
+	uint16 mask;
+	int16 x;
+	uint8 hdr;
+
+	for(b = 0; b < n; b += CIR_CODEC_BLOCK)
+	{
+		if(pos >= len)
+			return -1;
+		hdr = in[pos++];
+		w = hdr & CIR_CODEC_WIDTH_MASK;
+		if(w > 16 || (hdr & ~(CIR_CODEC_DELTA_FLAG | CIR_CODEC_WIDTH_MASK)) != 0 || len - pos < 2 * w)
+			return -1;
+		next = pos + 2 * w;
+
+		count = (n - b < CIR_CODEC_BLOCK) ? n - b : CIR_CODEC_BLOCK;
+		mask = (uint16)((1UL << w) - 1);
+		acc = 0;
+		bits = 0;
+		for(k = 0; k < count; k++)
+		{
+			for(; bits < w; bits += 8)
+				acc |= (uint64_t)in[pos++] << bits;
+			x = unzigzag((uint16)acc & mask);
+			acc >>= w;
+			bits -= w;
+
+			if(hdr & CIR_CODEC_DELTA_FLAG)
+				x = (int16)(uint16)(x + ((b + k >= 2) ? iq[b + k - 2] : 0));
+			iq[b + k] = x;
+		}
+
+		pos = next;
+	}
+
+	return (pos == len) ? 0 : -1;
+}
@@ -0,0 +1,88 @@
+/*
+ * cir_codec.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Lossless compression of the accumulator taps as read by dwt_readcir(), for the capture files and the stream (see
+ * cir_file.h and cir_stream.h). Away from the first path most taps are noise of a few tens of units, which need far
+ * fewer than 16 bits. The interleaved int16 real and imaginary values are cut into blocks of CIR_CODEC_BLOCK values
+ * (8 taps), each one coded on its own with one header byte followed by its 16 values packed on the same number of
+ * bits, 2 * width bytes in all:
+ *
+ *   header bit 7   0: the values themselves, 1: the difference with the same part of the previous tap (modulo 2^16)
+ *   header 4..0    width, 0 to 16 bits
+ *
+ * Values are zigzag coded (0, -1, 1, -2... to 0, 1, 2, 3...) and packed from the least significant bit of the first
+ * byte on. The encoder takes whichever of the two forms is narrower for each block, so the strong taps of the first
+ * path region cost at most one byte per block more than raw taps; the last block is padded with zeros. The analysis of
+ * the blocks has a scalar and a NEON version, as the cir_dsp.h kernels; both give the same output.
+ */
+
+#ifndef _CIR_CODEC_H_
+#define _CIR_CODEC_H_
+
+#include <stdint.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+
+#define CIR_CODEC_NONE			(0)			// raw int16 taps
+#define CIR_CODEC_DELTA			(1)			// block coded, see above
+
+#define CIR_CODEC_BLOCK			(16)		// int16 values per block
+
+// Largest encoded size of num_taps taps
+#define CIR_CODEC_MAX_LEN(num_taps)	((((num_taps) * 2 + CIR_CODEC_BLOCK - 1) / CIR_CODEC_BLOCK) * (1 + CIR_CODEC_BLOCK * 2))
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_codec_parse()
+ *
+ * @brief Parse a codec name: none or delta.
+ *
+ * @param name - codec name
+ *
+ * @return the CIR_CODEC_* value, -1 if unknown
+ */
+int cir_codec_parse(const char *name);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_codec_encode()
+ *
+ * @brief Compress taps with CIR_CODEC_DELTA.
+ *
+ * @param iq       - taps, 2 * num_taps values
+ * @param num_taps - number of taps
+ * @param out      - where to write the compressed taps, CIR_CODEC_MAX_LEN(num_taps) bytes
+ *
+ * @return the number of bytes written
+ */
+uint32 cir_codec_encode(const int16 *iq, uint16 num_taps, uint8 *out);
+uint32 cir_codec_encode_scalar(const int16 *iq, uint16 num_taps, uint8 *out);
+#ifdef __ARM_NEON
+uint32 cir_codec_encode_neon(const int16 *iq, uint16 num_taps, uint8 *out);
+#endif
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_codec_decode()
+ *
+ * @brief Decompress taps coded with CIR_CODEC_DELTA.
+ *
+ * @param in       - compressed taps
+ * @param len      - number of bytes of compressed taps
+ * @param iq       - where to return the taps, 2 * num_taps values
+ * @param num_taps - number of taps
+ *
+ * @return 0 on success, -1 if the data is corrupt or does not hold exactly num_taps taps
+ */
+int cir_codec_decode(const uint8 *in, uint32 len, int16 *iq, uint16 num_taps);
+
+#endif /* _CIR_CODEC_H_ */
@@ -0,0 +1,346 @@
+/*
+ * cir_dsp.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <math.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#include "cir_dsp.h"
+
+// Constant of the RX level formulas, per PRF (DW1000 User Manual, "Estimating the receive signal power")
+#define CIR_LEVEL_A_PRF16	(113.77f)
+#define CIR_LEVEL_A_PRF64	(121.74f)
+
+static float norm_scale(uint16 rxPreamCount)
+{
+	return rxPreamCount ? 1.0f / ((float)rxPreamCount * rxPreamCount) : 0.0f;
+}
+
+void cir_power_scalar(const int16 *iq, uint16 num_taps, uint32_t *pwr)
+{
+	uint16 i;
+
+	// Each square fits in an int32_t (at most 2^30), their sum only in an uint32_t
+	for(i = 0; i < num_taps; i++)
+		pwr[i] = (uint32_t)((int32_t)iq[2*i] * iq[2*i]) + (uint32_t)((int32_t)iq[2*i+1] * iq[2*i+1]);
+}
+
+void cir_power_norm_scalar(const int16 *iq, uint16 num_taps, uint16 rxPreamCount, float *pwr)
+{
+	float scale = norm_scale(rxPreamCount);
+	uint32_t p;
+	uint16 i;
+
+	for(i = 0; i < num_taps; i++)
+	{
+		p = (uint32_t)((int32_t)iq[2*i] * iq[2*i]) + (uint32_t)((int32_t)iq[2*i+1] * iq[2*i+1]);
+		pwr[i] = (float)p * scale;
+	}
+}
+
+void cir_magnitude_scalar(const int16 *iq, uint16 num_taps, float *mag)
+{
+	uint32_t p;
+	uint16 i;
+
+	for(i = 0; i < num_taps; i++)
+	{
+		p = (uint32_t)((int32_t)iq[2*i] * iq[2*i]) + (uint32_t)((int32_t)iq[2*i+1] * iq[2*i+1]);
+		mag[i] = sqrtf((float)p);
+	}
+}
+
+uint16 cir_peak_scalar(const uint32_t *pwr, uint16 num_taps, uint32_t *peak)
+{
+	uint16 index = 0;
+	uint16 i;
+
+	for(i = 1; i < num_taps; i++)
+	{
+		if(pwr[i] > pwr[index])
+			index = i;
+	}
+
+	if(peak != NULL)
+		*peak = pwr[index];
+	return index;
+}
+
+#ifdef __ARM_NEON
+
+void cir_power_neon(const int16 *iq, uint16 num_taps, uint32_t *pwr)
+{
+	int16x8x2_t v;
+	int32x4_t lo, hi;
+	uint16 i;
+
+	// 8 taps at a time, vld2 splits the real and imaginary parts. The sums wrap in the signed lanes, their bits are
+	// the uint32_t result.
+	for(i = 0; i + 8 <= num_taps; i += 8)
+	{
+		v = vld2q_s16(iq + 2*i);
+		lo = vmull_s16(vget_low_s16(v.val[0]), vget_low_s16(v.val[0]));
+		hi = vmull_s16(vget_high_s16(v.val[0]), vget_high_s16(v.val[0]));
+		lo = vmlal_s16(lo, vget_low_s16(v.val[1]), vget_low_s16(v.val[1]));
+		hi = vmlal_s16(hi, vget_high_s16(v.val[1]), vget_high_s16(v.val[1]));
+		vst1q_u32(pwr + i, vreinterpretq_u32_s32(lo));
+		vst1q_u32(pwr + i + 4, vreinterpretq_u32_s32(hi));
+	}
+
+	cir_power_scalar(iq + 2*i, num_taps - i, pwr + i);
+}
+
+void cir_power_norm_neon(const int16 *iq, uint16 num_taps, uint16 rxPreamCount, float *pwr)
+{
+	float scale = norm_scale(rxPreamCount);
+	int16x8x2_t v;
+	int32x4_t lo, hi;
+	uint16 i;
+
+	for(i = 0; i + 8 <= num_taps; i += 8)
+	{
+		v = vld2q_s16(iq + 2*i);
+		lo = vmull_s16(vget_low_s16(v.val[0]), vget_low_s16(v.val[0]));
+		hi = vmull_s16(vget_high_s16(v.val[0]), vget_high_s16(v.val[0]));
+		lo = vmlal_s16(lo, vget_low_s16(v.val[1]), vget_low_s16(v.val[1]));
+		hi = vmlal_s16(hi, vget_high_s16(v.val[1]), vget_high_s16(v.val[1]));
+		vst1q_f32(pwr + i, vmulq_n_f32(vcvtq_f32_u32(vreinterpretq_u32_s32(lo)), scale));
+		vst1q_f32(pwr + i + 4, vmulq_n_f32(vcvtq_f32_u32(vreinterpretq_u32_s32(hi)), scale));
+	}
+
+	cir_power_norm_scalar(iq + 2*i, num_taps - i, rxPreamCount, pwr + i);
+}
+
+static inline float32x4_t sqrt_f32x4(float32x4_t p)
+{
+#ifdef __aarch64__
+	return vsqrtq_f32(p);
+#else
+	// ARMv7 NEON has no square root: p * 1/sqrt(p), with the reciprocal estimate refined by two Newton-Raphson steps.
+	// p is kept away from 0 for the estimate only, so that a zero power gives 0 instead of 0 * inf.
+	float32x4_t q = vmaxq_f32(p, vdupq_n_f32(1e-30f));
+	float32x4_t e = vrsqrteq_f32(q);
+
+	e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(q, e), e));
+	e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(q, e), e));
+	return vmulq_f32(p, e);
+#endif
+}
+
+void cir_magnitude_neon(const int16 *iq, uint16 num_taps, float *mag)
+{
+	int16x8x2_t v;
+	int32x4_t lo, hi;
+	uint16 i;
+
+	for(i = 0; i + 8 <= num_taps; i += 8)
+	{
+		v = vld2q_s16(iq + 2*i);
+		lo = vmull_s16(vget_low_s16(v.val[0]), vget_low_s16(v.val[0]));
+		hi = vmull_s16(vget_high_s16(v.val[0]), vget_high_s16(v.val[0]));
+		lo = vmlal_s16(lo, vget_low_s16(v.val[1]), vget_low_s16(v.val[1]));
+		hi = vmlal_s16(hi, vget_high_s16(v.val[1]), vget_high_s16(v.val[1]));
+		vst1q_f32(mag + i, sqrt_f32x4(vcvtq_f32_u32(vreinterpretq_u32_s32(lo))));
+		vst1q_f32(mag + i + 4, sqrt_f32x4(vcvtq_f32_u32(vreinterpretq_u32_s32(hi))));
+	}
+
+	cir_magnitude_scalar(iq + 2*i, num_taps - i, mag + i);
+}
+
+uint16 cir_peak_neon(const uint32_t *pwr, uint16 num_taps, uint32_t *peak)
+{
+	static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+	uint32x4_t vmax, vindex, index, v, gt;
+	uint32_t lane_max[4], lane_index[4];
+	uint32_t best;
+	uint16 best_index;
+	uint16 i;
+	int lane;
+
+	if(num_taps < 4)
+		return cir_peak_scalar(pwr, num_taps, peak);
+
+	// Each lane keeps its own maximum and the first index it was seen at
+	vmax = vld1q_u32(pwr);
+	vindex = vld1q_u32(lanes);
+	index = vindex;
+	for(i = 4; i + 4 <= num_taps; i += 4)
+	{
+		index = vaddq_u32(index, vdupq_n_u32(4));
+		v = vld1q_u32(pwr + i);
+		gt = vcgtq_u32(v, vmax);
+		vmax = vbslq_u32(gt, v, vmax);
+		vindex = vbslq_u32(gt, index, vindex);
+	}
+	vst1q_u32(lane_max, vmax);
+	vst1q_u32(lane_index, vindex);
+
+	// On a tie between lanes the lowest index is the first occurrence
+	best = lane_max[0];
+	best_index = lane_index[0];
+	for(lane = 1; lane < 4; lane++)
+	{
+		if(lane_max[lane] > best || (lane_max[lane] == best && lane_index[lane] < best_index))
+		{
+			best = lane_max[lane];
+			best_index = lane_index[lane];
+		}
+	}
+
+	for(; i < num_taps; i++)
+	{
+		if(pwr[i] > best)
+		{
+			best = pwr[i];
+			best_index = i;
+		}
+	}
+
+	if(peak != NULL)
+		*peak = best;
+	return best_index;
+}
+
+void cir_power(const int16 *iq, uint16 num_taps, uint32_t *pwr)
+{
+	cir_power_neon(iq, num_taps, pwr);
+}
+
+void cir_power_norm(const int16 *iq, uint16 num_taps, uint16 rxPreamCount, float *pwr)
+{
+	cir_power_norm_neon(iq, num_taps, rxPreamCount, pwr);
+}
+
+void cir_magnitude(const int16 *iq, uint16 num_taps, float *mag)
+{
+	cir_magnitude_neon(iq, num_taps, mag);
+}
+
+uint16 cir_peak(const uint32_t *pwr, uint16 num_taps, uint32_t *peak)
+{
+	return cir_peak_neon(pwr, num_taps, peak);
+}
+
+#else
+
+void cir_power(const int16 *iq, uint16 num_taps, uint32_t *pwr)
+{
+	cir_power_scalar(iq, num_taps, pwr);
+}
+
+void cir_power_norm(const int16 *iq, uint16 num_taps, uint16 rxPreamCount, float *pwr)
+{
+	cir_power_norm_scalar(iq, num_taps, rxPreamCount, pwr);
+}
+
+void cir_magnitude(const int16 *iq, uint16 num_taps, float *mag)
+{
+	cir_magnitude_scalar(iq, num_taps, mag);
+}
+
+uint16 cir_peak(const uint32_t *pwr, uint16 num_taps, uint32_t *peak)
+{
+	return cir_peak_scalar(pwr, num_taps, peak);
+}
+
+#endif /* __ARM_NEON */
+
+float cir_first_path(const uint32_t *pwr, uint16 num_taps, uint16 first_tap, const dwt_rxdiag_t *diag, uint8 prf)
+{
+	float fp_dw = diag->firstPath / 64.0f;
+	float thr = CIR_FP_NOISE_FACTOR * diag->stdNoise;
+	int cir_len = CIR_LEN(prf);
+	float a0, a1, frac, fp;
+	int rel, start, end, i;
+
+	if(diag->stdNoise == 0)
+		return fp_dw;
+
+	// Search the window around firstPath, in pwr[] indexes. Each tap is compared with the tap before it.
+	rel = (int)fp_dw - first_tap;
+	if(rel < 0)
+		rel += cir_len;
+	start = rel - CIR_FP_WINDOW;
+	end = rel + CIR_FP_WINDOW;
+	if(start < 1)
+		start = 1;
+	if(end > num_taps - 1)
+		end = num_taps - 1;
+
+	for(i = start; i <= end; i++)
+	{
+		if((float)pwr[i] < thr * thr)
+			continue;
+
+		// Linear interpolation of the magnitude between the last tap below the threshold and this one
+		a0 = sqrtf((float)pwr[i-1]);
+		a1 = sqrtf((float)pwr[i]);
+		frac = (a1 > a0) ? (thr - a0) / (a1 - a0) : 1.0f;
+		if(frac < 0.0f)
+			frac = 0.0f;
+		fp = first_tap + i - 1 + frac;
+		return (fp >= cir_len) ? fp - cir_len : fp;
+	}
+
+	return fp_dw;
+}
+
+float cir_rx_power(const dwt_rxdiag_t *diag, uint8 prf)
+{
+	float n = diag->rxPreamCount;
+
+	if(diag->rxPreamCount == 0 || diag->maxGrowthCIR == 0)
+		return -INFINITY;
+
+	return 10.0f * log10f((float)diag->maxGrowthCIR * 131072.0f / (n * n)) -
+		   ((prf == DWT_PRF_16M) ? CIR_LEVEL_A_PRF16 : CIR_LEVEL_A_PRF64);
+}
+
+float cir_fp_power(const dwt_rxdiag_t *diag, uint8 prf)
+{
+	float n = diag->rxPreamCount;
+	float f1 = diag->firstPathAmp1;
+	float f2 = diag->firstPathAmp2;
+	float f3 = diag->firstPathAmp3;
+
+	if(diag->rxPreamCount == 0 || (f1 == 0 && f2 == 0 && f3 == 0))
+		return -INFINITY;
+
+	return 10.0f * log10f((f1 * f1 + f2 * f2 + f3 * f3) / (n * n)) - ((prf == DWT_PRF_16M) ? CIR_LEVEL_A_PRF16 : CIR_LEVEL_A_PRF64);
+}
+
+void cir_features(const int16 *iq, uint16 num_taps, uint16 first_tap, const dwt_rxdiag_t *diag, uint8 prf, uint32_t *pwr,
+				  cir_features_t *features)
+{
+	float scale = norm_scale(diag->rxPreamCount);
+	uint64_t energy = 0;
+	uint32_t peak;
+	uint16 i;
+
+	cir_power(iq, num_taps, pwr);
+	features->peak_index = (first_tap + cir_peak(pwr, num_taps, &peak)) % CIR_LEN(prf);
+	features->peak_power = (float)peak * scale;
+
+	for(i = 0; i < num_taps; i++)
+		energy += pwr[i];
+	features->energy = (float)energy * scale;
+
+	features->first_path = cir_first_path(pwr, num_taps, first_tap, diag, prf);
+	features->first_path_dw = diag->firstPath / 64.0f;
+	features->rx_power = cir_rx_power(diag, prf);
+	features->fp_power = cir_fp_power(diag, prf);
+}
@@ -0,0 +1,178 @@
+/*
+ * cir_dsp.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * CIR post-processing kernels, working on the accumulator taps as read by dwt_readcir(): interleaved int16 real and
+ * imaginary parts. Each vectorised kernel has a scalar version, <name>_scalar(), and when built for a NEON capable
+ * target (__ARM_NEON, e.g. aarch64 or -mfpu=neon on 32-bit ARM) a NEON version, <name>_neon(). <name>() calls the
+ * NEON version when it is built in. Buffers need no particular alignment and any number of taps can be processed.
+ *
+ * CIR windows may wrap around the end of the accumulator (see dwt_readcirwindow()): tap i of a window starting at
+ * first_tap is accumulator tap (first_tap + i) % CIR_LEN(prf), and accumulator indexes are returned in [0, CIR_LEN(prf)).
+ */
+
+#ifndef _CIR_DSP_H_
+#define _CIR_DSP_H_
+
+#include <stdint.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+
+#define CIR_FP_NOISE_FACTOR		(6.0f)		// leading edge threshold of cir_first_path(), in noise standard deviations
+#define CIR_FP_WINDOW			(16)		// taps searched on each side of firstPath by cir_first_path()
+
+// Number of taps of the CIR at a PRF
+#define CIR_LEN(prf)			(((prf) == DWT_PRF_16M) ? DWT_CIR_LEN_PRF16 : DWT_CIR_LEN_PRF64)
+
+// Features of one CIR, see cir_features()
+typedef struct
+{
+	float		first_path;		// refined first path, in accumulator taps
+	float		first_path_dw;	// first path found by the DW1000 (firstPath), in accumulator taps
+	uint16		peak_index;		// accumulator index of the strongest tap
+	float		peak_power;		// power of the strongest tap, normalised by rxPreamCount^2
+	float		energy;			// total power of the taps, normalised by rxPreamCount^2
+	float		rx_power;		// estimated RX level in dBm, see cir_rx_power()
+	float		fp_power;		// estimated first path level in dBm, see cir_fp_power()
+} cir_features_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_power()
+ *
+ * @brief Compute the power of each tap, re^2 + im^2. The result always fits in 32 bits.
+ *
+ * @param iq       - taps, 2 * num_taps values
+ * @param num_taps - number of taps
+ * @param pwr      - where to return the powers, num_taps values
+ *
+ * @return none
+ */
+void cir_power(const int16 *iq, uint16 num_taps, uint32_t *pwr);
+void cir_power_scalar(const int16 *iq, uint16 num_taps, uint32_t *pwr);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_power_norm()
+ *
+ * @brief Compute the power of each tap normalised by the number of accumulated preamble symbols, i.e.
+ *        (re^2 + im^2) / rxPreamCount^2, which makes frames received with different preamble counts comparable.
+ *
+ * @param iq           - taps, 2 * num_taps values
+ * @param num_taps     - number of taps
+ * @param rxPreamCount - preamble symbols accumulated, from the RX diagnostics
+ * @param pwr          - where to return the normalised powers, num_taps values
+ *
+ * @return none
+ */
+void cir_power_norm(const int16 *iq, uint16 num_taps, uint16 rxPreamCount, float *pwr);
+void cir_power_norm_scalar(const int16 *iq, uint16 num_taps, uint16 rxPreamCount, float *pwr);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_magnitude()
+ *
+ * @brief Compute the magnitude of each tap, sqrt(re^2 + im^2). The NEON version is accurate to about 1e-6 relative.
+ *
+ * @param iq       - taps, 2 * num_taps values
+ * @param num_taps - number of taps
+ * @param mag      - where to return the magnitudes, num_taps values
+ *
+ * @return none
+ */
+void cir_magnitude(const int16 *iq, uint16 num_taps, float *mag);
+void cir_magnitude_scalar(const int16 *iq, uint16 num_taps, float *mag);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_peak()
+ *
+ * @brief Find the strongest tap.
+ *
+ * @param pwr      - tap powers, from cir_power()
+ * @param num_taps - number of taps, at least 1
+ * @param peak     - where to return the power of the strongest tap, may be NULL
+ *
+ * @return the index of the first tap with the highest power
+ */
+uint16 cir_peak(const uint32_t *pwr, uint16 num_taps, uint32_t *peak);
+uint16 cir_peak_scalar(const uint32_t *pwr, uint16 num_taps, uint32_t *peak);
+
+#ifdef __ARM_NEON
+void cir_power_neon(const int16 *iq, uint16 num_taps, uint32_t *pwr);
+void cir_power_norm_neon(const int16 *iq, uint16 num_taps, uint16 rxPreamCount, float *pwr);
+void cir_magnitude_neon(const int16 *iq, uint16 num_taps, float *mag);
+uint16 cir_peak_neon(const uint32_t *pwr, uint16 num_taps, uint32_t *peak);
+#endif
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_first_path()
+ *
+ * @brief Refine the first path found by the DW1000: look for the leading edge of the first path, i.e. the first tap
+ *        around firstPath whose magnitude reaches CIR_FP_NOISE_FACTOR times the noise standard deviation, and
+ *        interpolate where the edge crosses that threshold between the two taps.
+ *
+ * @param pwr       - tap powers, from cir_power()
+ * @param num_taps  - number of taps
+ * @param first_tap - accumulator index of pwr[0]
+ * @param diag      - RX diagnostics of the frame
+ * @param prf       - DWT_PRF_16M or DWT_PRF_64M
+ *
+ * @return the first path in accumulator taps, firstPath itself (converted from 10.6 fixed point) if no edge is found
+ *         within the taps
+ */
+float cir_first_path(const uint32_t *pwr, uint16 num_taps, uint16 first_tap, const dwt_rxdiag_t *diag, uint8 prf);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_rx_power()
+ *
+ * @brief Estimate the RX level from the diagnostics, as in the DW1000 User Manual "Estimating the receive signal
+ *        power": 10 * log10(maxGrowthCIR * 2^17 / rxPreamCount^2) - A, A depending on the PRF.
+ *
+ * @param diag - RX diagnostics of the frame
+ * @param prf  - DWT_PRF_16M or DWT_PRF_64M
+ *
+ * @return the RX level in dBm
+ */
+float cir_rx_power(const dwt_rxdiag_t *diag, uint8 prf);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_fp_power()
+ *
+ * @brief Estimate the first path level from the diagnostics, as in the DW1000 User Manual "Estimating the signal power
+ *        in the first path": 10 * log10((firstPathAmp1^2 + firstPathAmp2^2 + firstPathAmp3^2) / rxPreamCount^2) - A.
+ *
+ * @param diag - RX diagnostics of the frame
+ * @param prf  - DWT_PRF_16M or DWT_PRF_64M
+ *
+ * @return the first path level in dBm
+ */
+float cir_fp_power(const dwt_rxdiag_t *diag, uint8 prf);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_features()
+ *
+ * @brief Extract the features of one CIR in a single call: tap powers, strongest tap, energy, refined first path and
+ *        signal levels.
+ *
+ * @param iq        - taps, 2 * num_taps values
+ * @param num_taps  - number of taps, at least 1
+ * @param first_tap - accumulator index of the first tap
+ * @param diag      - RX diagnostics of the frame
+ * @param prf       - DWT_PRF_16M or DWT_PRF_64M
+ * @param pwr       - scratch buffer of num_taps values, holds the tap powers on return
+ * @param features  - where to return the features
+ *
+ * @return none
+ */
+void cir_features(const int16 *iq, uint16 num_taps, uint16 first_tap, const dwt_rxdiag_t *diag, uint8 prf, uint32_t *pwr,
+				  cir_features_t *features);
+
+#endif /* _CIR_DSP_H_ */
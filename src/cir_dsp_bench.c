@@ -0,0 +1,258 @@
+/*
+ * cir_dsp_bench.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Micro-benchmark of the cir_dsp.h kernels on a synthetic CIR: time per CIR of the scalar and NEON versions, checking
+ * that both give the same results, and of the whole cir_features() extraction. Then the same for the tap compression of
+ * cir_codec.h, with its ratio; -f runs it on the records of capture files instead, for the ratio of real CIRs.
+ *
+ * Usage: cir_dsp_bench [-t taps] [-i iterations] [-f file.cir]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "cir_dsp.h"
+#include "cir_codec.h"
+#include "cir_reader.h"
+
+#define BENCH_ITER_DEF		(20000)
+
+static int16 iq[2 * DWT_CIR_LEN_PRF64];
+static uint32_t pwr_a[DWT_CIR_LEN_PRF64], pwr_b[DWT_CIR_LEN_PRF64];
+static float f_a[DWT_CIR_LEN_PRF64], f_b[DWT_CIR_LEN_PRF64];
+static dwt_rxdiag_t diag;
+static uint8 enc[CIR_CODEC_MAX_LEN(DWT_CIR_LEN_PRF64)];
+static int16 dec[2 * DWT_CIR_LEN_PRF64];
+
+// Results are accumulated here so that the compiler can't drop the benchmarked calls
+static volatile uint32_t sink;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Noise everywhere, then a first path at tap 745 followed by decaying multipath, as seen at 64 MHz PRF
+static void make_cir(uint16 taps)
+{
+	uint32_t seed = 12345;
+	int i, re, im;
+	double a;
+
+	for(i = 0; i < taps; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		re = (int)((seed >> 16) % 101) - 50;
+		seed = seed * 1103515245 + 12345;
+		im = (int)((seed >> 16) % 101) - 50;
+
+		if(i >= 745 && i < 800)
+		{
+			a = 12000.0 * exp(-(i - 745) / 8.0);
+			re += (int)(a * cos(i * 0.7));
+			im += (int)(a * sin(i * 0.7));
+		}
+
+		iq[2*i] = re;
+		iq[2*i+1] = im;
+	}
+
+	diag.firstPath = 745 * 64 - 20;
+	diag.stdNoise = 30;
+	diag.rxPreamCount = 1016;
+	diag.maxGrowthCIR = 2000;
+	diag.firstPathAmp1 = 5000;
+	diag.firstPathAmp2 = 9000;
+	diag.firstPathAmp3 = 7000;
+}
+
+#define BENCH(label, iter, call)																\
+	do {																						\
+		double t0 = now_ns();																	\
+		long n;																					\
+		for(n = 0; n < (iter); n++)																\
+			call;																				\
+		printf("%-24s %9.1f ns/CIR\n", label, (now_ns() - t0) / (iter));						\
+	} while(0)
+
+// Same, with the throughput in MB/s of raw taps
+#define BENCH_RATE(label, iter, bytes, call)													\
+	do {																						\
+		double t0 = now_ns(), t;																\
+		long n;																					\
+		for(n = 0; n < (iter); n++)																\
+			call;																				\
+		t = (now_ns() - t0) / (iter);															\
+		printf("%-24s %9.1f ns/CIR %8.1f MB/s\n", label, t, (bytes) * 1e3 / t);				\
+	} while(0)
+
+static void report_check(const char *name, int ok)
+{
+	printf("%-24s %s\n", name, ok ? "match" : "MISMATCH");
+}
+
+// Compress and decompress the taps of every record of a capture file
+static int codec_file(const char *path)
+{
+	cir_reader_t reader;
+	const cir_record_t *rec;
+	const int16 *cir;
+	double t_enc = 0, t_dec = 0, t0;
+	uint64_t raw = 0, packed = 0;
+	uint32 i, len, records = 0, errors = 0;
+
+	if(cir_reader_open(&reader, path) != 0)
+		return -1;
+
+	for(i = 0; i < reader.count; i++)
+	{
+		rec = cir_reader_record(&reader, i);
+		cir = cir_reader_taps(&reader, rec);
+		if(cir == NULL || rec->num_taps == 0 || rec->num_taps > DWT_CIR_LEN_PRF64)
+			continue;
+
+		t0 = now_ns();
+		len = cir_codec_encode(cir, rec->num_taps, enc);
+		t_enc += now_ns() - t0;
+
+		t0 = now_ns();
+		if(cir_codec_decode(enc, len, dec, rec->num_taps) != 0 || memcmp(cir, dec, rec->num_taps * DWT_CIR_TAP_LEN) != 0)
+			errors++;
+		t_dec += now_ns() - t0;
+
+		records++;
+		raw += rec->num_taps * DWT_CIR_TAP_LEN;
+		packed += len;
+	}
+
+	if(records > 0)
+		printf("%s: %lu CIRs, %.2f:1 (%.0f bytes/CIR), encode %.1f MB/s, decode %.1f MB/s, %lu mismatches\n", path, records,
+			   (double)raw / packed, (double)packed / records, raw * 1e3 / t_enc, raw * 1e3 / t_dec, errors);
+	else
+		printf("%s: no CIR\n", path);
+
+	cir_reader_close(&reader);
+	return errors ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	cir_features_t features;
+	long iter = BENCH_ITER_DEF;
+	uint16 taps = DWT_CIR_LEN_PRF64;
+	uint32_t peak;
+	uint32 len;
+	int files = 0, ret = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "t:i:f:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'f':
+			files = 1;
+			if(codec_file(optarg) != 0)
+				ret = 1;
+			break;
+		case 't':
+			taps = strtoul(optarg, NULL, 0);
+			if(taps == 0 || taps > DWT_CIR_LEN_PRF64)
+				taps = DWT_CIR_LEN_PRF64;
+			break;
+		case 'i':
+			iter = strtol(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t taps] [-i iterations] [-f file.cir]...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(files)
+		return ret;
+
+	make_cir(taps);
+	printf("%u taps, %ld iterations\n", taps, iter);
+
+	BENCH("power scalar", iter, cir_power_scalar(iq, taps, pwr_a));
+	BENCH("power_norm scalar", iter, cir_power_norm_scalar(iq, taps, diag.rxPreamCount, f_a));
+	BENCH("magnitude scalar", iter, cir_magnitude_scalar(iq, taps, f_a));
+	BENCH("peak scalar", iter, sink += cir_peak_scalar(pwr_a, taps, &peak));
+
+#ifdef __ARM_NEON
+	{
+		int ok;
+		int i;
+
+		BENCH("power neon", iter, cir_power_neon(iq, taps, pwr_b));
+		BENCH("power_norm neon", iter, cir_power_norm_neon(iq, taps, diag.rxPreamCount, f_b));
+		BENCH("magnitude neon", iter, cir_magnitude_neon(iq, taps, f_b));
+		BENCH("peak neon", iter, sink += cir_peak_neon(pwr_a, taps, &peak));
+
+		cir_power_scalar(iq, taps, pwr_a);
+		cir_power_neon(iq, taps, pwr_b);
+		for(ok = 1, i = 0; i < taps; i++)
+			ok &= (pwr_a[i] == pwr_b[i]);
+		report_check("power", ok);
+
+		cir_power_norm_scalar(iq, taps, diag.rxPreamCount, f_a);
+		cir_power_norm_neon(iq, taps, diag.rxPreamCount, f_b);
+		for(ok = 1, i = 0; i < taps; i++)
+			ok &= (f_a[i] == f_b[i]);
+		report_check("power_norm", ok);
+
+		// The ARMv7 square root is an estimate refined twice, not exact
+		cir_magnitude_scalar(iq, taps, f_a);
+		cir_magnitude_neon(iq, taps, f_b);
+		for(ok = 1, i = 0; i < taps; i++)
+			ok &= (fabsf(f_a[i] - f_b[i]) <= 1e-5f * f_a[i] + 1e-6f);
+		report_check("magnitude", ok);
+
+		report_check("peak", cir_peak_scalar(pwr_a, taps, NULL) == cir_peak_neon(pwr_a, taps, NULL));
+	}
+#else
+	(void) pwr_b;
+	(void) f_b;
+	printf("NEON not available in this build\n");
+#endif
+
+	BENCH("features", iter, cir_features(iq, taps, 0, &diag, DWT_PRF_64M, pwr_a, &features));
+
+	printf("first path %.2f (DW1000 %.2f), peak %u, RX level %.1f dBm, FP level %.1f dBm\n", features.first_path, features.first_path_dw,
+		   features.peak_index, features.rx_power, features.fp_power);
+
+	BENCH_RATE("codec encode scalar", iter, taps * DWT_CIR_TAP_LEN, sink += cir_codec_encode_scalar(iq, taps, enc));
+#ifdef __ARM_NEON
+	{
+		static uint8 enc_b[CIR_CODEC_MAX_LEN(DWT_CIR_LEN_PRF64)];
+
+		BENCH_RATE("codec encode neon", iter, taps * DWT_CIR_TAP_LEN, sink += cir_codec_encode_neon(iq, taps, enc_b));
+		len = cir_codec_encode_scalar(iq, taps, enc);
+		report_check("codec encode", cir_codec_encode_neon(iq, taps, enc_b) == len && memcmp(enc, enc_b, len) == 0);
+	}
+#endif
+	len = cir_codec_encode(iq, taps, enc);
+	BENCH_RATE("codec decode", iter, taps * DWT_CIR_TAP_LEN, sink += cir_codec_decode(enc, len, dec, taps));
+	report_check("codec round trip", cir_codec_decode(enc, len, dec, taps) == 0 && memcmp(iq, dec, taps * DWT_CIR_TAP_LEN) == 0);
+	printf("codec ratio %.2f:1, %lu bytes for %u\n", (double)(taps * DWT_CIR_TAP_LEN) / len, (unsigned long)len, taps * DWT_CIR_TAP_LEN);
+
+	return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * cir_dump.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Converts binary CIR capture files (see cir_file.h) to CSV on stdout, one line per record. Files are read through
+ * cir_reader.h, so the range and diagnostics options only look at the record headers and the index.
+ *
+ * Usage: cir_dump [-t] [-x] [-s first_seq] [-e last_seq] [-f min:max] [-p min:max] [-n max] file.cir...
+ *   -t          append the I/Q taps to each line (real0,imag0,real1,imag1,...)
+ *   -x          append the CIR features computed by cir_features() (see cir_dsp.h), before the taps
+ *   -s, -e      only records with a sequence number in [first_seq, last_seq]
+ *   -f min:max  only records with firstPath in [min, max] (raw 10.6 fixed point value)
+ *   -p min:max  only records with rxPreamCount in [min, max]
+ *   -n max      only records with stdNoise up to max
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cir_reader.h"
+#include "cir_dsp.h"
+
+// Scratch tap powers for -x
+static uint32_t pwr[DWT_CIR_LEN_PRF64];
+
+static int dump_file(const char *path, int taps, int features, uint32 first_seq, uint32 last_seq, const cir_filter_t *filter)
+{
+	cir_reader_t reader;
+	cir_iter_t iter;
+	const cir_record_t *rec;
+	const int16 *cir;
+	cir_features_t feat;
+	uint16 num_taps;
+	int i;
+
+	if(cir_reader_open(&reader, path) != 0)
+		return -1;
+
+	cir_iter_init(&iter, &reader, cir_reader_findseq(&reader, first_seq),
+				  (last_seq == 0xFFFFFFFFUL) ? reader.count : cir_reader_findseq(&reader, last_seq + 1), filter);
+
+	while((rec = cir_iter_next(&iter)) != NULL)
+	{
+		printf("%u,%u.%09u,%llu,%llu,%llu,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u",
+			   rec->seq, rec->host_sec, rec->host_nsec,
+			   (unsigned long long)rec->rx_stamp, (unsigned long long)rec->rx_raw_stamp, (unsigned long long)rec->tx_stamp,
+			   rec->diag.firstPath, rec->diag.firstPathAmp1, rec->diag.firstPathAmp2, rec->diag.firstPathAmp3,
+			   rec->diag.stdNoise, rec->diag.maxNoise, rec->diag.maxGrowthCIR, rec->diag.rxPreamCount,
+			   rec->chan, rec->prf, rec->length, rec->first_tap, rec->num_taps);
+		if(rec->sync_stamp)
+			printf(",%llu", (unsigned long long)rec->sync_stamp);
+		else
+			printf(",");
+		if(rec->vbat_mv)
+			printf(",%.2f,%.3f", rec->temp_cdeg / 100.0, rec->vbat_mv / 1000.0);
+		else
+			printf(",,");
+
+		cir = cir_reader_taps(&reader, rec);
+		if(cir == NULL)
+			fprintf(stderr, "%s: record %u: corrupt taps\n", path, rec->seq);
+
+		if(features)
+		{
+			num_taps = (cir == NULL) ? 0 : (rec->num_taps > DWT_CIR_LEN_PRF64) ? DWT_CIR_LEN_PRF64 : rec->num_taps;
+			if(num_taps > 0)
+			{
+				cir_features(cir, num_taps, rec->first_tap, &rec->diag, rec->prf, pwr, &feat);
+				printf(",%.3f,%.3f,%u,%g,%g,%.2f,%.2f", feat.first_path, feat.first_path_dw, feat.peak_index,
+					   feat.peak_power, feat.energy, feat.rx_power, feat.fp_power);
+			}
+			else
+				printf(",,,,,,,");
+		}
+
+		if(taps && cir != NULL)
+		{
+			for(i = 0; i < 2 * rec->num_taps; i++)
+				printf(",%d", cir[i]);
+		}
+		printf("\n");
+	}
+
+	cir_reader_close(&reader);
+	return 0;
+}
+
+static int parse_range(const char *arg, uint16 *min, uint16 *max)
+{
+	unsigned int lo, hi;
+
+	if(sscanf(arg, "%u:%u", &lo, &hi) != 2 || lo > hi || hi > 0xFFFF)
+		return -1;
+
+	*min = lo;
+	*max = hi;
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-t] [-x] [-s first_seq] [-e last_seq] [-f min:max] [-p min:max] [-n max] file.cir...\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	cir_filter_t filter;
+	uint32 first_seq = 0;
+	uint32 last_seq = 0xFFFFFFFFUL;
+	int taps = 0;
+	int features = 0;
+	int ret = 0;
+	int opt;
+
+	cir_filter_init(&filter);
+
+	while((opt = getopt(argc, argv, "txs:e:f:p:n:")) != -1)
+	{
+		switch(opt)
+		{
+		case 't':
+			taps = 1;
+			break;
+		case 'x':
+			features = 1;
+			break;
+		case 's':
+			first_seq = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			last_seq = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			if(parse_range(optarg, &filter.firstPath_min, &filter.firstPath_max) != 0)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'p':
+			if(parse_range(optarg, &filter.rxPreamCount_min, &filter.rxPreamCount_max) != 0)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'n':
+			filter.stdNoise_max = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind >= argc)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("seq,host_time,rx_stamp,rx_raw_stamp,tx_stamp,firstPath,firstPathAmp1,firstPathAmp2,firstPathAmp3,"
+		   "stdNoise,maxNoise,maxGrowthCIR,rxPreamCount,chan,prf,length,first_tap,num_taps,sync_stamp,temp,vbat%s%s\n",
+		   features ? ",first_path,first_path_dw,peak_index,peak_power,energy,rx_power,fp_power" : "", taps ? ",taps..." : "");
+
+	for(; optind < argc; optind++)
+	{
+		if(dump_file(argv[optind], taps, features, first_seq, last_seq, &filter) != 0)
+			ret = 1;
+	}
+
+	return ret;
+}
@@ -0,0 +1,340 @@
+/*
+ * cir_file.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "cir_file.h"
+
+#define CIR_PAD4(len)	(((len) + 3) & ~3UL)
+#define CIR_PAD8(len)	(((len) + 7) & ~7UL)
+
+// Fails to compile if the record header picked up padding
+typedef char cir_record_size_check[(sizeof(cir_record_t) == 104) ? 1 : -1];
+
+static int write_all(int fd, const uint8 *buf, uint32 len)
+{
+	ssize_t ret;
+
+	while(len > 0)
+	{
+		ret = write(fd, buf, len);
+		if(ret < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			perror("CIR file: write failed");
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int start_file(cir_file_t *file)
+{
+	char path[CIR_FILE_PATH_MAX + 16];
+	cir_file_hdr_t hdr;
+
+	snprintf(path, sizeof(path), "%s_%04lu.cir", file->prefix, file->index);
+
+	file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(file->fd < 0)
+	{
+		perror("CIR file: can't create file");
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CIR_FILE_MAGIC;
+	hdr.version = CIR_FILE_VERSION;
+	hdr.record_hdr_len = sizeof(cir_record_t);
+	hdr.index = file->index;
+
+	// The header goes through the buffer like everything else
+	memcpy(file->buf, &hdr, sizeof(hdr));
+	file->buf_len = sizeof(hdr);
+	file->file_len = sizeof(hdr);
+
+	return 0;
+}
+
+static int buffer_write(cir_file_t *file, const void *data, uint32 len)
+{
+	const uint8 *src = data;
+	uint32 n;
+
+	while(len > 0)
+	{
+		n = CIR_FILE_BUF_LEN - file->buf_len;
+		if(n > len)
+			n = len;
+
+		memcpy(file->buf + file->buf_len, src, n);
+		file->buf_len += n;
+		src += n;
+		len -= n;
+
+		if(file->buf_len == CIR_FILE_BUF_LEN && cir_file_flush(file) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int cir_file_open(cir_file_t *file, const char *prefix, uint32 rotate_len, const dwt_config_t *config)
+{
+	memset(file, 0, sizeof(*file));
+	strncpy(file->prefix, prefix, sizeof(file->prefix) - 1);
+	file->rotate_len = rotate_len;
+	file->config = *config;
+	file->fd = -1;
+
+	file->buf = malloc(CIR_FILE_BUF_LEN);
+	file->enc = malloc(CIR_CODEC_MAX_LEN(CIR_FRAME_TAPS_MAX));
+	if(file->buf == NULL || file->enc == NULL || start_file(file) != 0)
+	{
+		free(file->buf);
+		free(file->enc);
+		file->buf = NULL;
+		file->enc = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void cir_file_setconfig(cir_file_t *file, const dwt_config_t *config)
+{
+	file->config = *config;
+}
+
+void cir_file_setcodec(cir_file_t *file, uint8 codec)
+{
+	file->codec = codec;
+}
+
+void cir_record_init(cir_record_t *rec, const cir_frame_t *frame, const dwt_config_t *config, uint64_t tx_stamp, uint8 codec,
+					 uint8 *enc)
+{
+	uint32 len;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->sync = CIR_RECORD_SYNC;
+	rec->codec = CIR_CODEC_NONE;
+	rec->taps_len = frame->num_taps * DWT_CIR_TAP_LEN;
+	if(codec == CIR_CODEC_DELTA)
+	{
+		len = cir_codec_encode(frame->cir, frame->num_taps, enc);
+		if(len < rec->taps_len)
+		{
+			rec->codec = codec;
+			rec->taps_len = len;
+		}
+	}
+	rec->size = CIR_PAD8(sizeof(*rec) + CIR_PAD4(frame->length) + rec->taps_len);
+	rec->seq = frame->seq;
+	rec->status = frame->status;
+	rec->finfo = frame->info.finfo;
+	rec->host_sec = frame->host_time.tv_sec;
+	rec->host_nsec = frame->host_time.tv_nsec;
+	rec->rx_stamp = cir_stamp40(frame->info.rxStamp);
+	rec->rx_raw_stamp = cir_stamp40(frame->info.rxRawStamp);
+	rec->tx_stamp = tx_stamp;
+	rec->diag = frame->info.diag;
+	rec->chan = config->chan;
+	rec->prf = config->prf;
+	rec->txPreambLength = config->txPreambLength;
+	rec->rxPAC = config->rxPAC;
+	rec->txCode = config->txCode;
+	rec->rxCode = config->rxCode;
+	rec->nsSFD = config->nsSFD;
+	rec->dataRate = config->dataRate;
+	rec->phrMode = config->phrMode;
+	rec->sfdTO = config->sfdTO;
+	rec->length = frame->length;
+	rec->first_tap = frame->first_tap;
+	rec->num_taps = frame->num_taps;
+	rec->sync_stamp = frame->sync_stamp;
+	rec->temp_cdeg = frame->temp_cdeg;
+	rec->vbat_mv = frame->vbat_mv;
+}
+
+void cir_record_pack(uint8 *buf, const cir_record_t *rec, const cir_frame_t *frame, const uint8 *enc)
+{
+	uint32 data_len = CIR_PAD4(frame->length);
+	uint32 cir_len = rec->taps_len;
+
+	memcpy(buf, rec, sizeof(*rec));
+	memcpy(buf + sizeof(*rec), frame->data, frame->length);
+	memset(buf + sizeof(*rec) + frame->length, 0, data_len - frame->length);
+	memcpy(buf + sizeof(*rec) + data_len, (rec->codec != CIR_CODEC_NONE) ? (const void *)enc : (const void *)frame->cir, cir_len);
+	memset(buf + sizeof(*rec) + data_len + cir_len, 0, rec->size - sizeof(*rec) - data_len - cir_len);
+}
+
+// Move on to the next file of the series first if a record would take the current one past its size
+static int rotate(cir_file_t *file, uint32 size)
+{
+	if(file->rotate_len && file->file_len > sizeof(cir_file_hdr_t) && file->file_len + size > file->rotate_len)
+	{
+		if(cir_file_close(file) != 0)
+			return -1;
+		file->index++;
+		if(start_file(file) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int cir_file_append(cir_file_t *file, const cir_frame_t *frame, uint64_t tx_stamp)
+{
+	static const uint8 pad[8] = { 0 };
+	cir_record_t rec;
+	uint32 data_len = CIR_PAD4(frame->length);
+	uint32 cir_len;
+
+	cir_record_init(&rec, frame, &file->config, tx_stamp, file->codec, file->enc);
+	cir_len = rec.taps_len;
+
+	if(rotate(file, rec.size) != 0)
+		return -1;
+
+	if(buffer_write(file, &rec, sizeof(rec)) != 0 ||
+	   buffer_write(file, frame->data, frame->length) != 0 ||
+	   buffer_write(file, pad, data_len - frame->length) != 0 ||
+	   buffer_write(file, (rec.codec != CIR_CODEC_NONE) ? (const void *)file->enc : (const void *)frame->cir, cir_len) != 0 ||
+	   buffer_write(file, pad, rec.size - sizeof(rec) - data_len - cir_len) != 0)
+		return -1;
+
+	file->file_len += rec.size;
+
+	return 0;
+}
+
+int cir_file_append_record(cir_file_t *file, const cir_record_t *rec)
+{
+	if(rotate(file, rec->size) != 0 || buffer_write(file, rec, rec->size) != 0)
+		return -1;
+
+	file->file_len += rec->size;
+
+	return 0;
+}
+
+int cir_file_flush(cir_file_t *file)
+{
+	if(file->buf_len == 0)
+		return 0;
+
+	if(write_all(file->fd, file->buf, file->buf_len) != 0)
+		return -1;
+
+	file->buf_len = 0;
+	return 0;
+}
+
+int cir_file_close(cir_file_t *file)
+{
+	int ret = 0;
+
+	if(file->fd < 0)
+		return 0;
+
+	if(cir_file_flush(file) != 0)
+		ret = -1;
+	if(close(file->fd) != 0)
+		ret = -1;
+	file->fd = -1;
+
+	return ret;
+}
+
+int cir_file_readheader(FILE *f, cir_file_hdr_t *hdr)
+{
+	if(fread(hdr, sizeof(*hdr), 1, f) != 1)
+		return -1;
+
+	if(hdr->magic != CIR_FILE_MAGIC || hdr->version < 1 || hdr->version > CIR_FILE_VERSION || hdr->record_hdr_len < sizeof(cir_record_t))
+		return -1;
+
+	return 0;
+}
+
+int cir_file_readrecord(FILE *f, const cir_file_hdr_t *hdr, cir_record_t *rec, uint8 *data, int16 *cir)
+{
+	uint8 enc[CIR_CODEC_MAX_LEN(CIR_FRAME_TAPS_MAX)];
+	uint32 data_len;
+	uint32 cir_len;
+
+	if(fread(rec, sizeof(*rec), 1, f) != 1)
+		return feof(f) ? 0 : -1;
+
+	// Records of version 1 (files, or streams stored by cir_recv) have zeros in place of taps_len and codec
+	if(hdr->version < 2)
+		rec->codec = CIR_CODEC_NONE;
+	rec->taps_len = cir_record_tapslen(rec);
+
+	if(rec->sync != CIR_RECORD_SYNC || rec->length > CIR_FRAME_DATA_MAX || rec->num_taps > CIR_FRAME_TAPS_MAX ||
+	   rec->taps_len > sizeof(enc) || rec->codec > CIR_CODEC_DELTA)
+		return -1;
+
+	data_len = CIR_PAD4(rec->length);
+	cir_len = rec->taps_len;
+	if(rec->size != CIR_PAD8(hdr->record_hdr_len + data_len + cir_len))
+		return -1;
+
+	// Skip the part of the header this version does not know about
+	if(hdr->record_hdr_len > sizeof(*rec) && fseek(f, hdr->record_hdr_len - sizeof(*rec), SEEK_CUR) != 0)
+		return -1;
+
+	if(fread(data, 1, rec->length, f) != rec->length)
+		return -1;
+	if(data_len > rec->length && fseek(f, data_len - rec->length, SEEK_CUR) != 0)
+		return -1;
+	if(rec->codec == CIR_CODEC_NONE)
+	{
+		if(fread(cir, 1, cir_len, f) != cir_len)
+			return -1;
+	}
+	else if(fread(enc, 1, cir_len, f) != cir_len || cir_codec_decode(enc, cir_len, cir, rec->num_taps) != 0)
+		return -1;
+	if(rec->size > hdr->record_hdr_len + data_len + cir_len &&
+	   fseek(f, rec->size - (hdr->record_hdr_len + data_len + cir_len), SEEK_CUR) != 0)
+		return -1;
+
+	return 1;
+}
+
+uint32 cir_record_tapslen(const cir_record_t *rec)
+{
+	return (rec->codec != CIR_CODEC_NONE) ? rec->taps_len : (uint32)rec->num_taps * DWT_CIR_TAP_LEN;
+}
+
+uint64_t cir_stamp40(const uint8 *stamp)
+{
+	uint64_t value = 0;
+	int i;
+
+	for(i = 4; i >= 0; i--)
+		value = (value << 8) | stamp[i];
+
+	return value;
+}
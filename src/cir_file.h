@@ -0,0 +1,268 @@
+/*
+ * cir_file.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Binary CIR capture files. A file starts with a cir_file_hdr_t and is followed by records, each one made of a
+ * cir_record_t header, the frame payload padded to a multiple of 4 bytes and the interleaved int16 I/Q taps, raw or
+ * compressed (see cir_codec.h). Records are padded to a multiple of 8 bytes so that they can be used in place from a
+ * memory mapping (see cir_reader.h). Everything is little endian, as written by the Raspberry Pi. Records are appended
+ * to one file until it reaches the rotation size, then the next file of the series is started.
+ */
+
+#ifndef _CIR_FILE_H_
+#define _CIR_FILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+#include "cir_ring.h"
+#include "cir_codec.h"
+
+#define CIR_FILE_MAGIC          (0x52494344UL)      // "DCIR"
+#define CIR_FILE_VERSION        (2)                 // 2: taps may be compressed (cir_codec.h), version 1 files are still read
+#define CIR_RECORD_SYNC         (0x43455244UL)      // "DREC", starts every record
+
+#define CIR_FILE_BUF_LEN        (64 * 1024)         // write buffer, data reaches the disk in blocks of this size
+#define CIR_FILE_PATH_MAX       (256)
+
+// File header, once at the start of each file (16 bytes)
+typedef struct
+{
+	uint32_t magic;			// CIR_FILE_MAGIC
+	uint16_t version;		// CIR_FILE_VERSION
+	uint16_t record_hdr_len;	// sizeof(cir_record_t), records may grow in later versions
+	uint32_t index;			// position of this file in the rotation series
+	uint32_t reserved;
+} cir_file_hdr_t;
+
+// Record header (104 bytes), the layout has no implicit padding. Fixed width types are used so that the files read the same
+// on 64-bit hosts.
+typedef struct
+{
+	uint32_t		sync;			// CIR_RECORD_SYNC
+	uint32_t		size;			// total size of the record, this header and the padding included
+	uint32_t		seq;			// host side sequence number
+	uint32_t		status;			// SYS_STATUS as reported to the RX callback
+	uint32_t		finfo;			// RX_FINFO register
+	uint32_t		host_sec;		// CLOCK_MONOTONIC capture time
+	uint32_t		host_nsec;
+	uint32_t		taps_len;		// bytes of taps following the payload, num_taps * DWT_CIR_TAP_LEN unless compressed
+	uint64_t		rx_stamp;		// 40-bit adjusted RX timestamp
+	uint64_t		rx_raw_stamp;	// 40-bit raw RX timestamp
+	uint64_t		tx_stamp;		// 40-bit TX timestamp carried in the payload, 0 if unknown
+	dwt_rxdiag_t	diag;			// RX diagnostics (16 bytes)
+	uint8_t			chan;			// configuration the frame was received with, see dwt_config_t
+	uint8_t			prf;
+	uint8_t			txPreambLength;
+	uint8_t			rxPAC;
+	uint8_t			txCode;
+	uint8_t			rxCode;
+	uint8_t			nsSFD;
+	uint8_t			dataRate;
+	uint8_t			phrMode;
+	uint8_t			codec;			// CIR_CODEC_* of the taps, always CIR_CODEC_NONE in version 1 files
+	uint16_t		sfdTO;
+	uint16_t		length;			// bytes of payload following the header (before padding)
+	uint16_t		first_tap;		// accumulator index of the first tap, tap i is at (first_tap + i) % CIR length
+	uint16_t		num_taps;		// number of I/Q taps following the payload
+	uint16_t		reserved2;
+	int16_t			temp_cdeg;		// DW1000 temperature at capture, 0.01 degrees C (see tempcomp.h)
+	uint16_t		vbat_mv;		// DW1000 supply voltage at capture, mV, 0 if not measured
+	uint64_t		sync_stamp;		// rx_stamp in the timebase of the reference node (see clock_sync.h), 0 if not synchronised
+} cir_record_t;
+
+// Writer side of a rotating series of capture files
+typedef struct
+{
+	char			prefix[CIR_FILE_PATH_MAX];	// files are named <prefix>_<index>.cir
+	uint32			rotate_len;					// start a new file past this many bytes, 0 to never rotate
+	uint32			index;						// index of the current file
+	uint32			file_len;					// bytes written to the current file, buffer included
+	int				fd;
+	dwt_config_t	config;						// configuration stored in the records
+	uint8			codec;						// CIR_CODEC_* of the taps written by cir_file_append()
+	uint8			*enc;						// compressed taps, CIR_CODEC_MAX_LEN(CIR_FRAME_TAPS_MAX) bytes
+	uint8			*buf;
+	uint32			buf_len;					// bytes waiting in buf
+} cir_file_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_open()
+ *
+ * @brief Start a series of capture files with the first file, <prefix>_0000.cir.
+ *
+ * @param file       - writer to initialise
+ * @param prefix     - path prefix of the files
+ * @param rotate_len - size after which the next file is started, 0 to write a single file
+ * @param config     - configuration stored in the records, see cir_file_setconfig()
+ *
+ * @return 0 on success, -1 on error
+ */
+int cir_file_open(cir_file_t *file, const char *prefix, uint32 rotate_len, const dwt_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_setconfig()
+ *
+ * @brief Change the configuration stored in the following records, e.g. after a dwt_configure().
+ *
+ * @param file   - writer to use
+ * @param config - new configuration
+ *
+ * @return none
+ */
+void cir_file_setconfig(cir_file_t *file, const dwt_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_setcodec()
+ *
+ * @brief Compress the taps of the following records, CIR_CODEC_NONE by default. A record whose taps do not compress
+ *        is written with raw taps.
+ *
+ * @param file  - writer to use
+ * @param codec - CIR_CODEC_*
+ *
+ * @return none
+ */
+void cir_file_setcodec(cir_file_t *file, uint8 codec);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_append()
+ *
+ * @brief Append one captured frame. The record goes to the write buffer, the disk only sees whole buffers.
+ *
+ * @param file     - writer to use
+ * @param frame    - captured frame
+ * @param tx_stamp - TX timestamp of the frame if known (e.g. carried in the payload), 0 otherwise
+ *
+ * @return 0 on success, -1 on write error
+ */
+int cir_file_append(cir_file_t *file, const cir_frame_t *frame, uint64_t tx_stamp);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_append_record()
+ *
+ * @brief Append a record that is already in the file format, e.g. received from a cir_stream_t.
+ *
+ * @param file - writer to use
+ * @param rec  - record header, followed in memory by the rest of the record (rec->size bytes in all)
+ *
+ * @return 0 on success, -1 on write error
+ */
+int cir_file_append_record(cir_file_t *file, const cir_record_t *rec);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_record_init()
+ *
+ * @brief Fill in the record header of a captured frame, as cir_file_append() writes it, and compress the taps if asked
+ *        to (and if they do compress).
+ *
+ * @param rec      - header to fill in
+ * @param frame    - captured frame
+ * @param config   - configuration the frame was received with
+ * @param tx_stamp - TX timestamp of the frame if known, 0 otherwise
+ * @param codec    - CIR_CODEC_* to use for the taps
+ * @param enc      - where to compress them, CIR_CODEC_MAX_LEN(frame->num_taps) bytes, may be NULL for CIR_CODEC_NONE
+ *
+ * @return none
+ */
+void cir_record_init(cir_record_t *rec, const cir_frame_t *frame, const dwt_config_t *config, uint64_t tx_stamp, uint8 codec,
+					 uint8 *enc);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_record_pack()
+ *
+ * @brief Serialize a whole record: the header, the padded payload and the taps.
+ *
+ * @param buf   - where to write the record, rec->size bytes
+ * @param rec   - header from cir_record_init()
+ * @param frame - captured frame
+ * @param enc   - compressed taps from cir_record_init(), if rec->codec is not CIR_CODEC_NONE
+ *
+ * @return none
+ */
+void cir_record_pack(uint8 *buf, const cir_record_t *rec, const cir_frame_t *frame, const uint8 *enc);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_flush()
+ *
+ * @brief Write out whatever is waiting in the write buffer.
+ *
+ * @param file - writer to use
+ *
+ * @return 0 on success, -1 on write error
+ */
+int cir_file_flush(cir_file_t *file);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_close()
+ *
+ * @brief Flush and close the current file of the series.
+ *
+ * @param file - writer to close
+ *
+ * @return 0 on success, -1 on write error
+ */
+int cir_file_close(cir_file_t *file);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_readheader()
+ *
+ * @brief Read and check the header of a capture file.
+ *
+ * @param f   - file positioned at its start
+ * @param hdr - where to return the header
+ *
+ * @return 0 on success, -1 on error or if this is not a capture file of a supported version
+ */
+int cir_file_readheader(FILE *f, cir_file_hdr_t *hdr);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_file_readrecord()
+ *
+ * @brief Read the next record of a capture file.
+ *
+ * @param f    - file positioned at a record, i.e. after cir_file_readheader() or a previous record
+ * @param hdr  - header of the file, from cir_file_readheader()
+ * @param rec  - where to return the record header
+ * @param data - where to return the payload, at least CIR_FRAME_DATA_MAX bytes
+ * @param cir  - where to return the taps, decompressed, at least 2 * CIR_FRAME_TAPS_MAX values
+ *
+ * @return 1 if a record was read, 0 at the end of the file, -1 on a corrupt or truncated record
+ */
+int cir_file_readrecord(FILE *f, const cir_file_hdr_t *hdr, cir_record_t *rec, uint8 *data, int16 *cir);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_stamp40()
+ *
+ * @brief Convert a 5-byte little endian DW1000 timestamp to an integer.
+ *
+ * @param stamp - the timestamp as read from the device
+ *
+ * @return the timestamp value
+ */
+uint64_t cir_stamp40(const uint8 *stamp);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_record_tapslen()
+ *
+ * @brief Get the number of bytes of taps stored in a record.
+ *
+ * @param rec - record header
+ *
+ * @return the size of the taps, compressed or not
+ */
+uint32 cir_record_tapslen(const cir_record_t *rec);
+
+#endif /* _CIR_FILE_H_ */
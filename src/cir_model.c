@@ -0,0 +1,255 @@
+/*
+ * cir_model.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "cir_model.h"
+#include "cir_dsp.h"
+
+#define CIR_MODEL_VAR_MIN		(1e-12f)
+
+static int parse_float(const char *value, float min, float max, float *out)
+{
+	char *end;
+	float x = strtof(value, &end);
+
+	if(end == value || *end != '\0' || !(x > min && x < max))
+		return -1;
+	*out = x;
+	return 0;
+}
+
+static int parse_taps(const char *value, cir_model_config_t *config)
+{
+	char *end;
+	unsigned long pre, post;
+
+	pre = strtoul(value, &end, 10);
+	if(end == value || *end != ':')
+		return -1;
+	value = end + 1;
+	post = strtoul(value, &end, 10);
+	if(end == value || *end != '\0' || pre + post + 1 > CIR_MODEL_TAPS_MAX)
+		return -1;
+
+	config->pre = pre;
+	config->taps = pre + post + 1;
+	return 0;
+}
+
+int cir_model_parse(const char *arg, cir_model_config_t *config)
+{
+	char buf[CIR_MODEL_PATH_MAX + 128];
+	char *item, *end, *save = NULL;
+	int ret = 0;
+
+	memset(config, 0, sizeof(*config));
+	config->alpha = CIR_MODEL_ALPHA_DEF;
+	config->threshold = CIR_MODEL_THRESHOLD_DEF;
+	config->pre = CIR_MODEL_PRE_DEF;
+	config->taps = CIR_MODEL_TAPS_DEF;
+	config->report_sec = CIR_MODEL_REPORT_DEF;
+
+	if(strlen(arg) >= sizeof(buf))
+		return -1;
+	strcpy(buf, arg);
+
+	item = strtok_r(buf, ",", &save);
+	if(item == NULL || strlen(item) >= sizeof(config->path))
+		return -1;
+	strcpy(config->path, item);
+
+	for(item = strtok_r(NULL, ",", &save); ret == 0 && item != NULL; item = strtok_r(NULL, ",", &save))
+	{
+		if(strncmp(item, "alpha=", 6) == 0)
+			ret = parse_float(item + 6, 0, 1, &config->alpha);
+		else if(strncmp(item, "threshold=", 10) == 0)
+			ret = parse_float(item + 10, 0, INFINITY, &config->threshold);
+		else if(strncmp(item, "taps=", 5) == 0)
+			ret = parse_taps(item + 5, config);
+		else if(strncmp(item, "report=", 7) == 0)
+		{
+			config->report_sec = strtoul(item + 7, &end, 10);
+			ret = (end == item + 7 || *end != '\0') ? -1 : 0;
+		}
+		else if(strcmp(item, "forward") == 0)
+			config->forward = 1;
+		else
+			ret = -1;
+	}
+
+	return ret;
+}
+
+void cir_model_init(cir_model_t *model, const cir_model_config_t *config)
+{
+	memset(model, 0, sizeof(*model));
+	model->config = *config;
+}
+
+void cir_model_report_reset(cir_link_t *link)
+{
+	link->report_sum = 0;
+	link->report_max = 0;
+	link->report_frames = 0;
+}
+
+static cir_link_t *find_link(cir_model_t *model, uint8 key)
+{
+	cir_link_t *link;
+	unsigned int i;
+
+	for(i = 0; i < model->num_links; i++)
+	{
+		if(model->links[i].key == key)
+			return &model->links[i];
+	}
+
+	if(model->num_links == CIR_MODEL_LINKS_MAX)
+		return NULL;
+
+	link = &model->links[model->num_links++];
+	link->key = key;
+	return link;
+}
+
+// Aligned magnitudes of the model taps, NAN for those outside the captured taps. Returns the number of taps covered.
+static unsigned int align(cir_model_t *model, const cir_frame_t *frame, uint8 prf, float *x)
+{
+	const cir_model_config_t *config = &model->config;
+	int len = CIR_LEN(prf);
+	float fp = frame->info.diag.firstPath / 64.0f;
+	float scale = (frame->info.diag.rxPreamCount != 0) ? 1.0f / frame->info.diag.rxPreamCount : 1.0f;
+	int fp_int = (int)fp;
+	float frac = fp - fp_int;
+	unsigned int j, covered = 0;
+	int w;
+
+	cir_magnitude(frame->cir, frame->num_taps, model->mag);
+
+	for(j = 0; j < config->taps; j++)
+	{
+		// Index in the captured window of accumulator tap fp_int - pre + j, which may wrap around
+		w = ((fp_int - (int)config->pre + (int)j - (int)frame->first_tap) % len + len) % len;
+		if(w + 1 >= frame->num_taps)
+		{
+			x[j] = NAN;
+			continue;
+		}
+		x[j] = ((1 - frac) * model->mag[w] + frac * model->mag[w + 1]) * scale;
+		covered++;
+	}
+
+	return covered;
+}
+
+int cir_model_update(cir_model_t *model, const cir_frame_t *frame, uint8 prf, cir_link_t **link_out)
+{
+	const cir_model_config_t *config = &model->config;
+	float x[CIR_MODEL_TAPS_MAX];
+	uint32 warmup = (uint32)ceilf(1 / config->alpha);
+	cir_link_t *link;
+	double sum = 0;
+	float d, var, floor, w, alpha = config->alpha;
+	unsigned int j, scored = 0;
+	int flags = 0;
+
+	*link_out = NULL;
+	if(frame->num_taps == 0)
+		return 0;
+
+	if(align(model, frame, prf, x) * 2 < config->taps)
+	{
+		model->unaligned++;
+		return 0;
+	}
+
+	link = find_link(model, (frame->length > 0) ? frame->data[0] : 0);
+	if(link == NULL)
+	{
+		model->overflow++;
+		return 0;
+	}
+	*link_out = link;
+
+	// Score against the background learned so far, once it has enough frames
+	if(link->frames >= warmup)
+	{
+		for(j = 0; j < config->taps; j++)
+		{
+			if(isnan(x[j]))
+				continue;
+			d = x[j] - link->mean[j];
+			floor = CIR_MODEL_VAR_REL * link->mean[j];
+			var = fmaxf(fmaxf(link->var[j], floor * floor), CIR_MODEL_VAR_MIN);
+			sum += d * d / var;
+			scored++;
+		}
+	}
+
+	if(scored > 0)
+	{
+		link->score = sum / scored;
+		flags |= CIR_MODEL_SCORED;
+
+		if(!link->event && link->score >= config->threshold)
+		{
+			link->event = 1;
+			link->events++;
+			link->event_frames = 0;
+			link->event_max = 0;
+			link->event_start = frame->host_time;
+			link->below = 0;
+			flags |= CIR_MODEL_EVENT_START;
+		}
+
+		if(link->event)
+		{
+			flags |= CIR_MODEL_IN_EVENT;
+			link->event_frames++;
+			link->event_max = fmaxf(link->event_max, link->score);
+			link->below = (link->score < config->threshold) ? link->below + 1 : 0;
+			if(link->below >= CIR_MODEL_HOLD)
+			{
+				link->event = 0;
+				flags |= CIR_MODEL_EVENT_END;
+			}
+		}
+
+		link->report_sum += link->score;
+		link->report_max = fmaxf(link->report_max, link->score);
+		link->report_frames++;
+	}
+
+	// Learn the frame: a plain average over the first frames, then exponentially weighted. During an event only the
+	// mean moves, slowly: the variance would soon take in the change and end the event.
+	if(flags & CIR_MODEL_IN_EVENT)
+		alpha *= CIR_MODEL_EVENT_RATE;
+	link->frames++;
+	w = fmaxf(alpha, 1.0f / link->frames);
+	for(j = 0; j < config->taps; j++)
+	{
+		if(isnan(x[j]))
+			continue;
+		d = x[j] - link->mean[j];
+		link->mean[j] += w * d;
+		if(!(flags & CIR_MODEL_IN_EVENT))
+			link->var[j] = (1 - w) * (link->var[j] + w * d * d);
+	}
+
+	return flags;
+}
@@ -0,0 +1,159 @@
+/*
+ * cir_model.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Incremental background model of the CIRs of each link, and change detection against it, so that a receiver can
+ * report changes of the channel (e.g. people in the room) as they happen instead of keeping every CIR for later.
+ *
+ * Each frame gives the tap magnitudes |h| normalised by rxPreamCount, aligned on the first path found by the DW1000
+ * (firstPath, interpolated between taps for its fractional part): model tap j is accumulator tap firstPath - pre + j,
+ * from pre taps before the first path to taps - pre - 1 after it. Per model tap the link keeps an exponentially
+ * weighted mean and variance, with weight alpha for the new frame (the model forgets with a time constant of about
+ * 1 / alpha frames). The change score of a frame is the mean over the taps of (|h| - mean)^2 / variance, computed
+ * before the frame is learned: around 1 for a frame like the background, much more when the channel has changed. The
+ * variance is floored at (CIR_MODEL_VAR_REL * mean)^2 so that the quiet taps of a stable channel do not make the score
+ * jump on tiny changes.
+ *
+ * A link enters an event when its score reaches the threshold, and leaves it after CIR_MODEL_HOLD frames in a row
+ * below it. During an event the variance is kept and the mean learns CIR_MODEL_EVENT_RATE times more slowly, so that
+ * what changed is not taken as background at once but a lasting change (e.g. furniture moved) still is, after about
+ * 1 / (alpha * CIR_MODEL_EVENT_RATE) frames. The first 1 / alpha frames of a link only build the model (their weight
+ * is 1 / n, a plain average, until it reaches alpha) and are not scored.
+ *
+ * Frames do not identify their transmitter, so a link is a receiver and the first byte of the frames (e.g. the blinks
+ * and the clock sync beacons of dw1000_tx, sent by different nodes) up to CIR_MODEL_LINKS_MAX links per model.
+ *
+ * Specification: <path>[,alpha=<a>][,threshold=<score>][,taps=<pre>:<post>][,report=<s>][,forward], see
+ * cir_model_parse().
+ */
+
+#ifndef _CIR_MODEL_H_
+#define _CIR_MODEL_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+#include "cir_ring.h"
+
+#define CIR_MODEL_ALPHA_DEF		(0.01f)		// weight of a new frame
+#define CIR_MODEL_THRESHOLD_DEF	(4.0f)		// change score starting an event
+#define CIR_MODEL_PRE_DEF		(8)			// model taps before the first path
+#define CIR_MODEL_TAPS_DEF		(64)		// model taps
+#define CIR_MODEL_TAPS_MAX		(256)
+#define CIR_MODEL_REPORT_DEF	(10)		// seconds between two reports of the score of a link
+#define CIR_MODEL_LINKS_MAX		(4)
+#define CIR_MODEL_HOLD			(10)		// frames below the threshold ending an event
+#define CIR_MODEL_EVENT_RATE	(0.1f)		// learning rate during an event, relative to alpha
+#define CIR_MODEL_VAR_REL		(0.05f)		// variance floor, relative to the mean
+#define CIR_MODEL_PATH_MAX		(256)
+
+// Flags returned by cir_model_update()
+#define CIR_MODEL_SCORED		(0x01)		// the frame has a change score
+#define CIR_MODEL_EVENT_START	(0x02)		// the link entered an event with this frame
+#define CIR_MODEL_EVENT_END		(0x04)		// the link left its event with this frame
+#define CIR_MODEL_IN_EVENT		(0x08)		// the link is in an event (this frame included)
+
+typedef struct
+{
+	char	path[CIR_MODEL_PATH_MAX];	// where to write the events
+	float	alpha;
+	float	threshold;
+	uint16	pre;
+	uint16	taps;
+	uint32	report_sec;					// 0 for no periodic reports
+	int		forward;					// only keep the CIRs of the frames in an event
+} cir_model_config_t;
+
+typedef struct
+{
+	uint8	key;						// first byte of the frames
+	uint32	frames;						// frames learned
+	float	mean[CIR_MODEL_TAPS_MAX];
+	float	var[CIR_MODEL_TAPS_MAX];
+	float	score;						// score of the latest frame
+	int		event;						// in an event
+	uint32	below;						// frames of the event in a row below the threshold
+	uint32	events;						// events so far
+	uint32	event_frames;				// frames of the current or last event
+	float	event_max;					// highest score of the current or last event
+	struct timespec	event_start;		// host_time of the frame starting the current or last event
+	double	report_sum;					// sum of the scores since the last report
+	float	report_max;					// highest score since the last report
+	uint32	report_frames;				// frames scored since the last report
+} cir_link_t;
+
+typedef struct
+{
+	cir_model_config_t	config;
+	unsigned int		num_links;
+	cir_link_t			links[CIR_MODEL_LINKS_MAX];
+	uint32				unaligned;		// frames whose taps did not cover most of the model taps
+	uint32				overflow;		// frames of links beyond CIR_MODEL_LINKS_MAX
+	float				mag[CIR_FRAME_TAPS_MAX];	// scratch buffer of cir_model_update()
+} cir_model_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_model_parse()
+ *
+ * @brief Parse a model specification: the path of the event file, then comma separated options alpha=<a> (0 < a < 1),
+ *        threshold=<score>, taps=<pre>:<post> (model taps around the first path), report=<s> (0 for no periodic
+ *        reports) and forward.
+ *
+ * @param arg    - specification
+ * @param config - where to store the configuration
+ *
+ * @return 0 on success, -1 on error
+ */
+int cir_model_parse(const char *arg, cir_model_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_model_init()
+ *
+ * @brief Initialise a model without any link.
+ *
+ * @param model  - model to initialise
+ * @param config - configuration, from cir_model_parse()
+ *
+ * @return none
+ */
+void cir_model_init(cir_model_t *model, const cir_model_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_model_update()
+ *
+ * @brief Score a captured frame against the background of its link, then learn it. Frames without taps, or whose taps
+ *        cover less than half of the model taps, are left out.
+ *
+ * @param model - model to update
+ * @param frame - captured frame
+ * @param prf   - DWT_PRF_16M or DWT_PRF_64M
+ * @param link  - where to return the link of the frame, NULL if the frame was left out
+ *
+ * @return CIR_MODEL_* flags, 0 if the frame was left out or only learned
+ */
+int cir_model_update(cir_model_t *model, const cir_frame_t *frame, uint8 prf, cir_link_t **link);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_model_report_reset()
+ *
+ * @brief Start a new report period for a link.
+ *
+ * @param link - link
+ *
+ * @return none
+ */
+void cir_model_report_reset(cir_link_t *link);
+
+#endif /* _CIR_MODEL_H_ */
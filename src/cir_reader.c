@@ -0,0 +1,336 @@
+/*
+ * cir_reader.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cir_reader.h"
+
+#define CIR_INDEX_SUFFIX	".idx"
+
+// Whether a complete and sane record starts at offset
+static int record_valid(const cir_reader_t *reader, uint64_t offset)
+{
+	const cir_record_t *rec;
+
+	if(offset < sizeof(cir_file_hdr_t) || (offset & 7) != 0 || offset + reader->hdr->record_hdr_len > reader->len)
+		return 0;
+
+	rec = (const cir_record_t *)(reader->map + offset);
+	return rec->sync == CIR_RECORD_SYNC && rec->size >= reader->hdr->record_hdr_len && (rec->size & 7) == 0 &&
+		   offset + rec->size <= reader->len;
+}
+
+static int index_load(cir_reader_t *reader, const char *idx_path)
+{
+	cir_index_hdr_t hdr;
+	uint32 i;
+	FILE *f;
+
+	f = fopen(idx_path, "rb");
+	if(f == NULL)
+		return -1;
+
+	if(fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != CIR_INDEX_MAGIC || hdr.version != CIR_INDEX_VERSION ||
+	   hdr.file_len != reader->len || hdr.count > reader->len / reader->hdr->record_hdr_len)
+	{
+		fclose(f);
+		return -1;
+	}
+
+	reader->index = malloc((hdr.count ? hdr.count : 1) * sizeof(cir_index_entry_t));
+	if(reader->index == NULL || fread(reader->index, sizeof(cir_index_entry_t), hdr.count, f) != hdr.count)
+	{
+		free(reader->index);
+		reader->index = NULL;
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	// The same length does not make it the index of this file (e.g. rewritten since), every entry must be a record
+	for(i = 0; i < hdr.count; i++)
+	{
+		if(!record_valid(reader, reader->index[i].offset))
+		{
+			free(reader->index);
+			reader->index = NULL;
+			return -1;
+		}
+	}
+	reader->count = hdr.count;
+
+	return 0;
+}
+
+static void index_save(const cir_reader_t *reader, const char *idx_path)
+{
+	cir_index_hdr_t hdr;
+	FILE *f;
+
+	// Not being able to save the index (e.g. read-only capture directory) only costs a rebuild next time
+	f = fopen(idx_path, "wb");
+	if(f == NULL)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CIR_INDEX_MAGIC;
+	hdr.version = CIR_INDEX_VERSION;
+	hdr.file_len = reader->len;
+	hdr.count = reader->count;
+
+	if(fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	   fwrite(reader->index, sizeof(cir_index_entry_t), reader->count, f) != reader->count)
+	{
+		fclose(f);
+		unlink(idx_path);
+		return;
+	}
+
+	fclose(f);
+}
+
+static int index_build(cir_reader_t *reader)
+{
+	const cir_record_t *rec;
+	uint32 size = 1024;
+	size_t offset = sizeof(cir_file_hdr_t);
+	cir_index_entry_t *index;
+
+	reader->index = malloc(size * sizeof(cir_index_entry_t));
+	if(reader->index == NULL)
+		return -1;
+	reader->count = 0;
+
+	// Walk the record headers only, stop at the first incomplete or corrupt record
+	while(offset + reader->hdr->record_hdr_len <= reader->len)
+	{
+		if(!record_valid(reader, offset))
+			break;
+		rec = (const cir_record_t *)(reader->map + offset);
+
+		if(reader->count == size)
+		{
+			size *= 2;
+			index = realloc(reader->index, size * sizeof(cir_index_entry_t));
+			if(index == NULL)
+				return -1;
+			reader->index = index;
+		}
+
+		reader->index[reader->count].offset = offset;
+		reader->index[reader->count].host_ns = (uint64_t)rec->host_sec * 1000000000ULL + rec->host_nsec;
+		reader->index[reader->count].seq = rec->seq;
+		reader->index[reader->count].reserved = 0;
+		reader->count++;
+
+		offset += rec->size;
+	}
+
+	return 0;
+}
+
+int cir_reader_open(cir_reader_t *reader, const char *path)
+{
+	char idx_path[CIR_FILE_PATH_MAX + sizeof(CIR_INDEX_SUFFIX)];
+	struct stat st;
+	void *map;
+	int fd;
+
+	memset(reader, 0, sizeof(*reader));
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(cir_file_hdr_t))
+	{
+		fprintf(stderr, "%s: not a capture file\n", path);
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // the mapping keeps the file open
+	if(map == MAP_FAILED)
+	{
+		perror(path);
+		return -1;
+	}
+
+	reader->taps = malloc(2 * CIR_FRAME_TAPS_MAX * sizeof(int16));
+	if(reader->taps == NULL)
+	{
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	reader->map = map;
+	reader->len = st.st_size;
+	reader->hdr = (const cir_file_hdr_t *)reader->map;
+
+	if(reader->hdr->magic != CIR_FILE_MAGIC || reader->hdr->version < 1 || reader->hdr->version > CIR_FILE_VERSION ||
+	   reader->hdr->record_hdr_len < sizeof(cir_record_t) || (reader->hdr->record_hdr_len & 7) != 0)
+	{
+		fprintf(stderr, "%s: not a capture file\n", path);
+		cir_reader_close(reader);
+		return -1;
+	}
+
+	// Without a usable sidecar path the index is only kept in memory
+	if(snprintf(idx_path, sizeof(idx_path), "%s%s", path, CIR_INDEX_SUFFIX) >= (int)sizeof(idx_path))
+		idx_path[0] = '\0';
+
+	if(idx_path[0] == '\0' || index_load(reader, idx_path) != 0)
+	{
+		if(index_build(reader) != 0)
+		{
+			cir_reader_close(reader);
+			return -1;
+		}
+		if(idx_path[0] != '\0')
+			index_save(reader, idx_path);
+	}
+
+	return 0;
+}
+
+void cir_reader_close(cir_reader_t *reader)
+{
+	if(reader->map != NULL)
+		munmap((void *)reader->map, reader->len);
+	free(reader->index);
+	free(reader->taps);
+	memset(reader, 0, sizeof(*reader));
+}
+
+const cir_record_t *cir_reader_record(const cir_reader_t *reader, uint32 i)
+{
+	return (const cir_record_t *)(reader->map + reader->index[i].offset);
+}
+
+const uint8 *cir_reader_payload(const cir_reader_t *reader, const cir_record_t *rec)
+{
+	return (const uint8 *)rec + reader->hdr->record_hdr_len;
+}
+
+const int16 *cir_reader_taps(const cir_reader_t *reader, const cir_record_t *rec)
+{
+	// The payload is padded to 4 bytes
+	const uint8 *taps = cir_reader_payload(reader, rec) + ((rec->length + 3) & ~3U);
+
+	if(reader->hdr->version < 2 || rec->codec == CIR_CODEC_NONE)
+		return (const int16 *)taps;
+
+	if(rec->codec != CIR_CODEC_DELTA || rec->num_taps > CIR_FRAME_TAPS_MAX || rec->taps_len > rec->size ||
+	   taps + rec->taps_len > (const uint8 *)rec + rec->size ||
+	   cir_codec_decode(taps, rec->taps_len, reader->taps, rec->num_taps) != 0)
+		return NULL;
+	return reader->taps;
+}
+
+uint32 cir_reader_findseq(const cir_reader_t *reader, uint32 seq)
+{
+	uint32 lo = 0;
+	uint32 hi = reader->count;
+	uint32 mid;
+
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if(reader->index[mid].seq < seq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+uint32 cir_reader_findtime(const cir_reader_t *reader, uint64_t host_ns)
+{
+	uint32 lo = 0;
+	uint32 hi = reader->count;
+	uint32 mid;
+
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if(reader->index[mid].host_ns < host_ns)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+void cir_filter_init(cir_filter_t *filter)
+{
+	filter->firstPath_min = 0;
+	filter->firstPath_max = 0xFFFF;
+	filter->rxPreamCount_min = 0;
+	filter->rxPreamCount_max = 0xFFFF;
+	filter->stdNoise_min = 0;
+	filter->stdNoise_max = 0xFFFF;
+	filter->maxNoise_min = 0;
+	filter->maxNoise_max = 0xFFFF;
+	filter->firstPathAmp1_min = 0;
+	filter->firstPathAmp1_max = 0xFFFF;
+	filter->maxGrowthCIR_min = 0;
+	filter->maxGrowthCIR_max = 0xFFFF;
+}
+
+int cir_filter_match(const cir_filter_t *filter, const cir_record_t *rec)
+{
+	const dwt_rxdiag_t *diag = &rec->diag;
+
+	return diag->firstPath >= filter->firstPath_min && diag->firstPath <= filter->firstPath_max &&
+		   diag->rxPreamCount >= filter->rxPreamCount_min && diag->rxPreamCount <= filter->rxPreamCount_max &&
+		   diag->stdNoise >= filter->stdNoise_min && diag->stdNoise <= filter->stdNoise_max &&
+		   diag->maxNoise >= filter->maxNoise_min && diag->maxNoise <= filter->maxNoise_max &&
+		   diag->firstPathAmp1 >= filter->firstPathAmp1_min && diag->firstPathAmp1 <= filter->firstPathAmp1_max &&
+		   diag->maxGrowthCIR >= filter->maxGrowthCIR_min && diag->maxGrowthCIR <= filter->maxGrowthCIR_max;
+}
+
+void cir_iter_init(cir_iter_t *iter, const cir_reader_t *reader, uint32 first, uint32 end, const cir_filter_t *filter)
+{
+	iter->reader = reader;
+	iter->pos = first;
+	iter->end = (end > reader->count) ? reader->count : end;
+	iter->filter = filter;
+}
+
+const cir_record_t *cir_iter_next(cir_iter_t *iter)
+{
+	const cir_record_t *rec;
+
+	while(iter->pos < iter->end)
+	{
+		rec = cir_reader_record(iter->reader, iter->pos++);
+		if(iter->filter == NULL || cir_filter_match(iter->filter, rec))
+			return rec;
+	}
+
+	return NULL;
+}
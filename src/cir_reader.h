@@ -0,0 +1,214 @@
+/*
+ * cir_reader.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Random access to capture files (see cir_file.h) for offline analysis. The file is memory mapped and records are
+ * used in place, nothing is copied. An index of the records (offset, sequence number and capture time) is kept in a
+ * sidecar file <capture>.idx, built on the first open and rebuilt whenever the capture file has changed size.
+ */
+
+#ifndef _CIR_READER_H_
+#define _CIR_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cir_file.h"
+
+#define CIR_INDEX_MAGIC         (0x58444944UL)      // "DIDX"
+#define CIR_INDEX_VERSION       (1)
+
+// Sidecar index header (24 bytes), followed by one cir_index_entry_t per record
+typedef struct
+{
+	uint32_t magic;			// CIR_INDEX_MAGIC
+	uint32_t version;		// CIR_INDEX_VERSION
+	uint64_t file_len;		// size of the capture file the index was built from
+	uint32_t count;			// number of entries
+	uint32_t reserved;
+} cir_index_hdr_t;
+
+// One record of the capture file (24 bytes)
+typedef struct
+{
+	uint64_t offset;		// offset of the record in the capture file
+	uint64_t host_ns;		// capture time, CLOCK_MONOTONIC nanoseconds
+	uint32_t seq;			// host side sequence number
+	uint32_t reserved;
+} cir_index_entry_t;
+
+typedef struct
+{
+	const uint8				*map;		// whole capture file
+	size_t					len;
+	const cir_file_hdr_t	*hdr;
+	cir_index_entry_t		*index;		// records in file order, i.e. by increasing seq and host_ns
+	uint32					count;
+	int16					*taps;		// decompressed taps of the last compressed record, see cir_reader_taps()
+} cir_reader_t;
+
+// Diagnostics filter, a record matches if every field is within [min, max]. See cir_filter_init().
+typedef struct
+{
+	uint16 firstPath_min, firstPath_max;
+	uint16 rxPreamCount_min, rxPreamCount_max;
+	uint16 stdNoise_min, stdNoise_max;
+	uint16 maxNoise_min, maxNoise_max;
+	uint16 firstPathAmp1_min, firstPathAmp1_max;
+	uint16 maxGrowthCIR_min, maxGrowthCIR_max;
+} cir_filter_t;
+
+// Range iteration, see cir_iter_init()
+typedef struct
+{
+	const cir_reader_t	*reader;
+	uint32				pos;
+	uint32				end;
+	const cir_filter_t	*filter;
+} cir_iter_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_reader_open()
+ *
+ * @brief Map a capture file and load its index, building (and saving) it if the sidecar is missing or stale. A file
+ *        still being written is indexed up to its last complete record.
+ *
+ * @param reader - reader to initialise
+ * @param path   - capture file
+ *
+ * @return 0 on success, -1 on error
+ */
+int cir_reader_open(cir_reader_t *reader, const char *path);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_reader_close()
+ *
+ * @brief Unmap the capture file. Pointers into the records are invalid afterwards.
+ *
+ * @param reader - reader to close
+ *
+ * @return none
+ */
+void cir_reader_close(cir_reader_t *reader);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_reader_record()
+ *
+ * @brief Random access to a record.
+ *
+ * @param reader - reader to use
+ * @param i      - position of the record in the file, below reader->count
+ *
+ * @return the record header, in place in the mapping
+ */
+const cir_record_t *cir_reader_record(const cir_reader_t *reader, uint32 i);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_reader_payload()
+ *
+ * @brief Get the frame payload of a record, rec->length bytes.
+ *
+ * @param reader - reader to use
+ * @param rec    - record from this reader
+ *
+ * @return the payload, in place in the mapping
+ */
+const uint8 *cir_reader_payload(const cir_reader_t *reader, const cir_record_t *rec);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_reader_taps()
+ *
+ * @brief Get the I/Q taps of a record, rec->num_taps interleaved real/imaginary pairs. Compressed taps (see
+ *        cir_codec.h) are decompressed to a buffer of the reader, valid until the next call.
+ *
+ * @param reader - reader to use
+ * @param rec    - record from this reader
+ *
+ * @return the taps, in place in the mapping if not compressed, NULL if they are corrupt
+ */
+const int16 *cir_reader_taps(const cir_reader_t *reader, const cir_record_t *rec);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_reader_findseq()
+ *
+ * @brief Find the first record whose sequence number is at least seq.
+ *
+ * @param reader - reader to use
+ * @param seq    - sequence number to look for
+ *
+ * @return the position of the record, reader->count if there is none
+ */
+uint32 cir_reader_findseq(const cir_reader_t *reader, uint32 seq);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_reader_findtime()
+ *
+ * @brief Find the first record captured at or after host_ns.
+ *
+ * @param reader  - reader to use
+ * @param host_ns - CLOCK_MONOTONIC time in nanoseconds
+ *
+ * @return the position of the record, reader->count if there is none
+ */
+uint32 cir_reader_findtime(const cir_reader_t *reader, uint64_t host_ns);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_filter_init()
+ *
+ * @brief Initialise a filter that matches every record, to be narrowed down field by field.
+ *
+ * @param filter - filter to initialise
+ *
+ * @return none
+ */
+void cir_filter_init(cir_filter_t *filter);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_filter_match()
+ *
+ * @brief Check the diagnostics of a record against a filter. Only the record header is looked at.
+ *
+ * @param filter - filter to use
+ * @param rec    - record to check
+ *
+ * @return 1 if the record matches, 0 otherwise
+ */
+int cir_filter_match(const cir_filter_t *filter, const cir_record_t *rec);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_iter_init()
+ *
+ * @brief Start iterating over the records in [first, end) that match a filter.
+ *
+ * @param iter   - iterator to initialise
+ * @param reader - reader to use
+ * @param first  - position of the first record (see cir_reader_findseq() and cir_reader_findtime())
+ * @param end    - position after the last record, clamped to reader->count
+ * @param filter - filter to apply, NULL for all records
+ *
+ * @return none
+ */
+void cir_iter_init(cir_iter_t *iter, const cir_reader_t *reader, uint32 first, uint32 end, const cir_filter_t *filter);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_iter_next()
+ *
+ * @brief Get the next matching record.
+ *
+ * @param iter - iterator to use
+ *
+ * @return the record header, in place in the mapping, or NULL at the end of the range
+ */
+const cir_record_t *cir_iter_next(cir_iter_t *iter);
+
+#endif /* _CIR_READER_H_ */
@@ -0,0 +1,500 @@
+/*
+ * cir_recv.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Aggregator for the frames streamed by dw1000_rx_cir -N (see cir_stream.h). Batches are received over UDP, with
+ * recvmmsg(), and/or over TCP from any number of senders. The records of each node and device are appended as they are
+ * to their own series of capture files, <prefix>_<node>_d<device>_<index>.cir, readable with cir_dump. Lost batches
+ * (batch sequence gaps) and lost frames (record sequence gaps, e.g. ring overruns on the sender) are counted per source
+ * and reported every second.
+ *
+ * Usage: cir_recv [-u port] [-t port] [-o prefix] [-r rotate_mb] [-v]
+ *   -u port       UDP port to listen on (default 5400, 0 for none)
+ *   -t port       TCP port to listen on (default none)
+ *   -o prefix     prefix of the capture files (default cir)
+ *   -r rotate_mb  start a new capture file every rotate_mb MB (default 64, 0 to never rotate)
+ *   -v            report each source every second
+ */
+
+#define _GNU_SOURCE		// recvmmsg()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#ifdef DW1000_ZLIB
+#include <zlib.h>
+#endif
+
+#include "cir_stream.h"
+
+#define SOURCES_MAX			(64)		// node and device pairs
+#define CLIENTS_MAX			(32)		// TCP senders at once
+#define UDP_BATCH			(16)		// datagrams per recvmmsg()
+#define BUF_LEN				((sizeof(cir_stream_hdr_t) + CIR_STREAM_BATCH_MAX + 7) & ~7)
+
+typedef struct
+{
+	uint32		node;
+	uint16		device;
+	cir_file_t	file;
+	int			seen;			// a record has been received, last_rec_seq is valid
+	uint32		next_seq;		// batch sequence number expected next
+	uint32		last_rec_seq;
+	uint64_t	batches;
+	uint64_t	records;
+	uint64_t	bytes;
+	uint64_t	lost_batches;
+	uint64_t	lost_frames;
+	uint64_t	bad;			// malformed batches or records
+} source_t;
+
+typedef struct
+{
+	int			fd;
+	uint8		*buf;			// batch being reassembled
+	uint32		len;			// bytes of it received so far
+} client_t;
+
+static source_t sources[SOURCES_MAX];
+static unsigned int num_sources = 0;
+static client_t clients[CLIENTS_MAX];
+static uint8 *raw_buf;			// decompressed batch
+static const char *prefix = "cir";
+static uint32 rotate_len = 64 * 1024 * 1024;
+static uint64_t bad_batches = 0;	// batches that can't be attributed to a source
+
+static volatile sig_atomic_t running = 1;
+
+static void sigint_handler(int sig)
+{
+	running = 0;
+}
+
+static source_t *find_source(uint32 node, uint16 device)
+{
+	dwt_config_t config;
+	char path[CIR_FILE_PATH_MAX];
+	source_t *src;
+	unsigned int i;
+
+	for(i = 0; i < num_sources; i++)
+	{
+		if(sources[i].node == node && sources[i].device == device)
+			return &sources[i];
+	}
+
+	if(num_sources == SOURCES_MAX)
+		return NULL;
+
+	// The records carry the configuration they were received with, the one of the writer is not used
+	src = &sources[num_sources];
+	memset(src, 0, sizeof(*src));
+	memset(&config, 0, sizeof(config));
+	snprintf(path, sizeof(path), "%s_%08lx_d%u", prefix, (unsigned long)node, device);
+	if(cir_file_open(&src->file, path, rotate_len, &config) != 0)
+	{
+		fprintf(stderr, "Can't open the capture files %s\n", path);
+		return NULL;
+	}
+	src->node = node;
+	src->device = device;
+	num_sources++;
+
+	printf("New source: node %08lx device %u -> %s_*.cir\n", (unsigned long)node, device, path);
+	return src;
+}
+
+// Write the records of a batch and account for the gaps
+static void store_records(source_t *src, const uint8 *data, uint32 len)
+{
+	const cir_record_t *rec;
+	uint32 gap;
+
+	while(len > 0)
+	{
+		rec = (const cir_record_t *)data;
+		if(len < sizeof(*rec) || rec->sync != CIR_RECORD_SYNC || rec->size < sizeof(*rec) || rec->size > len ||
+		   (rec->size & 7) != 0)
+		{
+			src->bad++;
+			return;
+		}
+
+		if(src->seen)
+		{
+			gap = rec->seq - src->last_rec_seq - 1;
+			if(gap < 0x80000000UL)
+				src->lost_frames += gap;
+		}
+		src->seen = 1;
+		src->last_rec_seq = rec->seq;
+
+		if(cir_file_append_record(&src->file, rec) != 0)
+		{
+			perror("Can't write the capture file");
+			running = 0;
+			return;
+		}
+		src->records++;
+
+		data += rec->size;
+		len -= rec->size;
+	}
+}
+
+// Handle one batch, header included. buf is 8 byte aligned.
+static void handle_batch(const uint8 *buf, uint32 len)
+{
+	const cir_stream_hdr_t *hdr = (const cir_stream_hdr_t *)buf;
+	const uint8 *data = buf + sizeof(*hdr);
+	source_t *src;
+	uint32 gap;
+
+	if(len < sizeof(*hdr) || hdr->magic != CIR_STREAM_MAGIC || hdr->version < 1 || hdr->version > CIR_STREAM_VERSION ||
+	   hdr->len != len - sizeof(*hdr) || hdr->raw_len > CIR_STREAM_BATCH_MAX)
+	{
+		bad_batches++;
+		return;
+	}
+
+	src = find_source(hdr->node, hdr->device);
+	if(src == NULL)
+	{
+		bad_batches++;
+		return;
+	}
+
+	src->batches++;
+	src->bytes += len;
+	gap = hdr->seq - src->next_seq;
+	if(src->batches > 1 && gap < 0x80000000UL)
+		src->lost_batches += gap;
+	if(src->batches == 1 || gap < 0x80000000UL)
+		src->next_seq = hdr->seq + 1;
+
+	if(hdr->record_hdr_len != sizeof(cir_record_t))
+	{
+		src->bad++;
+		return;
+	}
+
+	if(hdr->flags & CIR_STREAM_FLAG_ZLIB)
+	{
+#ifdef DW1000_ZLIB
+		uLongf raw_len = CIR_STREAM_BATCH_MAX;
+
+		if(uncompress(raw_buf, &raw_len, data, hdr->len) != Z_OK || raw_len != hdr->raw_len)
+		{
+			src->bad++;
+			return;
+		}
+		data = raw_buf;
+#else
+		// Built without zlib (ZLIB=0)
+		src->bad++;
+		return;
+#endif
+	}
+	else if(hdr->raw_len != hdr->len)
+	{
+		src->bad++;
+		return;
+	}
+
+	store_records(src, data, hdr->raw_len);
+}
+
+static int listen_socket(int type, uint16 port)
+{
+	struct sockaddr_in6 addr;
+	int rcvbuf = 4 * 1024 * 1024;
+	int one = 1;
+	int fd;
+
+	fd = socket(AF_INET6, type, 0);
+	if(fd < 0)
+	{
+		perror("Can't create a socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(port);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	// Bursts of batches must not overflow the socket buffer while the files are being written
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || (type == SOCK_STREAM && listen(fd, CLIENTS_MAX) != 0))
+	{
+		perror("Can't listen");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void receive_udp(int fd, uint8 *bufs)
+{
+	struct mmsghdr msgs[UDP_BATCH];
+	struct iovec iovs[UDP_BATCH];
+	int ret, i;
+
+	memset(msgs, 0, sizeof(msgs));
+	for(i = 0; i < UDP_BATCH; i++)
+	{
+		iovs[i].iov_base = bufs + i * BUF_LEN;
+		iovs[i].iov_len = BUF_LEN;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	ret = recvmmsg(fd, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+	for(i = 0; i < ret; i++)
+		handle_batch(bufs + i * BUF_LEN, msgs[i].msg_len);
+}
+
+static void accept_client(int fd)
+{
+	unsigned int i;
+	int cfd;
+
+	cfd = accept(fd, NULL, NULL);
+	if(cfd < 0)
+		return;
+
+	for(i = 0; i < CLIENTS_MAX; i++)
+	{
+		if(clients[i].fd < 0)
+		{
+			clients[i].fd = cfd;
+			clients[i].len = 0;
+			return;
+		}
+	}
+
+	fprintf(stderr, "Too many TCP senders\n");
+	close(cfd);
+}
+
+// Reassemble the batches of a TCP sender: the header first, then the len bytes it announces
+static void receive_tcp(client_t *client)
+{
+	const cir_stream_hdr_t *hdr = (const cir_stream_hdr_t *)client->buf;
+	uint32 want = sizeof(*hdr);
+	ssize_t ret;
+
+	if(client->len >= sizeof(*hdr))
+		want += hdr->len;
+
+	ret = recv(client->fd, client->buf + client->len, want - client->len, 0);
+	if(ret <= 0)
+	{
+		close(client->fd);
+		client->fd = -1;
+		return;
+	}
+	client->len += ret;
+
+	if(client->len == sizeof(*hdr) && (hdr->magic != CIR_STREAM_MAGIC || hdr->len > CIR_STREAM_BATCH_MAX))
+	{
+		// A stream can't be resynchronised, the sender reconnects
+		bad_batches++;
+		close(client->fd);
+		client->fd = -1;
+		return;
+	}
+
+	if(client->len >= sizeof(*hdr) && client->len == sizeof(*hdr) + hdr->len)
+	{
+		handle_batch(client->buf, client->len);
+		client->len = 0;
+	}
+}
+
+static void report(int verbose)
+{
+	uint64_t batches = 0, records = 0, bytes = 0, lost_batches = 0, lost_frames = 0, bad = bad_batches;
+	source_t *src;
+	unsigned int i;
+
+	for(i = 0; i < num_sources; i++)
+	{
+		src = &sources[i];
+		batches += src->batches;
+		records += src->records;
+		bytes += src->bytes;
+		lost_batches += src->lost_batches;
+		lost_frames += src->lost_frames;
+		bad += src->bad;
+
+		if(verbose)
+			printf("  %08lx/%u: %llu batches %llu records %llu lost batches %llu lost frames %llu bad\n",
+				   (unsigned long)src->node, src->device, (unsigned long long)src->batches,
+				   (unsigned long long)src->records, (unsigned long long)src->lost_batches,
+				   (unsigned long long)src->lost_frames, (unsigned long long)src->bad);
+
+		cir_file_flush(&src->file);
+	}
+
+	printf("%u sources: %llu batches %llu records %llu kB, lost %llu batches %llu frames, %llu bad\n",
+		   num_sources, (unsigned long long)batches, (unsigned long long)records, (unsigned long long)(bytes / 1024),
+		   (unsigned long long)lost_batches, (unsigned long long)lost_frames, (unsigned long long)bad);
+	fflush(stdout);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-u port] [-t port] [-o prefix] [-r rotate_mb] [-v]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pollfd pfds[2 + CLIENTS_MAX];
+	client_t *polled[2 + CLIENTS_MAX];
+	uint16 udp_port = CIR_STREAM_PORT_DEF;
+	uint16 tcp_port = 0;
+	int udp_fd = -1, tcp_fd = -1;
+	int verbose = 0;
+	uint8 *udp_bufs;
+	time_t last_report;
+	unsigned int n, i;
+	int opt;
+
+	while((opt = getopt(argc, argv, "u:t:o:r:v")) != -1)
+	{
+		switch(opt)
+		{
+		case 'u':
+			udp_port = atoi(optarg);
+			break;
+		case 't':
+			tcp_port = atoi(optarg);
+			break;
+		case 'o':
+			prefix = optarg;
+			break;
+		case 'r':
+			rotate_len = atoi(optarg) * 1024 * 1024;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(udp_port == 0 && tcp_port == 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	udp_bufs = malloc(UDP_BATCH * BUF_LEN);
+	raw_buf = malloc(BUF_LEN);
+	if(udp_bufs == NULL || raw_buf == NULL)
+		return 1;
+	for(i = 0; i < CLIENTS_MAX; i++)
+	{
+		clients[i].fd = -1;
+		clients[i].buf = malloc(BUF_LEN);
+		if(clients[i].buf == NULL)
+			return 1;
+	}
+
+	if(udp_port != 0 && (udp_fd = listen_socket(SOCK_DGRAM, udp_port)) < 0)
+		return 1;
+	if(tcp_port != 0 && (tcp_fd = listen_socket(SOCK_STREAM, tcp_port)) < 0)
+		return 1;
+
+	signal(SIGINT, sigint_handler);
+	signal(SIGTERM, sigint_handler);
+
+	last_report = time(NULL);
+	while(running)
+	{
+		n = 0;
+		if(udp_fd >= 0)
+		{
+			pfds[n].fd = udp_fd;
+			pfds[n].events = POLLIN;
+			polled[n++] = NULL;
+		}
+		if(tcp_fd >= 0)
+		{
+			pfds[n].fd = tcp_fd;
+			pfds[n].events = POLLIN;
+			polled[n++] = NULL;
+		}
+		for(i = 0; i < CLIENTS_MAX; i++)
+		{
+			if(clients[i].fd >= 0)
+			{
+				pfds[n].fd = clients[i].fd;
+				pfds[n].events = POLLIN;
+				polled[n++] = &clients[i];
+			}
+		}
+
+		if(poll(pfds, n, 1000) > 0)
+		{
+			for(i = 0; i < n; i++)
+			{
+				if(!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+					continue;
+				if(polled[i] != NULL)
+					receive_tcp(polled[i]);
+				else if(pfds[i].fd == udp_fd)
+					receive_udp(udp_fd, udp_bufs);
+				else
+					accept_client(tcp_fd);
+			}
+		}
+
+		if(time(NULL) != last_report)
+		{
+			last_report = time(NULL);
+			report(verbose);
+		}
+	}
+
+	report(verbose);
+	for(i = 0; i < num_sources; i++)
+		cir_file_close(&sources[i].file);
+	for(i = 0; i < CLIENTS_MAX; i++)
+	{
+		if(clients[i].fd >= 0)
+			close(clients[i].fd);
+		free(clients[i].buf);
+	}
+	if(udp_fd >= 0)
+		close(udp_fd);
+	if(tcp_fd >= 0)
+		close(tcp_fd);
+	free(udp_bufs);
+	free(raw_buf);
+
+	return 0;
+}
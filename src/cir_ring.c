@@ -0,0 +1,102 @@
+/*
+ * cir_ring.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cir_ring.h"
+
+// head and tail are free running counters, the slot is the counter masked with the ring size. Each one is written by a
+// single side: the release store publishes the record contents, the acquire load on the other side makes them visible.
+
+int cir_ring_init(cir_ring_t *ring, uint32 size)
+{
+	if(size == 0 || (size & (size - 1)) != 0)
+		return -1;
+
+	ring->frames = malloc(size * sizeof(cir_frame_t));
+	if(ring->frames == NULL)
+		return -1;
+
+	// Touch every page now rather than on the first frames
+	memset(ring->frames, 0, size * sizeof(cir_frame_t));
+
+	ring->mask = size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->high_water = 0;
+	ring->drops = 0;
+
+	return 0;
+}
+
+void cir_ring_free(cir_ring_t *ring)
+{
+	free(ring->frames);
+	ring->frames = NULL;
+}
+
+cir_frame_t *cir_ring_claim(cir_ring_t *ring)
+{
+	uint32 head = ring->head;
+	uint32 tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail > ring->mask)
+	{
+		__atomic_store_n(&ring->drops, ring->drops + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	return &ring->frames[head & ring->mask];
+}
+
+void cir_ring_publish(cir_ring_t *ring)
+{
+	uint32 head = ring->head + 1;
+	uint32 occupancy = head - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+	if(occupancy > ring->high_water)
+		__atomic_store_n(&ring->high_water, occupancy, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+}
+
+cir_frame_t *cir_ring_peek(cir_ring_t *ring)
+{
+	uint32 tail = ring->tail;
+	uint32 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if(head == tail)
+		return NULL;
+
+	return &ring->frames[tail & ring->mask];
+}
+
+void cir_ring_release(cir_ring_t *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+void cir_ring_getstats(cir_ring_t *ring, cir_ring_stats_t *stats)
+{
+	uint32 tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	uint32 head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+	stats->size = ring->mask + 1;
+	stats->occupancy = head - tail;
+	stats->high_water = __atomic_load_n(&ring->high_water, __ATOMIC_RELAXED);
+	stats->produced = head;
+	stats->drops = __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,151 @@
+/*
+ * cir_ring.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Single producer / single consumer ring of preallocated CIR frame records. The producer is the capture side (the RX
+ * callback on the IRQ thread), the consumer is a writer thread doing serialization and disk I/O. Neither side ever
+ * blocks on the other: when the ring is full the new frame is dropped and counted.
+ */
+
+#ifndef _CIR_RING_H_
+#define _CIR_RING_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+
+#define CIR_FRAME_DATA_MAX      (127)                   // standard frame length, see dwt_configure()
+#define CIR_FRAME_TAPS_MAX      (DWT_CIR_LEN_PRF64)     // enough for the full accumulator at any PRF
+
+// One captured frame
+typedef struct
+{
+	uint32				seq;						// host side sequence number, counts drops as well
+	uint32				status;						// SYS_STATUS as reported to the RX callback
+	struct timespec		host_time;					// CLOCK_MONOTONIC time at which the frame was captured
+	dwt_rxframeinfo_t	info;						// timestamps, RX_FINFO and diagnostics
+	uint16				length;						// number of valid bytes in data
+	uint8				data[CIR_FRAME_DATA_MAX];	// frame payload
+	uint16				first_tap;					// accumulator index of cir[0]
+	uint16				num_taps;					// number of valid taps in cir
+	int16				cir[2 * CIR_FRAME_TAPS_MAX];	// interleaved real/imaginary taps, as read by dwt_readcir()
+	int32				carrier_int;				// carrier recovery integrator, read for the sync beacons only
+	uint64_t			sync_stamp;					// RX timestamp in the reference timebase, 0 if unknown
+	int16				temp_cdeg;					// latest temperature reading, 0.01 degrees C
+	uint16				vbat_mv;					// latest voltage reading, mV, 0 if none yet
+} cir_frame_t;
+
+// Ring statistics, see cir_ring_getstats()
+typedef struct
+{
+	uint32 size;			// number of slots
+	uint32 occupancy;		// frames currently waiting for the consumer
+	uint32 high_water;		// highest occupancy seen so far
+	uint32 produced;		// frames published by the producer
+	uint32 drops;			// frames dropped because the ring was full
+} cir_ring_stats_t;
+
+typedef struct
+{
+	cir_frame_t	*frames;
+	uint32		mask;		// size - 1, size is a power of two
+	uint32		head;		// next slot to fill, only written by the producer
+	uint32		tail;		// next slot to drain, only written by the consumer
+	uint32		high_water;	// only written by the producer
+	uint32		drops;		// only written by the producer
+} cir_ring_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_ring_init()
+ *
+ * @brief Allocate the frame records of a ring. All the memory is allocated (and touched) here so that neither side
+ *        allocates or faults while running.
+ *
+ * @param ring - ring to initialise
+ * @param size - number of frame records, must be a power of two
+ *
+ * @return 0 on success, -1 on error
+ */
+int cir_ring_init(cir_ring_t *ring, uint32 size);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_ring_free()
+ *
+ * @brief Release the frame records of a ring. Neither side may use the ring afterwards.
+ *
+ * @param ring - ring to release
+ *
+ * @return none
+ */
+void cir_ring_free(cir_ring_t *ring);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_ring_claim()
+ *
+ * @brief Producer side: get the next free frame record to fill. If the ring is full the frame is counted as dropped.
+ *
+ * @param ring - ring to use
+ *
+ * @return the record to fill, or NULL if the ring is full
+ */
+cir_frame_t *cir_ring_claim(cir_ring_t *ring);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_ring_publish()
+ *
+ * @brief Producer side: hand the record returned by the last cir_ring_claim() over to the consumer.
+ *
+ * @param ring - ring to use
+ *
+ * @return none
+ */
+void cir_ring_publish(cir_ring_t *ring);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_ring_peek()
+ *
+ * @brief Consumer side: get the oldest published record. It stays owned by the consumer until cir_ring_release().
+ *
+ * @param ring - ring to use
+ *
+ * @return the oldest record, or NULL if the ring is empty
+ */
+cir_frame_t *cir_ring_peek(cir_ring_t *ring);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_ring_release()
+ *
+ * @brief Consumer side: give the record returned by the last cir_ring_peek() back to the producer.
+ *
+ * @param ring - ring to use
+ *
+ * @return none
+ */
+void cir_ring_release(cir_ring_t *ring);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_ring_getstats()
+ *
+ * @brief Read the ring statistics. This can be called from any thread, the values are a consistent enough snapshot
+ *        for monitoring and for sizing the ring against burst rates.
+ *
+ * @param ring  - ring to use
+ * @param stats - where to return the statistics
+ *
+ * @return none
+ */
+void cir_ring_getstats(cir_ring_t *ring, cir_ring_stats_t *stats);
+
+#endif /* _CIR_RING_H_ */
@@ -0,0 +1,452 @@
+/*
+ * cir_stream.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _GNU_SOURCE		// sendmmsg()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#ifdef DW1000_ZLIB
+#include <zlib.h>
+#endif
+
+#include "cir_stream.h"
+
+#define CIR_STREAM_SPEC_MAX		(256)
+#define CIR_STREAM_RETRY_S		(1)		// between two TCP connection attempts
+#define CIR_STREAM_TIMEOUT_MS	(1000)	// to connect, and to send a batch over TCP
+
+// Largest record: full accumulator and longest standard frame
+#define CIR_STREAM_RECORD_MAX	(sizeof(cir_record_t) + ((CIR_FRAME_DATA_MAX + 3) & ~3) + CIR_FRAME_TAPS_MAX * DWT_CIR_TAP_LEN)
+
+typedef char cir_stream_hdr_size_check[(sizeof(cir_stream_hdr_t) == 32) ? 1 : -1];
+
+static long monotonic_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static void stat_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static uint8 *batch(cir_stream_t *stream, unsigned int i)
+{
+	return stream->bufs + i * stream->buf_len;
+}
+
+// Split "proto:host:port[,options]" and resolve the address
+static int parse_dest(cir_stream_t *stream, const char *dest)
+{
+	struct addrinfo hints, *res;
+	char buf[CIR_STREAM_SPEC_MAX];
+	char *host, *port, *opt, *end;
+	unsigned long value;
+	int err;
+
+	if(strlen(dest) >= sizeof(buf))
+		return -1;
+	strcpy(buf, dest);
+
+	if(strncmp(buf, "udp:", 4) == 0)
+		stream->tcp = 0;
+	else if(strncmp(buf, "tcp:", 4) == 0)
+		stream->tcp = 1;
+	else
+		return -1;
+
+	host = strtok(buf + 4, ",");
+	if(host == NULL || (port = strrchr(host, ':')) == NULL || port == host)
+		return -1;
+	*port++ = '\0';
+
+	while((opt = strtok(NULL, ",")) != NULL)
+	{
+		if(strcmp(opt, "zlib") == 0)
+		{
+			stream->zlib_level = 1;
+			continue;
+		}
+		if(strcmp(opt, "delta") == 0)
+		{
+			stream->codec = CIR_CODEC_DELTA;
+			continue;
+		}
+
+		end = strchr(opt, '=');
+		if(end == NULL)
+			return -1;
+		value = strtoul(end + 1, &end, 0);
+		if(*end != '\0')
+			return -1;
+
+		if(strncmp(opt, "zlib=", 5) == 0 && value >= 1 && value <= 9)
+			stream->zlib_level = value;
+		else if(strncmp(opt, "batch=", 6) == 0 && value >= sizeof(cir_stream_hdr_t) + CIR_STREAM_RECORD_MAX &&
+				value <= CIR_STREAM_BATCH_MAX)
+			stream->batch_max = value - sizeof(cir_stream_hdr_t);
+		else if(strncmp(opt, "node=", 5) == 0 && value <= 0xFFFFFFFFUL)
+			stream->node = value;
+		else
+			return -1;
+	}
+
+#ifndef DW1000_ZLIB
+	if(stream->zlib_level)
+	{
+		fprintf(stderr, "CIR stream: built without zlib (ZLIB=0)\n");
+		return -1;
+	}
+#endif
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = stream->tcp ? SOCK_STREAM : SOCK_DGRAM;
+	err = getaddrinfo(host, port, &hints, &res);
+	if(err != 0)
+	{
+		fprintf(stderr, "CIR stream: %s: %s\n", host, gai_strerror(err));
+		return -1;
+	}
+	memcpy(&stream->addr, res->ai_addr, res->ai_addrlen);
+	stream->addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+
+	return 0;
+}
+
+// Connect with a timeout, the writer thread must not hang on an unreachable aggregator
+static int tcp_connect(cir_stream_t *stream)
+{
+	struct timeval tv = { CIR_STREAM_TIMEOUT_MS / 1000, (CIR_STREAM_TIMEOUT_MS % 1000) * 1000 };
+	struct pollfd pfd;
+	socklen_t len = sizeof(int);
+	int one = 1;
+	int err = 0;
+	int fd;
+
+	stream->retry_sec = monotonic_sec() + CIR_STREAM_RETRY_S;
+
+	fd = socket(stream->addr.ss_family, SOCK_STREAM, 0);
+	if(fd < 0)
+		return -1;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if(connect(fd, (struct sockaddr *)&stream->addr, stream->addr_len) != 0)
+	{
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		if(errno != EINPROGRESS || poll(&pfd, 1, CIR_STREAM_TIMEOUT_MS) != 1 ||
+		   getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+		{
+			close(fd);
+			return -1;
+		}
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	stream->fd = fd;
+	return 0;
+}
+
+int cir_stream_open(cir_stream_t *stream, const char *dest, uint16 device, const dwt_config_t *config)
+{
+	memset(stream, 0, sizeof(*stream));
+	stream->fd = -1;
+	stream->node = gethostid();
+	stream->device = device;
+	stream->batch_max = CIR_STREAM_BATCH_DEF - sizeof(cir_stream_hdr_t);
+	stream->config = *config;
+
+	if(parse_dest(stream, dest) != 0)
+	{
+		fprintf(stderr, "CIR stream: bad destination %s\n", dest);
+		return -1;
+	}
+
+	// Batches stay 8 byte aligned so that the records can be used in place on the other end
+	stream->buf_len = (sizeof(cir_stream_hdr_t) + stream->batch_max + 7) & ~7;
+	stream->bufs = malloc(CIR_STREAM_QUEUE * stream->buf_len);
+	if(stream->bufs == NULL)
+		return -1;
+	memset(stream->bufs, 0, CIR_STREAM_QUEUE * stream->buf_len);
+
+	if(stream->codec != CIR_CODEC_NONE)
+	{
+		stream->enc = malloc(CIR_CODEC_MAX_LEN(CIR_FRAME_TAPS_MAX));
+		if(stream->enc == NULL)
+		{
+			free(stream->bufs);
+			return -1;
+		}
+	}
+
+#ifdef DW1000_ZLIB
+	if(stream->zlib_level)
+	{
+		stream->zbuf = malloc(compressBound(stream->batch_max));
+		if(stream->zbuf == NULL)
+		{
+			free(stream->enc);
+			free(stream->bufs);
+			return -1;
+		}
+	}
+#endif
+
+	if(stream->tcp)
+	{
+		if(tcp_connect(stream) != 0)
+			fprintf(stderr, "CIR stream: can't connect to %s yet, retrying\n", dest);
+		return 0;
+	}
+
+	stream->fd = socket(stream->addr.ss_family, SOCK_DGRAM, 0);
+	if(stream->fd < 0 || connect(stream->fd, (struct sockaddr *)&stream->addr, stream->addr_len) != 0)
+	{
+		perror("CIR stream: can't set up the UDP socket");
+		if(stream->fd >= 0)
+			close(stream->fd);
+		free(stream->enc);
+		free(stream->zbuf);
+		free(stream->bufs);
+		return -1;
+	}
+
+	return 0;
+}
+
+void cir_stream_setconfig(cir_stream_t *stream, const dwt_config_t *config)
+{
+	stream->config = *config;
+}
+
+// Close the batch being filled: compress it if worth it and fill in its header
+static void finish_batch(cir_stream_t *stream)
+{
+	unsigned int i = stream->queued;
+	cir_stream_hdr_t *hdr = (cir_stream_hdr_t *)batch(stream, i);
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = CIR_STREAM_MAGIC;
+	hdr->version = CIR_STREAM_VERSION;
+	hdr->node = stream->node;
+	hdr->device = stream->device;
+	hdr->records = stream->counts[i];
+	hdr->seq = stream->seq++;
+	hdr->len = stream->lens[i];
+	hdr->raw_len = stream->lens[i];
+	hdr->record_hdr_len = sizeof(cir_record_t);
+
+#ifdef DW1000_ZLIB
+	if(stream->zlib_level)
+	{
+		uLongf zlen = compressBound(stream->batch_max);
+
+		if(compress2(stream->zbuf, &zlen, (uint8 *)(hdr + 1), hdr->raw_len, stream->zlib_level) == Z_OK &&
+		   zlen < hdr->raw_len)
+		{
+			memcpy(hdr + 1, stream->zbuf, zlen);
+			hdr->len = zlen;
+			hdr->flags |= CIR_STREAM_FLAG_ZLIB;
+		}
+	}
+#endif
+
+	stream->queued++;
+}
+
+static int send_all(int fd, const uint8 *buf, uint32 len)
+{
+	ssize_t ret;
+
+	while(len > 0)
+	{
+		ret = send(fd, buf, len, MSG_NOSIGNAL);
+		if(ret < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+// Send the queued batches, those that can't be sent are dropped
+static int send_queue(cir_stream_t *stream)
+{
+	struct mmsghdr msgs[CIR_STREAM_QUEUE];
+	struct iovec iovs[CIR_STREAM_QUEUE];
+	const cir_stream_hdr_t *hdr;
+	unsigned int sent = 0;
+	unsigned int i;
+	int ret;
+
+	if(stream->tcp && stream->fd < 0 && monotonic_sec() >= stream->retry_sec)
+		tcp_connect(stream);
+
+	if(stream->tcp)
+	{
+		while(stream->fd >= 0 && sent < stream->queued)
+		{
+			hdr = (const cir_stream_hdr_t *)batch(stream, sent);
+			if(send_all(stream->fd, (const uint8 *)hdr, sizeof(*hdr) + hdr->len) != 0)
+			{
+				// The aggregator drops a connection it can't resynchronise, so the partly sent batch and the rest of the
+				// queue are lost (counted as dropped): reconnect later and start again on a batch boundary
+				perror("CIR stream: send failed");
+				close(stream->fd);
+				stream->fd = -1;
+				stream->retry_sec = monotonic_sec() + CIR_STREAM_RETRY_S;
+				break;
+			}
+			sent++;
+		}
+	}
+	else
+	{
+		memset(msgs, 0, sizeof(msgs));
+		for(i = 0; i < stream->queued; i++)
+		{
+			hdr = (const cir_stream_hdr_t *)batch(stream, i);
+			iovs[i].iov_base = (void *)hdr;
+			iovs[i].iov_len = sizeof(*hdr) + hdr->len;
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		// One system call for the whole queue, unless the socket buffer fills up
+		while(sent < stream->queued)
+		{
+			ret = sendmmsg(stream->fd, msgs + sent, stream->queued - sent, 0);
+			if(ret < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				// e.g. ECONNREFUSED while the aggregator is not running: drop this one and go on
+				sent++;
+				stat_add(&stream->stats.dropped, 1);
+				continue;
+			}
+			for(i = sent; i < sent + ret; i++)
+			{
+				hdr = (const cir_stream_hdr_t *)batch(stream, i);
+				stat_add(&stream->stats.batches, 1);
+				stat_add(&stream->stats.records, hdr->records);
+				stat_add(&stream->stats.bytes, sizeof(*hdr) + hdr->len);
+				stat_add(&stream->stats.raw_bytes, hdr->raw_len);
+			}
+			sent += ret;
+		}
+		stream->queued = 0;
+		return 0;
+	}
+
+	for(i = 0; i < sent; i++)
+	{
+		hdr = (const cir_stream_hdr_t *)batch(stream, i);
+		stat_add(&stream->stats.batches, 1);
+		stat_add(&stream->stats.records, hdr->records);
+		stat_add(&stream->stats.bytes, sizeof(*hdr) + hdr->len);
+		stat_add(&stream->stats.raw_bytes, hdr->raw_len);
+	}
+	stat_add(&stream->stats.dropped, stream->queued - sent);
+
+	ret = (sent == stream->queued) ? 0 : -1;
+	stream->queued = 0;
+	return ret;
+}
+
+int cir_stream_append(cir_stream_t *stream, const cir_frame_t *frame, uint64_t tx_stamp)
+{
+	unsigned int i = stream->queued;
+	cir_record_t rec;
+	int ret = 0;
+
+	cir_record_init(&rec, frame, &stream->config, tx_stamp, stream->codec, stream->enc);
+
+	if(stream->lens[i] + rec.size > stream->batch_max)
+	{
+		finish_batch(stream);
+		if(stream->queued == CIR_STREAM_QUEUE)
+			ret = send_queue(stream);
+		i = stream->queued;
+		stream->lens[i] = 0;
+		stream->counts[i] = 0;
+	}
+
+	cir_record_pack(batch(stream, i) + sizeof(cir_stream_hdr_t) + stream->lens[i], &rec, frame, stream->enc);
+	stream->lens[i] += rec.size;
+	stream->counts[i]++;
+
+	return ret;
+}
+
+int cir_stream_flush(cir_stream_t *stream)
+{
+	int ret;
+
+	if(stream->counts[stream->queued])
+		finish_batch(stream);
+	if(stream->queued == 0)
+		return 0;
+
+	ret = send_queue(stream);
+	stream->lens[0] = 0;
+	stream->counts[0] = 0;
+	return ret;
+}
+
+void cir_stream_close(cir_stream_t *stream)
+{
+	cir_stream_flush(stream);
+	if(stream->fd >= 0)
+		close(stream->fd);
+	stream->fd = -1;
+	free(stream->enc);
+	free(stream->zbuf);
+	free(stream->bufs);
+	stream->enc = NULL;
+	stream->zbuf = NULL;
+	stream->bufs = NULL;
+}
+
+void cir_stream_getstats(cir_stream_t *stream, cir_stream_stats_t *stats)
+{
+	stats->batches = __atomic_load_n(&stream->stats.batches, __ATOMIC_RELAXED);
+	stats->records = __atomic_load_n(&stream->stats.records, __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&stream->stats.bytes, __ATOMIC_RELAXED);
+	stats->raw_bytes = __atomic_load_n(&stream->stats.raw_bytes, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&stream->stats.dropped, __ATOMIC_RELAXED);
+}
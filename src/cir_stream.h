@@ -0,0 +1,172 @@
+/*
+ * cir_stream.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Network streaming of captured frames to an aggregator (see cir_recv.c). Frames are serialized as the records of
+ * the capture files (see cir_file.h) and packed into batches of up to batch= bytes, each one behind a
+ * cir_stream_hdr_t. Over UDP a batch is one datagram and the queued batches go out with a single sendmmsg() call;
+ * over TCP batches follow each other on the connection, which is re-established when lost. Every batch carries the
+ * node and device it comes from and a sequence number incremented by one per batch, batches dropped by the sender
+ * included, so the aggregator can count the batches lost on the way; the record sequence numbers tell frames lost
+ * before the stream. The taps of each record can be compressed (see cir_codec.h), and whole batches with zlib
+ * (make ZLIB=1).
+ *
+ * Destinations: udp:<host>:<port> or tcp:<host>:<port>, optionally followed by ,delta (tap compression),
+ * ,zlib[=level] ,batch=<bytes> and ,node=<id> (the host id by default).
+ */
+
+#ifndef _CIR_STREAM_H_
+#define _CIR_STREAM_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+#include "cir_ring.h"
+#include "cir_file.h"
+
+#define CIR_STREAM_MAGIC		(0x53524943UL)	// "CIRS", starts every batch
+#define CIR_STREAM_VERSION		(2)				// 2: the taps of the records may be compressed, see cir_file.h
+#define CIR_STREAM_PORT_DEF		(5400)
+
+#define CIR_STREAM_FLAG_ZLIB	(0x0001)		// payload compressed with zlib compress2()
+
+#define CIR_STREAM_BATCH_DEF	(16 * 1024)		// bytes of records per batch
+#define CIR_STREAM_BATCH_MAX	(60 * 1024)		// within the 64 kB limit of a UDP datagram
+#define CIR_STREAM_QUEUE		(16)			// batches sent per sendmmsg()
+
+// Batch header (32 bytes), followed by len bytes of records. Little endian, like the capture files.
+typedef struct
+{
+	uint32_t magic;			// CIR_STREAM_MAGIC
+	uint16_t version;		// CIR_STREAM_VERSION
+	uint16_t flags;			// CIR_STREAM_FLAG_*
+	uint32_t node;			// sending host
+	uint16_t device;		// receiver on that host
+	uint16_t records;		// number of records in the batch
+	uint32_t seq;			// batch sequence number of this node and device
+	uint32_t len;			// bytes following this header
+	uint32_t raw_len;		// bytes of records, once decompressed
+	uint32_t record_hdr_len;	// sizeof(cir_record_t) of the sender
+} cir_stream_hdr_t;
+
+// Sender counters, see cir_stream_getstats()
+typedef struct
+{
+	uint64_t batches;		// batches sent
+	uint64_t records;		// records sent
+	uint64_t bytes;			// bytes sent, headers included
+	uint64_t raw_bytes;		// bytes of records sent, before compression
+	uint64_t dropped;		// batches lost to send errors or while disconnected
+} cir_stream_stats_t;
+
+typedef struct
+{
+	int						fd;
+	int						tcp;
+	struct sockaddr_storage	addr;
+	socklen_t				addr_len;
+	long					retry_sec;		// CLOCK_MONOTONIC second of the next TCP connection attempt
+	int						zlib_level;		// 0 without compression
+	uint8					codec;			// CIR_CODEC_* of the taps
+	uint8					*enc;			// compressed taps of the record being added
+	uint32					node;
+	uint16					device;
+	uint32					batch_max;
+	dwt_config_t			config;			// configuration stored in the records
+	uint32					seq;			// sequence number of the next batch
+	uint8					*bufs;			// CIR_STREAM_QUEUE batches, header included
+	uint32					buf_len;		// size of each one
+	uint32					lens[CIR_STREAM_QUEUE];	// bytes of records in each batch
+	uint16					counts[CIR_STREAM_QUEUE];	// records in each batch
+	unsigned int			queued;			// batches complete and waiting to be sent, the next one is being filled
+	uint8					*zbuf;
+	cir_stream_stats_t		stats;
+} cir_stream_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_stream_open()
+ *
+ * @brief Set up a stream to an aggregator. Over TCP, a connection that cannot be established yet is retried by the
+ *        flushes, the batches are dropped meanwhile.
+ *
+ * @param stream - stream to initialise
+ * @param dest   - destination, see above
+ * @param device - receiver number, identifies the stream along with the node
+ * @param config - configuration stored in the records, see cir_stream_setconfig()
+ *
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int cir_stream_open(cir_stream_t *stream, const char *dest, uint16 device, const dwt_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_stream_setconfig()
+ *
+ * @brief Change the configuration stored in the following records.
+ *
+ * @param stream - stream to use
+ * @param config - new configuration
+ *
+ * @return none
+ */
+void cir_stream_setconfig(cir_stream_t *stream, const dwt_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_stream_append()
+ *
+ * @brief Add one captured frame to the current batch. Full batches are queued, and the queue is sent once full.
+ *
+ * @param stream   - stream to use
+ * @param frame    - captured frame
+ * @param tx_stamp - TX timestamp of the frame if known, 0 otherwise
+ *
+ * @return 0 on success, -1 if batches had to be dropped
+ */
+int cir_stream_append(cir_stream_t *stream, const cir_frame_t *frame, uint64_t tx_stamp);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_stream_flush()
+ *
+ * @brief Send the current batch and all the queued ones, e.g. when no frame has come for a while.
+ *
+ * @param stream - stream to use
+ *
+ * @return 0 on success, -1 if batches had to be dropped
+ */
+int cir_stream_flush(cir_stream_t *stream);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_stream_close()
+ *
+ * @brief Flush and close a stream.
+ *
+ * @param stream - stream to close
+ *
+ * @return none
+ */
+void cir_stream_close(cir_stream_t *stream);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn cir_stream_getstats()
+ *
+ * @brief Get the counters of a stream, from any thread.
+ *
+ * @param stream - stream
+ * @param stats  - where to copy the counters
+ *
+ * @return none
+ */
+void cir_stream_getstats(cir_stream_t *stream, cir_stream_stats_t *stats);
+
+#endif /* _CIR_STREAM_H_ */
@@ -0,0 +1,201 @@
+/*
+ * clock_sync.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "clock_sync.h"
+
+#define CLOCK_SYNC_WRAP			(1099511627776.0)	// 2^40
+#define CLOCK_SYNC_MASK			(0xFFFFFFFFFFULL)
+#define CLOCK_SYNC_DRIFT_SIGMA0	(20e-6)				// crystal tolerance, drift uncertainty without the carrier integrator
+
+// Signed difference of two 40-bit times
+static int64_t diff40(uint64_t a, uint64_t b)
+{
+	uint64_t d = (a - b) & CLOCK_SYNC_MASK;
+
+	return (d & (1ULL << 39)) ? (int64_t)d - (int64_t)(1ULL << 40) : (int64_t)d;
+}
+
+static double wrap40(double x)
+{
+	if(x >= CLOCK_SYNC_WRAP / 2)
+		x -= CLOCK_SYNC_WRAP;
+	else if(x < -CLOCK_SYNC_WRAP / 2)
+		x += CLOCK_SYNC_WRAP;
+	return x;
+}
+
+void clock_sync_defaults(clock_sync_params_t *params)
+{
+	params->tof = 0;
+	params->meas_sigma = 10;
+	params->carrier_sigma = 0.05e-6;
+	params->drift_walk = 1e-9;
+	params->gate = 5;
+}
+
+void clock_sync_init(clock_sync_t *sync, const clock_sync_params_t *params)
+{
+	memset(sync, 0, sizeof(*sync));
+	sync->params = *params;
+}
+
+// Start over from one beacon
+static void first_beacon(clock_sync_t *sync, uint64_t rx_stamp, double offset, double carrier)
+{
+	const clock_sync_params_t *pr = &sync->params;
+
+	sync->last = rx_stamp;
+	sync->offset = offset;
+	sync->drift = (pr->carrier_sigma > 0) ? carrier : 0;
+	sync->p[0][0] = pr->meas_sigma * pr->meas_sigma;
+	sync->p[0][1] = 0;
+	sync->p[1][0] = 0;
+	sync->p[1][1] = (pr->carrier_sigma > 0) ? pr->carrier_sigma * pr->carrier_sigma : CLOCK_SYNC_DRIFT_SIGMA0 * CLOCK_SYNC_DRIFT_SIGMA0;
+	sync->beacons = 1;
+	sync->rejects = 0;
+}
+
+// Covariance dt device time units after the last beacon: F P F' + Q, with the drift as integrated random walk
+static void predict_cov(const clock_sync_t *sync, double dt, double p[2][2])
+{
+	double q = sync->params.drift_walk * sync->params.drift_walk * fabs(dt) * DWT_TIME_UNITS;
+
+	p[0][0] = sync->p[0][0] + 2 * dt * sync->p[0][1] + dt * dt * sync->p[1][1] + q * dt * dt / 3;
+	p[0][1] = sync->p[0][1] + dt * sync->p[1][1] + q * dt / 2;
+	p[1][0] = p[0][1];
+	p[1][1] = sync->p[1][1] + q;
+}
+
+int clock_sync_beacon(clock_sync_t *sync, uint64_t rx_stamp, uint64_t tx_stamp, double carrier)
+{
+	const clock_sync_params_t *pr = &sync->params;
+	double offset, p[2][2], k0, k1, y, s;
+	double meas = diff40(tx_stamp, rx_stamp) + pr->tof;
+	int64_t dt;
+
+	if(sync->beacons == 0)
+	{
+		first_beacon(sync, rx_stamp, meas, carrier);
+		return 0;
+	}
+
+	// Beacons out of order, or so far apart that the prediction is stale (or the counter may have wrapped in between)
+	dt = diff40(rx_stamp, sync->last);
+	if(dt <= 0 || dt * DWT_TIME_UNITS > CLOCK_SYNC_HOLDOVER_S)
+	{
+		sync->resets++;
+		first_beacon(sync, rx_stamp, meas, carrier);
+		return 0;
+	}
+
+	offset = sync->offset + sync->drift * dt;
+	predict_cov(sync, dt, p);
+
+	y = wrap40(meas - offset);
+	s = p[0][0] + pr->meas_sigma * pr->meas_sigma;
+	if(sync->beacons >= CLOCK_SYNC_BEACONS_MIN && fabs(y) > pr->gate * sqrt(s))
+	{
+		sync->outliers++;
+		if(++sync->rejects < CLOCK_SYNC_REJECTS_MAX)
+			return -1;
+
+		// The reference has most likely been restarted
+		sync->resets++;
+		first_beacon(sync, rx_stamp, meas, carrier);
+		return 0;
+	}
+
+	// Offset measurement
+	k0 = p[0][0] / s;
+	k1 = p[1][0] / s;
+	offset += k0 * y;
+	sync->drift += k1 * y;
+	p[1][1] -= k1 * p[0][1];
+	p[0][1] -= k0 * p[0][1];
+	p[1][0] = p[0][1];
+	p[0][0] -= k0 * p[0][0];
+
+	// Drift measurement from the carrier integrator
+	if(pr->carrier_sigma > 0)
+	{
+		y = carrier - sync->drift;
+		s = p[1][1] + pr->carrier_sigma * pr->carrier_sigma;
+		k0 = p[0][1] / s;
+		k1 = p[1][1] / s;
+		offset += k0 * y;
+		sync->drift += k1 * y;
+		p[0][0] -= k0 * p[1][0];
+		p[0][1] -= k0 * p[1][1];
+		p[1][0] = p[0][1];
+		p[1][1] -= k1 * p[1][1];
+	}
+
+	sync->offset = wrap40(offset);
+	memcpy(sync->p, p, sizeof(p));
+	sync->last = rx_stamp;
+	sync->beacons++;
+	sync->rejects = 0;
+	return 0;
+}
+
+int clock_sync_map(const clock_sync_t *sync, uint64_t stamp, uint64_t *ref_stamp, double *sigma)
+{
+	double p[2][2];
+	int64_t dt;
+
+	if(sync->beacons < CLOCK_SYNC_BEACONS_MIN)
+		return -1;
+
+	// Frames just before the last beacon are mapped too, they are written after it
+	dt = diff40(stamp, sync->last);
+	if(fabs(dt * DWT_TIME_UNITS) > CLOCK_SYNC_HOLDOVER_S)
+		return -1;
+
+	*ref_stamp = (stamp + (uint64_t)llround(sync->offset + sync->drift * dt)) & CLOCK_SYNC_MASK;
+	if(sigma != NULL)
+	{
+		predict_cov(sync, dt, p);
+		*sigma = sqrt(p[0][0]);
+	}
+
+	return 0;
+}
+
+double clock_sync_carrier_ratio(const dwt_config_t *config, int32 carrier)
+{
+	double hz_to_ppm;
+
+	switch(config->chan)
+	{
+	case 1:
+		hz_to_ppm = HERTZ_TO_PPM_MULTIPLIER_CHAN_1;
+		break;
+	case 3:
+		hz_to_ppm = HERTZ_TO_PPM_MULTIPLIER_CHAN_3;
+		break;
+	case 5:
+	case 7:
+		hz_to_ppm = HERTZ_TO_PPM_MULTIPLIER_CHAN_5;
+		break;
+	default:
+		hz_to_ppm = HERTZ_TO_PPM_MULTIPLIER_CHAN_2;
+		break;
+	}
+
+	return carrier * ((config->dataRate == DWT_BR_110K) ? FREQ_OFFSET_MULTIPLIER_110KB : FREQ_OFFSET_MULTIPLIER) * hz_to_ppm / 1.0e6;
+}
@@ -0,0 +1,130 @@
+/*
+ * clock_sync.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Wireless clock synchronisation of a receiver to a reference node. The reference node sends beacons with delayed TX
+ * (dw1000_tx -B), each one carrying the 40-bit device time at which it leaves the antenna. For every beacon received,
+ * the offset between the reference time (TX timestamp plus the known propagation delay) and the local RX timestamp
+ * feeds a two state Kalman filter, offset and drift, along with the clock offset measured by the carrier recovery
+ * integrator of that frame (dwt_readcarrierintegrator()), which gives the drift directly. Any local timestamp can then
+ * be mapped to the reference timebase, so the frames of all the receivers synchronised to the same reference can be
+ * compared as they are captured, e.g. for TDoA.
+ *
+ * All times are 40-bit device times (15.65 ps units) and wrap around every 17.2 s; differences are taken modulo 2^40,
+ * which is far more than the time allowed between beacons (CLOCK_SYNC_HOLDOVER_S).
+ */
+
+#ifndef _CLOCK_SYNC_H_
+#define _CLOCK_SYNC_H_
+
+#include <stdint.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+
+#define CLOCK_SYNC_BEACON_TYPE		(0xBC)		// first byte of the beacon frames
+#define CLOCK_SYNC_BEACONS_MIN		(3)			// beacons before timestamps are mapped
+#define CLOCK_SYNC_REJECTS_MAX		(5)			// consecutive outliers before the filter starts over
+#define CLOCK_SYNC_HOLDOVER_S		(2.0)		// longest time between beacons, and from the last one to a mapped timestamp
+
+// Filter tuning, see clock_sync_defaults()
+typedef struct
+{
+	double		tof;			// propagation delay from the reference node, device time units
+	double		meas_sigma;		// timestamp noise of one beacon, device time units
+	double		carrier_sigma;	// noise of the carrier integrator clock offset, 0 to ignore it
+	double		drift_walk;		// random walk of the relative drift, per sqrt(s), e.g. 1e-9 for 1 ppb
+	double		gate;			// beacons with an innovation beyond gate sigmas are rejected
+} clock_sync_params_t;
+
+// Sync engine of one receiver
+typedef struct
+{
+	clock_sync_params_t	params;
+	uint64_t			last;			// local RX timestamp of the last beacon used
+	double				offset;			// reference - local time at last, device time units, in [-2^39, 2^39)
+	double				drift;			// d(reference) / d(local) - 1
+	double				p[2][2];		// covariance of offset and drift
+	uint32				beacons;		// beacons used since the filter started
+	uint32				rejects;		// consecutive beacons rejected
+	uint32				outliers;		// beacons rejected in total
+	uint32				resets;			// times the filter started over
+} clock_sync_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn clock_sync_defaults()
+ *
+ * @brief Fill in default tuning: 10 units (150 ps) of beacon noise, 0.05 ppm of carrier integrator noise, a drift
+ *        random walk of 1 ppb per sqrt(s) and a 5 sigma gate, without propagation delay.
+ *
+ * @param params - tuning to initialise
+ *
+ * @return none
+ */
+void clock_sync_defaults(clock_sync_params_t *params);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn clock_sync_init()
+ *
+ * @brief Start a sync engine, the first beacon sets the offset.
+ *
+ * @param sync   - engine to initialise
+ * @param params - tuning
+ *
+ * @return none
+ */
+void clock_sync_init(clock_sync_t *sync, const clock_sync_params_t *params);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn clock_sync_beacon()
+ *
+ * @brief Update the offset and drift from a beacon. Outliers are rejected; the filter starts over after too many of
+ *        them in a row and when the last beacon is more than CLOCK_SYNC_HOLDOVER_S old.
+ *
+ * @param sync      - engine to update
+ * @param rx_stamp  - local 40-bit RX timestamp of the beacon
+ * @param tx_stamp  - reference 40-bit TX timestamp carried by the beacon
+ * @param carrier   - relative clock offset of the reference measured on that beacon, see clock_sync_carrier_ratio()
+ *
+ * @return 0 if the beacon was used, -1 if it was rejected
+ */
+int clock_sync_beacon(clock_sync_t *sync, uint64_t rx_stamp, uint64_t tx_stamp, double carrier);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn clock_sync_map()
+ *
+ * @brief Map a local timestamp to the reference timebase.
+ *
+ * @param sync      - engine to use
+ * @param stamp     - local 40-bit timestamp
+ * @param ref_stamp - where to return the 40-bit reference timestamp
+ * @param sigma     - where to return its standard deviation in device time units, may be NULL
+ *
+ * @return 0 on success, -1 when not synchronised (not enough beacons yet, or none for CLOCK_SYNC_HOLDOVER_S)
+ */
+int clock_sync_map(const clock_sync_t *sync, uint64_t stamp, uint64_t *ref_stamp, double *sigma);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn clock_sync_carrier_ratio()
+ *
+ * @brief Convert a carrier recovery integrator reading (dwt_readcarrierintegrator(), after a good frame) to the clock
+ *        offset of the sender relative to the receiver.
+ *
+ * @param config  - configuration the frame was received with, the scale depends on the channel and data rate
+ * @param carrier - integrator value
+ *
+ * @return the clock offset ratio, positive when the remote clock is faster
+ */
+double clock_sync_carrier_ratio(const dwt_config_t *config, int32 carrier);
+
+#endif /* _CLOCK_SYNC_H_ */
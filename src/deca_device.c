@@ -12,11 +12,14 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "deca_types.h"
 #include "deca_param_types.h"
 #include "deca_regs.h"
 #include "deca_device_api.h"
+#include "telemetry.h"
 
 // Defines for enable_clocks function
 #define FORCE_SYS_XTI  0
@@ -54,24 +57,59 @@ uint32 _dwt_otpread(uint32 address);
 uint32 _dwt_otpprogword32(uint32 data, uint16 address);
 // Upload the device configuration into always on memory
 void _dwt_aonarrayupload(void);
+// Compose the SPI header of a register read or write
+int _dwt_readheader(uint16 recordNumber, uint16 index, uint8 *header);
+int _dwt_writeheader(uint16 recordNumber, uint16 index, uint8 *header);
+void _dwt_rxrestart(void);
+// Access the shadow copies of host owned registers
+uint32 _dwt_shadowread(int reg);
+void _dwt_shadowwrite(int reg, uint32 value);
+void _dwt_shadowwritten(int reg, uint32 mask, uint32 value);
 // -------------------------------------------------------------------------------------------------------------------
 
 /*!
  * Static data for DW1000 DecaWave Transceiver control
  */
 
+// -------------------------------------------------------------------------------------------------------------------
+// Host owned registers, i.e. only ever changed by the host (or by a reset or a wake-up), of which the driver keeps a
+// shadow copy so that read-modify-write sequences only need the write. See _dwt_shadowread().
+#define DWT_SHADOW_SYS_CFG      0
+#define DWT_SHADOW_SYS_MASK     1
+#define DWT_SHADOW_PMSC_CTRL0   2
+#define DWT_SHADOW_PMSC_CTRL1   3
+#define DWT_SHADOW_NUM          4
+
+static const struct
+{
+    uint16 regFileID;
+    uint16 index;
+} shadow_regs[DWT_SHADOW_NUM] =
+{
+    { SYS_CFG_ID, 0 },
+    { SYS_MASK_ID, 0 },
+    { PMSC_ID, PMSC_CTRL0_OFFSET },
+    { PMSC_ID, PMSC_CTRL1_OFFSET }
+};
+
 // -------------------------------------------------------------------------------------------------------------------
 // Structure to hold device data
 typedef struct
 {
     uint32      partID ;            // IC Part ID - read during initialisation
     uint32      lotID ;             // IC Lot ID - read during initialisation
+    dwt_otpcal_t otpCal ;           // OTP calibration values, read during initialisation or taken from otpCalTable
+    uint8       otpCalCached ;      // otpCal came from otpCalTable
+    const dwt_otpcal_t *otpCalTable ; // Known devices, see dwt_setotpcal()
+    uint16      otpCalNum ;         // Number of entries in otpCalTable
     uint8       longFrames ;        // Flag in non-standard long frame mode
     uint8       otprev ;            // OTP revision number (read during initialisation)
     uint32      txFCTRL ;           // Keep TX_FCTRL register config
     uint8       init_xtrim;         // initial XTAL trim value read from OTP (or defaulted to mid-range if OTP not programmed)
     uint8       dblbuffon;          // Double RX buffer mode flag
-    uint32      sysCFGreg ;         // Local copy of system config register
+    uint8       rxautoreen;         // Automatic RX re-enable flag
+    uint32      shadowReg[DWT_SHADOW_NUM] ; // Shadow copies of the host owned registers (SYS_CFG, SYS_MASK, PMSC_CTRL0/1)
+    uint8       shadowValid ;       // Bit n is set while shadowReg[n] holds the device value
     uint16      sleep_mode;         // Used for automatic reloading of LDO tune and microcode at wake-up
     uint8       wait4resp ;         // wait4response was set with last TX start command
     dwt_cb_data_t cbData;           // Callback data structure
@@ -82,12 +120,15 @@ typedef struct
 } dwt_local_data_t ;
 
 static dwt_local_data_t dw1000local[DWT_NUM_DW_DEV] ; // Static local device data, can be an array to support multiple DW1000 testing applications/platforms
-static dwt_local_data_t *pdw1000local = dw1000local ; // Static local data structure pointer
+// Static local data structure pointer. It is per thread so that threads serving different DW1000s (e.g. their IRQ threads) can each
+// point at their own device with dwt_setlocaldataptr().
+static __thread dwt_local_data_t *pdw1000local = dw1000local ;
 
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_setlocaldataptr()
  *
  * @brief This function sets the local data structure pointer to point to the element in the local array as given by the index.
+ *        The pointer is per thread, it only changes the device used by the calling thread.
  *
  * input parameters
  * @param index    - selects the array element to point to. Must be within the array bounds, i.e. < DWT_NUM_DW_DEV
@@ -99,7 +140,7 @@ static dwt_local_data_t *pdw1000local = dw1000local ; // Static local data struc
 int dwt_setlocaldataptr(unsigned int index)
 {
     // Check the index is within the array bounds
-    if (DWT_NUM_DW_DEV > index) // return error if index outside the array bounds
+    if (index >= DWT_NUM_DW_DEV) // return error if index outside the array bounds
     {
         return DWT_ERROR ;
     }
@@ -120,7 +161,8 @@ int dwt_setlocaldataptr(unsigned int index)
  *
  * NOTES:
  * 1.this function needs to be run before dwt_configuresleep, also the SPI frequency has to be < 3MHz
- * 2.it also reads and applies LDO tune and crystal trim values from OTP memory
+ * 2.it also reads and applies LDO tune and crystal trim values from OTP memory, unless they are in the table given to
+ *   dwt_setotpcal() for the part and lot ID of the device
  *
  * input parameters
  * @param config    -   specifies what configuration to load
@@ -139,14 +181,24 @@ int dwt_setlocaldataptr(unsigned int index)
 #define VTEMP_ADDRESS  (0x09)
 #define XTRIM_ADDRESS  (0x1E)
 
+// PG calibration polling, see dwt_pgcountsample()
+#define DWT_PGC_POLL_US         (20)
+#define DWT_PGC_TIMEOUT_US      (5000)
+
+// Wake-up polling, see dwt_spicswakeup()
+#define DWT_WAKEUP_POLL_US      (50)
+#define DWT_WAKEUP_TIMEOUT_US   (5000)
+
 int dwt_initialise(uint16 config)
 {
-    uint16 otp_addr = 0;
-    uint32 ldo_tune = 0;
+    dwt_otpcal_t *cal = &pdw1000local->otpCal;
+    uint16 i;
 
     pdw1000local->dblbuffon = 0; // Double buffer mode off by default
+    pdw1000local->rxautoreen = 0; // Automatic RX re-enable off by default
     pdw1000local->wait4resp = 0;
     pdw1000local->sleep_mode = 0;
+    dwt_invalidateshadow(); // The device may have been reset or woken up since the last initialisation
 
     pdw1000local->cbTxDone = NULL;
     pdw1000local->cbRxOk = NULL;
@@ -167,25 +219,44 @@ int dwt_initialise(uint16 config)
     // Configure the CPLL lock detect
     dwt_write8bitoffsetreg(EXT_SYNC_ID, EC_CTRL_OFFSET, EC_CTRL_PLLLCK);
 
-    // Read OTP revision number
-    otp_addr = _dwt_otpread(XTRIM_ADDRESS) & 0xffff;        // Read 32 bit value, XTAL trim val is in low octet-0 (5 bits)
-    pdw1000local->otprev = (otp_addr >> 8) & 0xff;            // OTP revision is next byte
+    // Load Part and Lot ID from OTP, they identify the device in the table of dwt_setotpcal()
+    pdw1000local->partID = _dwt_otpread(PARTID_ADDRESS);
+    pdw1000local->lotID = _dwt_otpread(LOTID_ADDRESS);
+
+    // The other calibration values never change for a given device, they are only read from OTP if not known yet
+    pdw1000local->otpCalCached = 0;
+    for (i = 0; i < pdw1000local->otpCalNum; i++)
+    {
+        if ((pdw1000local->otpCalTable[i].partID == pdw1000local->partID) && (pdw1000local->otpCalTable[i].lotID == pdw1000local->lotID))
+        {
+            *cal = pdw1000local->otpCalTable[i];
+            pdw1000local->otpCalCached = 1;
+            break;
+        }
+    }
+    if (!pdw1000local->otpCalCached)
+    {
+        cal->partID = pdw1000local->partID;
+        cal->lotID = pdw1000local->lotID;
+        cal->xtrim = _dwt_otpread(XTRIM_ADDRESS) & 0xffff;  // Read 32 bit value, XTAL trim val is in low octet-0 (5 bits)
+        cal->ldoTune = _dwt_otpread(LDOTUNE_ADDRESS);
+        cal->vBatP = _dwt_otpread(VBAT_ADDRESS) & 0xff;     // Voltage sensor reading at 3.3 V
+        cal->tempP = _dwt_otpread(VTEMP_ADDRESS) & 0xff;    // Temperature sensor reading at 23 C
+    }
+
+    // OTP revision number
+    pdw1000local->otprev = (cal->xtrim >> 8) & 0xff;        // OTP revision is next byte
 
-    // Load LDO tune from OTP and kick it if there is a value actually programmed.
-    ldo_tune = _dwt_otpread(LDOTUNE_ADDRESS);
-    if((ldo_tune & 0xFF) != 0)
+    // Kick LDO tune if there is a value actually programmed in OTP.
+    if((cal->ldoTune & 0xFF) != 0)
     {
         // Kick LDO tune
         dwt_write8bitoffsetreg(OTP_IF_ID, OTP_SF, OTP_SF_LDO_KICK); // Set load LDE kick bit
         pdw1000local->sleep_mode |= AON_WCFG_ONW_LLDO; // LDO tune must be kicked at wake-up
     }
 
-    // Load Part and Lot ID from OTP
-    pdw1000local->partID = _dwt_otpread(PARTID_ADDRESS);
-    pdw1000local->lotID = _dwt_otpread(LOTID_ADDRESS);
-
     // XTAL trim value is set in OTP for DW1000 module and EVK/TREK boards but that might not be the case in a custom design
-    pdw1000local->init_xtrim = otp_addr & 0x1F;
+    pdw1000local->init_xtrim = cal->xtrim & 0x1F;
     if (!pdw1000local->init_xtrim) // A value of 0 means that the crystal has not been trimmed
     {
         pdw1000local->init_xtrim = FS_XTALT_MIDRANGE ; // Set to mid-range if no calibration value inside
@@ -201,9 +272,10 @@ int dwt_initialise(uint16 config)
     }
     else // Should disable the LDERUN enable bit in 0x36, 0x4
     {
-        uint16 rega = dwt_read16bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET+1) ;
+        uint16 rega = (uint16) (_dwt_shadowread(DWT_SHADOW_PMSC_CTRL1) >> 8) ;
         rega &= 0xFDFF ; // Clear LDERUN bit
         dwt_write16bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET+1, rega) ;
+        _dwt_shadowwritten(DWT_SHADOW_PMSC_CTRL1, 0xFFFF00, (uint32) rega << 8);
     }
 
     _dwt_enableclocks(ENABLE_ALL_SEQ); // Enable clocks for sequencing
@@ -212,7 +284,7 @@ int dwt_initialise(uint16 config)
     dwt_write8bitoffsetreg(AON_ID, AON_CFG1_OFFSET, 0x00);
 
     // Read system register / store local copy
-    pdw1000local->sysCFGreg = dwt_read32bitreg(SYS_CFG_ID) ; // Read sysconfig register
+    _dwt_shadowread(DWT_SHADOW_SYS_CFG) ; // Read sysconfig register
 
     return DWT_SUCCESS ;
 
@@ -378,6 +450,82 @@ uint32 dwt_getlotid(void)
     return pdw1000local->lotID;
 }
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_setotpcal()
+ *
+ * @brief This is used to give dwt_initialise() the OTP calibration values of known devices, so that it only reads the
+ * part and lot ID from OTP and takes the other values from the entry with the same IDs, if any.
+ *
+ * input parameters
+ * @param table - known devices, e.g. as returned by dwt_getotpcal() on earlier runs, must stay valid until dwt_initialise()
+ * @param num - number of entries in the table, 0 to always read the values from OTP
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_setotpcal(const dwt_otpcal_t *table, uint16 num)
+{
+    pdw1000local->otpCalTable = table;
+    pdw1000local->otpCalNum = num;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_getotpcal()
+ *
+ * @brief This is used to return the OTP calibration values the device was initialised with
+ *
+ * NOTE: dwt_initialise() must be called prior to this function so that it can return a relevant value.
+ *
+ * input parameters
+ *
+ * output parameters
+ * @param cal - where to copy the values
+ *
+ * returns 1 if dwt_initialise() took them from the table of dwt_setotpcal(), 0 if it read them from OTP
+ */
+int dwt_getotpcal(dwt_otpcal_t *cal)
+{
+    *cal = pdw1000local->otpCal;
+    return pdw1000local->otpCalCached;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_geticrefvolt()
+ *
+ * @brief This is used to return the voltage sensor reading at 3.3 V, as programmed in OTP during production.
+ *
+ * NOTE: dwt_initialise() must be called prior to this function so that it can return a relevant value.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the 8 bit raw voltage reading, 0 if not programmed
+ */
+uint8 dwt_geticrefvolt(void)
+{
+    return pdw1000local->otpCal.vBatP;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_geticreftemp()
+ *
+ * @brief This is used to return the temperature sensor reading at 23 C, as programmed in OTP during production.
+ *
+ * NOTE: dwt_initialise() must be called prior to this function so that it can return a relevant value.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the 8 bit raw temperature reading, 0 if not programmed
+ */
+uint8 dwt_geticreftemp(void)
+{
+    return pdw1000local->otpCal.tempP;
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_readdevid()
  *
@@ -443,6 +591,7 @@ void dwt_configure(dwt_config_t *config)
     uint16 reg16 = lde_replicaCoeff[config->rxCode];
     uint8 prfIndex = config->prf - DWT_PRF_16M;
     uint8 bw = ((chan == 4) || (chan == 7)) ? 1 : 0 ; // Select wide or narrow band
+    uint32 sysconfig = _dwt_shadowread(DWT_SHADOW_SYS_CFG) ;
 
 #ifdef DWT_API_ERROR_CHECK
     assert(config->dataRate <= DWT_BR_6M8);
@@ -461,20 +610,20 @@ void dwt_configure(dwt_config_t *config)
     // For 110 kbps we need a special setup
     if(DWT_BR_110K == config->dataRate)
     {
-        pdw1000local->sysCFGreg |= SYS_CFG_RXM110K ;
+        sysconfig |= SYS_CFG_RXM110K ;
         reg16 >>= 3; // lde_replicaCoeff must be divided by 8
     }
     else
     {
-        pdw1000local->sysCFGreg &= (~SYS_CFG_RXM110K) ;
+        sysconfig &= (~SYS_CFG_RXM110K) ;
     }
 
     pdw1000local->longFrames = config->phrMode ;
 
-    pdw1000local->sysCFGreg &= ~SYS_CFG_PHR_MODE_11;
-    pdw1000local->sysCFGreg |= (SYS_CFG_PHR_MODE_11 & (config->phrMode << SYS_CFG_PHR_MODE_SHFT));
+    sysconfig &= ~SYS_CFG_PHR_MODE_11;
+    sysconfig |= (SYS_CFG_PHR_MODE_11 & (config->phrMode << SYS_CFG_PHR_MODE_SHFT));
 
-    dwt_write32bitreg(SYS_CFG_ID,pdw1000local->sysCFGreg) ;
+    _dwt_shadowwrite(DWT_SHADOW_SYS_CFG, sysconfig) ;
     // Set the lde_replicaCoeff
     dwt_write16bitoffsetreg(LDE_IF_ID, LDE_REPC_OFFSET, reg16) ;
 
@@ -560,6 +709,58 @@ void dwt_configure(dwt_config_t *config)
     dwt_write8bitoffsetreg(SYS_CTRL_ID, SYS_CTRL_OFFSET, SYS_CTRL_TXSTRT | SYS_CTRL_TRXOFF); // Request TX start and TRX off at the same time
 } // end dwt_configure()
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_configurefixed()
+ *
+ * @brief This function configures the DW1000 as dwt_configure() would for the configuration a dwt_fixedconfig_t was
+ * computed for, without any table lookup: the precomputed register writes, SYS_CFG first, are sent in one SPI message
+ * (one dwt_writetodevicebatch() call, so at most DWT_WRITE_BATCH_MAX writes in all, which dw1000_cfggen checks). The
+ * structure is generated by dw1000_cfggen, and the configuration it holds is the one to use for the rest of the driver.
+ *
+ * input parameters
+ * @param fixed - pointer to the precomputed configuration
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_configurefixed(const dwt_fixedconfig_t *fixed)
+{
+    dwt_writereq_t reqs[DWT_WRITE_BATCH_MAX] ;
+    uint8 sysCfg[4] ;
+    uint32 sysconfig = _dwt_shadowread(DWT_SHADOW_SYS_CFG) ;
+    int ret ;
+    uint16 i, n = 0 ;
+
+    if (fixed->count >= DWT_WRITE_BATCH_MAX)
+    {
+        return DWT_ERROR ;
+    }
+
+    // Only the 110 kb/s and PHR mode bits of SYS_CFG depend on the configuration, the others are kept as they are
+    sysconfig = (sysconfig & ~(SYS_CFG_RXM110K | SYS_CFG_PHR_MODE_11)) | fixed->sysCfg ;
+    for (i = 0 ; i < 4 ; i++)
+    {
+        sysCfg[i] = (uint8) (sysconfig >> (8 * i)) ;
+    }
+    reqs[n].recordNumber = SYS_CFG_ID ;
+    reqs[n].index = 0 ;
+    reqs[n].length = sizeof(sysCfg) ;
+    reqs[n++].buffer = sysCfg ;
+
+    for (i = 0 ; i < fixed->count ; i++)
+    {
+        reqs[n++] = fixed->writes[i] ;
+    }
+    ret = dwt_writetodevicebatch(reqs, n) ;
+
+    _dwt_shadowwritten(DWT_SHADOW_SYS_CFG, 0xFFFFFFFFUL, sysconfig) ;
+    pdw1000local->longFrames = fixed->config.phrMode ;
+    pdw1000local->txFCTRL = fixed->txFCTRL ;
+
+    return ret ;
+} // end dwt_configurefixed()
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_setrxantennadelay()
  *
@@ -715,6 +916,128 @@ void dwt_readaccdata(uint8 *buffer, uint16 len, uint16 accOffset)
     _dwt_enableclocks(READ_ACC_OFF); // Revert clocks back
 }
 
+/*
+ * Read numTaps taps from tap firstTap of the accumulator into dst, in as few transactions as the platform allows. The
+ * accumulator clocks must already be forced on.
+ */
+static int _dwt_readcirrun(uint8 *dst, uint16 firstTap, uint16 numTaps)
+{
+    uint8 header[3];
+    uint32 offset = (uint32) firstTap * DWT_CIR_TAP_LEN;
+    uint32 remaining = (uint32) numTaps * DWT_CIR_TAP_LEN;
+    uint32 maxChunk;
+    uint32 chunk;
+    int cnt;
+    int status = DWT_SUCCESS;
+
+    // Each transaction also carries up to 3 header octets and the dummy octet, only read whole taps per transaction
+    maxChunk = spimaxtransfer();
+    maxChunk = (maxChunk > 4) ? ((maxChunk - 4) & ~(DWT_CIR_TAP_LEN - 1)) : 0;
+    if (maxChunk == 0)
+    {
+        return DWT_ERROR;
+    }
+
+    while ((remaining > 0) && (status == DWT_SUCCESS))
+    {
+        chunk = (remaining > maxChunk) ? maxChunk : remaining;
+
+        cnt = _dwt_readheader(ACC_MEM_ID, offset, header);
+        status = readfromspidiscard(cnt, header, 1, chunk, dst);
+
+        dst += chunk;
+        offset += chunk;
+        remaining -= chunk;
+    }
+
+    return status;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readcir()
+ *
+ * @brief This is used to read a run of taps of the channel impulse response from the accumulator as 16-bit signed
+ *        real/imaginary pairs, e.g. the whole CIR (DWT_CIR_LEN_PRF16 or DWT_CIR_LEN_PRF64 taps from tap 0).
+ *
+ * NOTE: The accumulator clocks are only forced on once for the whole read, and the read is split into as few SPI
+ *       transactions as the platform can move (see spimaxtransfer()), usually a single one for the full CIR. The dummy
+ *       octet that starts each accumulator read is discarded by the SPI layer so the taps land contiguously in iq.
+ *
+ * input parameters
+ * @param iq - the buffer into which the taps will be read, must hold 2 * numTaps values (real part first)
+ * @param firstTap - the index of the first tap to read
+ * @param numTaps - the number of taps to read
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_readcir(int16 *iq, uint16 firstTap, uint16 numTaps)
+{
+    int status;
+
+    if (((uint32) firstTap + numTaps) * DWT_CIR_TAP_LEN > ACC_MEM_LEN)
+    {
+        return DWT_ERROR;
+    }
+
+    // Force on the ACC clocks if we are sequenced
+    _dwt_enableclocks(READ_ACC_ON);
+
+    status = _dwt_readcirrun((uint8 *) iq, firstTap, numTaps);
+
+    _dwt_enableclocks(READ_ACC_OFF); // Revert clocks back
+
+    TELEM_MARK(TELEM_CIR_READ);
+    return status;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readcirwindow()
+ *
+ * @brief This is used to read a window of taps of the channel impulse response, e.g. around the first path, wrapping
+ *        around to tap 0 at the end of the CIR.
+ *
+ * NOTE: When the window wraps, it is read with two runs of accumulator reads, the accumulator clocks being forced on
+ *       only once. Tap i of iq is tap (firstTap + i) % cirLen of the accumulator.
+ *
+ * input parameters
+ * @param iq - the buffer into which the taps will be read, must hold 2 * numTaps values (real part first)
+ * @param firstTap - the index of the first tap to read, less than cirLen
+ * @param numTaps - the number of taps to read, up to cirLen
+ * @param cirLen - the length of the CIR, DWT_CIR_LEN_PRF16 or DWT_CIR_LEN_PRF64
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_readcirwindow(int16 *iq, uint16 firstTap, uint16 numTaps, uint16 cirLen)
+{
+    uint16 run;
+    int status;
+
+    if ((firstTap >= cirLen) || (numTaps > cirLen) || ((uint32) cirLen * DWT_CIR_TAP_LEN > ACC_MEM_LEN))
+    {
+        return DWT_ERROR;
+    }
+
+    run = ((uint32) firstTap + numTaps > cirLen) ? (cirLen - firstTap) : numTaps;
+
+    // Force on the ACC clocks if we are sequenced
+    _dwt_enableclocks(READ_ACC_ON);
+
+    status = _dwt_readcirrun((uint8 *) iq, firstTap, run);
+    if ((status == DWT_SUCCESS) && (run < numTaps))
+    {
+        status = _dwt_readcirrun((uint8 *) (iq + 2 * run), 0, numTaps - run);
+    }
+
+    _dwt_enableclocks(READ_ACC_OFF); // Revert clocks back
+
+    TELEM_MARK(TELEM_CIR_READ);
+    return status;
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_readcarrierintegrator()
  *
@@ -767,18 +1090,81 @@ int32 dwt_readcarrierintegrator(void)
  */
 void dwt_readdiagnostics(dwt_rxdiag_t *diagnostics)
 {
-    // Read the HW FP index
-    diagnostics->firstPath = dwt_read16bitoffsetreg(RX_TIME_ID, RX_TIME_FP_INDEX_OFFSET);
+    uint8 fpIndexAmpl1[4] ;
+    uint8 finfo[RX_FINFO_LEN] ;
+    dwt_readreq_t reqs[4] =
+    {
+        // HW FP index and first path amplitude 1 are adjacent
+        { RX_TIME_ID, RX_TIME_FP_INDEX_OFFSET, 4, fpIndexAmpl1 },
+        // LDE diagnostic data
+        { LDE_IF_ID, LDE_THRESH_OFFSET, LDE_THRESH_LEN, (uint8*)&diagnostics->maxNoise },
+        // All 8 bytes of frame quality
+        { RX_FQUAL_ID, 0x0, RX_FQUAL_LEN, (uint8*)&diagnostics->stdNoise },
+        { RX_FINFO_ID, RX_FINFO_OFFSET, RX_FINFO_LEN, finfo }
+    } ;
+
+    // Read everything in one SPI message
+    dwt_readfromdevicebatch(reqs, 4);
+
+    diagnostics->firstPath = ((uint16)fpIndexAmpl1[1] << 8) + fpIndexAmpl1[0] ;
+    diagnostics->firstPathAmp1 = ((uint16)fpIndexAmpl1[3] << 8) + fpIndexAmpl1[2] ;
+    diagnostics->rxPreamCount = ((((uint32)finfo[3] << 24) + ((uint32)finfo[2] << 16)) & RX_FINFO_RXPACC_MASK) >> RX_FINFO_RXPACC_SHIFT ;
+
+    TELEM_MARK(TELEM_DIAG_READ);
+}
 
-    // LDE diagnostic data
-    diagnostics->maxNoise = dwt_read16bitoffsetreg(LDE_IF_ID, LDE_THRESH_OFFSET);
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readrxframe()
+ *
+ * @brief This reads everything the host usually needs after a good frame: the RX timestamps, the RX frame information
+ *        register, the diagnostics and the frame data, all in a single SPI message (see dwt_readfromdevicebatch()).
+ *        As with the individual reads, this must be done before the double buffer is toggled.
+ *
+ * input parameters
+ * @param info         - pointer to the structure in which to return the timestamps, RX_FINFO and diagnostics
+ * @param buffer       - the buffer into which the frame data will be read, may be NULL if length is 0
+ * @param length       - the length of frame data to read
+ * @param rxBufferOffset - the offset in the RX buffer at which to start reading the data
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_readrxframe(dwt_rxframeinfo_t *info, uint8 *buffer, uint16 length, uint16 rxBufferOffset)
+{
+    uint8 rxTime[RX_TIME_LLEN] ;
+    uint8 finfo[RX_FINFO_LEN] ;
+    dwt_readreq_t reqs[5] =
+    {
+        // Adjusted stamp, FP index, FP amplitude 1 and raw stamp make up the whole register
+        { RX_TIME_ID, RX_TIME_RX_STAMP_OFFSET, RX_TIME_LLEN, rxTime },
+        { LDE_IF_ID, LDE_THRESH_OFFSET, LDE_THRESH_LEN, (uint8*)&info->diag.maxNoise },
+        { RX_FQUAL_ID, 0x0, RX_FQUAL_LEN, (uint8*)&info->diag.stdNoise },
+        { RX_FINFO_ID, RX_FINFO_OFFSET, RX_FINFO_LEN, finfo },
+        { RX_BUFFER_ID, rxBufferOffset, length, buffer }
+    } ;
+    int status ;
 
-    // Read all 8 bytes in one SPI transaction
-    dwt_readfromdevice(RX_FQUAL_ID, 0x0, 8, (uint8*)&diagnostics->stdNoise);
+#ifdef DWT_API_ERROR_CHECK
+    assert((length == 0) || (buffer != NULL));
+#endif
 
-    diagnostics->firstPathAmp1 = dwt_read16bitoffsetreg(RX_TIME_ID, RX_TIME_FP_AMPL1_OFFSET);
+    status = dwt_readfromdevicebatch(reqs, (length > 0) ? 5 : 4);
+    if (status != DWT_SUCCESS)
+    {
+        return status ;
+    }
+
+    memcpy(info->rxStamp, &rxTime[RX_TIME_RX_STAMP_OFFSET], RX_TIME_RX_STAMP_LEN);
+    memcpy(info->rxRawStamp, &rxTime[RX_TIME_FP_RAWST_OFFSET], RX_TIME_RX_STAMP_LEN);
+    info->finfo = ((uint32)finfo[3] << 24) + ((uint32)finfo[2] << 16) + ((uint32)finfo[1] << 8) + finfo[0] ;
 
-    diagnostics->rxPreamCount = (dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXPACC_MASK) >> RX_FINFO_RXPACC_SHIFT  ;
+    info->diag.firstPath = ((uint16)rxTime[RX_TIME_FP_INDEX_OFFSET + 1] << 8) + rxTime[RX_TIME_FP_INDEX_OFFSET] ;
+    info->diag.firstPathAmp1 = ((uint16)rxTime[RX_TIME_FP_AMPL1_OFFSET + 1] << 8) + rxTime[RX_TIME_FP_AMPL1_OFFSET] ;
+    info->diag.rxPreamCount = (info->finfo & RX_FINFO_RXPACC_MASK) >> RX_FINFO_RXPACC_SHIFT ;
+
+    TELEM_MARK(TELEM_FRAME_READ);
+    return DWT_SUCCESS ;
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -945,21 +1331,92 @@ void dwt_writetodevice
 )
 {
     uint8 header[3] ; // Buffer to compose header in
+    int   cnt ; // Length of header
+#ifdef DWT_API_ERROR_CHECK
+    assert((index <= 0x7FFF) && ((index + length) <= 0x7FFF)); // Index and sub-addressable area are limited to 15-bits.
+#endif
+
+    // Write message header selecting WRITE operation and addresses as appropriate (this is one to three bytes long)
+    cnt = _dwt_writeheader(recordNumber, index, header);
+
+    // Write it to the SPI
+    writetospi(cnt,header,length,buffer);
+} // end dwt_writetodevice()
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_writetodevicebatch()
+ *
+ * @brief  this function is used to write several DW1000 registers or buffers at once. The headers for all the writes
+ *         are composed as for dwt_writetodevice() and handed to the platform in one go, which sends them as a single
+ *         SPI message with chip select released between the writes (see writetospibatch()).
+ *
+ * input parameters:
+ * @param reqs          - the writes to do, in order
+ * @param count         - number of writes, 1 to DWT_WRITE_BATCH_MAX
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_writetodevicebatch
+(
+    const dwt_writereq_t *reqs,
+    uint16  count
+)
+{
+    uint8 headers[DWT_WRITE_BATCH_MAX][3] ; // Buffers to compose headers in
+    dwt_spiwrite_t writes[DWT_WRITE_BATCH_MAX] ;
+    int   i ;
+
+    if ((count == 0) || (count > DWT_WRITE_BATCH_MAX))
+    {
+        return DWT_ERROR ;
+    }
+
+    for (i = 0 ; i < count ; i++)
+    {
+#ifdef DWT_API_ERROR_CHECK
+        assert((reqs[i].index <= 0x7FFF) && ((reqs[i].index + reqs[i].length) <= 0x7FFF)); // Index and sub-addressable area are limited to 15-bits.
+#endif
+        writes[i].headerLength = _dwt_writeheader(reqs[i].recordNumber, reqs[i].index, headers[i]);
+        writes[i].headerBuffer = headers[i];
+        writes[i].bodyLength = reqs[i].length;
+        writes[i].bodyBuffer = reqs[i].buffer;
+    }
+
+    return writetospibatch(count, writes);
+} // end dwt_writetodevicebatch()
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_writeheader()
+ *
+ * @brief  this function composes the header of a write access to the DW1000 device registers
+ *        a. check if sub index is used, if subindexing is used - set bit-6 to 1 to signify that the sub-index address follows the register index byte
+ *        b. set bit-7 for write operation
+ *        c. if extended sub address index is used (i.e. if index > 127) set bit-7 of the first sub-index byte following the first header byte
+ *
+ * input parameters:
+ * @param recordNumber  - ID of register file or buffer being accessed
+ * @param index         - byte index into register file or buffer being accessed
+ * @param header        - buffer of 3 bytes in which to compose the header
+ *
+ * output parameters
+ *
+ * returns the length of the header, 1 to 3 bytes
+ */
+int _dwt_writeheader(uint16 recordNumber, uint16 index, uint8 *header)
+{
     int   cnt = 0; // Counter for length of header
 #ifdef DWT_API_ERROR_CHECK
     assert(recordNumber <= 0x3F); // Record number is limited to 6-bits.
 #endif
 
-    // Write message header selecting WRITE operation and addresses as appropriate (this is one to three bytes long)
     if (index == 0) // For index of 0, no sub-index is required
     {
         header[cnt++] = 0x80 | recordNumber ; // Bit-7 is WRITE operation, bit-6 zero=NO sub-addressing, bits 5-0 is reg file id
     }
     else
     {
-#ifdef DWT_API_ERROR_CHECK
-        assert((index <= 0x7FFF) && ((index + length) <= 0x7FFF)); // Index and sub-addressable area are limited to 15-bits.
-#endif
         header[cnt++] = 0xC0 | recordNumber ; // Bit-7 is WRITE operation, bit-6 one=sub-address follows, bits 5-0 is reg file id
 
         if (index <= 127) // For non-zero index < 127, just a single sub-index byte is required
@@ -973,9 +1430,58 @@ void dwt_writetodevice
         }
     }
 
-    // Write it to the SPI
-    writetospi(cnt,header,length,buffer);
-} // end dwt_writetodevice()
+    return cnt;
+} // end _dwt_writeheader()
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_readheader()
+ *
+ * @brief  this function composes the header of a read access to the DW1000 device registers
+ *        a. check if sub index is used, if subindexing is used - set bit-6 to 1 to signify that the sub-index address follows the register index byte
+ *        b. leave bit-7 cleared for read operation
+ *        c. if extended sub address index is used (i.e. if index > 127) set bit-7 of the first sub-index byte following the first header byte
+ *
+ * input parameters:
+ * @param recordNumber  - ID of register file or buffer being accessed
+ * @param index         - byte index into register file or buffer being accessed
+ * @param header        - pointer to a 3-byte buffer in which to compose the header
+ *
+ * output parameters
+ *
+ * returns the length of the header (1 to 3 bytes)
+ */
+int _dwt_readheader(uint16 recordNumber, uint16 index, uint8 *header)
+{
+    int   cnt = 0; // Counter for length of header
+#ifdef DWT_API_ERROR_CHECK
+    assert(recordNumber <= 0x3F); // Record number is limited to 6-bits.
+#endif
+
+    // Message header selecting READ operation and addresses as appropriate (this is one to three bytes long)
+    if (index == 0) // For index of 0, no sub-index is required
+    {
+        header[cnt++] = (uint8) recordNumber ; // Bit-7 zero is READ operation, bit-6 zero=NO sub-addressing, bits 5-0 is reg file id
+    }
+    else
+    {
+#ifdef DWT_API_ERROR_CHECK
+        assert(index <= 0x7FFF); // Index is limited to 15-bits.
+#endif
+        header[cnt++] = (uint8)(0x40 | recordNumber) ; // Bit-7 zero is READ operation, bit-6 one=sub-address follows, bits 5-0 is reg file id
+
+        if (index <= 127) // For non-zero index < 127, just a single sub-index byte is required
+        {
+            header[cnt++] = (uint8) index ; // Bit-7 zero means no extension, bits 6-0 is index.
+        }
+        else
+        {
+            header[cnt++] = 0x80 | (uint8)(index) ; // Bit-7 one means extended index, bits 6-0 is low seven bits of index.
+            header[cnt++] =  (uint8) (index >> 7) ; // 8-bit value = high eight bits of index.
+        }
+    }
+
+    return cnt;
+} // end _dwt_readheader()
 
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_readfromdevice()
@@ -1009,37 +1515,61 @@ void dwt_readfromdevice
 )
 {
     uint8 header[3] ; // Buffer to compose header in
-    int   cnt = 0; // Counter for length of header
+    int   cnt ; // Length of header
 #ifdef DWT_API_ERROR_CHECK
-    assert(recordNumber <= 0x3F); // Record number is limited to 6-bits.
+    assert((index <= 0x7FFF) && ((index + length) <= 0x7FFF)); // Index and sub-addressable area are limited to 15-bits.
 #endif
 
     // Write message header selecting READ operation and addresses as appropriate (this is one to three bytes long)
-    if (index == 0) // For index of 0, no sub-index is required
+    cnt = _dwt_readheader(recordNumber, index, header);
+
+    // Do the read from the SPI
+    readfromspi(cnt, header, length, buffer);  // result is stored in the buffer
+} // end dwt_readfromdevice()
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readfromdevicebatch()
+ *
+ * @brief  this function is used to read several DW1000 registers or buffers at once. The headers for all the reads are
+ *         composed as for dwt_readfromdevice() and handed to the platform in one go, which sends them as a single SPI
+ *         message with chip select released between the reads (see readfromspibatch()).
+ *
+ * input parameters:
+ * @param reqs          - the reads to do, in order
+ * @param count         - number of reads, 1 to DWT_READ_BATCH_MAX
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_readfromdevicebatch
+(
+    const dwt_readreq_t *reqs,
+    uint16  count
+)
+{
+    uint8 headers[DWT_READ_BATCH_MAX][3] ; // Buffers to compose headers in
+    dwt_spiread_t reads[DWT_READ_BATCH_MAX] ;
+    int   i ;
+
+    if ((count == 0) || (count > DWT_READ_BATCH_MAX))
     {
-        header[cnt++] = (uint8) recordNumber ; // Bit-7 zero is READ operation, bit-6 zero=NO sub-addressing, bits 5-0 is reg file id
+        return DWT_ERROR ;
     }
-    else
+
+    for (i = 0 ; i < count ; i++)
     {
 #ifdef DWT_API_ERROR_CHECK
-        assert((index <= 0x7FFF) && ((index + length) <= 0x7FFF)); // Index and sub-addressable area are limited to 15-bits.
+        assert((reqs[i].index <= 0x7FFF) && ((reqs[i].index + reqs[i].length) <= 0x7FFF)); // Index and sub-addressable area are limited to 15-bits.
 #endif
-        header[cnt++] = (uint8)(0x40 | recordNumber) ; // Bit-7 zero is READ operation, bit-6 one=sub-address follows, bits 5-0 is reg file id
-
-        if (index <= 127) // For non-zero index < 127, just a single sub-index byte is required
-        {
-            header[cnt++] = (uint8) index ; // Bit-7 zero means no extension, bits 6-0 is index.
-        }
-        else
-        {
-            header[cnt++] = 0x80 | (uint8)(index) ; // Bit-7 one means extended index, bits 6-0 is low seven bits of index.
-            header[cnt++] =  (uint8) (index >> 7) ; // 8-bit value = high eight bits of index.
-        }
+        reads[i].headerLength = _dwt_readheader(reqs[i].recordNumber, reqs[i].index, headers[i]);
+        reads[i].headerBuffer = headers[i];
+        reads[i].readlength = reqs[i].length;
+        reads[i].readBuffer = reqs[i].buffer;
     }
 
-    // Do the read from the SPI
-    readfromspi(cnt, header, length, buffer);  // result is stored in the buffer
-} // end dwt_readfromdevice()
+    return readfromspibatch(count, reads);
+} // end dwt_readfromdevicebatch()
 
 
 
@@ -1212,7 +1742,7 @@ void dwt_write32bitoffsetreg(int regFileID,int regOffset,uint32 regval)
  */
 void dwt_enableframefilter(uint16 enable)
 {
-    uint32 sysconfig = SYS_CFG_MASK & dwt_read32bitreg(SYS_CFG_ID) ; // Read sysconfig register
+    uint32 sysconfig = SYS_CFG_MASK & _dwt_shadowread(DWT_SHADOW_SYS_CFG) ; // Read sysconfig register
 
     if(enable)
     {
@@ -1225,8 +1755,7 @@ void dwt_enableframefilter(uint16 enable)
         sysconfig &= ~(SYS_CFG_FFE);
     }
 
-    pdw1000local->sysCFGreg = sysconfig ;
-    dwt_write32bitreg(SYS_CFG_ID,sysconfig) ;
+    _dwt_shadowwrite(DWT_SHADOW_SYS_CFG, sysconfig) ;
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -1701,6 +2230,9 @@ void dwt_entersleep(void)
 {
     // Copy config to AON - upload the new configuration
     _dwt_aonarrayupload();
+
+    // Registers are lost or restored from AON while sleeping, re-read them after wake-up
+    dwt_invalidateshadow();
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -1869,7 +2401,7 @@ void dwt_configuresleep(uint16 mode, uint8 wake)
  */
 void dwt_entersleepaftertx(int enable)
 {
-    uint32 reg = dwt_read32bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET);
+    uint32 reg = _dwt_shadowread(DWT_SHADOW_PMSC_CTRL1);
     // Set the auto TX -> sleep bit
     if(enable)
     {
@@ -1879,7 +2411,7 @@ void dwt_entersleepaftertx(int enable)
     {
         reg &= ~(PMSC_CTRL1_ATXSLP);
     }
-    dwt_write32bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET, reg);
+    _dwt_shadowwrite(DWT_SHADOW_PMSC_CTRL1, reg);
 }
 
 
@@ -1895,6 +2427,7 @@ void dwt_entersleepaftertx(int enable)
  *
  * where fastest byte_rate is spi_rate (Hz) / 8 if the SPI is sending the bytes back-to-back.
  * To save time and power, a system designer could determine byte_rate value more precisely.
+ * The device is then polled until it is back in INIT (SLP2INIT event), so the call returns as soon as it is ready.
  *
  * NOTE: Alternatively the device can be waken up with WAKE_UP pin if configured for that operation
  *
@@ -1908,14 +2441,28 @@ void dwt_entersleepaftertx(int enable)
  */
 int dwt_spicswakeup(uint8 *buff, uint16 length)
 {
+    uint32 waited;
+
+    // The device may have gone to sleep on its own (e.g. after TX, see dwt_entersleepaftertx()), do not trust the shadow copies
+    dwt_invalidateshadow();
+
     if(dwt_readdevid() != DWT_DEVICE_ID) // Device was in deep sleep (the first read fails)
     {
         // Need to keep chip select line low for at least 500us
         dwt_readfromdevice(0x0, 0x0, length, buff); // Do a long read to wake up the chip (hold the chip select low)
 
-        // Need 5ms for XTAL to start and stabilise (could wait for PLL lock IRQ status bit !!!)
+        // Up to 5ms for XTAL to start and stabilise, much less if it was kept running (DWT_XTAL_EN): poll until the device
+        // reports it is back in INIT, its configuration restored if DWT_CONFIG was set.
         // NOTE: Polling of the STATUS register is not possible unless frequency is < 3MHz
-        deca_sleep(5);
+        for (waited = 0; waited < DWT_WAKEUP_TIMEOUT_US; waited += DWT_WAKEUP_POLL_US)
+        {
+            deca_usleep(DWT_WAKEUP_POLL_US);
+            if ((dwt_readdevid() == DWT_DEVICE_ID) && (dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_SLP2INIT))
+            {
+                break;
+            }
+        }
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_SLP2INIT); // Clear the event
     }
     else
     {
@@ -2026,19 +2573,19 @@ void dwt_loadopsettabfromotp(uint8 ops_sel)
 void dwt_setsmarttxpower(int enable)
 {
     // Config system register
-    pdw1000local->sysCFGreg = dwt_read32bitreg(SYS_CFG_ID) ; // Read sysconfig register
+    uint32 sysconfig = _dwt_shadowread(DWT_SHADOW_SYS_CFG) ; // Read sysconfig register
 
     // Disable smart power configuration
     if(enable)
     {
-        pdw1000local->sysCFGreg &= ~(SYS_CFG_DIS_STXP) ;
+        sysconfig &= ~(SYS_CFG_DIS_STXP) ;
     }
     else
     {
-        pdw1000local->sysCFGreg |= SYS_CFG_DIS_STXP ;
+        sysconfig |= SYS_CFG_DIS_STXP ;
     }
 
-    dwt_write32bitreg(SYS_CFG_ID,pdw1000local->sysCFGreg) ;
+    _dwt_shadowwrite(DWT_SHADOW_SYS_CFG, sysconfig) ;
 }
 
 
@@ -2061,8 +2608,7 @@ void dwt_enableautoack(uint8 responseDelayTime)
     // Set auto ACK reply delay
     dwt_write8bitoffsetreg(ACK_RESP_T_ID, ACK_RESP_T_ACK_TIM_OFFSET, responseDelayTime); // In symbols
     // Enable auto ACK
-    pdw1000local->sysCFGreg |= SYS_CFG_AUTOACK;
-    dwt_write32bitreg(SYS_CFG_ID,pdw1000local->sysCFGreg) ;
+    _dwt_shadowwrite(DWT_SHADOW_SYS_CFG, _dwt_shadowread(DWT_SHADOW_SYS_CFG) | SYS_CFG_AUTOACK) ;
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -2079,20 +2625,57 @@ void dwt_enableautoack(uint8 responseDelayTime)
  */
 void dwt_setdblrxbuffmode(int enable)
 {
+    uint32 sysconfig = _dwt_shadowread(DWT_SHADOW_SYS_CFG) ;
+
     if(enable)
     {
         // Enable double RX buffer mode
-        pdw1000local->sysCFGreg &= ~SYS_CFG_DIS_DRXB;
+        sysconfig &= ~SYS_CFG_DIS_DRXB;
         pdw1000local->dblbuffon = 1;
     }
     else
     {
         // Disable double RX buffer mode
-        pdw1000local->sysCFGreg |= SYS_CFG_DIS_DRXB;
+        sysconfig |= SYS_CFG_DIS_DRXB;
         pdw1000local->dblbuffon = 0;
     }
 
-    dwt_write32bitreg(SYS_CFG_ID,pdw1000local->sysCFGreg) ;
+    _dwt_shadowwrite(DWT_SHADOW_SYS_CFG, sysconfig) ;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_setautorxreenable()
+ *
+ * @brief This call enables the automatic re-enabling of the receiver. Together with the double receive buffer mode (see
+ *        dwt_setdblrxbuffmode()) this gives a continuous receive mode: the receiver keeps listening into the other buffer
+ *        while the host reads the frame from the current one, and dwt_isr() re-enables it after errors, timeouts and
+ *        overruns (the latter being counted in the OVER event counter, see dwt_readeventcounters()).
+ *
+ * input parameters
+ * @param enable - 1 to enable, 0 to disable the automatic re-enabling of the receiver
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_setautorxreenable(int enable)
+{
+    uint32 sysconfig = _dwt_shadowread(DWT_SHADOW_SYS_CFG) ;
+
+    if(enable)
+    {
+        // Enable auto re-enable of the receiver
+        sysconfig |= SYS_CFG_RXAUTR;
+        pdw1000local->rxautoreen = 1;
+    }
+    else
+    {
+        // Disable auto re-enable of the receiver
+        sysconfig &= ~SYS_CFG_RXAUTR;
+        pdw1000local->rxautoreen = 0;
+    }
+
+    _dwt_shadowwrite(DWT_SHADOW_SYS_CFG, sysconfig) ;
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -2168,11 +2751,15 @@ uint8 dwt_checkirq(void)
  *          - TXFRS (through cbTxDone callback)
  *          - RXRFTO/RXPTO (through cbRxTo callback)
  *          - RXPHE/RXFCE/RXRFSL/RXSFDTO/AFFREJ/LDEERR (through cbRxTo cbRxErr)
+ *          - RXOVRR (through cbRxErr callback)
  *        For all events, corresponding interrupts are cleared and necessary resets are performed. In addition, in the RXFCG case,
  *        received frame information and frame control are read before calling the callback. If double buffering is activated, it
  *        will also toggle between reception buffers once the reception callback processing has ended.
  *
- *        /!\ This version of the ISR supports double buffering but does not support automatic RX re-enabling!
+ *        If automatic RX re-enabling is activated (see dwt_setautorxreenable()), the receiver is turned on again after the reset
+ *        that follows any error, timeout or overrun event. Combined with double buffering, the frame reported to the cbRxOk
+ *        callback stays in the host side buffer only until the callback returns, so the callback must read everything it needs
+ *        (including the accumulator, which is not double buffered and will be overwritten by the next frame) before returning.
  *
  * NOTE:  In PC based system using (Cheetah or ARM) USB to SPI converter there can be no interrupts, however we still need something
  *        to take the place of it and operate in a polled way. In an embedded system this function should be configured to be triggered
@@ -2188,6 +2775,25 @@ void dwt_isr(void)
 {
     uint32 status = pdw1000local->cbData.status = dwt_read32bitreg(SYS_STATUS_ID); // Read status register low 32bits
 
+    // Handle receiver overrun event - This can only happen in double buffering mode, when a frame arrives while both buffers
+    // are still full. The contents of the buffers can't be trusted anymore so any good frame reported along with it is dropped.
+    if(status & SYS_STATUS_RXOVRR)
+    {
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXOVRR); // Clear overrun event bit
+
+        pdw1000local->wait4resp = 0;
+
+        _dwt_rxrestart();
+
+        status &= ~(SYS_STATUS_ALL_RX_GOOD | SYS_STATUS_ALL_RX_ERR);
+
+        // Call the corresponding callback if present
+        if(pdw1000local->cbRxErr != NULL)
+        {
+            pdw1000local->cbRxErr(&pdw1000local->cbData);
+        }
+    }
+
     // Handle RX good frame event
     if(status & SYS_STATUS_RXFCG)
     {
@@ -2195,6 +2801,7 @@ void dwt_isr(void)
         uint16 len;
 
         dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_GOOD); // Clear all receive status bits
+        TELEM_MARK(TELEM_STATUS_CLEAR);
 
         pdw1000local->cbData.rx_flags = 0;
 
@@ -2272,11 +2879,7 @@ void dwt_isr(void)
 
         pdw1000local->wait4resp = 0;
 
-        // Because of an issue with receiver restart after error conditions, an RX reset must be applied after any error or timeout event to ensure
-        // the next good frame's timestamp is computed correctly.
-        // See section "RX Message timestamp" in DW1000 User Manual.
-        dwt_forcetrxoff();
-        dwt_rxreset();
+        _dwt_rxrestart();
 
         // Call the corresponding callback if present
         if(pdw1000local->cbRxTo != NULL)
@@ -2292,11 +2895,7 @@ void dwt_isr(void)
 
         pdw1000local->wait4resp = 0;
 
-        // Because of an issue with receiver restart after error conditions, an RX reset must be applied after any error or timeout event to ensure
-        // the next good frame's timestamp is computed correctly.
-        // See section "RX Message timestamp" in DW1000 User Manual.
-        dwt_forcetrxoff();
-        dwt_rxreset();
+        _dwt_rxrestart();
 
         // Call the corresponding callback if present
         if(pdw1000local->cbRxErr != NULL)
@@ -2306,6 +2905,32 @@ void dwt_isr(void)
     }
 }
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_rxrestart()
+ *
+ * @brief This function resets the receiver after an error, timeout or overrun event and, if automatic RX re-enabling is
+ *        activated, turns it on again.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void _dwt_rxrestart(void)
+{
+    // Because of an issue with receiver restart after error conditions, an RX reset must be applied after any error or timeout event to ensure
+    // the next good frame's timestamp is computed correctly. The automatic re-enable done by the IC itself is therefore overridden here.
+    // See section "RX Message timestamp" in DW1000 User Manual.
+    dwt_forcetrxoff();
+    dwt_rxreset();
+
+    if(pdw1000local->rxautoreen)
+    {
+        dwt_rxenable(DWT_START_RX_IMMEDIATE); // Buffer pointers have been re-aligned by dwt_forcetrxoff()
+    }
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_isr_lplisten()
  *
@@ -2404,9 +3029,9 @@ void dwt_setleds(uint8 mode)
         dwt_write32bitoffsetreg(GPIO_CTRL_ID, GPIO_MODE_OFFSET, reg);
 
         // Enable LP Oscillator to run from counter and turn on de-bounce clock.
-        reg = dwt_read32bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET);
+        reg = _dwt_shadowread(DWT_SHADOW_PMSC_CTRL0);
         reg |= (PMSC_CTRL0_GPDCE | PMSC_CTRL0_KHZCLEN);
-        dwt_write32bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET, reg);
+        _dwt_shadowwrite(DWT_SHADOW_PMSC_CTRL0, reg);
 
         // Enable LEDs to blink and set default blink time.
         reg = PMSC_LEDC_BLNKEN | PMSC_LEDC_BLINK_TIME_DEF;
@@ -2446,9 +3071,11 @@ void dwt_setleds(uint8 mode)
  */
 void _dwt_enableclocks(int clocks)
 {
+    uint32 ctrl0 = _dwt_shadowread(DWT_SHADOW_PMSC_CTRL0);
     uint8 reg[2];
 
-    dwt_readfromdevice(PMSC_ID, PMSC_CTRL0_OFFSET, 2, reg);
+    reg[0] = (uint8) ctrl0;
+    reg[1] = (uint8) (ctrl0 >> 8);
     switch(clocks)
     {
         case ENABLE_ALL_SEQ:
@@ -2510,9 +3137,94 @@ void _dwt_enableclocks(int clocks)
     // Need to write lower byte separately before setting the higher byte(s)
     dwt_writetodevice(PMSC_ID, PMSC_CTRL0_OFFSET, 1, &reg[0]);
     dwt_writetodevice(PMSC_ID, 0x1, 1, &reg[1]);
+    _dwt_shadowwritten(DWT_SHADOW_PMSC_CTRL0, 0xFFFF, ((uint32) reg[1] << 8) | reg[0]);
 
 } // end _dwt_enableclocks()
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_shadowread()
+ *
+ * @brief This function returns the value of a host owned register from its shadow copy, reading it from the device
+ *        only if the shadow copy is not valid, i.e. after initialisation, a reset or a wake-up.
+ *
+ * input parameters
+ * @param reg - DWT_SHADOW_SYS_CFG, DWT_SHADOW_SYS_MASK, DWT_SHADOW_PMSC_CTRL0 or DWT_SHADOW_PMSC_CTRL1
+ *
+ * output parameters
+ *
+ * returns the 32-bit register value
+ */
+uint32 _dwt_shadowread(int reg)
+{
+    if (!(pdw1000local->shadowValid & (1 << reg)))
+    {
+        pdw1000local->shadowReg[reg] = dwt_read32bitoffsetreg(shadow_regs[reg].regFileID, shadow_regs[reg].index);
+        pdw1000local->shadowValid |= (1 << reg);
+    }
+
+    return pdw1000local->shadowReg[reg];
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_shadowwrite()
+ *
+ * @brief This function writes a whole host owned register and its shadow copy.
+ *
+ * input parameters
+ * @param reg   - DWT_SHADOW_SYS_CFG, DWT_SHADOW_SYS_MASK, DWT_SHADOW_PMSC_CTRL0 or DWT_SHADOW_PMSC_CTRL1
+ * @param value - 32-bit value to write
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void _dwt_shadowwrite(int reg, uint32 value)
+{
+    dwt_write32bitoffsetreg(shadow_regs[reg].regFileID, shadow_regs[reg].index, value);
+
+    pdw1000local->shadowReg[reg] = value;
+    pdw1000local->shadowValid |= (1 << reg);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn _dwt_shadowwritten()
+ *
+ * @brief This function updates the shadow copy of a host owned register after some of its bytes have been written
+ *        directly. A shadow copy that is not valid stays so, the other bytes being unknown.
+ *
+ * input parameters
+ * @param reg   - DWT_SHADOW_SYS_CFG, DWT_SHADOW_SYS_MASK, DWT_SHADOW_PMSC_CTRL0 or DWT_SHADOW_PMSC_CTRL1
+ * @param mask  - bits written
+ * @param value - value of the bits written
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void _dwt_shadowwritten(int reg, uint32 mask, uint32 value)
+{
+    pdw1000local->shadowReg[reg] = (pdw1000local->shadowReg[reg] & ~mask) | (value & mask);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_invalidateshadow()
+ *
+ * @brief This function drops the shadow copies of the host owned registers (SYS_CFG, SYS_MASK, PMSC_CTRL0/1), so that
+ *        they are read again from the device the next time they are needed. The driver calls it itself on soft reset,
+ *        before sleeping and on SPI wake-up; it must be called after waking the device up or resetting it by
+ *        other means, e.g. with the WAKEUP or RSTn pin.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_invalidateshadow(void)
+{
+    pdw1000local->shadowValid = 0;
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn _dwt_disablesequencing()
  *
@@ -2529,6 +3241,7 @@ void _dwt_disablesequencing(void) // Disable sequencing and go to state "INIT"
     _dwt_enableclocks(FORCE_SYS_XTI); // Set system clock to XTI
 
     dwt_write16bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET, PMSC_CTRL1_PKTSEQ_DISABLE); // Disable PMSC ctrl of RF and RX clk blocks
+    _dwt_shadowwritten(DWT_SHADOW_PMSC_CTRL1, 0xFFFF, PMSC_CTRL1_PKTSEQ_DISABLE);
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -2627,7 +3340,7 @@ void dwt_forcetrxoff(void)
     decaIrqStatus_t stat ;
     uint32 mask;
 
-    mask = dwt_read32bitreg(SYS_MASK_ID) ; // Read set interrupt mask
+    mask = _dwt_shadowread(DWT_SHADOW_SYS_MASK) ; // Read set interrupt mask
 
     // Need to beware of interrupts occurring in the middle of following read modify write cycle
     // We can disable the radio, but before the status is cleared an interrupt can be set (e.g. the
@@ -2704,17 +3417,17 @@ void dwt_setsniffmode(int enable, uint8 timeOn, uint8 timeOff)
         /* Configure ON/OFF times and enable PLL2 on/off sequencing by SNIFF mode. */
         uint16 sniff_reg = ((timeOff << 8) | timeOn) & RX_SNIFF_MASK;
         dwt_write16bitoffsetreg(RX_SNIFF_ID, RX_SNIFF_OFFSET, sniff_reg);
-        pmsc_reg = dwt_read32bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET);
+        pmsc_reg = _dwt_shadowread(DWT_SHADOW_PMSC_CTRL0);
         pmsc_reg |= PMSC_CTRL0_PLL2_SEQ_EN;
-        dwt_write32bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET, pmsc_reg);
+        _dwt_shadowwrite(DWT_SHADOW_PMSC_CTRL0, pmsc_reg);
     }
     else
     {
         /* Clear ON/OFF times and disable PLL2 on/off sequencing by SNIFF mode. */
         dwt_write16bitoffsetreg(RX_SNIFF_ID, RX_SNIFF_OFFSET, 0x0000);
-        pmsc_reg = dwt_read32bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET);
+        pmsc_reg = _dwt_shadowread(DWT_SHADOW_PMSC_CTRL0);
         pmsc_reg &= ~PMSC_CTRL0_PLL2_SEQ_EN;
-        dwt_write32bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET, pmsc_reg);
+        _dwt_shadowwrite(DWT_SHADOW_PMSC_CTRL0, pmsc_reg);
     }
 }
 
@@ -2750,7 +3463,7 @@ void dwt_setsniffmode(int enable, uint8 timeOn, uint8 timeOff)
  */
 void dwt_setlowpowerlistening(int enable)
 {
-    uint32 pmsc_reg = dwt_read32bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET);
+    uint32 pmsc_reg = _dwt_shadowread(DWT_SHADOW_PMSC_CTRL1);
     if (enable)
     {
         /* Configure RX to sleep and snooze features. */
@@ -2761,7 +3474,7 @@ void dwt_setlowpowerlistening(int enable)
         /* Reset RX to sleep and snooze features. */
         pmsc_reg &= ~(PMSC_CTRL1_ARXSLP | PMSC_CTRL1_SNOZE);
     }
-    dwt_write32bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET, pmsc_reg);
+    _dwt_shadowwrite(DWT_SHADOW_PMSC_CTRL1, pmsc_reg);
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -2857,27 +3570,25 @@ void dwt_setrxtimeout(uint16 time)
 {
     uint8 temp ;
 
-    temp = dwt_read8bitoffsetreg(SYS_CFG_ID, 3); // Read at offset 3 to get the upper byte only
+    temp = (uint8) (_dwt_shadowread(DWT_SHADOW_SYS_CFG) >> 24); // Take the upper byte only
 
     if(time > 0)
     {
         dwt_write16bitoffsetreg(RX_FWTO_ID, RX_FWTO_OFFSET, time) ;
 
         temp |= (uint8)(SYS_CFG_RXWTOE>>24); // Shift RXWTOE mask as we read the upper byte only
-        // OR in 32bit value (1 bit set), I know this is in high byte.
-        pdw1000local->sysCFGreg |= SYS_CFG_RXWTOE;
 
         dwt_write8bitoffsetreg(SYS_CFG_ID, 3, temp); // Write at offset 3 to write the upper byte only
     }
     else
     {
         temp &= ~((uint8)(SYS_CFG_RXWTOE>>24)); // Shift RXWTOE mask as we read the upper byte only
-        // AND in inverted 32bit value (1 bit clear), I know this is in high byte.
-        pdw1000local->sysCFGreg &= ~(SYS_CFG_RXWTOE);
 
         dwt_write8bitoffsetreg(SYS_CFG_ID, 3, temp); // Write at offset 3 to write the upper byte only
     }
 
+    _dwt_shadowwritten(DWT_SHADOW_SYS_CFG, 0xFF000000UL, (uint32) temp << 24);
+
 } // end dwt_setrxtimeout()
 
 
@@ -2931,7 +3642,7 @@ void dwt_setinterrupt(uint32 bitmask, uint8 enable)
     // Need to beware of interrupts occurring in the middle of following read modify write cycle
     stat = decamutexon() ;
 
-    mask = dwt_read32bitreg(SYS_MASK_ID) ; // Read register
+    mask = _dwt_shadowread(DWT_SHADOW_SYS_MASK) ; // Read register
 
     if(enable)
     {
@@ -2941,7 +3652,7 @@ void dwt_setinterrupt(uint32 bitmask, uint8 enable)
     {
         mask &= ~bitmask ; // Clear the bit
     }
-    dwt_write32bitreg(SYS_MASK_ID,mask) ; // New value
+    _dwt_shadowwrite(DWT_SHADOW_SYS_MASK, mask) ; // New value
 
     decamutexoff(stat) ;
 }
@@ -3028,6 +3739,7 @@ void dwt_rxreset(void)
 
     // Clear RX reset
     dwt_write8bitoffsetreg(PMSC_ID, PMSC_CTRL0_SOFTRESET_OFFSET, PMSC_CTRL0_RESET_CLEAR);
+    _dwt_shadowwritten(DWT_SHADOW_PMSC_CTRL0, 0xFF000000UL, (uint32) PMSC_CTRL0_RESET_CLEAR << 24);
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -3062,6 +3774,9 @@ void dwt_softreset(void)
     // Clear reset
     dwt_write8bitoffsetreg(PMSC_ID, PMSC_CTRL0_SOFTRESET_OFFSET, PMSC_CTRL0_RESET_CLEAR);
 
+    // All the registers are back to their reset values
+    dwt_invalidateshadow();
+
     pdw1000local->wait4resp = 0;
 }
 
@@ -3146,6 +3861,7 @@ void dwt_configcwmode(uint8 chan)
     //
     dwt_write8bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET, 0x22);
     dwt_write8bitoffsetreg(PMSC_ID, 0x1, 0x07);
+    _dwt_shadowwritten(DWT_SHADOW_PMSC_CTRL0, 0xFFFF, 0x0722);
 
     // Disable fine grain TX sequencing
     dwt_setfinegraintxseq(0);
@@ -3226,27 +3942,12 @@ uint16 dwt_readtempvbat(uint8 fastSPI)
     uint8 vbat_raw;
     uint8 temp_raw;
 
-    // These writes should be single writes and in sequence
-    wr_buf[0] = 0x80; // Enable TLD Bias
-    dwt_writetodevice(RF_CONF_ID,0x11,1,wr_buf);
-
-    wr_buf[0] = 0x0A; // Enable TLD Bias and ADC Bias
-    dwt_writetodevice(RF_CONF_ID,0x12,1,wr_buf);
-
-    wr_buf[0] = 0x0f; // Enable Outputs (only after Biases are up and running)
-    dwt_writetodevice(RF_CONF_ID,0x12,1,wr_buf);    //
-
-    // Reading All SAR inputs
-    wr_buf[0] = 0x00;
-    dwt_writetodevice(TX_CAL_ID, TC_SARL_SAR_C,1,wr_buf);
-    wr_buf[0] = 0x01; // Set SAR enable
-    dwt_writetodevice(TX_CAL_ID, TC_SARL_SAR_C,1,wr_buf);
+    dwt_sarstart();
 
     if(fastSPI == 1)
     {
         deca_sleep(1); // If using PLL clocks(and fast SPI rate) then this sleep is needed
-        // Read voltage and temperature.
-        dwt_readfromdevice(TX_CAL_ID, TC_SARL_SAR_LVBAT_OFFSET,2,wr_buf);
+        return dwt_sarread();
     }
     else //change to a slow clock
     {
@@ -3266,6 +3967,65 @@ uint16 dwt_readtempvbat(uint8 fastSPI)
     return ((temp_raw<<8)|(vbat_raw));
 }
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_sarstart()
+ *
+ * @brief this function starts a battery voltage and temperature measurement, the first half of dwt_readtempvbat() in
+ * fast SPI mode. The result is read with dwt_sarread() at least 1 ms later, meanwhile the device can be used as usual
+ * (e.g. to receive) and the host is free to do something else.
+ *
+ * input parameters:
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_sarstart(void)
+{
+    uint8 wr_buf[1];
+
+    // These writes should be single writes and in sequence
+    wr_buf[0] = 0x80; // Enable TLD Bias
+    dwt_writetodevice(RF_CONF_ID,0x11,1,wr_buf);
+
+    wr_buf[0] = 0x0A; // Enable TLD Bias and ADC Bias
+    dwt_writetodevice(RF_CONF_ID,0x12,1,wr_buf);
+
+    wr_buf[0] = 0x0f; // Enable Outputs (only after Biases are up and running)
+    dwt_writetodevice(RF_CONF_ID,0x12,1,wr_buf);    //
+
+    // Reading All SAR inputs
+    wr_buf[0] = 0x00;
+    dwt_writetodevice(TX_CAL_ID, TC_SARL_SAR_C,1,wr_buf);
+    wr_buf[0] = 0x01; // Set SAR enable
+    dwt_writetodevice(TX_CAL_ID, TC_SARL_SAR_C,1,wr_buf);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_sarread()
+ *
+ * @brief this function reads the battery voltage and temperature measured since dwt_sarstart(), and stops the SAR.
+ * See dwt_readtempvbat() for the conversion of the values.
+ *
+ * input parameters:
+ *
+ * output parameters
+ *
+ * returns  (temp_raw<<8)|(vbat_raw)
+ */
+uint16 dwt_sarread(void)
+{
+    uint8 buf[2];
+
+    // Read voltage and temperature.
+    dwt_readfromdevice(TX_CAL_ID, TC_SARL_SAR_LVBAT_OFFSET,2,buf);
+
+    // Clear SAR enable
+    dwt_write8bitoffsetreg(TX_CAL_ID, TC_SARL_SAR_C, 0x00);
+
+    return (uint16)((buf[1]<<8)|buf[0]);
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_readwakeuptemp()
  *
@@ -3330,8 +4090,8 @@ uint32 dwt_calcbandwidthtempadj(uint16 target_count)
     uint32 old_rf_conf_txpow_mask;
 
     // Record the current values of these registers, to restore later
-    old_pmsc_ctrl0 = dwt_read8bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET);
-    old_pmsc_ctrl1 = dwt_read16bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET);
+    old_pmsc_ctrl0 = (uint8) _dwt_shadowread(DWT_SHADOW_PMSC_CTRL0);
+    old_pmsc_ctrl1 = (uint16) _dwt_shadowread(DWT_SHADOW_PMSC_CTRL1);
     old_rf_conf_txpow_mask = dwt_read32bitreg(RF_CONF_ID);
 
     //  Set clock to XTAL
@@ -3521,8 +4281,8 @@ uint16 dwt_calcpgcount(uint8 pgdly)
     uint32 old_rf_conf_txpow_mask;
 
     // Record the current values of these registers, to restore later
-    old_pmsc_ctrl0 = dwt_read8bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET);
-    old_pmsc_ctrl1 = dwt_read16bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET);
+    old_pmsc_ctrl0 = (uint8) _dwt_shadowread(DWT_SHADOW_PMSC_CTRL0);
+    old_pmsc_ctrl1 = (uint16) _dwt_shadowread(DWT_SHADOW_PMSC_CTRL1);
     old_rf_conf_txpow_mask = dwt_read32bitreg(RF_CONF_ID);
 
     //  Set clock to XTAL
@@ -3563,6 +4323,88 @@ uint16 dwt_calcpgcount(uint8 pgdly)
 }
 
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_pgcountsample()
+ *
+ * @brief this function takes one pulse generator count measurement (PGC_STATUS) for a given PG_DELAY, as one iteration
+ * of dwt_calcpgcount() and dwt_calcbandwidthtempadj(), without their 100 ms wait: the end of the calibration is polled
+ * for instead, every DWT_PGC_POLL_US for up to DWT_PGC_TIMEOUT_US of CLOCK_MONOTONIC time, whatever the SPI rate. The
+ * clocks are switched for the measurement and restored after, so it must be done with the transceiver idle (no TX or RX
+ * in progress or pending).
+ *
+ * input parameters:
+ * @param pgdly - uint8 - the PG_DELAY to find the count value for
+ *
+ * output parameters:
+ * @param count - the PGC_STATUS count value
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR if the calibration did not complete
+ */
+int dwt_pgcountsample(uint8 pgdly, uint16 *count)
+{
+    struct timespec start, now;
+    long waited;
+    int status = DWT_ERROR;
+
+    // Used to store the current values of the registers so that they can be restored after
+    uint8 old_pmsc_ctrl0;
+    uint16 old_pmsc_ctrl1;
+    uint32 old_rf_conf_txpow_mask;
+
+    // Record the current values of these registers, to restore later
+    old_pmsc_ctrl0 = (uint8) _dwt_shadowread(DWT_SHADOW_PMSC_CTRL0);
+    old_pmsc_ctrl1 = (uint16) _dwt_shadowread(DWT_SHADOW_PMSC_CTRL1);
+    old_rf_conf_txpow_mask = dwt_read32bitreg(RF_CONF_ID);
+
+    //  Set clock to XTAL
+    dwt_write8bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET, PMSC_CTRL0_SYSCLKS_19M);
+    //  Disable sequencing
+    dwt_write16bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET, PMSC_CTRL1_PKTSEQ_DISABLE);
+    //  Turn on CLK PLL, Mix Bias and PG
+    dwt_write32bitreg(RF_CONF_ID, RF_CONF_TXPOW_MASK | RF_CONF_PGMIXBIASEN_MASK);
+    //  Set sys and TX clock to PLL
+    dwt_write8bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET, PMSC_CTRL0_SYSCLKS_125M | PMSC_CTRL0_TXCLKS_125M);
+
+    // Write bw setting to PG_DELAY register
+    dwt_write8bitoffsetreg(TX_CAL_ID, TC_PGDELAY_OFFSET, pgdly);
+
+    // Set cal direction and time
+    dwt_write8bitoffsetreg(TX_CAL_ID, TC_PGCCTRL_OFFSET, TC_PGCCTRL_DIR_CONV | TC_PGCCTRL_TMEAS_MASK);
+
+    // Start cal
+    dwt_write8bitoffsetreg(TX_CAL_ID, TC_PGCCTRL_OFFSET, TC_PGCCTRL_DIR_CONV | TC_PGCCTRL_TMEAS_MASK | TC_PGCCTRL_CALSTART);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // The TC_PGCCTRL_CALSTART bit clears automatically once the count is available. The timeout is in time, not in
+    // reads, as a fast SPI could otherwise give up before the calibration had a chance to complete.
+    for (;;)
+    {
+        if ((dwt_read8bitoffsetreg(TX_CAL_ID, TC_PGCCTRL_OFFSET) & TC_PGCCTRL_CALSTART) == 0)
+        {
+            // Read count value from the PG cal block
+            *count = dwt_read16bitoffsetreg(TX_CAL_ID, TC_PGCAL_STATUS_OFFSET) & TC_PGCAL_STATUS_DELAY_MASK;
+            status = DWT_SUCCESS;
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        waited = (now.tv_sec - start.tv_sec) * 1000000L + (now.tv_nsec - start.tv_nsec) / 1000;
+        if (waited >= DWT_PGC_TIMEOUT_US)
+        {
+            break;
+        }
+        deca_usleep(DWT_PGC_POLL_US);
+    }
+
+    // Restore old register values
+    dwt_write8bitoffsetreg(PMSC_ID, PMSC_CTRL0_OFFSET, old_pmsc_ctrl0);
+    dwt_write16bitoffsetreg(PMSC_ID, PMSC_CTRL1_OFFSET, old_pmsc_ctrl1);
+    dwt_write32bitreg(RF_CONF_ID, old_rf_conf_txpow_mask);
+
+    return status;
+}
+
+
 /* ===============================================================================================
    List of expected (known) device ID handled by this software
    ===============================================================================================
@@ -69,6 +69,14 @@ typedef signed long int32;
 
 #define DWT_TIME_UNITS          (1.0/499.2e6/128.0) //!< = 15.65e-12 s
 
+//! Channel impulse response (accumulator) size, each tap is a 16-bit real and a 16-bit imaginary value
+#define DWT_CIR_TAP_LEN         (4)         //!< bytes per accumulator tap
+#define DWT_CIR_LEN_PRF16       (992)       //!< number of taps for 16 MHz PRF
+#define DWT_CIR_LEN_PRF64       (1016)      //!< number of taps for 64 MHz PRF
+
+#define DWT_READ_BATCH_MAX      (8)         //!< maximum number of reads queued in one dwt_readfromdevicebatch() call
+#define DWT_WRITE_BATCH_MAX     (32)        //!< maximum number of writes queued in one dwt_writetodevicebatch() call
+
 #define DWT_DEVICE_ID   (0xDECA0130)        //!< DW1000 MP device ID
 
 //! constants for selecting the bit rate for data TX (and RX)
@@ -163,6 +171,17 @@ typedef signed long int32;
 #define DWT_LOADUCODE     0x1
 #define DWT_LOADNONE      0x0
 
+// OTP calibration values of one DW1000, see dwt_setotpcal()
+typedef struct
+{
+    uint32 partID;          // IC part ID
+    uint32 lotID;           // IC lot ID
+    uint32 ldoTune;         // LDO tune (low word), 0 if not programmed
+    uint16 xtrim;           // XTAL trim in the low 5 bits, OTP revision in the high octet
+    uint8  vBatP;           // voltage sensor reading at 3.3 V, 0 if not programmed
+    uint8  tempP;           // temperature sensor reading at 23 C, 0 if not programmed
+} dwt_otpcal_t;
+
 //DW1000 OTP operating parameter set selection
 #define DWT_OPSET_64LEN   0x0
 #define DWT_OPSET_TIGHT   0x1
@@ -249,6 +268,61 @@ typedef struct
 
 } dwt_deviceentcnts_t ;
 
+// One read of a batch, see dwt_readfromdevicebatch()
+typedef struct
+{
+    uint16 recordNumber ;           // ID of register file or buffer being accessed
+    uint16 index ;                  // byte index into register file or buffer being accessed
+    uint32 length ;                 // number of bytes to read
+    uint8  *buffer ;                // where to store the 'length' bytes read
+} dwt_readreq_t ;
+
+// One read of a batch as handed to the platform, see readfromspibatch()
+typedef struct
+{
+    uint16      headerLength ;      // number of bytes of header to write
+    const uint8 *headerBuffer ;     // header composed by the driver
+    uint32      readlength ;        // number of bytes of data to read
+    uint8       *readBuffer ;       // where to store the data read
+} dwt_spiread_t ;
+
+// One write of a batch, see dwt_writetodevicebatch()
+typedef struct
+{
+    uint16      recordNumber ;      // ID of register file or buffer being accessed
+    uint16      index ;             // byte index into register file or buffer being accessed
+    uint32      length ;            // number of bytes to write
+    const uint8 *buffer ;           // the 'length' bytes to write
+} dwt_writereq_t ;
+
+// One write of a batch as handed to the platform, see writetospibatch()
+typedef struct
+{
+    uint16      headerLength ;      // number of bytes of header to write
+    const uint8 *headerBuffer ;     // header composed by the driver
+    uint32      bodyLength ;        // number of bytes of data to write
+    const uint8 *bodyBuffer ;       // the data to write
+} dwt_spiwrite_t ;
+
+// The register writes of dwt_configure() for one configuration, computed at build time (see dwt_configurefixed())
+typedef struct
+{
+    dwt_config_t         config ;   // configuration the writes were computed for
+    uint32               sysCfg ;   // SYS_CFG bits set by dwt_configure() for it (110 kb/s mode, PHR mode)
+    uint32               txFCTRL ;  // TX_FCTRL as written by dwt_configure()
+    uint16               count ;    // number of writes
+    const dwt_writereq_t *writes ;  // the writes in the order of dwt_configure(), SYS_CFG excluded
+} dwt_fixedconfig_t ;
+
+// Everything read for a good frame by dwt_readrxframe()
+typedef struct
+{
+    uint8        rxStamp[5] ;       // adjusted RX timestamp, as returned by dwt_readrxtimestamp()
+    uint8        rxRawStamp[5] ;    // raw RX timestamp
+    uint32       finfo ;            // RX_FINFO register (frame length, bit rate, PRF, preamble count...)
+    dwt_rxdiag_t diag ;             // RX diagnostics, as returned by dwt_readdiagnostics()
+} dwt_rxframeinfo_t ;
+
 
 /********************************************************************************************************************/
 /*                                                 REMOVED API LIST                                                 */
@@ -262,7 +336,7 @@ typedef struct
  *    wants to set up.
  *  - dwt_checkoverrun: As automatic RX re-enabling is not supported anymore, this functions has become useless.
  *  - dwt_setautorxreenable: As automatic RX re-enabling is not supported anymore, this functions has become
- *    useless.
+ *    useless. (Reinstated since, see dwt_setautorxreenable() below.)
  *  - dwt_getrangebias: Range bias correction values are platform dependent and should therefore be managed at user
  *    application level.
  *  - dwt_xtaltrim: Renamed to dwt_setxtaltrim.
@@ -285,6 +359,7 @@ typedef struct
  * @fn dwt_setlocaldataptr()
  *
  * @brief This function sets the local data structure pointer to point to the element in the local array as given by the index.
+ *        The pointer is per thread, it only changes the device used by the calling thread.
  *
  * input parameters
  * @param index    - selects the array element to point to. Must be within the array bounds, i.e. < DWT_NUM_DW_DEV
@@ -325,6 +400,68 @@ uint32 dwt_getpartid(void);
  */
 uint32 dwt_getlotid(void);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_setotpcal()
+ *
+ * @brief This is used to give dwt_initialise() the OTP calibration values of known devices, so that it only reads the
+ * part and lot ID from OTP and takes the other values from the entry with the same IDs, if any.
+ *
+ * input parameters
+ * @param table - known devices, e.g. as returned by dwt_getotpcal() on earlier runs, must stay valid until dwt_initialise()
+ * @param num - number of entries in the table, 0 to always read the values from OTP
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_setotpcal(const dwt_otpcal_t *table, uint16 num);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_getotpcal()
+ *
+ * @brief This is used to return the OTP calibration values the device was initialised with
+ *
+ * NOTE: dwt_initialise() must be called prior to this function so that it can return a relevant value.
+ *
+ * input parameters
+ *
+ * output parameters
+ * @param cal - where to copy the values
+ *
+ * returns 1 if dwt_initialise() took them from the table of dwt_setotpcal(), 0 if it read them from OTP
+ */
+int dwt_getotpcal(dwt_otpcal_t *cal);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_geticrefvolt()
+ *
+ * @brief This is used to return the voltage sensor reading at 3.3 V, as programmed in OTP during production.
+ *
+ * NOTE: dwt_initialise() must be called prior to this function so that it can return a relevant value.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the 8 bit raw voltage reading, 0 if not programmed
+ */
+uint8 dwt_geticrefvolt(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_geticreftemp()
+ *
+ * @brief This is used to return the temperature sensor reading at 23 C, as programmed in OTP during production.
+ *
+ * NOTE: dwt_initialise() must be called prior to this function so that it can return a relevant value.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the 8 bit raw temperature reading, 0 if not programmed
+ */
+uint8 dwt_geticreftemp(void);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_readdevid()
  *
@@ -427,7 +564,8 @@ void dwt_setgpiovalue(uint32 gpioNum, uint32 value);
  *
  * NOTES:
  * 1.this function needs to be run before dwt_configuresleep, also the SPI frequency has to be < 3MHz
- * 2.it also reads and applies LDO tune and crystal trim values from OTP memory
+ * 2.it also reads and applies LDO tune and crystal trim values from OTP memory, unless they are in the table given to
+ *   dwt_setotpcal() for the part and lot ID of the device
  *
  * input parameters
  * @param config    -   specifies what configuration to load
@@ -473,6 +611,23 @@ void dwt_configure(dwt_config_t *config) ;
  */
 void dwt_configuretxrf(dwt_txconfig_t *config) ;
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_configurefixed()
+ *
+ * @brief This function configures the DW1000 as dwt_configure() would for the configuration a dwt_fixedconfig_t was
+ * computed for, without any table lookup: the precomputed register writes, SYS_CFG first, are sent in one SPI message
+ * (one dwt_writetodevicebatch() call, so at most DWT_WRITE_BATCH_MAX writes in all, which dw1000_cfggen checks). The
+ * structure is generated by dw1000_cfggen, and the configuration it holds is the one to use for the rest of the driver.
+ *
+ * input parameters
+ * @param fixed - pointer to the precomputed configuration
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_configurefixed(const dwt_fixedconfig_t *fixed) ;
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_setrxantennadelay()
  *
@@ -828,6 +983,23 @@ void dwt_setsnoozetime(uint8 snooze_time);
  */
 void dwt_setdblrxbuffmode(int enable);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_setautorxreenable()
+ *
+ * @brief This call enables the automatic re-enabling of the receiver. Together with the double receive buffer mode (see
+ *        dwt_setdblrxbuffmode()) this gives a continuous receive mode: the receiver keeps listening into the other buffer
+ *        while the host reads the frame from the current one, and dwt_isr() re-enables it after errors, timeouts and
+ *        overruns (the latter being counted in the OVER event counter, see dwt_readeventcounters()).
+ *
+ * input parameters
+ * @param enable - 1 to enable, 0 to disable the automatic re-enabling of the receiver
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_setautorxreenable(int enable);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_setrxtimeout()
  *
@@ -958,6 +1130,23 @@ void dwt_entersleep(void);
  */
 void dwt_entersleepaftertx(int enable);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_invalidateshadow()
+ *
+ * @brief The driver keeps shadow copies of the registers only the host changes (SYS_CFG, SYS_MASK, PMSC_CTRL0/1) so
+ *        that updating them does not need a read first. This function drops them, so that they are read again from
+ *        the device the next time they are needed. The driver calls it itself on soft reset, before sleeping and on
+ *        SPI wake-up; it must be called after waking the device up or resetting it by other means, e.g. with the
+ *        WAKEUP or RSTn pin.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_invalidateshadow(void);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_spicswakeup()
  *
@@ -970,6 +1159,7 @@ void dwt_entersleepaftertx(int enable);
  *
  * where fastest byte_rate is spi_rate (Hz) / 8 if the SPI is sending the bytes back-to-back.
  * To save time and power, a system designer could determine byte_rate value more precisely.
+ * The device is then polled until it is back in INIT (SLP2INIT event), so the call returns as soon as it is ready.
  *
  * NOTE: Alternatively the device can be waken up with WAKE_UP pin if configured for that operation
  *
@@ -1024,11 +1214,15 @@ uint8 dwt_checkirq(void);
  *          - TXFRS (through cbTxDone callback)
  *          - RXRFTO/RXPTO (through cbRxTo callback)
  *          - RXPHE/RXFCE/RXRFSL/RXSFDTO/AFFREJ/LDEERR (through cbRxTo cbRxErr)
+ *          - RXOVRR (through cbRxErr callback)
  *        For all events, corresponding interrupts are cleared and necessary resets are performed. In addition, in the RXFCG case,
  *        received frame information and frame control are read before calling the callback. If double buffering is activated, it
  *        will also toggle between reception buffers once the reception callback processing has ended.
  *
- *        /!\ This version of the ISR supports double buffering but does not support automatic RX re-enabling!
+ *        If automatic RX re-enabling is activated (see dwt_setautorxreenable()), the receiver is turned on again after the reset
+ *        that follows any error, timeout or overrun event. Combined with double buffering, the frame reported to the cbRxOk
+ *        callback stays in the host side buffer only until the callback returns, so the callback must read everything it needs
+ *        (including the accumulator, which is not double buffered and will be overwritten by the next frame) before returning.
  *
  * NOTE:  In PC based system using (Cheetah or ARM) USB to SPI converter there can be no interrupts, however we still need something
  *        to take the place of it and operate in a polled way. In an embedded system this function should be configured to be triggered
@@ -1270,6 +1464,45 @@ void dwt_readrxdata(uint8 *buffer, uint16 length, uint16 rxBufferOffset);
  */
 void dwt_readaccdata(uint8 *buffer, uint16 length, uint16 rxBufferOffset);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readcir()
+ *
+ * @brief This is used to read a run of taps of the channel impulse response from the accumulator as 16-bit signed
+ *        real/imaginary pairs, e.g. the whole CIR (DWT_CIR_LEN_PRF16 or DWT_CIR_LEN_PRF64 taps from tap 0).
+ *
+ * NOTE: The accumulator clocks are only forced on once for the whole read, and the read is split into as few SPI
+ *       transactions as the platform can move (see spimaxtransfer()), usually a single one for the full CIR. The dummy
+ *       octet that starts each accumulator read is discarded by the SPI layer so the taps land contiguously in iq.
+ *
+ * input parameters
+ * @param iq - the buffer into which the taps will be read, must hold 2 * numTaps values (real part first)
+ * @param firstTap - the index of the first tap to read
+ * @param numTaps - the number of taps to read
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_readcir(int16 *iq, uint16 firstTap, uint16 numTaps);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readcirwindow()
+ *
+ * @brief This is used to read a window of taps of the channel impulse response, e.g. around the first path, wrapping
+ *        around to tap 0 at the end of the CIR. Tap i of iq is tap (firstTap + i) % cirLen of the accumulator.
+ *
+ * input parameters
+ * @param iq - the buffer into which the taps will be read, must hold 2 * numTaps values (real part first)
+ * @param firstTap - the index of the first tap to read, less than cirLen
+ * @param numTaps - the number of taps to read, up to cirLen
+ * @param cirLen - the length of the CIR, DWT_CIR_LEN_PRF16 or DWT_CIR_LEN_PRF64
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_readcirwindow(int16 *iq, uint16 firstTap, uint16 numTaps, uint16 cirLen);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_readcarrierintegrator()
  *
@@ -1310,6 +1543,26 @@ int32 dwt_readcarrierintegrator(void) ;
  */
 void dwt_readdiagnostics(dwt_rxdiag_t * diagnostics);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readrxframe()
+ *
+ * @brief This reads everything the host usually needs after a good frame: the RX timestamps, the RX frame information
+ *        register, the diagnostics and the frame data, all in a single SPI message (see dwt_readfromdevicebatch()).
+ *        As with the individual reads, this must be done before the double buffer is toggled.
+ *
+ * input parameters
+ * @param info         - pointer to the structure in which to return the timestamps, RX_FINFO and diagnostics
+ * @param buffer       - the buffer into which the frame data will be read, may be NULL if length is 0
+ * @param length       - the length of frame data to read (the CRC is included in the frame length reported by the
+ *                       device, see dwt_cb_data_t.datalength)
+ * @param rxBufferOffset - the offset in the RX buffer at which to start reading the data
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_readrxframe(dwt_rxframeinfo_t *info, uint8 *buffer, uint16 length, uint16 rxBufferOffset);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_loadopsettabfromotp()
  *
@@ -1470,6 +1723,35 @@ void dwt_configcontinuousframemode(uint32 framerepetitionrate);
  */
 uint16 dwt_readtempvbat(uint8 fastSPI);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_sarstart()
+ *
+ * @brief this function starts a battery voltage and temperature measurement, the first half of dwt_readtempvbat() in
+ * fast SPI mode. The result is read with dwt_sarread() at least 1 ms later, meanwhile the device can be used as usual
+ * (e.g. to receive) and the host is free to do something else.
+ *
+ * input parameters:
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void dwt_sarstart(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_sarread()
+ *
+ * @brief this function reads the battery voltage and temperature measured since dwt_sarstart(), and stops the SAR.
+ * See dwt_readtempvbat() for the conversion of the values.
+ *
+ * input parameters:
+ *
+ * output parameters
+ *
+ * returns  (temp_raw<<8)|(vbat_raw)
+ */
+uint16 dwt_sarread(void);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_readwakeuptemp()
  *
@@ -1548,6 +1830,24 @@ uint32 dwt_calcpowertempadj(uint8 channel, uint32 ref_powerreg, double current_t
  */
 uint16 dwt_calcpgcount(uint8 pgdly);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_pgcountsample()
+ *
+ * @brief this function takes one pulse generator count measurement (PGC_STATUS) for a given PG_DELAY, as one iteration
+ * of dwt_calcpgcount() and dwt_calcbandwidthtempadj(), without their 100 ms wait: the end of the calibration is polled
+ * for instead, for up to a few milliseconds of CLOCK_MONOTONIC time, whatever the SPI rate. The clocks are switched for
+ * the measurement and restored after, so it must be done with the transceiver idle (no TX or RX in progress or pending).
+ *
+ * input parameters:
+ * @param pgdly - uint8 - the PG_DELAY to find the count value for
+ *
+ * output parameters:
+ * @param count - the PGC_STATUS count value
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR if the calibration did not complete
+ */
+int dwt_pgcountsample(uint8 pgdly, uint16 *count);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_writetodevice()
  *
@@ -1610,6 +1910,49 @@ void dwt_readfromdevice
     uint8   *buffer             // input parameter - pointer to buffer in which to return the read data.
 ) ;
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readfromdevicebatch()
+ *
+ * @brief  this function is used to read several DW1000 registers or buffers at once. The headers for all the reads are
+ *         composed as for dwt_readfromdevice() and handed to the platform in one go, which sends them as a single SPI
+ *         message with chip select released between the reads (see readfromspibatch()). This saves a system call and
+ *         the inter-transaction delay per read.
+ *
+ * input parameters:
+ * @param reqs          - the reads to do, in order
+ * @param count         - number of reads, 1 to DWT_READ_BATCH_MAX
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_readfromdevicebatch
+(
+    const dwt_readreq_t *reqs,  // input parameter - the reads to do
+    uint16  count               // input parameter - number of reads
+) ;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_writetodevicebatch()
+ *
+ * @brief  this function is used to write several DW1000 registers or buffers at once. The headers for all the writes
+ *         are composed as for dwt_writetodevice() and handed to the platform in one go, which sends them as a single
+ *         SPI message with chip select released between the writes (see writetospibatch()).
+ *
+ * input parameters:
+ * @param reqs          - the writes to do, in order
+ * @param count         - number of writes, 1 to DWT_WRITE_BATCH_MAX
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int dwt_writetodevicebatch
+(
+    const dwt_writereq_t *reqs, // input parameter - the writes to do
+    uint16  count               // input parameter - number of writes
+) ;
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_read32bitoffsetreg()
  *
@@ -1762,6 +2105,86 @@ int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength
  */
 int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn readfromspibatch()
+ *
+ * @brief
+ * Low level abstract function to do several reads from the SPI, each one being a header write followed by a data read
+ * as for readfromspi(). The reads should go out back to back with chip select released between them, e.g. as one
+ * chained message, so that the whole batch costs a single transaction on the host.
+ *
+ * Note: The body of this function is platform specific
+ *
+ * input parameters:
+ * @param count         - number of reads, 1 to DWT_READ_BATCH_MAX
+ * @param reads         - the reads to do, in order
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int readfromspibatch(uint16 count, const dwt_spiread_t *reads);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn writetospibatch()
+ *
+ * @brief
+ * Low level abstract function to do several writes to the SPI, each one being a header followed by a body as for
+ * writetospi(). The writes should go out back to back with chip select released between them, e.g. as one chained
+ * message, so that the whole batch costs a single transaction on the host.
+ *
+ * Note: The body of this function is platform specific
+ *
+ * input parameters:
+ * @param count         - number of writes, 1 to DWT_WRITE_BATCH_MAX
+ * @param writes        - the writes to do, in order
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int writetospibatch(uint16 count, const dwt_spiwrite_t *writes);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn readfromspidiscard()
+ *
+ * @brief
+ * Low level abstract function to read from the SPI, like readfromspi(), but the first 'discardLength' bytes clocked in
+ * after the header are thrown away instead of being stored. This is used for the accumulator, whose reads always start
+ * with a dummy octet.
+ *
+ * Note: The body of this function is platform specific
+ *
+ * input parameters:
+ * @param headerLength  - number of bytes header to write
+ * @param headerBuffer  - pointer to buffer containing the 'headerLength' bytes of header to write
+ * @param discardLength - number of bytes to read and discard before the data (at most 4)
+ * @param readlength    - number of bytes data being read
+ * @param readBuffer    - pointer to buffer in which to return the data (size required = readlength)
+ *
+ * output parameters
+ *
+ * returns DWT_SUCCESS for success, or DWT_ERROR for error
+ */
+int readfromspidiscard(uint16 headerLength, const uint8 *headerBuffer, uint16 discardLength, uint32 readlength, uint8 *readBuffer);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spimaxtransfer()
+ *
+ * @brief
+ * Returns the maximum number of bytes (header included) that one readfromspi()/writetospi() call can move, e.g. the
+ * spidev buffer size. Long reads such as dwt_readcir() are split accordingly.
+ *
+ * Note: The body of this function is platform specific
+ *
+ * input parameters:
+ *
+ * output parameters
+ *
+ * returns the maximum transaction size in bytes
+ */
+uint32 spimaxtransfer(void);
+
 // ---------------------------------------------------------------------------
 //
 // NB: The purpose of the deca_mutex.c file is to provide for microprocessor interrupt enable/disable, this is used for
@@ -1827,6 +2250,21 @@ void decamutexoff(decaIrqStatus_t s) ;
  */
 void deca_sleep(unsigned int time_ms);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn deca_usleep()
+ *
+ * @brief Wait for a given amount of time, for the short waits of wake-up polling.
+ * NB: The body of this function is platform specific
+ *
+ * input parameters:
+ * @param time_us - time to wait in microseconds
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void deca_usleep(unsigned int time_us);
+
 #ifdef __cplusplus
 }
 #endif
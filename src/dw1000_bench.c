@@ -0,0 +1,604 @@
+/*
+ * dw1000_bench.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Driver benchmarks against one DW1000, results written as JSON so that runs can be compared across driver changes:
+ *   reg_read     latency of a single 32-bit register read (DEV_ID), at the low, high and spi_autotune() SPI rates
+ *   cir_read     dwt_readcir() of the whole CIR, for several SPI transaction sizes (see spi_set_max_transfer())
+ *   diagnostics  dwt_readdiagnostics(), and dwt_readrxframe() which reads the same registers and the frame in one batch
+ *   init         reset_DW1000() to a configured DW1000, with the OTP calibration values read or cached (see otp_cache.h)
+ *   wakeup       dw1000_wakeup() from DEEPSLEEP and from SLEEP with the crystal running, the configuration kept in AON
+ *   end_to_end   frames/s captured with the CIR as in dw1000_rx_cir, against a dw1000_tx running at a known rate
+ * Each result has the latency distribution in ns (mean, min, percentiles, max) and the SPI traffic per operation.
+ *
+ * With an SPI path of the form replay:<file> (see spi_backend.h), the same run is replayed without hardware from a
+ * recording made with DW1000_SPI_RECORD, which times the host side of the driver alone.
+ *
+ * Usage: dw1000_bench [-d spi_path,rst_pin,irq_pin,irq_line] [-i iterations] [-e seconds] [-r tx_rate] [-c taps] [-o file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "platform.h"
+#include "profiles.h"
+#include "otp_cache.h"
+
+#define BENCH_ITER_DEF		(1000)
+#define E2E_SECONDS_DEF		(10)
+#define E2E_SAMPLES_MAX		(65536)	// callback durations kept for the end_to_end percentiles
+#define FRAME_SN_IDX		(1)		// sequence number byte of the dw1000_tx frames
+#define FRAME_LEN_MAX		(127)
+#define INIT_ITER_MAX		(100)	// init and wakeup take ms, fewer iterations than the other micro-benchmarks
+
+// DW1000 settings, selected with -P and -C as for dw1000_tx and dw1000_rx_cir
+static profile_t profile;
+static const dwt_config_t *config = &profile.config;
+
+// Transaction sizes of the cir_read runs, 0 for the backend limit
+static const uint32_t cir_chunks[] = { 64, 128, 256, 512, 1024, 2048, 0 };
+
+typedef struct
+{
+	uint64_t	n;
+	double		mean;
+	uint64_t	min, p50, p90, p99, p999, max;
+} bench_stats_t;
+
+// State of the end_to_end run, shared with rx_ok_cb() under the driver mutex
+static struct
+{
+	uint64_t	*samples;
+	uint32_t	num_samples;
+	uint32_t	frames;
+	uint32_t	lost;			// gaps in the dw1000_tx sequence numbers
+	int			have_sn;
+	uint8		last_sn;
+	uint16		cir_taps;
+} e2e;
+
+static int16 cir[2 * DWT_CIR_LEN_PRF64];
+static uint8 frame[FRAME_LEN_MAX];
+
+static int first_result = 1;
+
+// Register values are accumulated here so that the compiler can't drop the benchmarked reads
+static volatile uint32 sink;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+// Nearest rank percentile of sorted samples
+static uint64_t percentile(const uint64_t *sorted, uint32_t n, double p)
+{
+	uint32_t rank = (uint32_t)(p / 100.0 * n + 0.999999);
+
+	if(rank == 0)
+		rank = 1;
+	return sorted[(rank > n ? n : rank) - 1];
+}
+
+// Sorts samples in place
+static void compute_stats(uint64_t *samples, uint32_t n, bench_stats_t *st)
+{
+	double sum = 0;
+	uint32_t i;
+
+	memset(st, 0, sizeof(*st));
+	if(n == 0)
+		return;
+
+	qsort(samples, n, sizeof(*samples), cmp_u64);
+	for(i = 0; i < n; i++)
+		sum += samples[i];
+
+	st->n = n;
+	st->mean = sum / n;
+	st->min = samples[0];
+	st->p50 = percentile(samples, n, 50);
+	st->p90 = percentile(samples, n, 90);
+	st->p99 = percentile(samples, n, 99);
+	st->p999 = percentile(samples, n, 99.9);
+	st->max = samples[n - 1];
+}
+
+static void json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for(; *s; s++)
+	{
+		if(*s == '"' || *s == '\\')
+			fputc('\\', f);
+		if((unsigned char)*s >= 0x20)
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+static void json_begin_result(FILE *f, const char *name)
+{
+	fprintf(f, "%s\n    {\"name\": \"%s\"", first_result ? "" : ",", name);
+	first_result = 0;
+}
+
+static void json_stats(FILE *f, const bench_stats_t *st)
+{
+	fprintf(f, ", \"n\": %llu, \"mean_ns\": %.1f, \"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, "
+			"\"p999_ns\": %llu, \"max_ns\": %llu", (unsigned long long)st->n, st->mean, (unsigned long long)st->min,
+			(unsigned long long)st->p50, (unsigned long long)st->p90, (unsigned long long)st->p99,
+			(unsigned long long)st->p999, (unsigned long long)st->max);
+}
+
+// SPI traffic per operation between two spi_get_stats() snapshots, and the SPI clock rate it implies
+static void json_traffic(FILE *f, const spi_stats_t *before, const spi_stats_t *after, uint32_t ops)
+{
+	uint64_t bytes = (after->header_bytes - before->header_bytes) + (after->write_bytes - before->write_bytes) +
+					 (after->read_bytes - before->read_bytes);
+	uint64_t wire_ns = after->wire_ns - before->wire_ns;
+
+	fprintf(f, ", \"messages\": %.2f, \"transactions\": %.2f, \"bytes\": %.1f, \"wire_ns\": %.1f, \"spi_hz\": %.0f",
+			(double)(after->messages - before->messages) / ops, (double)(after->transactions - before->transactions) / ops,
+			(double)bytes / ops, (double)wire_ns / ops, wire_ns ? bytes * 8e9 / wire_ns : 0.0);
+}
+
+static void bench_reg_read(FILE *f, const char *rate, uint64_t *samples, uint32_t iter)
+{
+	spi_stats_t before, after;
+	bench_stats_t st;
+	uint64_t t0;
+	uint32_t i;
+
+	spi_get_stats(&before);
+	for(i = 0; i < iter; i++)
+	{
+		t0 = now_ns();
+		sink ^= dwt_read32bitreg(DEV_ID_ID);
+		samples[i] = now_ns() - t0;
+	}
+	spi_get_stats(&after);
+	compute_stats(samples, iter, &st);
+
+	json_begin_result(f, "reg_read");
+	fprintf(f, ", \"rate\": \"%s\"", rate);
+	json_traffic(f, &before, &after, iter);
+	json_stats(f, &st);
+	fprintf(f, "}");
+}
+
+static void bench_cir_read(FILE *f, uint32_t chunk, uint64_t *samples, uint32_t iter)
+{
+	uint16 taps = (config->prf == DWT_PRF_16M) ? DWT_CIR_LEN_PRF16 : DWT_CIR_LEN_PRF64;
+	spi_stats_t before, after;
+	bench_stats_t st;
+	uint64_t t0;
+	uint32_t i;
+
+	spi_set_max_transfer(chunk);
+
+	spi_get_stats(&before);
+	for(i = 0; i < iter; i++)
+	{
+		t0 = now_ns();
+		dwt_readcir(cir, 0, taps);
+		samples[i] = now_ns() - t0;
+	}
+	spi_get_stats(&after);
+	compute_stats(samples, iter, &st);
+
+	json_begin_result(f, "cir_read");
+	fprintf(f, ", \"chunk\": %lu, \"taps\": %u, \"mb_per_s\": %.3f", spimaxtransfer(), taps,
+			st.p50 ? taps * DWT_CIR_TAP_LEN * 1e3 / st.p50 : 0.0);
+	json_traffic(f, &before, &after, iter);
+	json_stats(f, &st);
+	fprintf(f, "}");
+
+	spi_set_max_transfer(0);
+}
+
+// Reset, initialise and configure the DW1000 again
+static void init_device(int cached)
+{
+	reset_DW1000();
+	spi_set_rate_low();
+	if(cached)
+		otp_cache_initialise(DWT_LOADUCODE);
+	else
+		dwt_initialise(DWT_LOADUCODE);
+	spi_set_rate_high();
+	profile_apply(&profile);
+}
+
+static void bench_init(FILE *f, int cached, uint64_t *samples, uint32_t iter)
+{
+	spi_stats_t before, after;
+	bench_stats_t st;
+	uint64_t t0;
+	uint32_t i;
+
+	spi_get_stats(&before);
+	for(i = 0; i < iter; i++)
+	{
+		t0 = now_ns();
+		init_device(cached);
+		samples[i] = now_ns() - t0;
+	}
+	spi_get_stats(&after);
+	compute_stats(samples, iter, &st);
+
+	json_begin_result(f, "init");
+	fprintf(f, ", \"otp\": \"%s\"", cached ? "cached" : "read");
+	json_traffic(f, &before, &after, iter);
+	json_stats(f, &st);
+	fprintf(f, "}");
+}
+
+// Times the wake-up alone, not dwt_entersleep(). The DW1000 needs init_device() afterwards.
+static void bench_wakeup(FILE *f, int xtal, uint64_t *samples, uint32_t iter)
+{
+	spi_stats_t before, after;
+	bench_stats_t st;
+	uint64_t t0;
+	uint32_t i, n = 0;
+
+	dwt_configuresleep(DWT_PRESRV_SLEEP | DWT_CONFIG, DWT_WAKE_CS | DWT_SLP_EN | (xtal ? DWT_XTAL_EN : 0));
+
+	spi_get_stats(&before);
+	for(i = 0; i < iter; i++)
+	{
+		dwt_entersleep();
+		deca_sleep(1);
+		t0 = now_ns();
+		if(dw1000_wakeup() != 0)
+			continue;
+		samples[n++] = now_ns() - t0;
+	}
+	spi_get_stats(&after);
+	compute_stats(samples, n, &st);
+	dwt_configuresleep(0, 0);
+
+	json_begin_result(f, "wakeup");
+	fprintf(f, ", \"mode\": \"%s\", \"failed\": %lu", xtal ? "sleep" : "deep", (unsigned long)(iter - n));
+	json_traffic(f, &before, &after, iter);
+	json_stats(f, &st);
+	fprintf(f, "}");
+}
+
+static void bench_diagnostics(FILE *f, uint64_t *samples, uint32_t iter)
+{
+	dwt_rxframeinfo_t info;
+	dwt_rxdiag_t diag;
+	spi_stats_t before, after;
+	bench_stats_t st;
+	uint64_t t0;
+	uint32_t i;
+
+	spi_get_stats(&before);
+	for(i = 0; i < iter; i++)
+	{
+		t0 = now_ns();
+		dwt_readdiagnostics(&diag);
+		samples[i] = now_ns() - t0;
+	}
+	spi_get_stats(&after);
+	compute_stats(samples, iter, &st);
+
+	json_begin_result(f, "diagnostics");
+	json_traffic(f, &before, &after, iter);
+	json_stats(f, &st);
+	fprintf(f, "}");
+
+	// What rx_ok_cb() pays instead: diagnostics, timestamps and a 12 byte frame as one batch
+	spi_get_stats(&before);
+	for(i = 0; i < iter; i++)
+	{
+		t0 = now_ns();
+		dwt_readrxframe(&info, frame, 12, 0);
+		samples[i] = now_ns() - t0;
+	}
+	spi_get_stats(&after);
+	compute_stats(samples, iter, &st);
+
+	json_begin_result(f, "rx_frame");
+	json_traffic(f, &before, &after, iter);
+	json_stats(f, &st);
+	fprintf(f, "}");
+}
+
+/*
+ * Called by dwt_isr() on the IRQ thread, with the driver mutex held. Reads what dw1000_rx_cir reads for a full CIR
+ * capture and times it.
+ */
+static void rx_ok_cb(const dwt_cb_data_t *cb_data)
+{
+	dwt_rxframeinfo_t info;
+	uint16 length = (cb_data->datalength > FRAME_LEN_MAX) ? FRAME_LEN_MAX : cb_data->datalength;
+	uint64_t t0 = now_ns();
+
+	dwt_readrxframe(&info, frame, length, 0);
+	dwt_readcir(cir, 0, e2e.cir_taps);
+
+	if(e2e.num_samples < E2E_SAMPLES_MAX)
+		e2e.samples[e2e.num_samples++] = now_ns() - t0;
+
+	if(length > FRAME_SN_IDX)
+	{
+		if(e2e.have_sn)
+			e2e.lost += (uint8)(frame[FRAME_SN_IDX] - e2e.last_sn - 1);
+		e2e.last_sn = frame[FRAME_SN_IDX];
+		e2e.have_sn = 1;
+	}
+	e2e.frames++;
+}
+
+static void rx_err_cb(const dwt_cb_data_t *cb_data)
+{
+	// dwt_isr() has already restarted the receiver
+	(void) cb_data;
+}
+
+static int bench_end_to_end(FILE *f, unsigned int seconds, double tx_rate)
+{
+	dwt_deviceentcnts_t counters;
+	spi_stats_t before, after;
+	bench_stats_t st;
+	decaIrqStatus_t s;
+	uint64_t t0, elapsed;
+	uint32_t frames;
+	double fps;
+
+	e2e.samples = malloc(E2E_SAMPLES_MAX * sizeof(*e2e.samples));
+	if(e2e.samples == NULL)
+		return -1;
+
+	// Receive as dw1000_rx_cir does: double buffered, re-enabled by the DW1000, woken up by the IRQ line
+	dwt_setdblrxbuffmode(1);
+	dwt_setautorxreenable(1);
+	dwt_configeventcounters(1);
+	dwt_setcallbacks(NULL, &rx_ok_cb, &rx_err_cb, &rx_err_cb);
+	dwt_setinterrupt(DWT_INT_RFCG | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL | DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_SFDT |
+					 DWT_INT_ARFE | DWT_INT_RXOVRR, 1);
+	if(irq_init() != 0)
+	{
+		free(e2e.samples);
+		return -1;
+	}
+
+	s = decamutexon();
+	dwt_setrxtimeout(0);
+	dwt_rxenable(DWT_START_RX_IMMEDIATE);
+	decamutexoff(s);
+
+	// The first second is not counted, the transmitter may just be starting
+	sleep(1);
+
+	s = decamutexon();
+	dwt_configeventcounters(1);
+	e2e.frames = 0;
+	e2e.lost = 0;
+	e2e.num_samples = 0;
+	spi_get_stats(&before);
+	t0 = now_ns();
+	decamutexoff(s);
+
+	sleep(seconds);
+
+	s = decamutexon();
+	elapsed = now_ns() - t0;
+	frames = e2e.frames;
+	spi_get_stats(&after);
+	dwt_readeventcounters(&counters);
+	dwt_forcetrxoff();
+	decamutexoff(s);
+
+	compute_stats(e2e.samples, e2e.num_samples, &st);
+	fps = frames * 1e9 / elapsed;
+
+	json_begin_result(f, "end_to_end");
+	fprintf(f, ", \"duration_s\": %.3f, \"frames\": %lu, \"frames_per_s\": %.2f, \"tx_rate_hz\": %.2f", elapsed / 1e9,
+			(unsigned long)frames, fps, tx_rate);
+	if(tx_rate > 0)
+		fprintf(f, ", \"ratio\": %.4f", fps / tx_rate);
+	fprintf(f, ", \"lost\": %lu, \"crc_good\": %u, \"crc_bad\": %u, \"overruns\": %u, \"cir_taps\": %u",
+			(unsigned long)e2e.lost, counters.CRCG, counters.CRCB, counters.OVER, e2e.cir_taps);
+	json_traffic(f, &before, &after, frames ? frames : 1);
+	json_stats(f, &st);
+	fprintf(f, "}");
+
+	free(e2e.samples);
+	return 0;
+}
+
+static int parse_wiring(const char *arg, dw1000_wiring_t *wiring, char *spi_path)
+{
+	if(sscanf(arg, "%63[^,],%d,%d,%d", spi_path, &wiring->rst_pin, &wiring->irq_pin, &wiring->irq_line) != 4)
+		return -1;
+	wiring->spi_path = spi_path;
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-d spi_path,rst_pin,irq_pin,irq_line] [-P profile] [-C profile_file] [-i iterations] [-e seconds] "
+			"[-r tx_rate] [-c taps] [-o file]\n", name);
+	fprintf(stderr, "  -d wiring     DW1000 to benchmark, /dev/spidev1.0 by default (replay:<file> for a recording)\n");
+	fprintf(stderr, "  -P profile    radio profile of the end_to_end run, the transmitter's (default %s), built-in:", PROFILE_DEFAULT);
+	profile_list(stderr);
+	fprintf(stderr, "  -C file       load the profiles of a file\n");
+	fprintf(stderr, "  -i iterations operations per micro-benchmark (default %d)\n", BENCH_ITER_DEF);
+	fprintf(stderr, "  -e seconds    duration of the end_to_end run, 0 to skip it (default %d)\n", E2E_SECONDS_DEF);
+	fprintf(stderr, "  -r tx_rate    frame rate of the transmitter in Hz (dw1000_tx -r), to report the captured ratio\n");
+	fprintf(stderr, "  -c taps       CIR taps read per frame in the end_to_end run (default: all)\n");
+	fprintf(stderr, "  -o file       JSON output, stdout by default\n");
+}
+
+int main(int argc, char *argv[])
+{
+	dw1000_wiring_t wiring;
+	char spi_path[DW1000_SPI_PATH_MAX];
+	const char *out_path = NULL;
+	const char *profile_spec = PROFILE_DEFAULT;
+	const char *profile_path = NULL;
+	uint32_t iter = BENCH_ITER_DEF;
+	unsigned int seconds = E2E_SECONDS_DEF;
+	double tx_rate = 0;
+	uint64_t *samples;
+	unsigned int i;
+	FILE *f = stdout;
+	int opt;
+
+	memset(&wiring, 0, sizeof(wiring));
+	strcpy(spi_path, "/dev/spidev1.0");
+	e2e.cir_taps = 0;
+
+	while((opt = getopt(argc, argv, "d:P:C:i:e:r:c:o:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'd':
+			if(parse_wiring(optarg, &wiring, spi_path) != 0)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'P':
+			profile_spec = optarg;
+			break;
+		case 'C':
+			profile_path = optarg;
+			break;
+		case 'i':
+			iter = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			tx_rate = strtod(optarg, NULL);
+			break;
+		case 'c':
+			e2e.cir_taps = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if((profile_path != NULL && profile_load(profile_path) < 0) || profile_get(profile_spec, &profile) != 0)
+		return 1;
+	if(e2e.cir_taps == 0)
+		e2e.cir_taps = (config->prf == DWT_PRF_16M) ? DWT_CIR_LEN_PRF16 : DWT_CIR_LEN_PRF64;
+	if(iter == 0 || e2e.cir_taps > ((config->prf == DWT_PRF_16M) ? DWT_CIR_LEN_PRF16 : DWT_CIR_LEN_PRF64))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	samples = malloc(iter * sizeof(*samples));
+	if(samples == NULL)
+	{
+		fprintf(stderr, "Could not allocate memory\n");
+		return 1;
+	}
+
+	if(dw1000_dev_init(0, wiring.spi_path ? &wiring : NULL) == NULL)
+	{
+		fprintf(stderr, "Unable to set up the DW1000\n");
+		return 1;
+	}
+	reset_DW1000();
+
+	spi_set_rate_low();
+	if(dwt_initialise(DWT_LOADUCODE) == DWT_ERROR)
+	{
+		fprintf(stderr, "Unable to initialize UCODE\n");
+		return 1;
+	}
+	profile_apply(&profile);
+
+	if(out_path != NULL)
+	{
+		f = fopen(out_path, "w");
+		if(f == NULL)
+		{
+			perror("Can't create the output file");
+			return 1;
+		}
+	}
+
+	fprintf(f, "{\n  \"bench\": \"dw1000_bench\", \"time\": %ld, \"spi_path\": ", (long)time(NULL));
+	json_string(f, spi_path);
+	fprintf(f, ", \"profile\": ");
+	json_string(f, profile_spec);
+	fprintf(f, ", \"frame_us\": %lu, \"iterations\": %lu,\n  \"results\": [", profile_frame_us(config, 12),
+			(unsigned long)iter);
+
+	fprintf(stderr, "reg_read\n");
+	bench_reg_read(f, "low", samples, iter);
+	spi_set_rate_high();
+	bench_reg_read(f, "high", samples, iter);
+
+	// The rest runs at the fastest rate the wiring allows
+	fprintf(stderr, "autotune: %d Hz\n", spi_autotune());
+	bench_reg_read(f, "tuned", samples, iter);
+
+	fprintf(stderr, "cir_read\n");
+	for(i = 0; i < sizeof(cir_chunks) / sizeof(cir_chunks[0]); i++)
+		bench_cir_read(f, cir_chunks[i], samples, iter);
+
+	fprintf(stderr, "diagnostics\n");
+	bench_diagnostics(f, samples, iter);
+
+	fprintf(stderr, "init, wakeup\n");
+	dwt_setotpcal(NULL, 0);
+	bench_init(f, 0, samples, (iter < INIT_ITER_MAX) ? iter : INIT_ITER_MAX);
+	bench_init(f, 1, samples, (iter < INIT_ITER_MAX) ? iter : INIT_ITER_MAX);
+	bench_wakeup(f, 0, samples, (iter < INIT_ITER_MAX) ? iter : INIT_ITER_MAX);
+	bench_wakeup(f, 1, samples, (iter < INIT_ITER_MAX) ? iter : INIT_ITER_MAX);
+	init_device(1);
+
+	if(seconds)
+	{
+		fprintf(stderr, "end_to_end, %u s\n", seconds);
+		if(bench_end_to_end(f, seconds, tx_rate) != 0)
+			fprintf(stderr, "end_to_end run failed\n");
+	}
+
+	fprintf(f, "\n  ]\n}\n");
+	if(f != stdout)
+		fclose(f);
+
+	spi_print_stats(stderr);
+	free(samples);
+	return 0;
+}
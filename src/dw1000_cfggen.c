@@ -0,0 +1,233 @@
+/*
+ * dw1000_cfggen.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Build time generator of the dwt_fixedconfig_t of a radio profile, for the builds of a single fixed profile (make
+ * fixed-<profile>, see dwt_configurefixed()). The driver is linked against the platform functions below instead of
+ * platform.c: dwt_configure() is run for the profile, each register write it makes is recorded, and the whole sequence
+ * is printed as C source, with the profile specification as dw1000_fixed_profile.
+ *
+ * dwt_configure() only reads the SYS_CFG shadow copy, which reads as 0 here so that what it writes is the part that
+ * depends on the configuration. Any other read would make the writes depend on the device, and is an error.
+ *
+ * Usage: dw1000_cfggen [-C profile_file] profile > fixed_config.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "profiles.h"
+#include "spi_backend.h"
+
+#define CFGGEN_WRITES_MAX		(64)
+#define CFGGEN_WRITE_LEN_MAX	(8)
+
+typedef struct
+{
+	uint16	reg;
+	uint16	index;
+	uint32	len;
+	uint8	data[CFGGEN_WRITE_LEN_MAX];
+} cfggen_write_t;
+
+static cfggen_write_t writes[CFGGEN_WRITES_MAX];
+static unsigned int num_writes = 0;
+static int errors = 0;
+
+static void decode_header(uint16 len, const uint8 *header, uint16 *reg, uint16 *index)
+{
+	*reg = header[0] & 0x3F;
+	*index = 0;
+	if(len > 1)
+		*index = header[1] & 0x7F;
+	if(len > 2)
+		*index |= (uint16)header[2] << 7;
+}
+
+int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength, const uint8 *bodyBuffer)
+{
+	cfggen_write_t *w;
+
+	if(num_writes == CFGGEN_WRITES_MAX || bodylength > CFGGEN_WRITE_LEN_MAX)
+	{
+		fprintf(stderr, "dwt_configure() write too long or too many writes\n");
+		errors++;
+		return DWT_ERROR;
+	}
+
+	w = &writes[num_writes++];
+	decode_header(headerLength, headerBuffer, &w->reg, &w->index);
+	w->len = bodylength;
+	memcpy(w->data, bodyBuffer, bodylength);
+	return DWT_SUCCESS;
+}
+
+int writetospibatch(uint16 count, const dwt_spiwrite_t *writes)
+{
+	uint16 i;
+
+	for(i = 0; i < count; i++)
+		writetospi(writes[i].headerLength, writes[i].headerBuffer, writes[i].bodyLength, writes[i].bodyBuffer);
+	return DWT_SUCCESS;
+}
+
+int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer)
+{
+	uint16 reg, index;
+
+	decode_header(headerLength, headerBuffer, &reg, &index);
+	if(reg != SYS_CFG_ID || index != 0)
+	{
+		fprintf(stderr, "dwt_configure() reads register 0x%02X:%u, its writes depend on the device\n", reg, index);
+		errors++;
+	}
+	memset(readBuffer, 0, readlength);
+	return DWT_SUCCESS;
+}
+
+int readfromspidiscard(uint16 headerLength, const uint8 *headerBuffer, uint16 discardLength, uint32 readlength, uint8 *readBuffer)
+{
+	(void) discardLength;
+	return readfromspi(headerLength, headerBuffer, readlength, readBuffer);
+}
+
+int readfromspibatch(uint16 count, const dwt_spiread_t *reads)
+{
+	uint16 i;
+
+	for(i = 0; i < count; i++)
+		readfromspi(reads[i].headerLength, reads[i].headerBuffer, reads[i].readlength, reads[i].readBuffer);
+	return DWT_SUCCESS;
+}
+
+uint32 spimaxtransfer(void)
+{
+	return 4096;
+}
+
+decaIrqStatus_t decamutexon(void)
+{
+	return 0;
+}
+
+void decamutexoff(decaIrqStatus_t s)
+{
+	(void) s;
+}
+
+void deca_sleep(unsigned int time_ms)
+{
+	(void) time_ms;
+}
+
+void deca_usleep(unsigned int time_us)
+{
+	(void) time_us;
+}
+
+static uint32 le32(const uint8 *data)
+{
+	return data[0] | ((uint32)data[1] << 8) | ((uint32)data[2] << 16) | ((uint32)data[3] << 24);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-C profile_file] profile > fixed_config.c\n", name);
+	fprintf(stderr, "  profile   profile specification, optionally with key=value overrides, built-in:");
+	profile_list(stderr);
+}
+
+int main(int argc, char *argv[])
+{
+	profile_t profile;
+	const dwt_config_t *c = &profile.config;
+	uint32 sys_cfg = 0, tx_fctrl = 0;
+	unsigned int i, j, n = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "C:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'C':
+			if(profile_load(optarg) < 0)
+				return 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind != argc - 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if(profile_get(argv[optind], &profile) != 0)
+		return 1;
+
+	dwt_configure(&profile.config);
+	if(errors)
+		return 1;
+
+	// dwt_configurefixed() sends the whole sequence, SYS_CFG included, in one SPI message
+	if(num_writes > DWT_WRITE_BATCH_MAX || num_writes > SPI_XFER_MAX)
+	{
+		fprintf(stderr, "%s: %u register writes, more than the %u of one SPI message\n", argv[optind], num_writes,
+				(unsigned int)((DWT_WRITE_BATCH_MAX < SPI_XFER_MAX) ? DWT_WRITE_BATCH_MAX : SPI_XFER_MAX));
+		return 1;
+	}
+
+	printf("/* Generated by dw1000_cfggen for profile %s, do not edit. */\n\n", argv[optind]);
+	printf("#include \"deca_device_api.h\"\n#include \"profiles.h\"\n\n");
+	printf("const char dw1000_fixed_profile[] = \"%s\";\n\n", argv[optind]);
+
+	for(i = 0; i < num_writes; i++)
+	{
+		if(writes[i].reg == SYS_CFG_ID && writes[i].index == 0 && writes[i].len == 4)
+		{
+			sys_cfg = le32(writes[i].data);
+			continue;
+		}
+		if(writes[i].reg == TX_FCTRL_ID && writes[i].index == 0 && writes[i].len == 4)
+			tx_fctrl = le32(writes[i].data);
+
+		printf("static const uint8 w%u[] = {", i);
+		for(j = 0; j < writes[i].len; j++)
+			printf("%s0x%02X", j ? ", " : "", writes[i].data[j]);
+		printf("};\n");
+	}
+
+	printf("\nstatic const dwt_writereq_t writes[] = {\n");
+	for(i = 0; i < num_writes; i++)
+	{
+		if(writes[i].reg == SYS_CFG_ID && writes[i].index == 0 && writes[i].len == 4)
+			continue;
+		printf("\t{0x%02X, 0x%04X, %lu, w%u},\n", writes[i].reg, writes[i].index, (unsigned long)writes[i].len, i);
+		n++;
+	}
+	printf("};\n\n");
+
+	printf("const dwt_fixedconfig_t dw1000_fixed_config = {\n");
+	printf("\t{%u, %u, 0x%02X, %u, %u, %u, %u, %u, %u, %u},\n", c->chan, c->prf, c->txPreambLength, c->rxPAC, c->txCode,
+		   c->rxCode, c->nsSFD, c->dataRate, c->phrMode, c->sfdTO);
+	printf("\t0x%08lX, 0x%08lX, %u, writes\n", (unsigned long)sys_cfg, (unsigned long)tx_fctrl, n);
+	printf("};\n");
+
+	return 0;
+}
@@ -24,278 +24,947 @@
  */
 
 #include <stdio.h>
-#include <stdlib.h> // malloc, free
+#include <stdlib.h> // strtoul
 #include <unistd.h>
 #include <stdint.h>
-#include <string.h> // memset
+#include <string.h> // memcpy
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
 
 #include "deca_device_api.h"
 #include "deca_regs.h"
 #include "platform.h"
+#include "cir_ring.h"
+#include "cir_file.h"
+#include "cir_stream.h"
+#include "telemetry.h"
+#include "profiles.h"
+#include "rt.h"
+#include "clock_sync.h"
+#include "otp_cache.h"
+#include "tempcomp.h"
+#include "frame_filter.h"
+#include "cir_model.h"
 
 /* Example application name and version to display on LCD screen. */
 #define APP_NAME "HEADCOUNT RX v1.0"
 
-/* Default communication configuration. We use here EVK1000's default mode (mode 3). */
-static dwt_config_t config = {
-    2,               /* Channel number. */
-    DWT_PRF_64M,     /* Pulse repetition frequency. */
-    DWT_PLEN_1024,   /* Preamble length. Used in TX only. */
-    DWT_PAC32,       /* Preamble acquisition chunk size. Used in RX only. */
-    9,               /* TX preamble code. Used in TX only. */
-    9,               /* RX preamble code. Used in RX only. */
-    1,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
-    DWT_BR_110K,     /* Data rate. */
-    DWT_PHRMODE_STD, /* PHY header mode. */
-    (1025 + 64 - 32) /* SFD timeout (preamble length + 1 + SFD length - PAC size). Used in RX only. */
-};
-
-static dwt_rxdiag_t diagnostics;
-
-/* Buffer to store received frame. See NOTE 1 below. */
+/* Communication configuration, selected with -P and -C. By default EVK1000's default mode (mode 3). See NOTE 15 below. */
+static const char *profile_spec = PROFILE_DEFAULT;
+static const char *profile_path = NULL;
+static profile_t profile;
+
+/* Set by SIGHUP to reload the profile file and switch all the receivers to the profile selected. */
+static volatile sig_atomic_t reload = 0;
+
+/* Layout of the received frame. See NOTE 1 below. */
 #define BLINK_FRAME_SN_IDX 1
 #define TS_IDX   2 
 #define FRAME_LEN_MAX 127
-#define RX_BUF_LEN 12
-static uint8 rx_buffer[RX_BUF_LEN];
 
-/* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
-static uint32 status_reg = 0;
+/* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. It is written by the
+ * callbacks below, which run on the IRQ thread. */
+static volatile uint32 status_reg = 0;
 
-/* Hold copy of frame length of frame received (if good) so that it can be examined at a debug breakpoint. */
-static uint16 frame_len = 0;
+// 992 samples for 16MHz PRF - 3968 bytes (DWT_CIR_LEN_PRF16)
+// 1016 samples for 64MHz PRF - 4064 bytes (DWT_CIR_LEN_PRF64)
+#define CIR_SAMPLES 100 //DWT_CIR_LEN_PRF64
 
-// 992 samples for 16MHz PRF - 3968 bytes
-// 1016 samples for 64MHz PRF - 4064 bytes
-#define CIR_SAMPLES 100 //1016
+/* Set with -w pre:post to capture only the taps from firstPath - pre to firstPath + post instead of CIR_SAMPLES from tap 0. See NOTE 6 below. */
+static uint16 cir_pre = 0;
+static uint16 cir_window = 0; /* Taps per window, 0 when windowing is off. */
 
 typedef unsigned long long uint64;
 typedef signed long long int64;
 
-struct cir_tap_struct {
-    uint16 real;
-    uint16 img;
-};
+/* Ring of captured frames between rx_ok_cb() and the writer thread, must be a power of two. See NOTE 5 below. */
+#define RING_FRAMES 64
+
+/* Capture files written by the writer thread: <prefix>_<index>.cir, a new file every ROTATE_MB_DEF MB by default. See NOTE 11 below. */
+#define PREFIX_DEF "cir"
+#define ROTATE_MB_DEF 64
+
+/* Capture state of one DW1000, each receiver has its own IRQ thread, ring, writer thread and files. See NOTE 12 below. */
+typedef struct
+{
+    dw1000_dev_t *dev;
+    dw1000_wiring_t wiring;
+    char spi_path[DW1000_SPI_PATH_MAX];
+    cir_ring_t ring;
+    uint32 rx_seq; /* Host side sequence number of the next good frame, dropped frames included. */
+    cir_file_t cir_file;
+    cir_stream_t stream;
+    clock_sync_t sync; /* Only used by the writer thread. */
+    time_t sync_report; /* Host second of the last sync report. */
+    tempcomp_t tempcomp; /* Only used by the main thread. */
+    int16 temp_cdeg; /* Latest temperature and voltage, written by the main thread under decamutexon(). See NOTE 19 below. */
+    uint16 vbat_mv;
+    uint32 filtered; /* Frames dropped by the host filter, only written by the IRQ thread. */
+    cir_model_t model; /* Only used by the writer thread. See NOTE 22 below. */
+    time_t model_report; /* Host second of the last model report. */
+    uint32 model_skipped; /* Frames outside events not kept with forward, only written by the writer thread. */
+    pthread_t writer_thread;
+} rx_dev_t;
+
+static rx_dev_t rx_devs[DWT_NUM_DW_DEV];
+static unsigned int num_devs = 0;
+
+/* Cleared by the main loop to tell the writer thread to drain the ring and exit. */
+static volatile int running = 1;
+
+/* Set with -v to print a line per frame. */
+static int verbose = 0;
+
+/* Set with -N to stream the frames to an aggregator, capture files are then only written with -o. See NOTE 17 below. */
+static const char *stream_dest = NULL;
+static int write_files = 1;
 
-#define ACC_CHUNK 64 // bytes read at the same time
+/* Set with -c to compress the taps in the capture files. See NOTE 21 below. */
+static int file_codec = CIR_CODEC_NONE;
 
-void copyCIRToBuffer(uint8 *buffer, uint16 len)
+/* Set with -S to align the RX timestamps to the beacons of a time reference (dw1000_tx -B). See NOTE 18 below. */
+static int sync_on = 0;
+static double sync_tof_ns[DWT_NUM_DW_DEV];
+
+/* Set with -F to keep foreign frames out of the capture, in the DW1000 and before any readout. See NOTE 20 below. */
+static frame_filter_t filter;
+static int filter_on = 0;
+
+/* Set with -M to detect the changes of each link against its background, events going to model_out. See NOTE 22 below. */
+static cir_model_config_t model_config;
+static int model_on = 0;
+static FILE *model_out = NULL;
+
+/* Set with -s to export the capture telemetry, to a file or a unix:<path> socket. See NOTE 13 below. */
+static const char *stats_dest = NULL;
+
+/* Set with -R to run the IRQ threads in real time. See NOTE 16 below. */
+static rt_config_t rt_config;
+
+/* Callbacks called by dwt_isr() on the IRQ thread. See NOTE 5 below. */
+static void rx_ok_cb(const dwt_cb_data_t *cb_data);
+static void rx_err_cb(const dwt_cb_data_t *cb_data);
+
+/**
+ * Update the sync engine of a receiver with a beacon, and map the RX timestamp of any frame to the reference timebase. Called by the writer
+ * thread, in capture order.
+ */
+static void sync_frame(rx_dev_t *rx, cir_frame_t *frame, uint64 tx_stamp)
 {
-    int loc = 0;
-    uint16 toRead = 0;
-    int lastRead = 0;
+    uint64_t rx_stamp = cir_stamp40(frame->info.rxStamp);
+    uint64_t ref_stamp;
+    double sigma;
+    int synced;
 
-    // we need to create a buffer to discard the dummy byte
-    uint8 buf[ACC_CHUNK+1];
-    
-    while(1)
+    if (frame->length >= TS_IDX + sizeof(uint64) && frame->data[0] == CLOCK_SYNC_BEACON_TYPE)
     {
+        clock_sync_beacon(&rx->sync, rx_stamp, tx_stamp, clock_sync_carrier_ratio(&profile.config, frame->carrier_int));
+    }
 
-        memset((void *) buf, 0, ACC_CHUNK + 1);
+    synced = (clock_sync_map(&rx->sync, rx_stamp, &ref_stamp, &sigma) == 0);
+    frame->sync_stamp = synced ? ref_stamp : 0;
 
-        if(len > ACC_CHUNK)
+    if (frame->host_time.tv_sec != rx->sync_report)
+    {
+        rx->sync_report = frame->host_time.tv_sec;
+        if (synced)
         {
-            // need to loop again
-            // only read the max allowable number of characters
-            toRead = ACC_CHUNK;
+            printf("%u: sync: %lu beacons, %lu outliers, %lu resets, drift %.3f ppm, +/- %.0f ps\r\n", dw1000_dev_index(rx->dev),
+                   rx->sync.beacons, rx->sync.outliers, rx->sync.resets, rx->sync.drift * 1e6, sigma * DWT_TIME_UNITS * 1e12);
         }
         else
         {
-            // we will cover the entire length in this iteration of the loop
-            // only read the remaining length
-            toRead = len;
-            lastRead = 1;
+            printf("%u: sync: not synchronised (%lu beacons)\r\n", dw1000_dev_index(rx->dev), rx->sync.beacons);
+        }
+    }
+}
+
+static double wall_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * Score a frame against the background of its link and write out the events and periodic reports, one JSON object per line. Called by the
+ * writer thread, in capture order. Returns whether the CIR of the frame is to be kept.
+ */
+static int model_frame(rx_dev_t *rx, const cir_frame_t *frame)
+{
+    cir_link_t *link;
+    unsigned int i;
+    int flags;
+
+    flags = cir_model_update(&rx->model, frame, profile.config.prf, &link);
+
+    if (flags & CIR_MODEL_EVENT_START)
+    {
+        fprintf(model_out, "{\"time\": %.3f, \"device\": %u, \"link\": %u, \"event\": \"start\", \"seq\": %lu, \"score\": %.2f}\n", wall_time(),
+                dw1000_dev_index(rx->dev), link->key, frame->seq, link->score);
+    }
+    if (flags & CIR_MODEL_EVENT_END)
+    {
+        fprintf(model_out, "{\"time\": %.3f, \"device\": %u, \"link\": %u, \"event\": \"end\", \"seq\": %lu, \"frames\": %lu, "
+                "\"duration\": %.3f, \"max_score\": %.2f}\n", wall_time(), dw1000_dev_index(rx->dev), link->key, frame->seq, link->event_frames,
+                (frame->host_time.tv_sec - link->event_start.tv_sec) + (frame->host_time.tv_nsec - link->event_start.tv_nsec) * 1e-9,
+                link->event_max);
+    }
+
+    if (rx->model_report == 0)
+    {
+        rx->model_report = frame->host_time.tv_sec;
+    }
+    else if (model_config.report_sec != 0 && frame->host_time.tv_sec - rx->model_report >= (time_t) model_config.report_sec)
+    {
+        rx->model_report = frame->host_time.tv_sec;
+        for (i = 0; i < rx->model.num_links; i++)
+        {
+            link = &rx->model.links[i];
+            fprintf(model_out, "{\"time\": %.3f, \"device\": %u, \"link\": %u, \"learned\": %lu, \"frames\": %lu, \"mean_score\": %.2f, "
+                    "\"max_score\": %.2f, \"events\": %lu, \"in_event\": %d, \"unaligned\": %lu}\n", wall_time(), dw1000_dev_index(rx->dev),
+                    link->key, link->frames, link->report_frames, link->report_frames ? link->report_sum / link->report_frames : 0.0,
+                    link->report_max, link->events, link->event, rx->model.unaligned);
+            cir_model_report_reset(link);
         }
+    }
+
+    if (!model_config.forward || (flags & CIR_MODEL_IN_EVENT))
+    {
+        return 1;
+    }
+    rx->model_skipped++;
+    return 0;
+}
 
-        // read from device
-        dwt_readaccdata(buf, toRead, loc);
+/**
+ * Writer thread: serializes the frames captured by rx_ok_cb() to disk, off the capture path.
+ */
+static void *writer_loop(void *arg)
+{
+    rx_dev_t *rx = arg;
+    cir_frame_t *frame;
+    uint64 time;
+    uint64_t t0;
 
-        // copy to the buffer
-        memcpy((void *) &buffer[loc], (void *) &buf[1], toRead);
+    /* Events are per device: select it to be woken up by its rx_ok_cb(). */
+    dw1000_dev_select(rx->dev);
 
-        if(lastRead)
+    while (1)
+    {
+        frame = cir_ring_peek(&rx->ring);
+        if (frame == NULL)
         {
-            break;
+            if (!running)
+            {
+                break;
+            }
+            /* Woken up by rx_ok_cb(). After 100 ms without frames, write out what has been buffered so far. */
+            if (irq_event_wait(100) < 0)
+            {
+                if (write_files)
+                {
+                    cir_file_flush(&rx->cir_file);
+                }
+                if (stream_dest != NULL)
+                {
+                    cir_stream_flush(&rx->stream);
+                }
+            }
+            continue;
+        }
+
+        /*  Get the TX timestamp carried by the payload. */
+        time = 0;
+        if (frame->length >= TS_IDX + sizeof(uint64))
+        {
+            memcpy((void *) &time, (void *) &frame->data[TS_IDX], sizeof(uint64));
+        }
+
+        /* Align the RX timestamp to the time reference, after the update of a beacon. See NOTE 18 below. */
+        if (sync_on)
+        {
+            sync_frame(rx, frame, time);
+        }
+
+        /* Change detection, and with forward only the frames of an event are kept. See NOTE 22 below. */
+        if (model_on && !model_frame(rx, frame))
+        {
+            cir_ring_release(&rx->ring);
+            continue;
         }
 
-        // decrease remaining length
-        len = len - toRead;
+        if (verbose)
+        {
+            printf("%u/%lu: %u MSG Received! DATA: %llu, FP: %d, STD_NOISE: %d, MAX_NOISE: %d\r\n", dw1000_dev_index(rx->dev), frame->seq,
+                   frame->data[BLINK_FRAME_SN_IDX], time, frame->info.diag.firstPath, frame->info.diag.stdNoise, frame->info.diag.maxNoise);
+        }
 
-        // increase pointer in buffer
-        loc = loc + toRead;
+        t0 = TELEM_NOW();
+        if (write_files && cir_file_append(&rx->cir_file, frame, time) != 0)
+        {
+            printf("Unable to write the capture file\r\n");
+        }
+        /* Batches that can't be sent are dropped and counted, the capture goes on. */
+        if (stream_dest != NULL)
+        {
+            cir_stream_append(&rx->stream, frame, time);
+        }
+        TELEM_RECORD(TELEM_WRITE, TELEM_NOW() - t0);
+
+        cir_ring_release(&rx->ring);
     }
+
+    if (write_files)
+    {
+        cir_file_close(&rx->cir_file);
+    }
+    if (stream_dest != NULL)
+    {
+        cir_stream_close(&rx->stream);
+    }
+    return NULL;
+}
+
+/**
+ * Parse a -d argument: spi_path,rst_pin,irq_pin,irq_line.
+ */
+static int parse_wiring(const char *arg, rx_dev_t *rx)
+{
+    if (sscanf(arg, "%63[^,],%d,%d,%d", rx->spi_path, &rx->wiring.rst_pin, &rx->wiring.irq_pin, &rx->wiring.irq_line) != 4)
+    {
+        return -1;
+    }
+    rx->wiring.spi_path = rx->spi_path;
+    return 0;
 }
 
-void saveInfoToFile(char *filename, uint64 time, struct cir_tap_struct *cir, dwt_rxdiag_t *diagnostics)
+/**
+ * CIR length of a configuration, in taps.
+ */
+static uint16 cir_length(const dwt_config_t *config)
+{
+    return (config->prf == DWT_PRF_16M) ? DWT_CIR_LEN_PRF16 : DWT_CIR_LEN_PRF64;
+}
+
+/**
+ * Parse a -S argument: the beacon propagation delay from the time reference to each receiver, in ns, e.g. 12.5,20.1. The last one is used
+ * for the receivers that have none.
+ */
+static int parse_sync(const char *arg)
 {
-    FILE *output_file;
-    int i;
-    
-    output_file = fopen(filename, "w");
-    if (output_file == NULL){
-        printf("unable to write\n");
-    }
-    else {
-        
-        fprintf(output_file, "timestamp, %llu\n", time);
-        
-        fprintf(output_file, "maxNoise,%u\n", diagnostics->maxNoise);
-        fprintf(output_file, "stdNoise,%u\n", diagnostics->stdNoise);
-        fprintf(output_file, "firstPath,%u\n", diagnostics->firstPath);
-        fprintf(output_file, "firstPathAmp1,%u\n", diagnostics->firstPathAmp1);
-        fprintf(output_file, "firstPathAmp2,%u\n", diagnostics->firstPathAmp2);
-        fprintf(output_file, "firstPathAmp3,%u\n", diagnostics->firstPathAmp3);
-        fprintf(output_file, "maxGrowthCIR,%u\n", diagnostics->maxGrowthCIR);
-        fprintf(output_file, "rxPreamCount,%u\n", diagnostics->rxPreamCount);
-        
-        fprintf(output_file, "CIRIQ\n");
-        for (i = 0; i < CIR_SAMPLES; i++)
+    const char *p = arg;
+    char *end;
+    unsigned int i = 0;
+    double tof;
+
+    do
+    {
+        tof = strtod(p, &end);
+        if (end == p || (*end != ',' && *end != '\0') || tof < 0 || i == DWT_NUM_DW_DEV)
         {
-            fprintf(output_file, "%d,%d\n", cir[i].real, cir[i].img);
+            return -1;
         }
-        
-        fclose(output_file);
-        printf("Saving successful");
+        sync_tof_ns[i++] = tof;
+        p = end + 1;
+    }
+    while (*end == ',');
+
+    for (; i < DWT_NUM_DW_DEV; i++)
+    {
+        sync_tof_ns[i] = tof;
+    }
+    sync_on = 1;
+    return 0;
+}
+
+/**
+ * Parse a -w argument: pre:post, the window must fit in the CIR.
+ */
+static int parse_window(const char *arg)
+{
+    unsigned int pre, post;
+
+    if (sscanf(arg, "%u:%u", &pre, &post) != 2 || pre + post + 1 > cir_length(&profile.config))
+    {
+        return -1;
     }
+    cir_pre = pre;
+    cir_window = pre + post + 1;
+    return 0;
+}
+
+/**
+ * Load the profile file if any, then resolve the profile selected.
+ */
+static int load_profile(profile_t *p)
+{
+    if (profile_path != NULL && profile_load(profile_path) < 0)
+    {
+        return -1;
+    }
+    return profile_get(profile_spec, p);
+}
+
+static void sighup_handler(int sig)
+{
+    (void) sig;
+    reload = 1;
+}
+
+/**
+ * Switch all the receivers to the profile selected, on SIGHUP. The current profile is kept if the new one does not load or does not fit the
+ * -w window. See NOTE 15 below.
+ */
+static void switch_profile(void)
+{
+    profile_t next;
+    cir_ring_stats_t stats;
+    decaIrqStatus_t s;
+    unsigned int i;
+    rx_dev_t *rx;
+
+    if (load_profile(&next) != 0 || cir_window > cir_length(&next.config))
+    {
+        printf("Profile not switched\r\n");
+        return;
+    }
+
+    /* Stop all the receivers, then let the writers drain the frames received with the old profile. */
+    for (i = 0; i < num_devs; i++)
+    {
+        dw1000_dev_select(rx_devs[i].dev);
+        s = decamutexon();
+        dwt_forcetrxoff();
+        decamutexoff(s);
+    }
+    for (i = 0; i < num_devs; i++)
+    {
+        rx = &rx_devs[i];
+        dw1000_dev_select(rx->dev);
+        irq_event_signal();
+        do
+        {
+            usleep(1000);
+            cir_ring_getstats(&rx->ring, &stats);
+        }
+        while (stats.occupancy != 0);
+    }
+
+    profile = next;
+    for (i = 0; i < num_devs; i++)
+    {
+        rx = &rx_devs[i];
+        dw1000_dev_select(rx->dev);
+        cir_file_setconfig(&rx->cir_file, &profile.config);
+        if (stream_dest != NULL)
+        {
+            cir_stream_setconfig(&rx->stream, &profile.config);
+        }
+        s = decamutexon();
+        profile_switch(&profile);
+        dwt_setrxtimeout(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        decamutexoff(s);
+    }
+
+    profile_print(stdout, &profile);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-d spi_path,rst_pin,irq_pin,irq_line]... [-P profile] [-C profile_file] [-n frames] [-o prefix] [-r rotate_mb] [-c codec] [-w pre:post]\r\n"
+           "       [-N dest] [-S tof_ns[,tof_ns]...] [-F filter] [-M model] [-R rt] [-s stats] [-v]\r\n", name);
+    printf("  -d wiring     add a receiver (wiringPi pins, gpiochip0 IRQ line), up to %d; one on /dev/spidev1.0 by default\r\n", DWT_NUM_DW_DEV);
+    printf("  -P profile    radio profile, optionally with key=value overrides (e.g. %s,rate=6m8,preamble=128), reselected on SIGHUP\r\n", PROFILE_DEFAULT);
+    printf("                built-in:");
+    profile_list(stdout);
+    printf("  -C file       load the profiles of a file, reloaded on SIGHUP\r\n");
+    printf("  -n frames     number of frames to capture per receiver, 0 (default) to run forever\r\n");
+    printf("  -o prefix     capture files prefix (default %s), <prefix>_d<receiver> with several receivers\r\n", PREFIX_DEF);
+    printf("  -r rotate_mb  start a new capture file every rotate_mb MB, 0 for a single file (default %d)\r\n", ROTATE_MB_DEF);
+    printf("  -c codec      compress the taps in the capture files: none (default) or delta, lossless\r\n");
+    printf("  -w pre:post   capture the taps from pre before to post after the first path (e.g. 64:128), %d from tap 0 by default\r\n", CIR_SAMPLES);
+    printf("  -N dest       stream the frames to cir_recv: udp:<host>:<port> or tcp:<host>:<port>, then [,delta][,zlib[=level]][,batch=bytes]\r\n");
+    printf("                [,node=id] (delta compresses the taps)\r\n");
+    printf("                (default port %d); capture files are then only written with -o\r\n", CIR_STREAM_PORT_DEF);
+    printf("  -S tof_ns     tag the frames with their RX timestamp in the timebase of a dw1000_tx -B reference, given the propagation delay\r\n");
+    printf("                from the reference to each receiver in ns\r\n");
+    printf("  -F filter     only capture some frames: tx (those of dw1000_tx), fc=<byte>[+<byte>...] (first frame control byte, checked on the\r\n");
+    printf("                host), types=data[+beacon][+ack][+mac][+rsvd][+coord], pan=<id>, addr=<short> (802.15.4 filtering by the DW1000)\r\n");
+    printf("  -M model      change detection against the background of each link, events to a file (- for stdout): path[,alpha=a]\r\n");
+    printf("                [,threshold=score][,taps=pre:post][,report=s][,forward] (alpha %.2f, threshold %.0f, taps %d:%d, report every %d s\r\n",
+           CIR_MODEL_ALPHA_DEF, CIR_MODEL_THRESHOLD_DEF, CIR_MODEL_PRE_DEF, CIR_MODEL_TAPS_DEF - CIR_MODEL_PRE_DEF - 1, CIR_MODEL_REPORT_DEF);
+    printf("                by default), forward only keeps the CIRs of the frames of an event; needs -w or the full CIR\r\n");
+    printf("  -R rt         real-time capture: priority[,cpu=N]...[,deadline=us], e.g. 80,cpu=3 (SCHED_FIFO, locked memory, deadline %d us)\r\n",
+           RT_DEADLINE_US_DEF);
+    printf("  -s stats      export phase latency histograms and event counters to a file, or a unix:<path> socket\r\n");
+    printf("  -v            print a line per frame\r\n");
 }
 
 /**
  * Application entry point.
  */
-int main(void)
+int main(int argc, char *argv[])
 {
-    uint64 time = 0;
-    uint8 squence_num = 0;
-    uint8 *cir_buffer;
-    int i;
+    dwt_deviceentcnts_t counters;
+    cir_ring_stats_t stats;
+    irq_stats_t irq_stats;
+    cir_stream_stats_t stream_stats;
+    clock_sync_params_t sync_params;
+    unsigned long max_frames = 0;
+    const char *prefix = NULL;
+    const char *window = NULL;
+    char dev_prefix[CIR_FILE_PATH_MAX];
+    unsigned long rotate_mb = ROTATE_MB_DEF;
+    unsigned int done;
+    unsigned int poll;
+    unsigned int i;
+    rx_dev_t *rx;
+    decaIrqStatus_t s;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:P:C:n:o:r:c:w:N:S:F:M:R:s:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            if (num_devs == DWT_NUM_DW_DEV || parse_wiring(optarg, &rx_devs[num_devs]) != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            num_devs++;
+            break;
+        case 'P':
+            profile_spec = optarg;
+            break;
+        case 'C':
+            profile_path = optarg;
+            break;
+        case 'n':
+            max_frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            prefix = optarg;
+            break;
+        case 'r':
+            rotate_mb = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            file_codec = cir_codec_parse(optarg);
+            if (file_codec < 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'w':
+            window = optarg;
+            break;
+        case 'N':
+            stream_dest = optarg;
+            break;
+        case 'S':
+            if (parse_sync(optarg) != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'F':
+            if (frame_filter_parse(optarg, &filter) != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            filter_on = 1;
+            break;
+        case 'M':
+            if (cir_model_parse(optarg, &model_config) != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            model_on = 1;
+            break;
+        case 'R':
+            if (rt_parse(optarg, &rt_config) != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 's':
+            stats_dest = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
 
-    cir_buffer = (uint8 *) malloc(4*CIR_SAMPLES);
+    /* Streaming replaces the local files unless a prefix is given too. */
+    if (prefix == NULL)
+    {
+        prefix = PREFIX_DEF;
+        write_files = (stream_dest == NULL);
+    }
 
-    struct cir_tap_struct *cir = (struct cir_tap_struct *) &cir_buffer[0];
+    if (load_profile(&profile) != 0)
+    {
+        exit(1);
+    }
+    profile_print(stdout, &profile);
 
-    if(cir_buffer == NULL)
+    /* The window is checked against the CIR length of the profile. */
+    if (window != NULL && parse_window(window) != 0)
     {
-        printf("Could not allocate memory\r\n");
+        usage(argv[0]);
         exit(1);
     }
 
-    /* Start with board specific hardware init. */
-    hardware_init();
+    /* Events are written a line at a time, so the lines of the writer threads don't mix. See NOTE 22 below. */
+    if (model_on)
+    {
+        model_out = (strcmp(model_config.path, "-") == 0) ? stdout : fopen(model_config.path, "a");
+        if (model_out == NULL)
+        {
+            printf("Unable to open the event file\r\n");
+            exit(1);
+        }
+        setvbuf(model_out, NULL, _IOLBF, 0);
+    }
 
-    /* Reset and initialise DW1000. See NOTE 2 below.
-     * For initialisation, DW1000 clocks must be temporarily set to crystal speed. After initialisation SPI rate can be increased for optimum
-     * performance. */
-    reset_DW1000(); /* Target specific drive of RSTn line into DW1000 low for a period. */
-    spi_set_rate_low();
-    if (dwt_initialise(DWT_LOADUCODE) == DWT_ERROR)
+    /* Lock everything in memory before the rings and buffers are allocated, the capture threads never page fault. See NOTE 16 below. */
+    if (rt_init(&rt_config) != 0)
     {
-        printf("Unable to initialize UCODE\r\n");
         exit(1);
     }
-    spi_set_rate_high();
 
-    /* Configure DW1000. */
-    dwt_configure(&config);
+    /* Without -d, a single receiver wired as in the README. */
+    if (num_devs == 0)
+    {
+        num_devs = 1;
+    }
 
-    printf("%s\r\n", APP_NAME);
-    
-    int sampletime = 0;
-    /* Loop forever receiving frames. */
-    while (sampletime<1)
+    /* Start with board specific hardware init, and reset all the receivers before initialising any of them as they may share the reset line. */
+    for (i = 0; i < num_devs; i++)
+    {
+        rx = &rx_devs[i];
+        rx->dev = dw1000_dev_init(i, rx->wiring.spi_path ? &rx->wiring : NULL);
+        if (rx->dev == NULL)
+        {
+            printf("Unable to set up receiver %u\r\n", i);
+            exit(1);
+        }
+
+        reset_DW1000(); /* Target specific drive of RSTn line into DW1000 low for a period. */
+    }
+
+    for (i = 0; i < num_devs; i++)
     {
-        printf("start sample\n");
-        sampletime++;
+        rx = &rx_devs[i];
+        dw1000_dev_select(rx->dev);
+
+        if (num_devs == 1)
+        {
+            snprintf(dev_prefix, sizeof(dev_prefix), "%s", prefix);
+        }
+        else
+        {
+            snprintf(dev_prefix, sizeof(dev_prefix), "%s_d%u", prefix, i);
+        }
+        if (write_files && cir_file_open(&rx->cir_file, dev_prefix, rotate_mb * 1024 * 1024, &profile.config) != 0)
+        {
+            printf("Unable to create the capture file\r\n");
+            exit(1);
+        }
+        cir_file_setcodec(&rx->cir_file, file_codec);
+        if (stream_dest != NULL && cir_stream_open(&rx->stream, stream_dest, i, &profile.config) != 0)
+        {
+            printf("Unable to set up the stream\r\n");
+            exit(1);
+        }
+
+        clock_sync_defaults(&sync_params);
+        sync_params.tof = sync_tof_ns[i] * 1e-9 / DWT_TIME_UNITS;
+        clock_sync_init(&rx->sync, &sync_params);
+        cir_model_init(&rx->model, &model_config);
+
+        /* All frame records are allocated up front, nothing is allocated while capturing. */
+        if (cir_ring_init(&rx->ring, RING_FRAMES) != 0)
+        {
+            printf("Could not allocate memory\r\n");
+            exit(1);
+        }
+
+        if (pthread_create(&rx->writer_thread, NULL, writer_loop, rx) != 0)
+        {
+            printf("Unable to start the writer thread\r\n");
+            exit(1);
+        }
 
-        /* TESTING BREAKPOINT LOCATION #1 */
+        /* Initialise DW1000, with the OTP calibration values cached by earlier runs (see otp_cache.h). See NOTE 2 below.
+         * For initialisation, DW1000 clocks must be temporarily set to crystal speed. After initialisation SPI rate can be increased for optimum
+         * performance. */
+        spi_set_rate_low();
+        if (otp_cache_initialise(DWT_LOADUCODE) == DWT_ERROR)
+        {
+            printf("Unable to initialize UCODE\r\n");
+            exit(1);
+        }
 
-        /* Clear local RX buffer to avoid having leftovers from previous receptions  This is not necessary but is included here to aid reading
-         * the RX buffer.
-         * This is a good place to put a breakpoint. Here (after first time through the loop) the local status register will be set for last event
-         * and if a good receive has happened the data buffer will have the data in it, and frame_len will be set to the length of the RX frame. */
-        for (i = 0 ; i < RX_BUF_LEN; i++ )
+        /* Run the SPI as fast as this wiring reliably allows. See NOTE 14 below. */
+        if (spi_autotune() < 0)
         {
-            rx_buffer[i] = 0;
+            printf("Unable to set the SPI rate\r\n");
+            exit(1);
         }
 
-        // clear cir_buffer before next sampling
-        memset((void *) cir_buffer, 0, 4*CIR_SAMPLES);
-        memset((void *) &time, 0, 8);   //may go wrong
-
-        diagnostics.firstPath = 0;
-        diagnostics.firstPathAmp1 = 0;
-        diagnostics.firstPathAmp2 = 0;
-        diagnostics.firstPathAmp3 = 0;
-        diagnostics.maxGrowthCIR = 0;
-        diagnostics.rxPreamCount = 0;
-        diagnostics.maxNoise = 0;
-        diagnostics.stdNoise = 0;
-
-        /* Set timeout. */
-        /* Activate reception immediately. See NOTE 3 below. */
+        /* Configure DW1000: dwt_configure() and the TX RF settings of the profile. */
+        profile_apply(&profile);
+
+        /* Let the DW1000 reject foreign 802.15.4 frames itself, they are then only counted (ARFE). See NOTE 20 below. */
+        if (filter_on)
+        {
+            frame_filter_apply(&filter);
+        }
+
+        /* Measure the temperature and voltage in the background, the receivers don't transmit so nothing is compensated. See NOTE 19 below. */
+        tempcomp_init(&rx->tempcomp, &profile.config, &profile.txconfig, 0);
+
+        /* Receive continuously: the DW1000 fills one RX buffer while we read the other one and turns the receiver on again by itself. See
+         * NOTE 4 below. */
+        dwt_setdblrxbuffmode(1);
+        dwt_setautorxreenable(1);
+
+        /* Activate event counters. See NOTE 7 below. */
+        dwt_configeventcounters(1);
+
+        /* Register RX call-back and enable the interrupts we want to be woken up on. See NOTE 5 below. */
+        dwt_setcallbacks(NULL, &rx_ok_cb, &rx_err_cb, &rx_err_cb);
+        dwt_setinterrupt(DWT_INT_RFCG | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL | DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_SFDT | DWT_INT_ARFE
+                         | DWT_INT_RXOVRR, 1);
+        if (irq_init() != 0)
+        {
+            printf("Unable to set up the IRQ line\r\n");
+            exit(1);
+        }
+    }
+
+    if (stats_dest != NULL && telem_start(stats_dest, TELEM_EXPORT_PERIOD_MS) != 0)
+    {
+        printf("Unable to export the telemetry\r\n");
+        exit(1);
+    }
+
+    signal(SIGHUP, sighup_handler);
+
+    printf("%s\r\n", APP_NAME);
+
+    /* Activate reception immediately, once. See NOTE 3 below. */
+    for (i = 0; i < num_devs; i++)
+    {
+        dw1000_dev_select(rx_devs[i].dev);
+        s = decamutexon();
         dwt_setrxtimeout(0);
         dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        decamutexoff(s);
+    }
+
+    /* Report frame loss once a second until the requested number of frames has been captured by every receiver. See NOTE 10 below. */
+    do
+    {
+        /* Meanwhile, read the temperature and voltage of each receiver between frames. See NOTE 19 below. */
+        for (poll = 0; poll < 1000 / TEMPCOMP_POLL_MS; poll++)
+        {
+            usleep(TEMPCOMP_POLL_MS * 1000);
+            for (i = 0; i < num_devs; i++)
+            {
+                rx = &rx_devs[i];
+                dw1000_dev_select(rx->dev);
+                s = decamutexon();
+                if (tempcomp_poll(&rx->tempcomp, 0) & TEMPCOMP_NEW_READING)
+                {
+                    rx->temp_cdeg = (int16) (rx->tempcomp.temp * 100);
+                    rx->vbat_mv = (uint16) (rx->tempcomp.vbat * 1000);
+                }
+                decamutexoff(s);
+            }
+        }
 
-        /* Poll until a frame is properly received or an error/timeout occurs. See NOTE 4 below.
-         * STATUS register is 5 bytes long but, as the event we are looking at is in the first byte of the register, we can use this simplest API
-         * function to access it. */
-        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_ERR)))
-        { };
+        if (reload)
+        {
+            reload = 0;
+            switch_profile();
+        }
 
-        if (status_reg & SYS_STATUS_RXFCG)
+        done = 0;
+        for (i = 0; i < num_devs; i++)
         {
-            /* Clear good RX frame event in the DW1000 status register. */
-            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+            rx = &rx_devs[i];
+            dw1000_dev_select(rx->dev);
+            s = decamutexon();
+            dwt_readeventcounters(&counters);
+            spi_check();
+            decamutexoff(s);
+            cir_ring_getstats(&rx->ring, &stats);
 
-            /* A frame has been received, copy it to our local buffer. */
-            frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
-            if (frame_len <= RX_BUF_LEN)
+            printf("%u: CRCG: %u, CRCB: %u, PHE: %u, RSL: %u, OVER: %u, ring: %lu/%lu (max %lu), drops: %lu\r\n", i, counters.CRCG,
+                   counters.CRCB, counters.PHE, counters.RSL, counters.OVER, stats.occupancy, stats.size, stats.high_water, stats.drops);
+            if (filter_on)
+            {
+                printf("%u: filtered: %u by the DW1000 (ARFE), %lu on the host\r\n", i, counters.ARFE, (unsigned long) rx->filtered);
+            }
+            if (model_on && model_config.forward)
+            {
+                printf("%u: model: %lu frames outside events not kept\r\n", i, (unsigned long) rx->model_skipped);
+            }
+            if (rx->tempcomp.valid)
+            {
+                printf("%u: %.1f C, %.2f V\r\n", i, rx->tempcomp.temp, rx->tempcomp.vbat);
+            }
+            if (rt_enabled())
             {
-                dwt_readrxdata(rx_buffer, frame_len, 0);
+                irq_get_stats(&irq_stats);
+                printf("%u: RT deadline missed by %lu of %lu IRQs, longest %lu us\r\n", i, (unsigned long) irq_stats.missed,
+                       (unsigned long) irq_stats.irqs, (unsigned long) irq_stats.max_us);
             }
-            /*  Get timestamp to our local buffer. */
-            memcpy((void *) &squence_num, (void *) &rx_buffer[BLINK_FRAME_SN_IDX], sizeof(uint8));
-            memcpy((void *) &time, (void *) &rx_buffer[TS_IDX], sizeof(uint64));
-            printf("%u MSG Received! DATA: %llu\r\n", squence_num, time);
-            
-            /*  Get diagnostic to our local buffer. */
-            dwt_readdiagnostics(&diagnostics);
-            printf("FP: %d, STD_NOISE: %d, MAX_NOISE: %d \r\n", diagnostics.firstPath, diagnostics.stdNoise, diagnostics.maxNoise);
-            
-            /*  Get CIR to our local buffer. */
-            copyCIRToBuffer((uint8 *) cir_buffer, 4*CIR_SAMPLES);
-
-            printf("CIR Real: ");
-            for (i = 0; i < CIR_SAMPLES; i++)
+            if (stream_dest != NULL)
             {
-                printf("%04X ", cir[i].real);
+                cir_stream_getstats(&rx->stream, &stream_stats);
+                printf("%u: stream: %llu batches, %llu records, %llu kB (%llu kB raw), dropped %llu batches\r\n", i,
+                       (unsigned long long) stream_stats.batches, (unsigned long long) stream_stats.records,
+                       (unsigned long long) (stream_stats.bytes / 1024), (unsigned long long) (stream_stats.raw_bytes / 1024),
+                       (unsigned long long) stream_stats.dropped);
             }
-            printf("\n");
 
-            printf("CIR Imaginary: ");
-            for (i = 0; i < CIR_SAMPLES; i++)
+            if (max_frames != 0 && stats.produced + stats.drops >= max_frames)
             {
-                 printf("%04X ", cir[i].img);
+                done++;
             }
-            
-            char filename[32];
-            snprintf(filename, 31, "time_%llu.csv", time);
-            saveInfoToFile(filename, time, cir, &diagnostics);
-            
-            printf("\n");
         }
-        else
-        {
-            /* Clear RX error events in the DW1000 status register. */
-            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
+    }
+    while (done < num_devs);
 
-            /* Reset RX to properly reinitialise LDE operation. */
-            dwt_rxreset();
-        }
+    for (i = 0; i < num_devs; i++)
+    {
+        dw1000_dev_select(rx_devs[i].dev);
+        s = decamutexon();
+        dwt_forcetrxoff();
+        decamutexoff(s);
     }
-    
+
+    /* Let the writers drain what is left in the rings. */
+    running = 0;
+    for (i = 0; i < num_devs; i++)
+    {
+        rx = &rx_devs[i];
+        dw1000_dev_select(rx->dev);
+        irq_event_signal();
+        pthread_join(rx->writer_thread, NULL);
+        cir_ring_free(&rx->ring);
+    }
+
     printf("End sample\n");
-    cir = NULL;
-    free(cir_buffer);
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rx_ok_cb()
+ *
+ * @brief Callback to process RX good frame events
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void rx_ok_cb(const dwt_cb_data_t *cb_data)
+{
+    /* Called on the IRQ thread of the receiver, which has it selected. */
+    rx_dev_t *rx = &rx_devs[dw1000_dev_index(dw1000_dev_current())];
+    uint16 cir_len = cir_length(&profile.config);
+    cir_frame_t *frame;
+
+    status_reg = cb_data->status;
+
+    /* Drop foreign frames on their frame control, which dwt_isr() has already read, before anything else is read. See NOTE 20 below. */
+    if (filter_on && !frame_filter_accept(&filter, cb_data))
+    {
+        rx->filtered++;
+        return;
+    }
+
+    /* The ring is full: the writer is behind, the frame is counted in the ring drops. */
+    frame = cir_ring_claim(&rx->ring);
+    if (frame == NULL)
+    {
+        rx->rx_seq++;
+        return;
+    }
+
+    frame->seq = rx->rx_seq++;
+    frame->status = cb_data->status;
+    clock_gettime(CLOCK_MONOTONIC, &frame->host_time);
+
+    /* Everything must be read before returning: dwt_isr() toggles the RX buffer afterwards and the accumulator is overwritten by the next
+     * frame. Frame data, timestamps and diagnostics all come in one SPI message. See NOTE 9 below. */
+    frame->length = (cb_data->datalength > CIR_FRAME_DATA_MAX) ? CIR_FRAME_DATA_MAX : cb_data->datalength;
+    dwt_readrxframe(&frame->info, frame->data, frame->length, 0);
+    if (frame->length == cb_data->datalength)
+    {
+        spi_check_frame(frame->data, frame->length);
+    }
+
+    /* The clock offset of a beacon is only in the carrier integrator until the next frame. See NOTE 18 below. */
+    frame->carrier_int = 0;
+    if (sync_on && frame->length >= TS_IDX + sizeof(uint64) && frame->data[0] == CLOCK_SYNC_BEACON_TYPE)
+    {
+        frame->carrier_int = dwt_readcarrierintegrator();
+    }
+
+    /*  Get CIR to the frame record, around the first path index just read with the diagnostics when windowing. See NOTE 2 and 6 below. */
+    if (cir_window)
+    {
+        frame->first_tap = ((frame->info.diag.firstPath >> 6) % cir_len + cir_len - cir_pre) % cir_len;
+        frame->num_taps = cir_window;
+        dwt_readcirwindow(frame->cir, frame->first_tap, frame->num_taps, cir_len);
+    }
+    else
+    {
+        frame->first_tap = 0;
+        frame->num_taps = CIR_SAMPLES;
+        dwt_readcir(frame->cir, frame->first_tap, frame->num_taps);
+    }
+
+    /* The IRQ thread runs with the same lock as decamutexon(), the reading can't change under it. */
+    frame->temp_cdeg = rx->temp_cdeg;
+    frame->vbat_mv = rx->vbat_mv;
+
+    cir_ring_publish(&rx->ring);
+    TELEM_MARK(TELEM_ENQUEUE);
+    irq_event_signal();
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rx_err_cb()
+ *
+ * @brief Callback to process RX error and timeout events
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void rx_err_cb(const dwt_cb_data_t *cb_data)
+{
+    /* Nothing else to do: dwt_isr() has already cleared the events and restarted the receiver. */
+    status_reg = cb_data->status;
 }
 
 /*****************************************************************************************************************************************************
@@ -303,21 +972,99 @@ int main(void)
  *
  * 1. In this example, maximum frame length is set to 127 bytes which is 802.15.4 UWB standard maximum frame length. DW1000 supports an extended
  *    frame length (up to 1023 bytes long) mode which is not used in this example.
- * 2. Accumulator values are complex numbers: one 16-bit integer for real part and one 16-bit value for imaginary part, for each sample. In this
- *    example, we chose to read 3 values below the first path index and 3 values above. It must be noted that the first byte read when accessing the
- *    accumulator memory is always garbage and must be discarded, that is why the data length to read is increased by one byte here.
+ * 2. Accumulator values are complex numbers: one 16-bit signed integer for real part and one 16-bit signed value for imaginary part, for each
+ *    sample. The first byte read when accessing the accumulator memory is always garbage and must be discarded: dwt_readcir() drops it in the SPI
+ *    layer and reads the requested taps in as few SPI transactions as possible, with the accumulator clocks forced on only once.
  * 3. In this example, LDE microcode is loaded even if timestamps are not used because diagnostics values are computed during LDE execution. If LDE is
  *    not loaded and running, dwt_readdiagnostics will return all 0 values.
- * 4. Manual reception activation is performed here but DW1000 offers several features that can be used to handle more complex scenarios or to
- *    optimise system's overall performance (e.g. timeout after a given time, automatic re-enabling of reception in case of errors, etc.).
- * 5. We use polled mode of operation here to keep the example as simple as possible but RXFCG and error/timeout status events can be used to generate
- *    interrupts. Please refer to DW1000 User Manual for more details on "interrupts".
+ * 4. Reception is activated only once. With double buffering the DW1000 receives the next frame into the second RX buffer while the host reads
+ *    the first one, and with automatic re-enabling the receiver stays on after each frame. dwt_isr() resets the receiver after errors and overruns
+ *    and, in this mode, turns it on again. The accumulator is not double buffered, so the CIR must be read before the receiver completes the next
+ *    frame: this is why everything is read from the callback.
+ * 5. RXFCG and error/timeout events are signalled on the DW1000 IRQ line instead of polling SYS_STATUS over SPI. irq_init() services the line on its
+ *    own thread by calling dwt_isr(), which clears the events, resets the receiver after errors and calls the registered callbacks. That thread is
+ *    the capture thread: rx_ok_cb() only does SPI reads into a preallocated record of a single producer / single consumer ring (see cir_ring.h) and
+ *    never blocks. The writer thread drains the ring and does all the printing and file I/O, so a slow disk only fills the ring. When the ring is
+ *    full new frames are dropped and counted. Any SPI access from the main thread is done with the driver mutex held.
  * 6. Here we chose to read only a few values around the first path index but it is possible and can be useful to get all accumulator values, using
  *    the relevant offset and length parameters. Reading the whole accumulator will require 4064 bytes of memory. First path value gotten from
  *    dwt_readdiagnostics is a 10.6 bits fixed point value calculated by the DW1000. By dividing this value by 64, we end up with the integer part of
  *    it. This value can be used to access the accumulator samples around the calculated first path index as it is done here.
+ *    With -w pre:post, each frame gets the window [firstPath/64 - pre, firstPath/64 + post], located from the first path index that
+ *    dwt_readrxframe() has just read (RX_TIME_FP_INDEX) and read with dwt_readcirwindow(). The CIR is circular: a window running past either end
+ *    wraps around, so tap i of a record is accumulator tap (first_tap + i) % 1016 (992 at 16 MHz PRF). A 64:128 window moves 772 bytes instead of
+ *    4064 for the full CIR, about a fifth of the SPI time per frame.
  * 7. Event counters are never reset in this example but this can be done by re-enabling them (i.e. calling again dwt_configeventcounters with
- *    "enable" parameter set).
+ *    "enable" parameter set). Frames lost because both RX buffers were still full are counted in OVER.
  * 8. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
  *    DW1000 API Guide for more details on the DW1000 driver functions.
+ * 9. dwt_readrxframe() queues the RX_TIME, LDE_THRESH, RX_FQUAL and RX_FINFO registers and the RX buffer as one batch (see
+ *    dwt_readfromdevicebatch()), which the platform sends as a single SPI message with chip select released between the reads. This replaces the
+ *    separate dwt_readrxdata(), dwt_readdiagnostics() (itself 4 reads) and timestamp reads, so a good frame costs one system call instead of ~8.
+ * 10. The ring occupancy, its high watermark and the drop count are reported along with the event counters, so the ring can be sized against the
+ *     burst rates seen: a high watermark close to RING_FRAMES means the ring is too small for the writer. OVER counts frames lost on the DW1000
+ *     side (both RX buffers full), the ring drops count frames lost on the host side.
+ * 11. The writer appends each frame as a binary record (header with diagnostics, timestamps, sequence number and configuration, then the payload
+ *     and the raw int16 I/Q taps, see cir_file.h) to a single file, buffered and written out in 64 kB blocks. This is about a third of the size of
+ *     the equivalent CSV and costs no file creation per frame. Use cir_dump to convert the files to CSV.
+ * 12. Several receivers can capture at once (e.g. for AoA/TDoA), one -d option per DW1000 giving its spidev node (i.e. SPI bus and chip select,
+ *     spi1-2cs provides /dev/spidev1.0 and /dev/spidev1.1), reset and IRQ pins. Each receiver runs as in the single receiver case on its own
+ *     threads: the IRQ thread of a receiver only services that receiver and runs its callbacks with it selected (see dw1000_dev_select()), so
+ *     rx_ok_cb() finds its ring from the selected device. Frames from receiver N go to <prefix>_dN_<index>.cir, with their own sequence numbers.
+ * 13. To tell where frames are lost, the capture path is timed phase by phase (IRQ detected, status cleared, frame and diagnostics read, CIR
+ *     read, enqueued) along with the writer's file appends, into per receiver histograms (see telemetry.h). With -s, a thread publishes them
+ *     once a second with a snapshot of the event counters: a long cir_read points at SPI, a long write with ring drops at the disk, and OVER at
+ *     the receiver running out of RX buffers. The marks compile to nothing with make TELEMETRY=0.
+ * 14. spi_autotune() steps the SPI rate up from 10 MHz to the 20 MHz DW1000 limit, checking each step with DEV_ID reads and TX buffer test
+ *     patterns, and keeps the fastest rate that passes with one step of margin. Twice the rate halves the CIR readout. The FCS of each good frame
+ *     is checked again on the host (spi_check_frame()) and DEV_ID once a second (spi_check()): a mismatch can only come from the SPI bus, and
+ *     steps the rate back down.
+ * 15. The radio configuration comes from a profile (see profiles.h): -P picks a built-in profile or one of the -C file, with optional overrides,
+ *     and profile_get() fills in and checks what depends on the rest (PAC, SFD timeout, TX power). The short preamble 6.8 Mb/s profiles take
+ *     over 10 times less airtime per frame than the default one, at the cost of range. On SIGHUP the file is loaded again and the receivers
+ *     are switched without dwt_initialise(): they are stopped, the writers drain the frames of the old profile, and profile_switch() applies
+ *     the new one before reception is restarted. Records carry the configuration they were received with, so one capture can hold both sides
+ *     of an A/B comparison: edit the profile that -P names in the file and kill -HUP the process.
+ * 16. With -R, the readout after RXFCG is made predictable: rt_init() locks all memory (rings, file buffers and stacks included) so that no page
+ *     fault can happen while capturing, and each IRQ thread runs at a SCHED_FIFO priority, on the CPU given for its receiver (see rt.h). Boot
+ *     with isolcpus=<cpu> to keep everything else off that CPU. The time from the IRQ edge to the end of dwt_isr() is checked against the
+ *     deadline for every IRQ and the misses are reported once a second: with a deadline below the frame period, no miss means no frame could
+ *     have been lost to host latency. The writer threads, which do the file I/O, keep the normal priority.
+ * 17. With -N, the writer threads also serialize the frames as capture file records into batches of about 16 kB (see cir_stream.h) sent to a
+ *     cir_recv aggregator, which writes one series of capture files per node and receiver. Over UDP, the full batches are queued and sent 16 at
+ *     a time with one sendmmsg() call; over TCP the connection is re-established when lost, at most once a second. Batches that can't be sent
+ *     are dropped rather than stalling the writer, which would fill the ring, and they still take a batch sequence number, so cir_recv counts
+ *     them as lost along with those lost on the network; gaps in the record sequence numbers are frames lost before the stream. zlib
+ *     compression (make ZLIB=1, then ,zlib) is worth it on slow links, at some CPU cost on the writer threads.
+ * 18. With -S, each receiver keeps its clock synchronised to a time reference sending beacons (dw1000_tx -B), and every record gets its RX
+ *     timestamp in the timebase of the reference (sync_stamp, see cir_file.h), so the captures of all the receivers line up for TDoA without
+ *     an offline alignment step. For each beacon, rx_ok_cb() also reads the carrier integrator, one more 3-byte SPI read; the writer thread
+ *     feeds the offset between the TX timestamp it carries, delayed by the propagation time given for the receiver, and its RX timestamp to
+ *     a Kalman filter of the clock offset and drift, with the carrier integrator as a direct drift measurement (see clock_sync.h). Outlier
+ *     beacons are rejected. Frames are left without sync_stamp until 3 beacons are in and more than 2 s after the last one; the writer
+ *     reports the drift and the uncertainty of the alignment once a second.
+ * 19. dwt_readtempvbat() waits 1 ms for the SAR ADC, which would hold the device lock, and so the first frame after it, for that long. Instead
+ *     the main loop polls a tempcomp state machine (see tempcomp.h) every 10 ms per receiver: one poll starts a measurement (5 single-byte
+ *     writes), a later one reads it back (one 2-byte read and one write), once a second; the receiver stays on throughout. Every record then
+ *     carries the latest reading, temp_cdeg and vbat_mv (see cir_file.h), so CIR and timing changes can be told apart from thermal drift.
+ *     The PG_DELAY calibration, which stops the receiver, and the TX power compensation are only used by dw1000_tx -K.
+ * 20. Every good frame costs a readout of its data, diagnostics and CIR, foreign traffic included. With -F, frames are filtered out before that
+ *     (see frame_filter.h). For transmitters sending 802.15.4 frames, types=, pan= and addr= configure the frame filtering of the DW1000
+ *     (dwt_enableframefilter(), dwt_setpanid(), dwt_setaddress16()): other frames are rejected in hardware, without an RX good frame event,
+ *     and only show in the ARFE event counter. The blinks and beacons of dw1000_tx have no 802.15.4 addressing and would all be rejected, so
+ *     for them (-F tx) or any other first frame control byte (fc=), the RX callback checks the two frame control bytes that dwt_isr() reads
+ *     anyway and returns at once on a mismatch: no extra SPI access, and the rest of the frame is never read. Both stages can be combined.
+ *     Filtered frames take no sequence number, gaps still only mean frames lost to the ring.
+ * 21. A full CIR is 4064 bytes per frame, mostly noise of a few tens of units away from the first path. With -c delta for the capture files and
+ *     ,delta for the stream, the writer threads compress the taps of each record losslessly (see cir_codec.h): blocks of 8 taps are packed on
+ *     as many bits as their largest value, or their largest difference with the previous tap, needs, which is a few microseconds per CIR,
+ *     NEON assisted where available, well within what one writer thread has to spare. cir_dsp_bench -f <file.cir> reports the ratio and the
+ *     speed on real captures. Records whose taps would not get smaller keep raw taps; cir_dump and cir_reader decompress transparently.
+ * 22. With -M, the writer threads keep a background model of each link (receiver and first frame byte, see cir_model.h): exponentially
+ *     weighted mean and variance of the normalised magnitude |h| / rxPreamCount of each tap around firstPath, and score every frame against
+ *     it before learning it. Instead of every CIR, the event file gets a line when a link enters an event (score at or above the threshold)
+ *     and one when it leaves it, and every report= seconds a summary per link: a few kilobytes per hour instead of gigabytes. With forward,
+ *     only the frames of an event are written to the capture files or the stream, so their CIRs can be looked at later. The model taps must be
+ *     captured: with the default 100 taps from tap 0 there is nothing to align, use -w (e.g. -w 16:64) or the full CIR. The first 1 / alpha
+ *     frames of a link only build its model, so the room should be empty when the capture starts.
  ****************************************************************************************************************************************************/
@@ -0,0 +1,900 @@
+/*! ----------------------------------------------------------------------------
+ *  @file    dw1000_twr_resp.c
+ *  @brief   Single-sided and double-sided two-way ranging with CIR capture
+ *
+ *           Two devices range with each other, the INIT one (initiator) starting every exchange with a poll frame:
+ *               - SS-TWR: poll, then response carrying the poll RX and response TX timestamps. The initiator computes the range.
+ *               - DS-TWR: poll, response, then final frame carrying the poll TX, response RX and final TX timestamps. The RESP one (responder)
+ *                 computes the range.
+ *           Both ends capture the CIR of every frame they receive to binary capture files (see cir_file.h).
+ *
+ * @attention
+ *
+ * Copyright 2015 (c) Decawave Ltd, Dublin, Ireland.
+ *
+ * All rights reserved.
+ *
+ * @author Decawave
+ */
+
+#include <stdio.h>
+#include <stdlib.h> // strtoul
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h> // memcpy
+#include <time.h>
+
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "platform.h"
+#include "cir_ring.h"
+#include "cir_file.h"
+#include "telemetry.h"
+#include "profiles.h"
+#include "rt.h"
+#include "clock_sync.h"
+#include "otp_cache.h"
+
+/* Example application name and version to display on LCD screen. */
+#define APP_NAME "HEADCOUNT TWR v1.0"
+
+/* Communication configuration, selected with -P and -C, the same on both ends. By default EVK1000's default mode (mode 3). See NOTE 7 below. */
+static profile_t profile;
+static const dwt_config_t *config = &profile.config;
+
+/* Default antenna delay values for 64 MHz PRF. See NOTE 1 below. */
+#define TX_ANT_DLY 16436
+#define RX_ANT_DLY 16436
+
+/* Frames used in the ranging process. See NOTE 2 below. */
+static uint8 tx_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x21, 0, 0};
+static uint8 tx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static uint8 tx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x23, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+/* Indexes to access some of the fields in the frames defined above. */
+#define ALL_MSG_COMMON_LEN 10
+#define ALL_MSG_SN_IDX 2
+#define ALL_MSG_FUNC_IDX 9
+#define FUNC_POLL 0x21
+#define FUNC_RESP 0x10
+#define FUNC_FINAL 0x23
+#define RESP_MSG_POLL_RX_TS_IDX 10
+#define RESP_MSG_RESP_TX_TS_IDX 15
+#define FINAL_MSG_POLL_TX_TS_IDX 10
+#define FINAL_MSG_RESP_RX_TS_IDX 15
+#define FINAL_MSG_FINAL_TX_TS_IDX 20
+#define MSG_TS_LEN 5
+
+/* Default period between two exchanges, in microseconds: 100 ranges per second. */
+#define PERIOD_US_DEF 10000
+
+/* Default delay between a frame RX timestamp and the TX of the reply, in microseconds. Used for the response on the responder and for the final
+ * frame on the initiator. It is raised by REPLY_DLY_STEP_US every time the host is too late for it. See NOTE 3 below. */
+#define REPLY_DLY_US_DEF 2700
+#define REPLY_DLY_STEP_US 50
+#define REPLY_DLY_US_MAX 20000
+
+/* Delay between the end of a TX and turning the receiver on for the reply, and how long to wait for the reply, in UWB microseconds (1 uus =
+ * 512/499.2 us). The timeout covers the longest reply delay. */
+#define TX_TO_RX_DLY_UUS 100
+#define RX_TIMEOUT_UUS 30000
+
+/* Delay between reading the system time and the first poll, in microseconds. */
+#define START_MARGIN_US 2000
+
+/* Conversion factor between microseconds and device time units: 1 us = 499.2 * 128 = 63897.6 device time units. */
+#define US_TO_DWT_TIME(us) (((uint64) (us) * 638976) / 10)
+
+/* Device time is a 40-bit counter, and delayed TX only uses its upper 31 bits (the low 9 bits are ignored by the DW1000). */
+#define DWT_TIME_MASK 0xFFFFFFFFFFULL
+#define DWT_DLY_MASK  0xFFFFFFFE00ULL
+
+/* Speed of light in air, in metres per second. */
+#define SPEED_OF_LIGHT 299702547
+
+/* Ring of captured frames between rx_ok_cb() and the main loop, must be a power of two. See NOTE 4 below. */
+#define RING_FRAMES 64
+
+/* Capture files <prefix>_<index>.cir, with the prefix exp<exp_number>_I or exp<exp_number>_R. */
+#define ROTATE_MB 64
+
+typedef unsigned long long uint64;
+typedef signed long long int64;
+
+/* Range computed from a captured frame, if any, kept next to it in the ring. */
+typedef struct
+{
+    int valid;
+    double tof; /* Time of flight, in seconds. */
+} twr_slot_t;
+
+static cir_ring_t ring;
+static twr_slot_t slots[RING_FRAMES];
+
+/* Used instead of a ring record when the ring is full, so that the exchange still goes on. */
+static cir_frame_t scratch_frame;
+
+/* Host side sequence number of the next captured frame, dropped frames included. */
+static uint32 rx_seq = 0;
+
+/* Settings, see usage(). */
+static int initiator = 0;
+static int double_sided = 1;
+static unsigned long max_exchanges = 0;
+static unsigned long period_us = PERIOD_US_DEF;
+static uint16 tx_ant_dly = TX_ANT_DLY;
+static uint16 rx_ant_dly = RX_ANT_DLY;
+static uint16 num_taps;
+static int verbose = 0;
+static const char *stats_dest = NULL;
+static rt_config_t rt_config;
+
+/* Ranging state, only used from the IRQ thread once started. */
+static uint8 msg_seq = 0;                       /* Sequence number of the current exchange, in all its frames. */
+static uint64 poll_tx_time;                     /* Scheduled device time of the current poll. */
+static uint64 poll_tx_ts, resp_rx_ts;           /* Initiator timestamps. */
+static uint64 poll_rx_ts, resp_tx_ts;           /* Responder timestamps. */
+static int final_pending = 0;                   /* Initiator: the final frame is on its way. */
+static unsigned long reply_dly_us = REPLY_DLY_US_DEF;
+
+/* Exchange counters, written by the IRQ thread and reported by the main loop. */
+static volatile unsigned long exchanges = 0;
+static volatile unsigned long timeouts = 0;
+static volatile unsigned long rx_errors = 0;
+static volatile unsigned long late_tx = 0;
+
+/* Cleared by the main loop to stop starting new exchanges. */
+static volatile int running = 1;
+
+/***** Function declarations *****/
+
+static void start_poll(void);
+static void next_poll(void);
+static void rx_listen(void);
+static void tx_done_cb(const dwt_cb_data_t *cb_data);
+static void rx_ok_cb(const dwt_cb_data_t *cb_data);
+static void rx_to_cb(const dwt_cb_data_t *cb_data);
+static void rx_err_cb(const dwt_cb_data_t *cb_data);
+static uint64 get_system_timestamp_u64(void);
+static void msg_set_ts(uint8 *ts_field, uint64 ts);
+static uint64 msg_get_ts(const uint8 *ts_field);
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-P profile] [-C profile_file] [-m ss|ds] [-n exchanges] [-p period_us] [-d reply_us] [-c taps] [-t tx_ant_dly] [-r rx_ant_dly]\r\n"
+           "       [-R rt] [-s stats] [-v] INIT|RESP exp_number\r\n", name);
+    printf("  -P profile     radio profile, optionally with key=value overrides (default %s), built-in:", PROFILE_DEFAULT);
+    profile_list(stdout);
+    printf("  -C file        load the profiles of a file\r\n");
+    printf("  -m ss|ds       single-sided or double-sided (default) TWR, the same on both ends\r\n");
+    printf("  -n exchanges   number of exchanges to run, 0 (default) to run forever\r\n");
+    printf("  -p period_us   time between two polls, initiator only (default %d)\r\n", PERIOD_US_DEF);
+    printf("  -d reply_us    initial reply delay after a frame RX timestamp (default %d), raised automatically when too short\r\n",
+           REPLY_DLY_US_DEF);
+    printf("  -c taps        number of CIR taps captured per frame (default all)\r\n");
+    printf("  -t tx_ant_dly  TX antenna delay, in device time units (default %d)\r\n", TX_ANT_DLY);
+    printf("  -r rx_ant_dly  RX antenna delay, in device time units (default %d)\r\n", RX_ANT_DLY);
+    printf("  -R rt          run the exchange in real time: priority[,cpu=N][,deadline=us], e.g. 80,cpu=3, see NOTE 8 below\r\n");
+    printf("  -s stats       export phase latency histograms and event counters to a file, or a unix:<path> socket\r\n");
+    printf("  -v             print a line per range\r\n");
+}
+
+/**
+ * Application entry point.
+ */
+int main(int argc, char *argv[])
+{
+    cir_file_t cir_file;
+    char prefix[CIR_FILE_PATH_MAX];
+    cir_ring_stats_t stats;
+    irq_stats_t irq_stats;
+    cir_frame_t *frame;
+    twr_slot_t *slot;
+    struct timespec report, now;
+    unsigned long ranges = 0;
+    double dist_sum = 0;
+    uint64 tx_stamp;
+    uint64_t t0;
+    const char *profile_spec = PROFILE_DEFAULT;
+    const char *profile_path = NULL;
+    int taps_set = 0;
+    decaIrqStatus_t s;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "P:C:m:n:p:d:c:t:r:R:s:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'P':
+            profile_spec = optarg;
+            break;
+        case 'C':
+            profile_path = optarg;
+            break;
+        case 'm':
+            if (strcmp(optarg, "ss") != 0 && strcmp(optarg, "ds") != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            double_sided = (strcmp(optarg, "ds") == 0);
+            break;
+        case 'n':
+            max_exchanges = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            period_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            reply_dly_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            num_taps = strtoul(optarg, NULL, 0);
+            taps_set = 1;
+            break;
+        case 't':
+            tx_ant_dly = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            rx_ant_dly = strtoul(optarg, NULL, 0);
+            break;
+        case 'R':
+            if (rt_parse(optarg, &rt_config) != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 's':
+            stats_dest = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 2 || (strcmp(argv[optind], "INIT") != 0 && strcmp(argv[optind], "RESP") != 0) || num_taps > CIR_FRAME_TAPS_MAX
+        || reply_dly_us > REPLY_DLY_US_MAX || period_us == 0 || US_TO_DWT_TIME(period_us) >= (DWT_TIME_MASK >> 1))
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    initiator = (strcmp(argv[optind], "INIT") == 0);
+
+    if ((profile_path != NULL && profile_load(profile_path) < 0) || profile_get(profile_spec, &profile) != 0)
+    {
+        exit(1);
+    }
+    profile_print(stdout, &profile);
+    if (!taps_set)
+    {
+        num_taps = (config->prf == DWT_PRF_16M) ? DWT_CIR_LEN_PRF16 : DWT_CIR_LEN_PRF64;
+    }
+
+    snprintf(prefix, sizeof(prefix), "exp%s_%s", argv[optind + 1], initiator ? "I" : "R");
+    if (cir_file_open(&cir_file, prefix, ROTATE_MB * 1024 * 1024, config) != 0)
+    {
+        printf("Unable to create the capture file\r\n");
+        exit(1);
+    }
+
+    /* Lock everything in memory before anything is allocated. See NOTE 8 below. */
+    if (rt_init(&rt_config) != 0)
+    {
+        exit(1);
+    }
+
+    /* All frame records are allocated up front, nothing is allocated while ranging. */
+    if (cir_ring_init(&ring, RING_FRAMES) != 0)
+    {
+        printf("Could not allocate memory\r\n");
+        exit(1);
+    }
+
+    /* Start with board specific hardware init. */
+    hardware_init();
+
+    /* Reset and initialise DW1000, with the OTP calibration values cached by earlier runs (see otp_cache.h).
+     * For initialisation, DW1000 clocks must be temporarily set to crystal speed. After initialisation SPI rate can be increased for optimum
+     * performance. */
+    reset_DW1000(); /* Target specific drive of RSTn line into DW1000 low for a period. */
+    spi_set_rate_low();
+    if (otp_cache_initialise(DWT_LOADUCODE) == DWT_ERROR)
+    {
+        printf("Unable to initialize UCODE\r\n");
+        exit(1);
+    }
+
+    /* Run the SPI as fast as this wiring reliably allows, see spi_autotune(). */
+    if (spi_autotune() < 0)
+    {
+        printf("Unable to set the SPI rate\r\n");
+        exit(1);
+    }
+
+    /* Configure DW1000: dwt_configure() and the TX RF settings of the profile. */
+    profile_apply(&profile);
+
+    /* Apply default antenna delay value. See NOTE 1 below. */
+    dwt_setrxantennadelay(rx_ant_dly);
+    dwt_settxantennadelay(tx_ant_dly);
+
+    /* The whole exchange runs from the callbacks, on the IRQ thread. See NOTE 4 below. */
+    dwt_setcallbacks(&tx_done_cb, &rx_ok_cb, &rx_to_cb, &rx_err_cb);
+    dwt_setinterrupt(DWT_INT_TFRS | DWT_INT_RFCG | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL | DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_SFDT
+                     | DWT_INT_ARFE, 1);
+    if (irq_init() != 0)
+    {
+        printf("Unable to set up the IRQ line\r\n");
+        exit(1);
+    }
+
+    /* Phase latencies and event counters, see telemetry.h. */
+    if (stats_dest != NULL)
+    {
+        dwt_configeventcounters(1);
+        if (telem_start(stats_dest, TELEM_EXPORT_PERIOD_MS) != 0)
+        {
+            printf("Unable to export the telemetry\r\n");
+            exit(1);
+        }
+    }
+
+    printf("%s: %s-TWR %s\r\n", APP_NAME, double_sided ? "DS" : "SS", initiator ? "initiator" : "responder");
+
+    /* Start the first exchange, or start listening for it. */
+    s = decamutexon();
+    if (initiator)
+    {
+        poll_tx_time = (get_system_timestamp_u64() + US_TO_DWT_TIME(START_MARGIN_US)) & DWT_DLY_MASK;
+        start_poll();
+    }
+    else
+    {
+        rx_listen();
+    }
+    decamutexoff(s);
+
+    clock_gettime(CLOCK_MONOTONIC, &report);
+
+    /* Save the captured frames and report ranges, once a second or per range with -v. */
+    while (running || cir_ring_peek(&ring) != NULL)
+    {
+        frame = cir_ring_peek(&ring);
+        if (frame == NULL)
+        {
+            /* Woken up by rx_ok_cb(). After 100 ms without frames, write out what has been buffered so far. */
+            if (irq_event_wait(100) < 0)
+            {
+                cir_file_flush(&cir_file);
+            }
+        }
+        else
+        {
+            slot = &slots[frame - ring.frames];
+
+            /* Store the TX timestamp carried by the frame with it: response TX in a response, final TX in a final frame. */
+            tx_stamp = 0;
+            if (frame->length > ALL_MSG_COMMON_LEN && frame->data[ALL_MSG_FUNC_IDX] == FUNC_RESP
+                && frame->length >= RESP_MSG_RESP_TX_TS_IDX + MSG_TS_LEN)
+            {
+                tx_stamp = msg_get_ts(&frame->data[RESP_MSG_RESP_TX_TS_IDX]);
+            }
+            else if (frame->length > ALL_MSG_COMMON_LEN && frame->data[ALL_MSG_FUNC_IDX] == FUNC_FINAL
+                     && frame->length >= FINAL_MSG_FINAL_TX_TS_IDX + MSG_TS_LEN)
+            {
+                tx_stamp = msg_get_ts(&frame->data[FINAL_MSG_FINAL_TX_TS_IDX]);
+            }
+
+            if (slot->valid)
+            {
+                ranges++;
+                dist_sum += slot->tof * SPEED_OF_LIGHT;
+                if (verbose)
+                {
+                    printf("%lu: %u DIST: %3.3f m\r\n", frame->seq, frame->data[ALL_MSG_SN_IDX], slot->tof * SPEED_OF_LIGHT);
+                }
+            }
+
+            t0 = TELEM_NOW();
+            if (cir_file_append(&cir_file, frame, tx_stamp) != 0)
+            {
+                printf("Unable to write the capture file\r\n");
+            }
+            TELEM_RECORD(TELEM_WRITE, TELEM_NOW() - t0);
+
+            cir_ring_release(&ring);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - report.tv_sec) * 1000000000LL + (now.tv_nsec - report.tv_nsec) >= 1000000000LL)
+        {
+            cir_ring_getstats(&ring, &stats);
+            s = decamutexon();
+            spi_check();
+            decamutexoff(s);
+            printf("exchanges: %lu, ranges: %lu (mean %3.3f m), timeouts: %lu, errors: %lu, late: %lu, reply delay: %lu us, drops: %lu\r\n",
+                   exchanges, ranges, ranges ? dist_sum / ranges : 0.0, timeouts, rx_errors, late_tx, reply_dly_us, stats.drops);
+            if (rt_enabled())
+            {
+                irq_get_stats(&irq_stats);
+                printf("RT deadline missed by %lu of %lu IRQs, longest %lu us\r\n", (unsigned long) irq_stats.missed, (unsigned long) irq_stats.irqs,
+                       (unsigned long) irq_stats.max_us);
+            }
+            report = now;
+            ranges = 0;
+            dist_sum = 0;
+        }
+
+        if (max_exchanges != 0 && exchanges >= max_exchanges)
+        {
+            running = 0;
+        }
+    }
+
+    s = decamutexon();
+    dwt_forcetrxoff();
+    decamutexoff(s);
+
+    cir_file_close(&cir_file);
+    cir_ring_free(&ring);
+
+    printf("End ranging\r\n");
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn start_poll()
+ *
+ * @brief Send the poll frame of the next exchange at poll_tx_time and wait for the response. If the host is too late for that, the poll is
+ *        moved to the first slot still ahead of the device time.
+ *
+ * @param  none
+ *
+ * @return  none
+ */
+static void start_poll(void)
+{
+    tx_poll_msg[ALL_MSG_SN_IDX] = msg_seq;
+    dwt_writetxdata(sizeof(tx_poll_msg), tx_poll_msg, 0); /* Zero offset in TX buffer. */
+    dwt_writetxfctrl(sizeof(tx_poll_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+
+    /* The receiver is turned on by the DW1000 itself after the poll, and the response must come within RX_TIMEOUT_UUS. */
+    dwt_setrxaftertxdelay(TX_TO_RX_DLY_UUS);
+    dwt_setrxtimeout(RX_TIMEOUT_UUS);
+
+    dwt_setdelayedtrxtime((uint32) (poll_tx_time >> 8));
+    while (dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) == DWT_ERROR)
+    {
+        late_tx++;
+        poll_tx_time = (get_system_timestamp_u64() + US_TO_DWT_TIME(START_MARGIN_US)) & DWT_DLY_MASK;
+        dwt_setdelayedtrxtime((uint32) (poll_tx_time >> 8));
+    }
+
+    /* The poll TX timestamp is known without reading it back: the scheduled time plus the antenna delay. */
+    poll_tx_ts = (poll_tx_time + tx_ant_dly) & DWT_TIME_MASK;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn next_poll()
+ *
+ * @brief Close the current exchange on the initiator, successful or not, and start the next one one period after the previous poll.
+ *
+ * @param  none
+ *
+ * @return  none
+ */
+static void next_poll(void)
+{
+    final_pending = 0;
+    exchanges++;
+    if (!running || (max_exchanges != 0 && exchanges >= max_exchanges))
+    {
+        return;
+    }
+
+    msg_seq++;
+    poll_tx_time = (poll_tx_time + US_TO_DWT_TIME(period_us)) & DWT_DLY_MASK;
+    start_poll();
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rx_listen()
+ *
+ * @brief Turn the receiver on for the next poll, on the responder.
+ *
+ * @param  none
+ *
+ * @return  none
+ */
+static void rx_listen(void)
+{
+    dwt_setrxtimeout(0);
+    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn send_reply()
+ *
+ * @brief Send a reply frame reply_dly_us after the RX timestamp of the frame it answers. If the host is too late for that, the reply delay is
+ *        raised for the next exchanges. See NOTE 3 below.
+ *
+ * @param  msg - reply frame, with a TX timestamp field at ts_idx to fill in
+ * @param  len - length of the reply frame, CRC included
+ * @param  ts_idx - index of the TX timestamp field in msg
+ * @param  rx_ts - RX timestamp of the frame replied to
+ * @param  mode - DWT_START_TX_DELAYED, or'ed with DWT_RESPONSE_EXPECTED if a frame is expected after the reply
+ * @param  tx_ts - where to return the TX timestamp of the reply
+ *
+ * @return  1 if the reply is on its way, 0 if it was too late
+ */
+static int send_reply(uint8 *msg, uint16 len, int ts_idx, uint64 rx_ts, uint8 mode, uint64 *tx_ts)
+{
+    uint64 tx_time = (rx_ts + US_TO_DWT_TIME(reply_dly_us)) & DWT_DLY_MASK;
+
+    *tx_ts = (tx_time + tx_ant_dly) & DWT_TIME_MASK;
+    msg[ALL_MSG_SN_IDX] = msg_seq;
+    msg_set_ts(&msg[ts_idx], *tx_ts);
+
+    dwt_writetxdata(len, msg, 0); /* Zero offset in TX buffer. */
+    dwt_writetxfctrl(len, 0, 1); /* Zero offset in TX buffer, ranging. */
+
+    if (mode & DWT_RESPONSE_EXPECTED)
+    {
+        dwt_setrxaftertxdelay(TX_TO_RX_DLY_UUS);
+        dwt_setrxtimeout(RX_TIMEOUT_UUS);
+    }
+
+    dwt_setdelayedtrxtime((uint32) (tx_time >> 8));
+    if (dwt_starttx(mode) == DWT_ERROR)
+    {
+        late_tx++;
+        if (reply_dly_us + REPLY_DLY_STEP_US <= REPLY_DLY_US_MAX)
+        {
+            reply_dly_us += REPLY_DLY_STEP_US;
+        }
+        return 0;
+    }
+
+    return 1;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn is_msg()
+ *
+ * @brief Check that a received frame is a given frame of the current exchange.
+ *
+ * @param  frame - received frame
+ * @param  func - function code of the expected frame
+ * @param  len - length of the expected frame, CRC included
+ *
+ * @return  1 if it is the expected frame, 0 otherwise
+ */
+static int is_msg(const cir_frame_t *frame, uint8 func, uint16 len)
+{
+    return frame->length == len && frame->data[ALL_MSG_FUNC_IDX] == func && frame->data[ALL_MSG_SN_IDX] == msg_seq;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn clock_offset_ratio()
+ *
+ * @brief Get the clock offset of the remote device relative to the local one, from the carrier integrator of the last frame received.
+ *
+ * @param  none
+ *
+ * @return  the clock offset ratio, positive when the remote clock is faster
+ */
+static double clock_offset_ratio(void)
+{
+    return clock_sync_carrier_ratio(config, dwt_readcarrierintegrator());
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tx_done_cb()
+ *
+ * @brief Callback to process TX confirmation events
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void tx_done_cb(const dwt_cb_data_t *cb_data)
+{
+    (void) cb_data;
+
+    if (initiator)
+    {
+        /* The final frame ends a DS-TWR exchange. After a poll the receiver is already on for the response. */
+        if (final_pending)
+        {
+            next_poll();
+        }
+    }
+    else if (!double_sided)
+    {
+        /* The SS-TWR response ends the exchange. In DS-TWR the receiver is already on for the final frame. */
+        exchanges++;
+        rx_listen();
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rx_ok_cb()
+ *
+ * @brief Callback to process RX good frame events. The reply, if any, is scheduled first and the CIR is read while it waits for its time.
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void rx_ok_cb(const dwt_cb_data_t *cb_data)
+{
+    cir_frame_t *frame;
+    twr_slot_t *slot;
+    twr_slot_t scratch_slot;
+    uint64 rx_ts;
+    uint64 final_tx_ts;
+    int64 ra, rb, da, db;
+    int replied = 0;
+
+    /* The ring is full: the main loop is behind, the frame is counted in the ring drops but still used for ranging. */
+    frame = cir_ring_claim(&ring);
+    if (frame == NULL)
+    {
+        frame = &scratch_frame;
+        slot = &scratch_slot;
+    }
+    else
+    {
+        slot = &slots[frame - ring.frames];
+    }
+
+    frame->seq = rx_seq++;
+    frame->status = cb_data->status;
+    clock_gettime(CLOCK_MONOTONIC, &frame->host_time);
+
+    /* Frame data, timestamps and diagnostics all come in one SPI message. */
+    frame->length = (cb_data->datalength > CIR_FRAME_DATA_MAX) ? CIR_FRAME_DATA_MAX : cb_data->datalength;
+    dwt_readrxframe(&frame->info, frame->data, frame->length, 0);
+    if (frame->length == cb_data->datalength)
+    {
+        spi_check_frame(frame->data, frame->length);
+    }
+    rx_ts = cir_stamp40(frame->info.rxStamp);
+    slot->valid = 0;
+
+    if (initiator)
+    {
+        if (is_msg(frame, FUNC_RESP, sizeof(tx_resp_msg)))
+        {
+            resp_rx_ts = rx_ts;
+
+            if (double_sided)
+            {
+                /* Send the final frame with all the initiator timestamps. Its own TX timestamp is filled in by send_reply(). */
+                msg_set_ts(&tx_final_msg[FINAL_MSG_POLL_TX_TS_IDX], poll_tx_ts);
+                msg_set_ts(&tx_final_msg[FINAL_MSG_RESP_RX_TS_IDX], resp_rx_ts);
+                replied = send_reply(tx_final_msg, sizeof(tx_final_msg), FINAL_MSG_FINAL_TX_TS_IDX, resp_rx_ts, DWT_START_TX_DELAYED,
+                                     &final_tx_ts);
+                final_pending = replied;
+            }
+            else
+            {
+                /* SS-TWR: the responder turnaround is corrected with the clock offset measured on its response. See NOTE 5 below. */
+                ra = (int64) ((resp_rx_ts - poll_tx_ts) & DWT_TIME_MASK);
+                db = (int64) ((msg_get_ts(&frame->data[RESP_MSG_RESP_TX_TS_IDX]) - msg_get_ts(&frame->data[RESP_MSG_POLL_RX_TS_IDX]))
+                              & DWT_TIME_MASK);
+                slot->tof = ((ra - db * (1 - clock_offset_ratio())) / 2.0) * DWT_TIME_UNITS;
+                slot->valid = 1;
+            }
+        }
+        else
+        {
+            rx_errors++;
+        }
+    }
+    else
+    {
+        if (frame->length == sizeof(tx_poll_msg) && frame->data[ALL_MSG_FUNC_IDX] == FUNC_POLL)
+        {
+            /* A poll starts a new exchange, whatever happened to the previous one. */
+            msg_seq = frame->data[ALL_MSG_SN_IDX];
+            poll_rx_ts = rx_ts;
+            msg_set_ts(&tx_resp_msg[RESP_MSG_POLL_RX_TS_IDX], poll_rx_ts);
+            replied = send_reply(tx_resp_msg, sizeof(tx_resp_msg), RESP_MSG_RESP_TX_TS_IDX, poll_rx_ts,
+                                 DWT_START_TX_DELAYED | (double_sided ? DWT_RESPONSE_EXPECTED : 0), &resp_tx_ts);
+        }
+        else if (double_sided && is_msg(frame, FUNC_FINAL, sizeof(tx_final_msg)))
+        {
+            /* DS-TWR with asymmetric reply times. See NOTE 5 below. */
+            ra = (int64) ((msg_get_ts(&frame->data[FINAL_MSG_RESP_RX_TS_IDX]) - msg_get_ts(&frame->data[FINAL_MSG_POLL_TX_TS_IDX]))
+                          & DWT_TIME_MASK);
+            rb = (int64) ((rx_ts - resp_tx_ts) & DWT_TIME_MASK);
+            da = (int64) ((msg_get_ts(&frame->data[FINAL_MSG_FINAL_TX_TS_IDX]) - msg_get_ts(&frame->data[FINAL_MSG_RESP_RX_TS_IDX]))
+                          & DWT_TIME_MASK);
+            db = (int64) ((resp_tx_ts - poll_rx_ts) & DWT_TIME_MASK);
+            slot->tof = ((double) ra * rb - (double) da * db) / (double) (ra + rb + da + db) * DWT_TIME_UNITS;
+            slot->valid = 1;
+            exchanges++;
+        }
+        else
+        {
+            rx_errors++;
+        }
+    }
+
+    /* The accumulator is only overwritten by the next reception, so the CIR can be read while the reply waits for its slot. See NOTE 3
+     * below. */
+    if (frame != &scratch_frame)
+    {
+        frame->first_tap = 0;
+        frame->num_taps = num_taps;
+        dwt_readcir(frame->cir, frame->first_tap, frame->num_taps);
+        cir_ring_publish(&ring);
+        TELEM_MARK(TELEM_ENQUEUE);
+        irq_event_signal();
+    }
+
+    /* Nothing is on its way: the exchange is over, start the next one. */
+    if (!replied)
+    {
+        if (initiator)
+        {
+            next_poll();
+        }
+        else
+        {
+            rx_listen();
+        }
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rx_to_cb()
+ *
+ * @brief Callback to process RX timeout events
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void rx_to_cb(const dwt_cb_data_t *cb_data)
+{
+    (void) cb_data;
+
+    /* dwt_isr() has already reset the receiver. */
+    timeouts++;
+    if (initiator)
+    {
+        next_poll();
+    }
+    else
+    {
+        rx_listen();
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rx_err_cb()
+ *
+ * @brief Callback to process RX error events
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void rx_err_cb(const dwt_cb_data_t *cb_data)
+{
+    (void) cb_data;
+
+    /* dwt_isr() has already reset the receiver. */
+    rx_errors++;
+    if (initiator)
+    {
+        next_poll();
+    }
+    else
+    {
+        rx_listen();
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn get_system_timestamp_u64()
+ *
+ * @brief Get the system time in a 64-bit variable.
+ *
+ * @param  none
+ *
+ * @return  64-bit value of the system time.
+ */
+static uint64 get_system_timestamp_u64(void)
+{
+    uint8 ts_tab[5];
+
+    dwt_readsystime(ts_tab);
+    return cir_stamp40(ts_tab);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn msg_set_ts()
+ *
+ * @brief Fill a timestamp field of a ranging frame with a 40-bit timestamp, least significant byte first.
+ *
+ * @param  ts_field  pointer to the first byte of the timestamp field to fill
+ * @param  ts  timestamp value
+ *
+ * @return  none
+ */
+static void msg_set_ts(uint8 *ts_field, uint64 ts)
+{
+    int i;
+    for (i = 0; i < MSG_TS_LEN; i++)
+    {
+        ts_field[i] = (uint8) ts;
+        ts >>= 8;
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn msg_get_ts()
+ *
+ * @brief Read a 40-bit timestamp field of a ranging frame.
+ *
+ * @param  ts_field  pointer to the first byte of the timestamp field to read
+ *
+ * @return  the timestamp value
+ */
+static uint64 msg_get_ts(const uint8 *ts_field)
+{
+    return cir_stamp40(ts_field);
+}
+
+/*****************************************************************************************************************************************************
+ * NOTES:
+ *
+ * 1. The sum of the values is the TX to RX antenna delay, experimentally determined by a calibration process. Here we use a hard coded typical value
+ *    but, in a real application, each device should have its own antenna delay properly calibrated to get the best possible precision when
+ *    performing range measurements.
+ * 2. The frames used here are Decawave specific ranging frames, complying with the IEEE 802.15.4 standard data frame encoding. The frames are the
+ *    following:
+ *     - a poll frame sent by the initiator to trigger the ranging exchange.
+ *     - a response frame sent by the responder, carrying the poll RX and response TX timestamps (used by SS-TWR).
+ *     - a final frame sent by the initiator in DS-TWR, carrying the poll TX, response RX and final TX timestamps.
+ *    All messages end with a 2-byte checksum automatically set by DW1000. The first 10 bytes of those frames are common and are composed of the
+ *    following fields:
+ *     - byte 0/1: frame control (0x8841 to indicate a data frame using 16-bit addressing).
+ *     - byte 2: sequence number, the same in all the frames of one exchange.
+ *     - byte 3/4: PAN ID (0xDECA).
+ *     - byte 5/6: destination address, hard coded constants to keep the example simple.
+ *     - byte 7/8: source address.
+ *     - byte 9: function code (specific values to indicate which message it is in the ranging process).
+ *    Timestamps are 40-bit values sent on 5 bytes, least significant byte first. The TX timestamps are known before sending: a delayed TX starts
+ *    at the scheduled time, rounded down to 512 device time units, plus the TX antenna delay.
+ * 3. Replies are sent as delayed TX so that their timestamps are known in advance. The delay from the RX timestamp of the frame replied to covers
+ *    the rest of that frame on air after its timestamp (the timestamp marks the end of the SFD), the IRQ thread wake-up and the SPI accesses
+ *    needed to read the frame and write the reply. It is kept as short as the host allows: when the reply cannot be scheduled in time,
+ *    dwt_starttx() fails, the exchange is abandoned and the delay is raised by REPLY_DLY_STEP_US, so after a few exchanges it settles just above
+ *    the actual host turnaround. The CIR is read after the reply is scheduled, which keeps the full accumulator read out of the turnaround. The
+ *    accumulator is not overwritten before the next reception starts: with the default configuration the reply airtime alone is longer than a
+ *    full CIR read at 10 MHz, if taps are lost with faster configurations reduce them with -c.
+ * 4. The exchange runs entirely on the IRQ thread, from the callbacks, so its timing does not depend on the main thread. rx_ok_cb() captures
+ *    every received frame into a record of a single producer / single consumer ring (see cir_ring.h), with the range computed from it next to it
+ *    in slots[]. The main thread drains the ring into the capture files and does all the printing. Polls are scheduled one period apart in
+ *    device time, an exchange that fails (timeout, error, late reply) is simply skipped and the next poll keeps its slot.
+ * 5. The formulas are those of the DW1000 User Manual and of the Decawave APS013 application note. SS-TWR depends on the clock offset between
+ *    the two devices over the responder turnaround, which is estimated from the carrier integrator of the response. DS-TWR with asymmetric
+ *    reply times cancels the clock offset to first order, without requiring the two reply times to be equal.
+ * 6. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
+ *    DW1000 API Guide for more details on the DW1000 driver functions.
+ * 7. The radio configuration comes from a profile (see profiles.h), -P with the same profile on both ends. The antenna delays above were
+ *    calibrated for 64 MHz PRF and the reply delay grows by itself when a slower profile makes the host late for it.
+ * 8. The reply delay has to cover the host's worst case turnaround, from the IRQ edge to the reply being scheduled. With -R the whole exchange
+ *    runs at a SCHED_FIFO priority on the CPU given, with all memory locked (see rt.h), which cuts that worst case enough for reply delays well
+ *    below a millisecond with the fast profiles. IRQs serviced later than the deadline after their edge are reported once a second: -d can be
+ *    lowered as long as there are none and no late replies.
+ ****************************************************************************************************************************************************/
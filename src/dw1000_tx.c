@@ -18,41 +18,94 @@
  * Chenxi Wang <chenxiwa@andrew.cmu.edu>
  */
 
+#define _GNU_SOURCE /* clock_nanosleep() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <signal.h>
 
 #include "deca_device_api.h"
 #include "deca_regs.h"
 #include "platform.h"
+#include "profiles.h"
+#include "rt.h"
+#include "clock_sync.h"
+#include "tdma.h"
+#include "otp_cache.h"
+#include "tempcomp.h"
 
 /* Example application name and version to display on LCD screen. */
 #define APP_NAME "HEADCOUNT TX v1.0"
 
-/* Default communication configuration. We use here EVK1000's default mode (mode 3). */
-static dwt_config_t config = {
-    2,               /* Channel number. */
-    DWT_PRF_64M,     /* Pulse repetition frequency. */
-    DWT_PLEN_1024,   /* Preamble length. Used in TX only. */
-    DWT_PAC32,       /* Preamble acquisition chunk size. Used in RX only. */
-    9,               /* TX preamble code. Used in TX only. */
-    9,               /* RX preamble code. Used in RX only. */
-    1,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
-    DWT_BR_110K,     /* Data rate. */
-    DWT_PHRMODE_STD, /* PHY header mode. */
-    (1025 + 64 - 32) /* SFD timeout (preamble length + 1 + SFD length - PAC size). Used in RX only. */
-};
+/* Communication configuration, selected with -P and -C. By default EVK1000's default mode (mode 3). See NOTE 12 below. */
+static const char *profile_spec = PROFILE_DEFAULT;
+static const char *profile_path = NULL;
+static profile_t profile;
 
+/* Set by SIGHUP to reload the profile file and switch to the profile selected. */
+static volatile sig_atomic_t reload = 0;
 
 /* Index to access to sequence number of the blink frame in the tx_msg array. */
-#define BLINK_FRAME_SN_IDX 1   //not used
+#define BLINK_FRAME_SN_IDX 1
 #define TS_IDX   2   // time_stamp index
+#define TX_FRAME_LEN 12
+
+/* Default inter-frame period, in microseconds. See NOTE 7 below. */
+#define TX_PERIOD_US_DEF 100000
+
+/* Delay between reading the system time and the first frame, in microseconds. It must cover writing the frame to the DW1000. */
+#define TX_START_MARGIN_US 2000
+
+/* Default antenna delay value for 64 MHz PRF. See NOTE 8 below. */
+#define TX_ANT_DLY 16436
+
+/* Conversion factor between microseconds and device time units: 1 us = 499.2 * 128 = 63897.6 device time units. */
+#define US_TO_DWT_TIME(us) (((uint64) (us) * 638976) / 10)
+
+/* Device time is a 40-bit counter, and delayed TX only uses its upper 31 bits (the low 9 bits are ignored by the DW1000). */
+#define DWT_TIME_MASK 0xFFFFFFFFFFULL
+#define DWT_DLY_MASK  0xFFFFFFFE00ULL
+
+/* Set with -T: TDMA coordinator (tdma_slot -1) or member sending in slot tdma_slot. See NOTE 15 below. */
+static const char *tdma_spec = NULL;
+static tdma_config_t tdma;
+static int tdma_slot = -1;
+
+/* Frame received by a TDMA member, written by rx_ok_cb() and rx_err_cb() on the IRQ thread before they signal the main thread. */
+static volatile int rx_result; /* 1 for a beacon, 0 for any other frame, -1 for an RX error or timeout */
+static volatile int rx_done;   /* set by rx_ok_cb() and rx_err_cb() */
+static volatile int tx_done;   /* set by tx_done_cb() */
+static uint64_t rx_beacon_stamp;
+static int32 rx_beacon_carrier;
+static tdma_config_t rx_beacon_layout;
+
+/* Set with -Z: the DW1000 sleeps between frames, with the crystal kept running (DWT_XTAL_EN) for "sleep". See NOTE 16 below. */
+static int sleep_between = 0;
+static uint8 sleep_wake = DWT_WAKE_CS | DWT_SLP_EN;
+
+/* Set with -K: TX power, and PG_DELAY unless sending beacons, compensated for temperature between frames. See NOTE 17 below. */
+static int temp_comp = 0;
+static double temp_threshold = TEMPCOMP_THRESHOLD_DEF;
+static tempcomp_t tempcomp;
+
+/* Host time to write a frame after wake-up, before its preamble starts, with -Z. */
+#define TX_WAKE_MARGIN_US 300
+
+/* Shortest period with -Z, the crystal takes a few ms to start after DEEPSLEEP. */
+#define TX_SLEEP_PERIOD_MIN_US 10000
+
+/* Longest wait for the TX frame sent event with -Z. */
+#define TX_SLEEP_WAIT_MS 100
+
+/* Frames alternate between two halves of the 1024-byte TX buffer, so the next frame can be written while the current one is sent. See NOTE 10 below. */
+#define TX_BUF_OFFSET(seq) (((seq) & 1) ? 512 : 0)
 
-/* Inter-frame delay period, in milliseconds. */
-#define TX_DELAY_MS 2000
+/* Interval between rate reports, in seconds. */
+#define TX_REPORT_S 1
 
 typedef unsigned long long uint64;
 typedef signed long long int64;
@@ -61,81 +114,784 @@ typedef signed long long int64;
 
 static uint64 get_tx_timestamp_u64(void);
 static uint64 get_system_timestamp_u64(void);
+static void tx_done_cb(const dwt_cb_data_t *cb_data);
+static void rx_ok_cb(const dwt_cb_data_t *cb_data);
+static void rx_err_cb(const dwt_cb_data_t *cb_data);
+static int run_member(uint8 *msg, uint16 ant_dly, unsigned long max_frames, int verbose);
+static int run_sleeping(uint8 *msg, uint16 len, uint16 ant_dly, unsigned long period_us, unsigned long max_frames, int verbose);
+static void write_frame(uint8 *msg, uint16 len, uint8 seq, uint64 tx_stamp);
+static double elapsed_s(const struct timespec *start, const struct timespec *end);
+
+/**
+ * Load the profile file if any, then resolve the profile selected.
+ */
+static int load_profile(profile_t *p)
+{
+    if (profile_path != NULL && profile_load(profile_path) < 0)
+    {
+        return -1;
+    }
+    return profile_get(profile_spec, p);
+}
+
+static void sighup_handler(int sig)
+{
+    (void) sig;
+    reload = 1;
+}
+
+/**
+ * Start the temperature compensation of the TX RF settings of the profile, with the TEMPCOMP_* flags given.
+ */
+static void start_tempcomp(uint32 flags)
+{
+    tempcomp_init(&tempcomp, &profile.config, &profile.txconfig, flags);
+    tempcomp.threshold = temp_threshold;
+}
+
+/**
+ * Switch to the profile selected, between two frames. The current profile is kept if the new one does not load.
+ */
+static void switch_profile(void)
+{
+    decaIrqStatus_t s;
+    profile_t next;
+
+    if (load_profile(&next) != 0)
+    {
+        printf("Profile not switched\n");
+        return;
+    }
+    profile = next;
 
+    s = decamutexon();
+    profile_switch(&profile);
+    decamutexoff(s);
+
+    /* The new TX RF settings are the reference from now on. */
+    if (temp_comp)
+    {
+        start_tempcomp(tempcomp.flags);
+    }
+
+    profile_print(stdout, &profile);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-P profile] [-C profile_file] [-n frames] [-p period_us | -r rate_hz] [-a ant_dly] [-B] [-T tdma] [-Z deep|sleep] [-K threshold] [-R rt] [-v]\n", name);
+    printf("  -P profile    radio profile, optionally with key=value overrides (default %s), reselected on SIGHUP, built-in:", PROFILE_DEFAULT);
+    profile_list(stdout);
+    printf("  -C file       load the profiles of a file, reloaded on SIGHUP\n");
+    printf("  -n frames     number of frames to send, 0 (default) to run forever\n");
+    printf("  -p period_us  frame period in device time, in microseconds (default %d)\n", TX_PERIOD_US_DEF);
+    printf("  -r rate_hz    frame rate, in frames per second (same as -p 1000000/rate_hz)\n");
+    printf("  -a ant_dly    TX antenna delay, in device time units (default %d)\n", TX_ANT_DLY);
+    printf("  -B            send clock sync beacons for the receivers (dw1000_rx_cir -S), see NOTE 14 below\n");
+    printf("  -T tdma       TDMA: coord[,slots=N][,slot=us][,gap=us][,guard=us] to send the beacons (%d slots, %d us gap, %d us guard by\n"
+           "                default), or the slot number to send in, see NOTE 15 below\n", TDMA_SLOTS_DEF, TDMA_GAP_US_DEF, TDMA_GUARD_US_DEF);
+    printf("  -Z mode       put the DW1000 to sleep between frames, deep (DEEPSLEEP) or sleep (crystal kept running, faster wake-up), see\n"
+           "                NOTE 16 below\n");
+    printf("  -K threshold  compensate the TX power and PG delay for temperature changes of threshold degrees C (e.g. %.0f), see NOTE 17 below\n",
+           TEMPCOMP_THRESHOLD_DEF);
+    printf("  -R rt         real-time mode: priority[,cpu=N][,deadline=us], e.g. 80,cpu=3 (SCHED_FIFO, locked memory), see NOTE 13 below\n");
+    printf("  -v            read back each TX timestamp and check it against the one sent\n");
+}
 
 /**
  * Application entry point.
  */
-int main(void)
+int main(int argc, char *argv[])
 {
-    uint8 squence_num=0;
-    uint32 exchangeNo = 0;
-    uint32 frame_len = 0;
-    uint32 status_reg = 0;
-    int ret = 0;
-    uint64 time_now = 0;
-    
+    uint8 squence_num = 0;
+    unsigned long max_frames = 0;
+    unsigned long frames = 0;
+    unsigned long late = 0;
+    unsigned long period_us = TX_PERIOD_US_DEF;
+    uint16 ant_dly = TX_ANT_DLY;
+    int verbose = 0;
+    uint64 tx_time;
+    uint64 tx_stamp;
+    uint64 next_stamp;
+    unsigned long report_frames = 0;
+    struct timespec start, report, now;
+    dwt_otpcal_t otp_cal;
+    int otp_cached;
+    rt_config_t rt_config;
+    irq_stats_t irq_stats;
+    decaIrqStatus_t s;
+    int opt;
+
+    memset(&rt_config, 0, sizeof(rt_config));
+
     /* The frame sent in this example is adjusted from an 802.15.4e standard blink. It is a 12-byte frame composed of the following fields:
-     *     - byte 0: frame type (0xC5 for a blink).
+     *     - byte 0: frame type (0xab, or CLOCK_SYNC_BEACON_TYPE with -B).
      *     - byte 1: sequence number, incremented for each new frame.
-     *     - byte 2 -> 9: tx_timestamp
-     *     - byte 10/11: frame check-sum, automatically set by DW1000.  */
-    uint8 tx_msg[] = {0xab, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // size = 1+1+8+2 = 12
+     *     - byte 2 -> 9: tx_timestamp, the 40-bit device time at which the frame leaves the antenna. See NOTE 7 below.
+     *     - byte 10/11: frame check-sum, automatically set by DW1000.
+     * TDMA beacons carry the superframe layout before the check-sum, see tdma.h. */
+    uint8 tx_msg[TDMA_BEACON_LEN] = {0xab, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // size = 1+1+8+2 = 12, TDMA beacons are longer
+    uint16 tx_len = TX_FRAME_LEN;
+
+    while ((opt = getopt(argc, argv, "P:C:n:p:r:a:BT:Z:K:R:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'P':
+            profile_spec = optarg;
+            break;
+        case 'C':
+            profile_path = optarg;
+            break;
+        case 'n':
+            max_frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            period_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            period_us = strtoul(optarg, NULL, 0);
+            period_us = period_us ? 1000000 / period_us : 0;
+            break;
+        case 'a':
+            ant_dly = strtoul(optarg, NULL, 0);
+            break;
+        case 'B':
+            tx_msg[0] = CLOCK_SYNC_BEACON_TYPE;
+            break;
+        case 'T':
+            tdma_spec = optarg;
+            if (tdma_parse(optarg, &tdma, &tdma_slot) != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'Z':
+            sleep_between = 1;
+            if (strcmp(optarg, "sleep") == 0)
+            {
+                sleep_wake |= DWT_XTAL_EN;
+            }
+            else if (strcmp(optarg, "deep") != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'K':
+            temp_comp = 1;
+            temp_threshold = strtod(optarg, NULL);
+            if (temp_threshold <= 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'R':
+            if (rt_parse(optarg, &rt_config) != 0)
+            {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    /* Half the counter period is the furthest a delayed TX can be scheduled. */
+    if (period_us == 0 || US_TO_DWT_TIME(period_us) >= (DWT_TIME_MASK >> 1))
+    {
+        printf("Period out of range\n");
+        exit(1);
+    }
+
+    /* The device time starts over at each wake-up, so frames can't be scheduled on a common timebase. */
+    if (sleep_between && (tdma_spec != NULL || tx_msg[0] == CLOCK_SYNC_BEACON_TYPE || period_us < TX_SLEEP_PERIOD_MIN_US))
+    {
+        printf("-Z needs a period of at least %d us, and can't be used with -B or -T\n", TX_SLEEP_PERIOD_MIN_US);
+        exit(1);
+    }
+
+    /* The compensation runs between the frames of the periodic loop, TDMA members and -Z have none to spare. */
+    if (temp_comp && (sleep_between || (tdma_spec != NULL && tdma_slot >= 0)))
+    {
+        printf("-K can't be used with -Z or a TDMA slot\n");
+        exit(1);
+    }
+
+    if (load_profile(&profile) != 0)
+    {
+        exit(1);
+    }
+    profile_print(stdout, &profile);
+
+    /* The TDMA coordinator sends one beacon per superframe, the members send their frames in its slots. See NOTE 15 below. */
+    if (tdma_spec != NULL && tdma_slot < 0)
+    {
+        if (tdma_derive(&tdma, &profile.config, TX_FRAME_LEN) != 0)
+        {
+            exit(1);
+        }
+        tx_len = TDMA_BEACON_LEN;
+        tdma_beacon_pack(tx_msg, &tdma);
+        period_us = tdma_superframe_us(&tdma);
+        printf("TDMA coordinator: %u slots of %u us, %u us gap, %u us guard, %lu us superframe\n", tdma.num_slots, tdma.slot_us, tdma.gap_us,
+               tdma.guard_us, (unsigned long) period_us);
+    }
+
+    if (profile_frame_us(&profile.config, tx_len) >= period_us)
+    {
+        printf("Warning: the period is shorter than the airtime of a frame\n");
+    }
+
+    /* The main thread schedules the frames and writes them over SPI: in real-time mode it runs on the CPU of the IRQ thread, at the same
+     * priority. See NOTE 13 below. */
+    if (rt_init(&rt_config) != 0 || rt_thread_enter(0) != 0)
+    {
+        exit(1);
+    }
     
     /* Start with board specific hardware init. */
 	hardware_init();
 
-    /* Reset and initialise DW1000. See NOTE 2 below.
+    /* Reset and initialise DW1000, with the OTP calibration values cached by earlier runs. See NOTE 2 and NOTE 16 below.
      * For initialisation, DW1000 clocks must be temporarily set to crystal speed. After initialisation SPI rate can be increased for optimum
      * performance. */
+    clock_gettime(CLOCK_MONOTONIC, &start);
     reset_DW1000(); /* Target specific drive of RSTn line into DW1000 low for a period. */
     spi_set_rate_low();
-    if (dwt_initialise(DWT_LOADNONE) == DWT_ERROR)
+    if (otp_cache_initialise((tdma_spec != NULL && tdma_slot >= 0) ? DWT_LOADUCODE : DWT_LOADNONE) == DWT_ERROR)
     {
         while (1)
         { };
     }
-    spi_set_rate_high();
 
-    /* Configure DW1000. See NOTE 3 below. */
-    dwt_configure(&config);
+    /* Run the SPI as fast as this wiring reliably allows, see spi_autotune(). */
+    if (spi_autotune() < 0)
+    {
+        printf("Unable to set the SPI rate\r\n");
+        exit(1);
+    }
+
+    /* Configure DW1000: dwt_configure() and the TX RF settings of the profile. See NOTE 3 below. */
+    profile_apply(&profile);
     dwt_setleds(0b00000011);
 
+    /* Apply the TX antenna delay, it is part of the TX timestamp sent in the frame. */
+    dwt_settxantennadelay(ant_dly);
+
+    otp_cached = dwt_getotpcal(&otp_cal);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("DW1000 part %08lx lot %08lx initialised in %.2f ms, OTP calibration %s\n", otp_cal.partID, otp_cal.lotID,
+           elapsed_s(&start, &now) * 1e3, otp_cached ? "cached" : "read");
+
+    /* Sleep with the configuration saved in the AON memory, restored at wake-up. See NOTE 16 below. */
+    if (sleep_between)
+    {
+        dwt_configuresleep(DWT_PRESRV_SLEEP | DWT_CONFIG, sleep_wake);
+    }
+
+    /* Get woken up by the TX frame sent interrupt instead of polling. See NOTE 5 below. TDMA members also receive the beacons. */
+    if (tdma_spec != NULL && tdma_slot >= 0)
+    {
+        dwt_setrxantennadelay(ant_dly);
+        dwt_setcallbacks(&tx_done_cb, &rx_ok_cb, &rx_err_cb, &rx_err_cb);
+        dwt_setinterrupt(DWT_INT_TFRS | DWT_INT_RFCG | DWT_INT_RPHE | DWT_INT_RFCE | DWT_INT_RFSL | DWT_INT_RFTO | DWT_INT_RXPTO | DWT_INT_SFDT
+                         | DWT_INT_ARFE, 1);
+    }
+    else
+    {
+        dwt_setcallbacks(&tx_done_cb, NULL, NULL, NULL);
+        dwt_setinterrupt(DWT_INT_TFRS, 1);
+    }
+    if (irq_init() != 0)
+    {
+        printf("Unable to set up the IRQ line\n");
+        exit(1);
+    }
+
+    signal(SIGHUP, sighup_handler);
+
     printf("%s\n", APP_NAME);
-    
-    int sampletime = 0;
-    /* Loop forever sending frames periodically. */
-    while(sampletime<1)
-    {
-        sampletime++;
-        /* Get tx_timestamp */
-        time_now = time(NULL);
-        
-        memcpy((void *) &tx_msg[TS_IDX], (void *) &time_now, sizeof(uint64)); // copy tx timestamp
-        memcpy((void *) &tx_msg[BLINK_FRAME_SN_IDX], (void *) &squence_num, sizeof(uint8));
-        
-        /* Write frame data to DW1000 and prepare transmission. See NOTE 4 below.*/
-        dwt_writetxdata(sizeof(tx_msg), tx_msg, 0); /* Zero offset in TX buffer. */
-        dwt_writetxfctrl(sizeof(tx_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
-
-        /* Start transmission. */
-        dwt_starttx(DWT_START_TX_IMMEDIATE);
-
-        /* Poll DW1000 until TX frame sent event set. See NOTE 5 below.
-         * STATUS register is 5 bytes long but, as the event we are looking at is in the first byte of the register, we can use this simplest API
-         * function to access it.*/
-        while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
-        { };
 
-        /* Clear TX frame sent event. */
-        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+    if (tdma_spec != NULL && tdma_slot >= 0)
+    {
+        return run_member(tx_msg, ant_dly, max_frames, verbose);
+    }
+    if (sleep_between)
+    {
+        return run_sleeping(tx_msg, tx_len, ant_dly, period_us, max_frames, verbose);
+    }
+
+    printf("Target rate %.1f frames/s\n", 1000000.0 / period_us);
+
+    /* PG_DELAY is calibrated with the clocks of the DW1000 switched to the crystal, which slows the device time down for a while, so not for
+     * beacons: their timestamps must stay on a steady timebase. */
+    if (temp_comp)
+    {
+        start_tempcomp((tx_msg[0] == CLOCK_SYNC_BEACON_TYPE) ? TEMPCOMP_POWER : TEMPCOMP_POWER | TEMPCOMP_BANDWIDTH);
+    }
+
+    /* The first slot is taken from the current system time, all the following ones are exactly one period apart. */
+    s = decamutexon();
+    tx_time = (get_system_timestamp_u64() + US_TO_DWT_TIME(TX_START_MARGIN_US)) & DWT_DLY_MASK;
+    /* The TX timestamp is known before sending: the scheduled time plus the antenna delay. */
+    tx_stamp = (tx_time + ant_dly) & DWT_TIME_MASK;
+    write_frame(tx_msg, tx_len, squence_num, tx_stamp);
+    decamutexoff(s);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    report = start;
+
+    /* Loop sending frames periodically. The data of each frame is already in the TX buffer when its turn comes. */
+    while (max_frames == 0 || frames < max_frames)
+    {
+        s = decamutexon();
+
+        /* Point the TX frame control at the half of the buffer holding this frame. See NOTE 4 below.*/
+        dwt_writetxfctrl(tx_len, TX_BUF_OFFSET(squence_num), 0); /* No ranging. */
+
+        /* Schedule transmission at the slot. See NOTE 6 below. */
+        dwt_setdelayedtrxtime((uint32) (tx_time >> 8));
+        if (dwt_starttx(DWT_START_TX_DELAYED) == DWT_ERROR)
+        {
+            /* Too late for this slot: move on to the first slot still ahead of the device time. The frame has to be rewritten with its new
+             * timestamp, nothing is being sent so the buffer half is free. */
+            late++;
+            tx_time = (get_system_timestamp_u64() + US_TO_DWT_TIME(TX_START_MARGIN_US)) & DWT_DLY_MASK;
+            tx_stamp = (tx_time + ant_dly) & DWT_TIME_MASK;
+            write_frame(tx_msg, tx_len, squence_num, tx_stamp);
+            decamutexoff(s);
+            if (verbose)
+            {
+                printf("Slot missed, rescheduling (%lu late)\n", late);
+            }
+            continue;
+        }
+
+        /* While this frame waits for its slot and goes on air, write the next one to the other half of the TX buffer. */
+        tx_time = (tx_time + US_TO_DWT_TIME(period_us)) & DWT_DLY_MASK;
+        next_stamp = (tx_time + ant_dly) & DWT_TIME_MASK;
+        if (max_frames == 0 || frames + 1 < max_frames)
+        {
+            write_frame(tx_msg, tx_len, (uint8) (squence_num + 1), next_stamp);
+        }
+
+        decamutexoff(s);
+
+        /* Sleep until dwt_isr() reports the TX frame sent event, it also clears the event. See NOTE 5 below. */
+        irq_event_wait(0);
+
+        if (verbose)
+        {
+            uint64 tx_read;
 
-        /* Execute a delay between transmissions. */
-//        sleep_ms(TX_DELAY_MS);
+            s = decamutexon();
+            tx_read = get_tx_timestamp_u64();
+            decamutexoff(s);
+            printf("%u MSG SENT! TX timestamp: %llu (read back %llu)\n", squence_num, tx_stamp, tx_read);
+        }
 
-        /* How to print uint8??????? */
-        printf("%u MSG SENT! Time: %llu\n", squence_num, time_now);
+        squence_num++;
+        frames++;
+        report_frames++;
+        tx_stamp = next_stamp;
+
+        /* Nothing is on air until the next slot: switch now, the next frame is already in the TX buffer. */
+        if (reload)
+        {
+            reload = 0;
+            switch_profile();
+        }
+
+        /* The transceiver is idle until the next frame is started: one step of the temperature compensation. See NOTE 17 below. */
+        if (temp_comp)
+        {
+            s = decamutexon();
+            if (tempcomp_poll(&tempcomp, 1) & TEMPCOMP_UPDATED)
+            {
+                printf("%.1f C: pg_delay 0x%02X, tx_power 0x%08lX\n", tempcomp.comp_temp, tempcomp.txconfig.PGdly, tempcomp.txconfig.power);
+            }
+            decamutexoff(s);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (elapsed_s(&report, &now) >= TX_REPORT_S)
+        {
+            printf("%.1f frames/s (target %.1f), %lu sent, %lu slots missed\n", report_frames / elapsed_s(&report, &now),
+                   1000000.0 / period_us, frames, late);
+            if (temp_comp && tempcomp.valid)
+            {
+                printf("%.1f C, %.2f V, TX RF settings for %.1f C (%lu updates, %lu PG count errors)\n", tempcomp.temp, tempcomp.vbat,
+                       tempcomp.comp_temp, (unsigned long) tempcomp.updates, (unsigned long) tempcomp.errors);
+            }
+            if (rt_enabled())
+            {
+                irq_get_stats(&irq_stats);
+                printf("RT deadline missed by %lu of %lu IRQs, longest %lu us\n", (unsigned long) irq_stats.missed, (unsigned long) irq_stats.irqs,
+                       (unsigned long) irq_stats.max_us);
+            }
+            report = now;
+            report_frames = 0;
+
+            /* Step the SPI rate down if the link is no longer reliable. */
+            s = decamutexon();
+            spi_check();
+            decamutexoff(s);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("%lu frames sent in %.3f s, %.1f frames/s (target %.1f), %lu slots missed\n", frames, elapsed_s(&start, &now),
+           frames / elapsed_s(&start, &now), 1000000.0 / period_us, late);
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn local_time()
+ *
+ * @brief Convert a duration on the clock of the coordinator to the local clock.
+ *
+ * @param  ref_time - duration in device time units of the coordinator
+ * @param  ratio - clock offset of the coordinator, positive when its clock is faster, see clock_sync_carrier_ratio()
+ *
+ * @return  the duration in local device time units
+ */
+static uint64 local_time(uint64 ref_time, double ratio)
+{
+    return ref_time - (int64) (ref_time * ratio);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn wait_done()
+ *
+ * @brief Wait for the event of a TDMA member that sets done. The RX and TX done callbacks signal the same per device event, so one that
+ *        fired late (e.g. a frame received between a timeout and dwt_forcetrxoff()) must not be taken for the one waited for.
+ *
+ * @param  done - flag set by the callback, cleared with the event count before the operation is started
+ * @param  timeout_ms - maximum time to wait for each event in milliseconds
+ *
+ * @return  0 once done is set, -1 on timeout
+ */
+static int wait_done(volatile int *done, unsigned int timeout_ms)
+{
+    while (!*done)
+    {
+        if (irq_event_wait(timeout_ms) < 0)
+        {
+            return *done ? 0 : -1;
+        }
+    }
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn run_member()
+ *
+ * @brief TDMA member loop: get the beacon of each superframe, then send one frame in the slot given with -T, timed from the beacon. Missed
+ *        beacons are predicted from the previous one for up to TDMA_MISSED_MAX superframes, after which the member listens continuously until
+ *        it gets a beacon again. See NOTE 15 below.
+ *
+ * @param  msg - frame to send
+ * @param  ant_dly - TX antenna delay
+ * @param  max_frames - number of frames to send, 0 to run forever
+ * @param  verbose - print a line per superframe
+ *
+ * @return  exit status of the application
+ */
+static int run_member(uint8 *msg, uint16 ant_dly, unsigned long max_frames, int verbose)
+{
+    tdma_config_t layout;
+    unsigned int missed = TDMA_MISSED_MAX;
+    unsigned long frames = 0, beacons = 0, lost = 0, late = 0, report_frames = 0;
+    uint8 seq = 0;
+    uint64 beacon_stamp = 0;
+    uint64 expected = 0;
+    uint64 tx_time, tx_stamp;
+    uint64_t lead;
+    uint16 rx_timeout, pre_timeout;
+    double ratio = 0;
+    struct timespec report, now;
+    decaIrqStatus_t s;
+    int listening, ret;
+
+    memset(&layout, 0, sizeof(layout));
+    clock_gettime(CLOCK_MONOTONIC, &report);
+    printf("TDMA member, slot %d\n", tdma_slot);
+
+    while (max_frames == 0 || frames < max_frames)
+    {
+        /* Listen for the next beacon: continuously until one is heard, then only around the time it is expected. */
+        s = decamutexon();
+        rx_result = -1;
+        rx_done = 0;
+        irq_event_clear();
+        listening = (missed >= TDMA_MISSED_MAX);
+        if (listening)
+        {
+            dwt_setrxtimeout(0);
+            dwt_setpreambledetecttimeout(0);
+            dwt_rxenable(DWT_START_RX_IMMEDIATE);
+            ret = DWT_SUCCESS;
+        }
+        else
+        {
+            expected = (beacon_stamp + local_time(US_TO_DWT_TIME(tdma_superframe_us(&layout)), ratio)) & DWT_TIME_MASK;
+            tdma_rx_window(&layout, &profile.config, TDMA_BEACON_LEN, &lead, &rx_timeout, &pre_timeout);
+            dwt_setrxtimeout(rx_timeout);
+            dwt_setpreambledetecttimeout(pre_timeout);
+            dwt_setdelayedtrxtime((uint32) (((expected - lead) & DWT_TIME_MASK) >> 8));
+            ret = dwt_rxenable(DWT_START_RX_DELAYED | DWT_IDLE_ON_DLY_ERR);
+        }
+        decamutexoff(s);
+
+        /* Woken up by rx_ok_cb() or rx_err_cb(), which includes the RX timeouts of the window. */
+        if (ret == DWT_SUCCESS && wait_done(&rx_done, listening ? 1000 : tdma_superframe_us(&layout) / 1000 + 100) < 0)
+        {
+            s = decamutexon();
+            dwt_forcetrxoff();
+            decamutexoff(s);
+        }
+
+        if (rx_result == 1)
+        {
+            beacon_stamp = rx_beacon_stamp;
+            ratio = clock_sync_carrier_ratio(&profile.config, rx_beacon_carrier);
+            layout = rx_beacon_layout;
+            missed = 0;
+            beacons++;
+        }
+        else if (listening)
+        {
+            continue;
+        }
+        else
+        {
+            /* Keep to the schedule: the beacon was sent when expected. */
+            beacon_stamp = expected;
+            missed++;
+            lost++;
+            if (missed == TDMA_MISSED_MAX)
+            {
+                printf("Beacons lost, listening\n");
+                continue;
+            }
+        }
+
+        if (tdma_slot >= layout.num_slots)
+        {
+            printf("Slot %d not in the %u slots of the superframe\n", tdma_slot, layout.num_slots);
+            exit(1);
+        }
+
+        /* Send in the slot, timed from the beacon on the local clock corrected for the drift measured on the beacon. */
+        tx_time = (beacon_stamp + local_time(tdma_slot_offset(&layout, tdma_slot), ratio) - ant_dly) & DWT_DLY_MASK;
+        tx_stamp = (tx_time + ant_dly) & DWT_TIME_MASK;
+        s = decamutexon();
+        write_frame(msg, TX_FRAME_LEN, seq, tx_stamp);
+        dwt_writetxfctrl(TX_FRAME_LEN, TX_BUF_OFFSET(seq), 0); /* No ranging. */
+        dwt_setdelayedtrxtime((uint32) (tx_time >> 8));
+        tx_done = 0;
+        irq_event_clear();
+        ret = dwt_starttx(DWT_START_TX_DELAYED);
+        decamutexoff(s);
+        if (ret == DWT_ERROR)
+        {
+            late++;
+        }
+        else
+        {
+            wait_done(&tx_done, 100);
+            frames++;
+            report_frames++;
+        }
+        if (verbose)
+        {
+            printf("%u: beacon %s, %s\n", seq, missed ? "missed" : "received", (ret == DWT_ERROR) ? "slot missed" : "sent");
+        }
+        seq++;
+
+        if (reload)
+        {
+            reload = 0;
+            switch_profile();
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (elapsed_s(&report, &now) >= TX_REPORT_S)
+        {
+            printf("%.1f frames/s, %lu sent, %lu beacons, %lu lost, %lu slots missed, drift to the coordinator %.3f ppm\n",
+                   report_frames / elapsed_s(&report, &now), frames, beacons, lost, late, ratio * 1e6);
+            report = now;
+            report_frames = 0;
+
+            s = decamutexon();
+            spi_check();
+            decamutexoff(s);
+        }
     }
+
+    printf("%lu frames sent, %lu beacons, %lu lost, %lu slots missed\n", frames, beacons, lost, late);
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn run_sleeping()
+ *
+ * @brief Duty-cycled loop of -Z: wake the DW1000 up, send one frame as soon as it is written, and put it back to sleep until the next period
+ *        of the host clock. See NOTE 16 below.
+ *
+ * @param  msg - frame to send
+ * @param  len - frame length, FCS included
+ * @param  ant_dly - TX antenna delay
+ * @param  period_us - frame period on the host clock
+ * @param  max_frames - number of frames to send, 0 to run forever
+ * @param  verbose - print a line per frame
+ *
+ * @return  exit status of the application
+ */
+static int run_sleeping(uint8 *msg, uint16 len, uint16 ant_dly, unsigned long period_us, unsigned long max_frames, int verbose)
+{
+    unsigned long frames = 0, late = 0, lost = 0, wakes = 0, report_frames = 0;
+    double wake_s, wake_sum = 0, wake_max = 0;
+    uint64 tx_time, tx_stamp;
+    uint8 seq = 0;
+    int asleep = 0;
+    struct timespec next, report, t0, now;
+    decaIrqStatus_t s;
+    int ret;
+
+    printf("Sleeping between frames, %.1f frames/s\n", 1000000.0 / period_us);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    report = next;
+
+    while (max_frames == 0 || frames < max_frames)
+    {
+        s = decamutexon();
+
+        /* Asleep since the previous frame: the configuration comes back from the AON memory but the antenna delay does not, the interrupt
+         * mask is set again as well. */
+        if (asleep)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            if (dw1000_wakeup() != 0)
+            {
+                decamutexoff(s);
+                printf("The DW1000 did not wake up\n");
+                return 1;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            wake_s = elapsed_s(&t0, &now);
+            wake_sum += wake_s;
+            wake_max = (wake_s > wake_max) ? wake_s : wake_max;
+            wakes++;
+
+            dwt_settxantennadelay(ant_dly);
+            dwt_setinterrupt(DWT_INT_TFRS, 1);
+        }
+
+        /* Awake with nothing on air: switch now, dwt_entersleep() then saves the new configuration. */
+        if (reload)
+        {
+            reload = 0;
+            switch_profile();
+        }
+
+        /* The device time started over at wake-up, the frame goes out as soon as it is written, after its preamble. */
+        tx_time = (get_system_timestamp_u64() + US_TO_DWT_TIME(profile_preamble_us(&profile.config) + TX_WAKE_MARGIN_US)) & DWT_DLY_MASK;
+        tx_stamp = (tx_time + ant_dly) & DWT_TIME_MASK;
+        write_frame(msg, len, seq, tx_stamp);
+        dwt_writetxfctrl(len, TX_BUF_OFFSET(seq), 0);
+        dwt_setdelayedtrxtime((uint32) (tx_time >> 8));
+        ret = dwt_starttx(DWT_START_TX_DELAYED);
+        decamutexoff(s);
+
+        if (ret == DWT_ERROR)
+        {
+            late++;
+        }
+        else if (irq_event_wait(TX_SLEEP_WAIT_MS) != 0)
+        {
+            lost++;
+        }
+        else
+        {
+            if (verbose)
+            {
+                printf("%u MSG SENT! TX timestamp: %llu\n", seq, tx_stamp);
+            }
+            frames++;
+            report_frames++;
+        }
+        seq++;
+
+        s = decamutexon();
+        dwt_entersleep();
+        decamutexoff(s);
+        asleep = 1;
+
+        next.tv_nsec += (period_us % 1000000) * 1000;
+        next.tv_sec += period_us / 1000000 + next.tv_nsec / 1000000000;
+        next.tv_nsec %= 1000000000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (elapsed_s(&report, &now) >= TX_REPORT_S)
+        {
+            printf("%.1f frames/s (target %.1f), %lu sent, %lu too late, %lu without TX done, wake-up %.0f us average %.0f us max\n",
+                   report_frames / elapsed_s(&report, &now), 1000000.0 / period_us, frames, late, lost, wakes ? wake_sum / wakes * 1e6 : 0,
+                   wake_max * 1e6);
+            report = now;
+            report_frames = 0;
+            wake_sum = 0;
+            wake_max = 0;
+            wakes = 0;
+        }
+    }
+
+    printf("%lu frames sent, %lu too late, %lu without TX done\n", frames, late, lost);
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn write_frame()
+ *
+ * @brief Fill in the sequence number and TX timestamp of a frame and write it to its half of the TX buffer.
+ *
+ * @param  msg - frame to send
+ * @param  len - length of the frame, CRC included
+ * @param  seq - sequence number of the frame, also selects the TX buffer half
+ * @param  tx_stamp - TX timestamp to embed in the frame
+ *
+ * @return  none
+ */
+static void write_frame(uint8 *msg, uint16 len, uint8 seq, uint64 tx_stamp)
+{
+    memcpy((void *) &msg[TS_IDX], (void *) &tx_stamp, sizeof(uint64)); // copy tx timestamp
+    memcpy((void *) &msg[BLINK_FRAME_SN_IDX], (void *) &seq, sizeof(uint8));
+    dwt_writetxdata(len, msg, TX_BUF_OFFSET(seq));
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn elapsed_s()
+ *
+ * @brief Time between two host clock readings, in seconds.
+ *
+ * @param  start - earlier reading
+ * @param  end - later reading
+ *
+ * @return  the elapsed time
+ */
+static double elapsed_s(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
 }
 
 /*! ------------------------------------------------------------------------------------------------------------------
@@ -185,10 +941,73 @@ static uint64 get_system_timestamp_u64(void)
     return ts;
 }
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tx_done_cb()
+ *
+ * @brief Callback to process TX frame sent events
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void tx_done_cb(const dwt_cb_data_t *cb_data)
+{
+    tx_done = 1;
+    irq_event_signal();
+}
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rx_ok_cb()
+ *
+ * @brief Callback to process RX good frame events of a TDMA member: a beacon is read with its RX timestamp and the clock offset measured
+ *        by the carrier integrator, which has to be read before the next frame.
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void rx_ok_cb(const dwt_cb_data_t *cb_data)
+{
+    uint8 buf[TDMA_BEACON_LEN];
+    uint8 ts_tab[5];
+    int i;
 
+    rx_result = 0;
+    if (cb_data->datalength == TDMA_BEACON_LEN)
+    {
+        dwt_readrxdata(buf, TDMA_BEACON_LEN, 0);
+        if (tdma_beacon_parse(buf, TDMA_BEACON_LEN, &rx_beacon_layout) == 0)
+        {
+            dwt_readrxtimestamp(ts_tab);
+            rx_beacon_stamp = 0;
+            for (i = 4; i >= 0; i--)
+            {
+                rx_beacon_stamp <<= 8;
+                rx_beacon_stamp |= ts_tab[i];
+            }
+            rx_beacon_carrier = dwt_readcarrierintegrator();
+            rx_result = 1;
+        }
+    }
+    rx_done = 1;
+    irq_event_signal();
+}
 
-
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rx_err_cb()
+ *
+ * @brief Callback to process RX error and timeout events of a TDMA member
+ *
+ * @param  cb_data  callback data
+ *
+ * @return  none
+ */
+static void rx_err_cb(const dwt_cb_data_t *cb_data)
+{
+    rx_result = -1;
+    rx_done = 1;
+    irq_event_signal();
+}
 
 /*****************************************************************************************************************************************************
  * NOTES:
@@ -200,13 +1019,64 @@ static uint64 get_system_timestamp_u64(void)
  * 2. In this example, LDE microcode is not loaded upon calling dwt_initialise(). This will prevent the IC from generating an RX timestamp. If
  *    time-stamping is required, DWT_LOADUCODE parameter should be used. See two-way ranging examples (e.g. examples 5a/5b).
  * 3. In a real application, for optimum performance within regulatory limits, it may be necessary to set TX pulse bandwidth and TX power, (using
- *    the dwt_configuretxrf API call) to per device calibrated values saved in the target system or the DW1000 OTP memory.
+ *    the dwt_configuretxrf API call) to per device calibrated values saved in the target system or the DW1000 OTP memory. The profile sets
+ *    the typical values of the DW1000 User Manual for its channel and PRF, pg_delay and tx_power in the profile override them.
  * 4. dwt_writetxdata() takes the full size of tx_msg as a parameter but only copies (size - 2) bytes as the check-sum at the end of the frame is
  *    automatically appended by the DW1000. This means that our tx_msg could be two bytes shorter without losing any data (but the sizeof would not
  *    work anymore then as we would still have to indicate the full length of the frame to dwt_writetxdata()).
- * 5. We use polled mode of operation here to keep the example as simple as possible but the TXFRS status event can be used to generate an interrupt.
- *    Please refer to DW1000 User Manual for more details on "interrupts".
- * 6. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
- *    DW1000 API Guide for more details on the DW1000 driver functions.
+ * 5. The TXFRS event is signalled on the DW1000 IRQ line, which irq_init() services on its own thread by calling dwt_isr(). The main loop sleeps
+ *    until the callback wakes it up instead of keeping the SPI bus busy with SYS_STATUS reads.
+ * 6. dwt_setdelayedtrxtime() takes the upper 32 bits of the 40-bit device time, and the DW1000 ignores the lowest bit of that as well, so frames can
+ *    only be scheduled on multiples of 512 device time units (about 8 ns). The slots are therefore kept masked with DWT_DLY_MASK. If the frame is
+ *    written too late for its slot, dwt_starttx() returns an error and nothing is sent, so the next slot is taken from the current device time.
+ * 7. Every frame is scheduled one period after the previous one in device time, so the spacing between frames does not depend on host scheduling.
+ *    The period must be long enough for the frame airtime and for the host to write the next frame (a few ms at 110 kbps with a 1024 symbols
+ *    preamble). The TX timestamp carried by the frame is computed beforehand, so it does not need to be read back after the transmission.
+ * 8. The sum of the TX and RX antenna delays should be calibrated per device, see the DW1000 User Manual. The value used here is the typical one
+ *    for 64 MHz PRF used by the Decawave examples.
+ * 9. The rate report compares the frames actually sent with the target rate. The host only has to keep ahead of the schedule: missed slots are
+ *    rescheduled, so a host that cannot keep up shows as a lower achieved rate and a growing missed slots count.
+ * 10. Writing a frame to the TX buffer is the longest SPI transfer of the loop. With two buffer halves, the next frame is written right after
+ *     the current one is scheduled, during its wait and airtime, so once TX is done only the 4-byte TX_FCTRL write and the delayed start are
+ *     left before the next slot. TX_FCTRL itself is only rewritten after TX done as the DW1000 reads it when the transmission starts.
+ * 11. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
+ *     DW1000 API Guide for more details on the DW1000 driver functions.
+ * 12. The radio configuration comes from a profile (see profiles.h), -P with the same profile as the receivers. On SIGHUP the profile file
+ *     is loaded again and the profile applied with profile_switch() right after a frame has been sent, without dwt_initialise(): the frames
+ *     keep their schedule and sequence numbers, so the receivers can tell exactly where the switch happened.
+ * 13. With -R, memory is locked and both the main thread and the IRQ thread run at a SCHED_FIFO priority on the CPU given (see rt.h), so the
+ *     next frame reliably makes it to the DW1000 before its slot: short periods then no longer show up as missed slots. The TXFRS IRQs
+ *     serviced later than the deadline after their edge are reported with the rate.
+ * 14. With -B this node is the time reference of a set of receivers: its frames are marked as beacons, and as their TX timestamp is exact (the
+ *     delayed TX slot plus the antenna delay) each one gives a receiver running dw1000_rx_cir -S the offset between the two clocks, while the
+ *     carrier integrator of the receiver measures their frequency offset (see clock_sync.h). A 10 Hz rate (-r 10) is plenty; beacons must not be
+ *     more than 2 s apart.
+ * 15. With many transmitters on one channel, frames sent at independent times collide more and more often as nodes are added. With -T they
+ *     share TDMA superframes instead (see tdma.h): the coordinator (-T coord) sends a beacon every superframe, which carries the layout (slot
+ *     count and length, gap after the beacon, guard time), and each member (-T <slot>) sends one frame per superframe in its own slot, so the
+ *     aggregate frame rate grows with the number of slots instead of collapsing. Slots are derived from the frame airtime of the profile plus
+ *     the guard time unless given. A member times its slot from the RX timestamp of the beacon (it loads the LDE microcode for it, unlike NOTE
+ *     2), corrected for the clock drift that the carrier integrator measures on the beacon, and sends with delayed TX. It then only opens its
+ *     receiver around the next beacon, with delayed RX, a frame wait timeout (dwt_setrxtimeout()) and a preamble detection timeout
+ *     (dwt_setpreambledetecttimeout()) that turn it off if no beacon starts within the guard time. A missed beacon is assumed to have been sent
+ *     on time for up to TDMA_MISSED_MAX superframes, after which the member stops sending and listens continuously. Beacons are also clock sync
+ *     beacons (NOTE 14), so the receivers can run with -S and tell the slot of each frame from its sync_stamp.
+ * 16. A start runs the reset, dwt_initialise() at the slow SPI rate and the whole configuration. The OTP calibration values read by
+ *     dwt_initialise() (XTAL trim, LDO tune, sensor references) never change for a device, so they are kept in a cache file keyed by part and
+ *     lot ID (see otp_cache.h) and only the two ID words are read from OTP on later starts; the time to initialise is printed at start up. A
+ *     node that only sends now and then does not need to be reinitialised at all: with -Z the DW1000 goes to DEEPSLEEP (or SLEEP with the
+ *     crystal running, for "sleep") after each frame, its configuration saved in the AON memory by dwt_entersleep() and restored when
+ *     dw1000_wakeup() holds its chip select low (dwt_configuresleep() with DWT_CONFIG and DWT_WAKE_CS). Only the antenna delay and the
+ *     interrupt mask are written again before the frame; its TX timestamp stays exact, from the device time after wake-up. The device time
+ *     starts over at each wake-up, so the period is kept by the host clock instead of delayed TX, hence no -B or -T. The wake-up time is
+ *     reported with the rate: a chip select held for about 500 us, then the crystal start up after DEEPSLEEP, see dw1000_bench for both modes.
+ * 17. The TX power and the bandwidth of the pulse generator drift with temperature. dwt_readtempvbat(), dwt_calcpgcount() and
+ *     dwt_calcbandwidthtempadj() would stall the frames for 1 ms to 1.7 s; with -K the same work is done by a state machine (see tempcomp.h), one
+ *     step after each TX done, when the next frame is already written and not yet started: a temperature measurement once a second, the PG
+ *     count of the PG_DELAY of the profile at the first reading as the reference, then, when the temperature has moved by more than the
+ *     threshold since the settings in use were computed, 7 bisection steps of PG_DELAY back to that count (one dwt_pgcountsample() each, which
+ *     polls for the end of the calibration instead of sleeping 100 ms) and the TX power of the profile corrected by dwt_calcpowertempadj().
+ *     Only then are the new settings written. The PG count needs the clocks switched to the crystal, which slows down the device time, so with
+ *     -B (and for the TDMA coordinator) only the TX power is compensated, and a new profile on SIGHUP becomes the reference.
  ****************************************************************************************************************************************************/
 
@@ -0,0 +1,147 @@
+/*
+ * frame_filter.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_filter.h"
+#include "clock_sync.h"
+
+static const struct
+{
+	const char	*name;
+	uint16		mask;
+} ff_types[] = {
+	{ "data",	DWT_FF_DATA_EN },
+	{ "beacon",	DWT_FF_BEACON_EN },
+	{ "ack",	DWT_FF_ACK_EN },
+	{ "mac",	DWT_FF_MAC_EN },
+	{ "rsvd",	DWT_FF_RSVD_EN },
+	{ "coord",	DWT_FF_COORD_EN },
+};
+
+static int parse_u16(const char *value, unsigned long max, uint16 *out)
+{
+	char *end;
+	unsigned long n = strtoul(value, &end, 0);
+
+	if(end == value || *end != '\0' || n > max)
+		return -1;
+	*out = n;
+	return 0;
+}
+
+static void accept_fc(frame_filter_t *filter, uint8 fc)
+{
+	filter->host = 1;
+	filter->fc_map[fc >> 3] |= 1 << (fc & 7);
+}
+
+// '+' separated list of names or numbers
+static int parse_list(char *list, frame_filter_t *filter, int types)
+{
+	char *item, *save = NULL;
+	uint16 n;
+	unsigned int i;
+
+	for(item = strtok_r(list, "+", &save); item != NULL; item = strtok_r(NULL, "+", &save))
+	{
+		if(!types)
+		{
+			if(parse_u16(item, 0xFF, &n) != 0)
+				return -1;
+			accept_fc(filter, n);
+			continue;
+		}
+
+		for(i = 0; i < sizeof(ff_types) / sizeof(ff_types[0]); i++)
+		{
+			if(strcmp(item, ff_types[i].name) == 0)
+				break;
+		}
+		if(i == sizeof(ff_types) / sizeof(ff_types[0]))
+			return -1;
+		filter->hw_types |= ff_types[i].mask;
+	}
+
+	return 0;
+}
+
+int frame_filter_parse(const char *arg, frame_filter_t *filter)
+{
+	char buf[128];
+	char *item, *save = NULL;
+	int addressed = 0;
+	int ret = 0;
+
+	memset(filter, 0, sizeof(*filter));
+	filter->pan_id = 0xFFFF;
+	filter->short_addr = 0xFFFF;
+
+	if(strlen(arg) >= sizeof(buf))
+		return -1;
+	strcpy(buf, arg);
+
+	for(item = strtok_r(buf, ",", &save); ret == 0 && item != NULL; item = strtok_r(NULL, ",", &save))
+	{
+		if(strcmp(item, "tx") == 0)
+		{
+			accept_fc(filter, FRAME_FILTER_BLINK);
+			accept_fc(filter, CLOCK_SYNC_BEACON_TYPE);
+		}
+		else if(strncmp(item, "fc=", 3) == 0)
+			ret = parse_list(item + 3, filter, 0);
+		else if(strncmp(item, "types=", 6) == 0)
+			ret = parse_list(item + 6, filter, 1);
+		else if(strncmp(item, "pan=", 4) == 0)
+		{
+			ret = parse_u16(item + 4, 0xFFFF, &filter->pan_id);
+			addressed = 1;
+		}
+		else if(strncmp(item, "addr=", 5) == 0)
+		{
+			ret = parse_u16(item + 5, 0xFFFF, &filter->short_addr);
+			addressed = 1;
+		}
+		else
+			ret = -1;
+	}
+
+	if(addressed && filter->hw_types == 0)
+		filter->hw_types = DWT_FF_DATA_EN;
+
+	return (ret != 0 || (filter->hw_types == 0 && !filter->host)) ? -1 : 0;
+}
+
+void frame_filter_apply(const frame_filter_t *filter)
+{
+	if(filter->hw_types == 0)
+		return;
+
+	dwt_setpanid(filter->pan_id);
+	dwt_setaddress16(filter->short_addr);
+	dwt_enableframefilter(filter->hw_types);
+}
+
+int frame_filter_accept(const frame_filter_t *filter, const dwt_cb_data_t *cb_data)
+{
+	uint8 fc = cb_data->fctrl[0];
+
+	if(!filter->host)
+		return 1;
+
+	// The frame control bytes are only meaningful with a payload before the FCS
+	return cb_data->datalength > 2 && (filter->fc_map[fc >> 3] & (1 << (fc & 7)));
+}
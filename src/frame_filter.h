@@ -0,0 +1,86 @@
+/*
+ * frame_filter.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Two stages to keep foreign frames from costing a diagnostics and CIR readout each:
+ *
+ *   - the frame filtering of the DW1000 (dwt_enableframefilter()) rejects 802.15.4 frames by type, PAN ID and
+ *     destination address before they are reported at all. It only accepts frames with a valid 802.15.4 MAC header, so
+ *     not the blinks and beacons of dw1000_tx, whose first byte is not a meaningful frame control;
+ *   - the host check runs first thing in the RX callback, on the two frame control bytes dwt_isr() has already read
+ *     (dwt_cb_data_t.fctrl), and drops frames whose first byte is not in an accepted set before anything else is read.
+ *
+ * Specification, comma separated items:
+ *
+ *   tx                   accept the frames of dw1000_tx only (host check of 0xAB blinks and clock sync beacons)
+ *   fc=0xab[+0x41...]    host check: accepted first frame control bytes
+ *   types=data[+...]     hardware filtering of the frame types: data, beacon, ack, mac, rsvd, and coord to accept
+ *                        frames without destination address
+ *   pan=0xDECA           PAN ID for hardware filtering (0xFFFF by default), implies types=data if not given
+ *   addr=0x0001          short address for hardware filtering (0xFFFF by default), implies types=data if not given
+ */
+
+#ifndef _FRAME_FILTER_H_
+#define _FRAME_FILTER_H_
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+
+#define FRAME_FILTER_BLINK		(0xAB)		// first byte of the frames of dw1000_tx
+
+typedef struct
+{
+	uint16	hw_types;		// DWT_FF_* frame types, 0 for no hardware filtering
+	uint16	pan_id;
+	uint16	short_addr;
+	int		host;			// first frame control bytes checked on the host
+	uint8	fc_map[32];		// accepted first frame control bytes, one bit each
+} frame_filter_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn frame_filter_parse()
+ *
+ * @brief Parse a filter specification, see above.
+ *
+ * @param arg    - specification
+ * @param filter - where to store the filter
+ *
+ * @return 0 on success, -1 on error
+ */
+int frame_filter_parse(const char *arg, frame_filter_t *filter);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn frame_filter_apply()
+ *
+ * @brief Configure the hardware filtering of the device selected, if any. The configuration is kept by dwt_configure(),
+ *        so it survives profile switches.
+ *
+ * @param filter - filter to apply
+ *
+ * @return none
+ */
+void frame_filter_apply(const frame_filter_t *filter);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn frame_filter_accept()
+ *
+ * @brief Host check of a frame reported by dwt_isr(), from the callback data only (no SPI access).
+ *
+ * @param filter  - filter
+ * @param cb_data - callback data of the RX good frame event
+ *
+ * @return 1 to keep the frame, 0 to drop it
+ */
+int frame_filter_accept(const frame_filter_t *filter, const dwt_cb_data_t *cb_data);
+
+#endif /* _FRAME_FILTER_H_ */
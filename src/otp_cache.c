@@ -0,0 +1,123 @@
+/*
+ * otp_cache.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "deca_device_api.h"
+#include "otp_cache.h"
+
+// Devices initialise one at a time, the table is read by dwt_initialise()
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static dwt_otpcal_t cache[OTP_CACHE_MAX];
+static unsigned int cache_num;
+
+static const char *cache_path(void)
+{
+	const char *path = getenv(OTP_CACHE_ENV);
+
+	return (path != NULL) ? path : OTP_CACHE_PATH_DEF;
+}
+
+// Read the file again each time, another process may have added devices
+static void load(const char *path)
+{
+	char line[128];
+	unsigned long part, lot, ldo;
+	unsigned int xtrim, vbat, temp;
+	FILE *f;
+
+	cache_num = 0;
+	f = fopen(path, "r");
+	if(f == NULL)
+		return;
+
+	while(cache_num < OTP_CACHE_MAX && fgets(line, sizeof(line), f) != NULL)
+	{
+		if(line[0] == '#')
+			continue;
+		if(sscanf(line, "%lx %lx %lx %x %x %x", &part, &lot, &ldo, &xtrim, &vbat, &temp) != 6)
+			continue;
+
+		cache[cache_num].partID = part;
+		cache[cache_num].lotID = lot;
+		cache[cache_num].ldoTune = ldo;
+		cache[cache_num].xtrim = xtrim;
+		cache[cache_num].vBatP = vbat;
+		cache[cache_num].tempP = temp;
+		cache_num++;
+	}
+	fclose(f);
+}
+
+static void store(const char *path)
+{
+	char tmp[256];
+	unsigned int i;
+	FILE *f;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if(f == NULL)
+		return;
+
+	fprintf(f, "# part_id lot_id ldo_tune xtrim vbat temp\n");
+	for(i = 0; i < cache_num; i++)
+		fprintf(f, "%08lx %08lx %08lx %04x %02x %02x\n", cache[i].partID, cache[i].lotID, cache[i].ldoTune, cache[i].xtrim,
+				cache[i].vBatP, cache[i].tempP);
+
+	if(fclose(f) != 0)
+	{
+		remove(tmp);
+		return;
+	}
+	rename(tmp, path);
+}
+
+int otp_cache_initialise(uint16 config)
+{
+	const char *path = cache_path();
+	dwt_otpcal_t cal;
+	int ret;
+
+	if(path[0] == '\0')
+	{
+		dwt_setotpcal(NULL, 0);
+		return dwt_initialise(config);
+	}
+
+	pthread_mutex_lock(&cache_lock);
+	load(path);
+	dwt_setotpcal(cache, cache_num);
+	ret = dwt_initialise(config);
+	dwt_setotpcal(NULL, 0);
+
+	if(ret == DWT_SUCCESS && !dwt_getotpcal(&cal))
+	{
+		// Newest last, the oldest ones make room
+		if(cache_num == OTP_CACHE_MAX)
+		{
+			memmove(&cache[0], &cache[1], (OTP_CACHE_MAX - 1) * sizeof(cache[0]));
+			cache_num--;
+		}
+		cache[cache_num++] = cal;
+		store(path);
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	return ret;
+}
@@ -0,0 +1,47 @@
+/*
+ * otp_cache.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Persistent cache of the OTP calibration values of the DW1000s seen before (see dwt_setotpcal()), so that restarting
+ * an application only reads the part and lot ID from OTP. The cache is a text file, $DW1000_OTP_CACHE or
+ * OTP_CACHE_PATH_DEF, with one line per device keyed by part and lot ID:
+ *
+ *   # part_id lot_id ldo_tune xtrim vbat temp
+ *   1a2b3c4d 00c0ffee 00000088 0213 9e 80
+ *
+ * A board moved to another chip select or SPI bus is still found. An empty DW1000_OTP_CACHE disables the cache.
+ */
+
+#ifndef _OTP_CACHE_H_
+#define _OTP_CACHE_H_
+
+#include "deca_types.h"
+
+#define OTP_CACHE_ENV			"DW1000_OTP_CACHE"
+#define OTP_CACHE_PATH_DEF		"/var/tmp/dw1000_otp"
+#define OTP_CACHE_MAX			(32)		// devices kept, the least recently added ones are dropped
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn otp_cache_initialise()
+ *
+ * @brief dwt_initialise() the selected device with the OTP calibration values of the cache. The values of a device
+ *        not in the cache yet are read from OTP and added to it.
+ *
+ * @param config - dwt_initialise() configuration, e.g. DWT_LOADUCODE
+ *
+ * @return DWT_SUCCESS for success, or DWT_ERROR for error, as dwt_initialise(). Failing to read or write the cache
+ *         file is not an error, the values are read from OTP then.
+ */
+int otp_cache_initialise(uint16 config);
+
+#endif /* _OTP_CACHE_H_ */
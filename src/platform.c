@@ -19,29 +19,83 @@
 
 #include "platform.h"
 #include <unistd.h> // for usleep
-#include <linux/spi/spidev.h>
 #include <sys/ioctl.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include "deca_regs.h"
+#include "spi_backend.h"
+#include "telemetry.h"
+#include "rt.h"
 
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <linux/gpio.h>
+#ifndef DW1000_NO_WIRINGPI
 #include <wiringPi.h>
+#endif
 
 #define SPI_SPEED_SLOW    				( 3000000)
 #define SPI_SPEED_FAST  	  			(10000000)
+#define SPI_SPEED_MAX 					(20000000) // DW1000 limit once its PLL is locked
+#define SPI_TUNE_READS 					(64) // DEV_ID reads per spi_autotune() step
+#define SPI_TUNE_PATTERNS 				(8) // TX buffer write/readbacks per spi_autotune() step
+#define SPI_DELAY_US 					(0) // the DW1000 needs no gap between transactions
+#define SPI_WAKEUP_LEN 					(SPI_SPEED_SLOW / 8 * 6 / 10000) // bytes read at SPI_SPEED_SLOW in 600 us
 #define SPI_PATH 						"/dev/spidev1.0"
-
-static uint32_t mode 	= 0;
-static uint8_t bits 	= 8;
-static uint32_t speed 	= SPI_SPEED_SLOW;
-static uint16_t delay_us 	= 10;
-
-static int fd;
-
-int RSTPin = 2; // BCM27
-int IRQPin = 3; // BCM22
+#define GPIO_CHIP_PATH 					"/dev/gpiochip0"
+#define IRQ_POLL_US 					(1000) // dwt_isr() period when the backend has no IRQ line
+#define SPI_RECORD_ENV 					"DW1000_SPI_RECORD" // record the SPI traffic of device N to $DW1000_SPI_RECORD.N
+
+// Rates tried by spi_autotune(), in order
+static const uint32_t tune_rates[] = { SPI_SPEED_FAST, 12000000, 14000000, 16000000, 18000000, SPI_SPEED_MAX };
+#define SPI_TUNE_STEPS 					((int)(sizeof(tune_rates) / sizeof(tune_rates[0])))
+
+// Wiring of the single board setup, used by hardware_init()
+static const dw1000_wiring_t wiring_def = {
+	.spi_path = SPI_PATH,
+	.rst_pin = 2,  // BCM27
+	.irq_pin = 3,  // BCM22
+	.irq_line = 22, // gpiochip0 line offset of irq_pin
+};
+
+struct dw1000_dev
+{
+	unsigned int index; 			// position in devices[], also the driver's local data, see dwt_setlocaldataptr()
+	char spi_path[DW1000_SPI_PATH_MAX]; // spidev node, i.e. bus and chip select
+	int rst_pin;
+	int irq_pin;
+	int irq_line;
+
+	spi_backend_t *spi; 			// see spi_backend.h
+	int pins; 						// the backend drives a real DW1000, RSTn and IRQ are used
+	uint32_t speed;
+	int tune_step; 					// tune_rates[] entry used by spi_set_rate_high(), -1 for SPI_SPEED_SLOW
+	uint16_t delay_us;
+	uint32_t max_transfer; 			// spi_set_max_transfer() limit, 0 for the backend's own
+	spi_stats_t stats;
+
+	int irq_fd;
+	pthread_t irq_thread;
+	pthread_mutex_t irq_lock; 		// recursive, held while dwt_isr() runs
+	irq_stats_t irq_stats; 			// written by the IRQ thread only
+
+	pthread_mutex_t event_lock;
+	pthread_cond_t event_cond;
+	unsigned int event_count;
+};
+
+static struct dw1000_dev devices[DWT_NUM_DW_DEV];
+#ifndef DW1000_NO_WIRINGPI
+static int wiringpi_ready = 0;
+#endif
+
+// Device the calling thread talks to, see dw1000_dev_select(). All the SPI, IRQ and mutex functions below apply to it.
+static __thread struct dw1000_dev *cur = &devices[0];
 
 /* Wrapper function to be used by decadriver. Declared in deca_device_api.h */
 void deca_sleep(unsigned int time_ms)
@@ -54,178 +108,664 @@ void sleep_ms(unsigned int time_ms)
 	usleep(time_ms * 1000);
 }
 
-int spi_set_rate_low (void)
+void deca_usleep(unsigned int time_us)
 {
-	speed = SPI_SPEED_SLOW;
-	if(ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed)==-1){
-		perror("SPI: Can't set max speed HZ");
-		return -1;
-	}
-	if(ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed)==-1){
-		perror("SPI: Can't get max speed HZ.");
-		return -1;
-	}
+	usleep(time_us);
+}
 
-	return 0;
+int spi_set_rate_low (void)
+{
+	cur->speed = SPI_SPEED_SLOW;
+	return cur->spi->ops->set_speed(cur->spi, cur->speed);
 }
 
 int spi_set_rate_high (void)
 {
-	speed = SPI_SPEED_FAST;
-	if(ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed)==-1){
-		perror("SPI: Can't set max speed HZ");
-		return -1;
+	cur->speed = (cur->tune_step >= 0) ? tune_rates[cur->tune_step] : SPI_SPEED_SLOW;
+	return cur->spi->ops->set_speed(cur->spi, cur->speed);
+}
+
+// Errors in <reads> DEV_ID reads and <patterns> write/readbacks of the whole TX buffer, at the current rate
+static unsigned int spi_test(unsigned int reads, unsigned int patterns)
+{
+	uint8 tx[TX_BUFFER_LEN], rx[TX_BUFFER_LEN];
+	uint32_t seed = 0x2545F491;
+	unsigned int errors = 0;
+	unsigned int i, p;
+
+	for(i = 0; i < reads; i++)
+	{
+		if(dwt_readdevid() != DWT_DEVICE_ID)
+			errors++;
 	}
-	if(ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed)==-1){
-		perror("SPI: Can't get max speed HZ.");
-		return -1;
+
+	for(p = 0; p < patterns; p++)
+	{
+		for(i = 0; i < TX_BUFFER_LEN; i++)
+		{
+			switch(p % 4)
+			{
+			case 0: 	tx[i] = (i & 1) ? 0xAA : 0x55; break; 	// a bit toggle on every clock
+			case 1: 	tx[i] = (i & 1) ? 0xFF : 0x00; break; 	// runs of 8 bits
+			case 2: 	tx[i] = 1 << (i % 8); break; 			// walking one
+			default:
+				seed = seed * 1103515245 + 12345;
+				tx[i] = seed >> 24;
+				break;
+			}
+		}
+
+		memset(rx, ~tx[0], sizeof(rx));
+		dwt_writetodevice(TX_BUFFER_ID, 0, TX_BUFFER_LEN, tx);
+		dwt_readfromdevice(TX_BUFFER_ID, 0, TX_BUFFER_LEN, rx);
+		if(memcmp(tx, rx, TX_BUFFER_LEN) != 0)
+			errors++;
 	}
 
-	return 0;
+	return errors;
 }
 
-int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength, const uint8 *bodyBuffer)
+int spi_autotune(void)
 {
-	int status;
-	int i;
+	int best = -1;
+	int step;
 
-	for (i = 0; i < 128; i++)
+	for(step = 0; step < SPI_TUNE_STEPS; step++)
 	{
-		
+		cur->speed = tune_rates[step];
+		if(cur->spi->ops->set_speed(cur->spi, cur->speed) != 0 || spi_test(SPI_TUNE_READS, SPI_TUNE_PATTERNS) != 0)
+			break;
+		best = step;
 	}
 
-	uint8_t txbuf[headerLength+bodylength];
-	uint8_t rxbuf[headerLength+bodylength];
+	// A failing step means the last good one is close to what the wiring allows, so one step of margin is kept, but
+	// never below SPI_SPEED_FAST, which was just verified. Passing at SPI_SPEED_MAX only says the DW1000 limit was
+	// reached, not the wiring's.
+	if(step < SPI_TUNE_STEPS && best > 0)
+		best--;
 
-	struct spi_ioc_transfer transfer = {
-		.tx_buf = (unsigned long)txbuf,
-		.rx_buf = (unsigned long)rxbuf,
-		.len = headerLength+bodylength,
-		.delay_usecs = delay_us,
-		.speed_hz = speed,
-		.bits_per_word = bits,
-	};
+	cur->tune_step = best;
+	if(spi_set_rate_high() != 0)
+		return -1;
+	return cur->speed;
+}
 
-	int j;
-	for(j = 0; j < headerLength; j++)
+// Step the rate of spi_set_rate_high() down until DEV_ID reads pass again, at worst down to SPI_SPEED_SLOW.
+// The TX buffer may hold a frame waiting to be sent, so only DEV_ID is read here.
+static void spi_fallback(void)
+{
+	cur->stats.integrity_errors++;
+
+	while(cur->tune_step >= 0)
 	{
-		txbuf[j] = headerBuffer[j];
+		cur->tune_step--;
+		cur->stats.fallbacks++;
+		spi_set_rate_high();
+		fprintf(stderr, "SPI (device %u): integrity error, falling back to %lu Hz\n", cur->index, (unsigned long)cur->speed);
+		if(spi_test(SPI_TUNE_READS, 0) == 0)
+			break;
 	}
+}
+
+int spi_check(void)
+{
+	if(dwt_readdevid() == DWT_DEVICE_ID)
+		return 0;
+
+	spi_fallback();
+	return -1;
+}
+
+int spi_check_frame(const uint8 *frame, uint16 length)
+{
+	uint16_t crc = 0;
+	uint16 i;
+	int bit;
+
+	if(length < 2)
+		return 0;
 
-	for(j = 0; j < bodylength; j++)
+	// IEEE 802.15.4 FCS: CRC-16/KERMIT over the frame, sent least significant byte first as its last 2 bytes
+	for(i = 0; i < length - 2; i++)
 	{
-		txbuf[headerLength+j] = bodyBuffer[j];
+		crc ^= frame[i];
+		for(bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
 	}
+	if(frame[length - 2] == (crc & 0xFF) && frame[length - 1] == (crc >> 8))
+		return 0;
 
-	//printf("hdr buf: %02X %02X body buf: %02X %02X tx buf: %02X %02X %02X %02X\n", headerBuffer[0], headerBuffer[1], bodyBuffer[0], bodyBuffer[1], txbuf[0], txbuf[1], txbuf[headerLength], txbuf[headerLength+1]);
-	//printf("hdr: %d body: %d tx: %d\n", headerLength, bodylength, transfer.len);
+	// The DW1000 checked the FCS on air (RXFCG), so a mismatch here means the frame was corrupted on the SPI bus
+	spi_fallback();
+	return -1;
+}
+
+int spi_set_delay(uint16_t delay_usecs)
+{
+	cur->delay_us = delay_usecs;
+	cur->spi->ops->set_delay(cur->spi, delay_usecs);
+	return 0;
+}
+
+// All the SPI functions below end up here: one message of count transactions, chip select released in between
+static int spi_transfer(const spi_xfer_t *xfers, unsigned int count)
+{
+	uint64_t bits_clocked = 0;
+	unsigned int i;
+
+	cur->stats.messages++;
+	cur->stats.transactions += count;
+	for(i = 0; i < count; i++)
+	{
+		cur->stats.header_bytes += xfers[i].header_len;
+		if(xfers[i].tx)
+			cur->stats.write_bytes += xfers[i].len;
+		else
+			cur->stats.read_bytes += xfers[i].discard + xfers[i].len;
+		bits_clocked += 8 * ((uint64_t)xfers[i].header_len + xfers[i].discard + xfers[i].len);
+	}
+	cur->stats.wire_ns += bits_clocked * 1000000000ULL / cur->speed;
 
-	// send the SPI message (all of the above fields, inc. buffers)
-	status = ioctl(fd, SPI_IOC_MESSAGE(1), &transfer);
-	if(status < 0)
+	if(cur->spi->ops->transfer(cur->spi, xfers, count) != 0)
 		return DWT_ERROR;
 
 	return DWT_SUCCESS;
+}
+
+int writetospi(uint16 headerLength, const uint8 *headerBuffer, uint32 bodylength, const uint8 *bodyBuffer)
+{
+	// Header and body go out as two segments of one message, so chip select stays asserted in between and nothing
+	// needs to be copied
+	spi_xfer_t xfer = {
+		.header = headerBuffer,
+		.header_len = headerLength,
+		.tx = bodyBuffer,
+		.len = bodylength,
+	};
 
+	return spi_transfer(&xfer, 1);
 
 } // end writetospi()
 
 int readfromspi(uint16 headerLength, const uint8 *headerBuffer, uint32 readlength, uint8 *readBuffer)
 {
-	int status;
-	uint8_t buf[readlength];
+	// The header is clocked out from its own buffer and the data is clocked straight into the caller's buffer
+	spi_xfer_t xfer = {
+		.header = headerBuffer,
+		.header_len = headerLength,
+		.rx = readBuffer,
+		.len = readlength,
+	};
+
+	return spi_transfer(&xfer, 1);
+
+} // end readfromspi()
 
-	struct spi_ioc_transfer transfer = {
-		.tx_buf = (unsigned long)headerBuffer,
-		.rx_buf = (unsigned long)buf,
-		.len = headerLength+readlength,
-		.delay_usecs = delay_us,
-		.speed_hz = speed,
-		.bits_per_word = bits,
+int readfromspidiscard(uint16 headerLength, const uint8 *headerBuffer, uint16 discardLength, uint32 readlength, uint8 *readBuffer)
+{
+	// Same as readfromspi() with the leading bytes clocked in and dropped by the backend
+	spi_xfer_t xfer = {
+		.header = headerBuffer,
+		.header_len = headerLength,
+		.rx = readBuffer,
+		.discard = discardLength,
+		.len = readlength,
 	};
 
-	// send the SPI message (all of the above fields, inc. buffers)
-	status = ioctl(fd, SPI_IOC_MESSAGE(1), &transfer);
-	if(status < 0)
+	if(discardLength > 4)
 		return DWT_ERROR;
 
-	int j;
-	for(j = 0; j < readlength; j++)
+	return spi_transfer(&xfer, 1);
+
+} // end readfromspidiscard()
+
+int readfromspibatch(uint16 count, const dwt_spiread_t *reads)
+{
+	// Each read is one transaction as in readfromspi(), chip select is released between them
+	spi_xfer_t xfers[DWT_READ_BATCH_MAX];
+	int i;
+
+	if(count == 0 || count > DWT_READ_BATCH_MAX || count > SPI_XFER_MAX)
+		return DWT_ERROR;
+
+	memset(xfers, 0, sizeof(xfers));
+
+	for(i = 0; i < count; i++)
 	{
-		readBuffer[j] = buf[j+headerLength];
+		xfers[i].header = reads[i].headerBuffer;
+		xfers[i].header_len = reads[i].headerLength;
+		xfers[i].rx = reads[i].readBuffer;
+		xfers[i].len = reads[i].readlength;
 	}
 
-	return DWT_SUCCESS;
+	return spi_transfer(xfers, count);
 
-} // end readfromspi()
+} // end readfromspibatch()
+
+int writetospibatch(uint16 count, const dwt_spiwrite_t *writes)
+{
+	// Each write is one transaction as in writetospi(), chip select is released between them
+	spi_xfer_t xfers[DWT_WRITE_BATCH_MAX];
+	int i;
+
+	if(count == 0 || count > DWT_WRITE_BATCH_MAX || count > SPI_XFER_MAX)
+		return DWT_ERROR;
+
+	memset(xfers, 0, sizeof(xfers));
+
+	for(i = 0; i < count; i++)
+	{
+		xfers[i].header = writes[i].headerBuffer;
+		xfers[i].header_len = writes[i].headerLength;
+		xfers[i].tx = writes[i].bodyBuffer;
+		xfers[i].len = writes[i].bodyLength;
+	}
+
+	return spi_transfer(xfers, count);
+
+} // end writetospibatch()
+
+uint32 spimaxtransfer(void)
+{
+	uint32_t max_transfer = cur->spi->ops->max_transfer(cur->spi);
+
+	if(cur->max_transfer && cur->max_transfer < max_transfer)
+		return cur->max_transfer;
+	return max_transfer;
+}
+
+void spi_set_max_transfer(uint32_t bytes)
+{
+	cur->max_transfer = bytes;
+}
+
+void spi_get_stats(spi_stats_t *stats)
+{
+	*stats = cur->stats;
+}
+
+void spi_reset_stats(void)
+{
+	memset(&cur->stats, 0, sizeof(cur->stats));
+}
+
+void spi_print_stats(FILE *f)
+{
+	const spi_stats_t *st = &cur->stats;
+
+	fprintf(f, "SPI %s (device %u): %llu messages, %llu transactions, %llu header + %llu write + %llu read bytes, "
+			"%.3f ms on the wire, %lu Hz, %llu integrity errors, %llu fallbacks\n", cur->spi->ops->name, cur->index,
+			(unsigned long long)st->messages, (unsigned long long)st->transactions, (unsigned long long)st->header_bytes,
+			(unsigned long long)st->write_bytes, (unsigned long long)st->read_bytes, st->wire_ns / 1e6,
+			(unsigned long)cur->speed, (unsigned long long)st->integrity_errors, (unsigned long long)st->fallbacks);
+	if(cur->spi->ops->print_stats)
+		cur->spi->ops->print_stats(cur->spi, f);
+}
+
+// Set up the RSTn and IRQ pins of a device whose backend drives a real DW1000
+static int pins_init(struct dw1000_dev *dev)
+{
+#ifdef DW1000_NO_WIRINGPI
+	(void) dev;
+	fprintf(stderr, "DW1000: built without wiringPi (WIRINGPI=0), only replay:<file> SPI paths can be used\n");
+	return -1;
+#else
+	// sets up the wiringPi library, once for all devices
+	if (!wiringpi_ready) {
+		if (wiringPiSetup () < 0) {
+			fprintf (stderr, "Unable to setup wiringPi: %s\n", strerror (errno));
+			return -1;
+		}
+		wiringpi_ready = 1;
+	}
+
+	pinMode(dev->irq_pin, INPUT);
+	pinMode(dev->rst_pin, OUTPUT);
+	digitalWrite(dev->rst_pin, HIGH);
+	return 0;
+#endif
+}
+
+dw1000_dev_t *dw1000_dev_init(unsigned int index, const dw1000_wiring_t *wiring)
+{
+	struct dw1000_dev *dev;
+	pthread_mutexattr_t attr;
+	const char *record;
+
+	if(index >= DWT_NUM_DW_DEV){
+		fprintf(stderr, "DW1000: device %u out of range, built for %d devices (DWT_NUM_DW_DEV)\n", index, DWT_NUM_DW_DEV);
+		return NULL;
+	}
+	if(wiring == NULL)
+		wiring = &wiring_def;
+
+	dev = &devices[index];
+	memset(dev, 0, sizeof(*dev));
+	dev->index = index;
+	strncpy(dev->spi_path, wiring->spi_path, sizeof(dev->spi_path) - 1);
+	dev->rst_pin = wiring->rst_pin;
+	dev->irq_pin = wiring->irq_pin;
+	dev->irq_line = wiring->irq_line;
+	dev->speed = SPI_SPEED_SLOW;
+	dev->tune_step = 0;
+	dev->delay_us = SPI_DELAY_US;
+	dev->irq_fd = -1;
+
+	// The driver enters critical sections long before irq_init(), and dwt_isr() itself enters critical sections (e.g.
+	// dwt_forcetrxoff()), so the lock is set up here and must be recursive
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&dev->irq_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_mutex_init(&dev->event_lock, NULL);
+	pthread_cond_init(&dev->event_cond, NULL);
+
+	dw1000_dev_select(dev);
+	TELEM_DEVICE(dev);
+
+	dev->spi = spi_backend_open(dev->spi_path);
+	if(dev->spi == NULL)
+		return NULL;
+
+	record = getenv(SPI_RECORD_ENV);
+	if(record != NULL && record[0] != '\0')
+	{
+		spi_backend_t *rec;
+		char path[256];
+
+		snprintf(path, sizeof(path), "%s.%u", record, index);
+		rec = spi_record_open(dev->spi, path);
+		if(rec == NULL){
+			dev->spi->ops->close(dev->spi);
+			return NULL;
+		}
+		dev->spi = rec;
+	}
+
+	dev->pins = dev->spi->ops->hardware;
+	if(dev->pins && pins_init(dev) != 0)
+		return NULL;
+
+	if(dev->spi->ops->set_speed(dev->spi, dev->speed) != 0)
+		return NULL;
+	dev->spi->ops->set_delay(dev->spi, dev->delay_us);
+
+	return dev;
+}
+
+void dw1000_dev_select(dw1000_dev_t *dev)
+{
+	cur = dev;
+	dwt_setlocaldataptr(dev->index);
+}
+
+dw1000_dev_t *dw1000_dev_current(void)
+{
+	return cur;
+}
+
+unsigned int dw1000_dev_index(const dw1000_dev_t *dev)
+{
+	return dev->index;
+}
 
 int hardware_init (void)
 {
-	// sets up the wiringPi library
-	if (wiringPiSetup () < 0) {
-		fprintf (stderr, "Unable to setup wiringPi: %s\n", strerror (errno));
-		return 1;
+	return dw1000_dev_init(0, NULL) ? 0 : -1;
+}
+
+int reset_DW1000(void)
+{
+#ifndef DW1000_NO_WIRINGPI
+	if(cur->pins)
+	{
+		digitalWrite(cur->rst_pin, LOW);
+		usleep(2000);
+		digitalWrite(cur->rst_pin, HIGH);
 	}
+#endif
+	dwt_invalidateshadow();		// the registers are back to their reset values
+    return 0;
+}
 
-	pinMode(IRQPin, INPUT);
-	pinMode(RSTPin, OUTPUT);
-	digitalWrite(RSTPin, HIGH);
+int dw1000_wakeup(void)
+{
+	uint8 buf[SPI_WAKEUP_LEN];
+	int ret;
+
+	// Chip select must be held low for 500 us, a dummy read of SPI_WAKEUP_LEN bytes at the slow rate does it
+	spi_set_rate_low();
+	ret = dwt_spicswakeup(buf, sizeof(buf));
+	spi_set_rate_high();
+	return (ret == DWT_SUCCESS) ? 0 : -1;
+}
 
-	// The following calls set up the SPI bus properties
-	if((fd = open(SPI_PATH, O_RDWR))<0){
-		perror("SPI Error: Can't open device.");
-		return -1;
+decaIrqStatus_t decamutexon(void)
+{
+	// The "interrupt" is the IRQ thread below, so taking its lock keeps dwt_isr() out of the critical section
+	pthread_mutex_lock(&cur->irq_lock);
+	return 1;   // return state before disable, value is used to re-enable in decamutexoff call
+}
+
+void decamutexoff(decaIrqStatus_t s)        // put a function here that re-enables the interrupt at the end of the critical section
+{
+	if(s) {
+		pthread_mutex_unlock(&cur->irq_lock);
 	}
-	if(ioctl(fd, SPI_IOC_WR_MODE, &mode)==-1){
-		perror("SPI: Can't set SPI mode.");
-		return -1;
+}
+
+static int irq_line_active(void)
+{
+	struct gpiohandle_data data;
+
+	if(ioctl(cur->irq_fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0)
+		return 0;
+
+	return data.values[0];
+}
+
+static void irq_service(void)
+{
+	decaIrqStatus_t s;
+
+	// The DW1000 IRQ output is level based: keep servicing while the line is still high so that an event raised while
+	// dwt_isr() was running (and which therefore produced no new edge) is not lost.
+	do {
+		TELEM_MARK(TELEM_DETECT);
+		s = decamutexon();
+		dwt_isr();
+		decamutexoff(s);
+	} while(irq_line_active());
+}
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Account for one IRQ serviced, from the edge of the line to the end of dwt_isr()
+static void irq_account(uint64_t edge_ns, uint64_t done_ns)
+{
+	irq_stats_t *st = &cur->irq_stats;
+	uint64_t deadline = rt_deadline_ns();
+	uint32_t us = (done_ns - edge_ns) / 1000;
+
+	__atomic_store_n(&st->irqs, st->irqs + 1, __ATOMIC_RELAXED);
+	if(us > st->max_us)
+		__atomic_store_n(&st->max_us, us, __ATOMIC_RELAXED);
+	if(deadline && done_ns - edge_ns > deadline)
+		__atomic_store_n(&st->missed, st->missed + 1, __ATOMIC_RELAXED);
+}
+
+static void *irq_loop(void *arg)
+{
+	struct pollfd pfd;
+	struct gpioevent_data event;
+	uint64_t wake_ns, edge_ns;
+
+	// This thread only ever services the device it was started for
+	dw1000_dev_select(arg);
+
+	pfd.fd = cur->irq_fd;
+	pfd.events = POLLIN | POLLPRI;
+
+	// An event may already be pending from before the line was requested
+	if(irq_line_active())
+		irq_service();
+
+	while(1)
+	{
+		if(poll(&pfd, 1, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			perror("IRQ: poll failed");
+			break;
+		}
+
+		wake_ns = monotonic_ns();
+		if(read(cur->irq_fd, &event, sizeof(event)) != sizeof(event))
+			continue;
+
+		// Line events are stamped with CLOCK_MONOTONIC by the kernel (CLOCK_REALTIME before Linux 5.7: the wakeup
+		// is used instead then)
+		edge_ns = (event.timestamp <= wake_ns && wake_ns - event.timestamp < 1000000000ULL) ? event.timestamp : wake_ns;
+		irq_service();
+		irq_account(edge_ns, monotonic_ns());
 	}
-	if(ioctl(fd, SPI_IOC_RD_MODE, &mode)==-1){
-		perror("SPI: Can't get SPI mode.");
+
+	return NULL;
+}
+
+// Without a device there is no IRQ line: dwt_isr() is run periodically instead and replays the status reads
+static void *irq_poll_loop(void *arg)
+{
+	dw1000_dev_select(arg);
+
+	while(1)
+	{
+		usleep(IRQ_POLL_US);
+		irq_service();
+	}
+
+	return NULL;
+}
+
+// Start the IRQ thread of the selected device, in real time if rt_init() has been called
+static int irq_start(void *(*loop)(void *))
+{
+	pthread_attr_t attr;
+	int err;
+
+	if(rt_thread_attr(&attr, cur->index) != 0){
+		fprintf(stderr, "IRQ: Can't set up the IRQ thread\n");
 		return -1;
 	}
-	if(ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits)==-1){
-		perror("SPI: Can't set bits per word.");
+
+	err = pthread_create(&cur->irq_thread, &attr, loop, cur);
+	pthread_attr_destroy(&attr);
+	if(err != 0){
+		fprintf(stderr, "IRQ: Can't start IRQ thread: %s\n", strerror(err));
 		return -1;
 	}
-	if(ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &bits)==-1){
-		perror("SPI: Can't get bits per word.");
+
+	return 0;
+}
+
+int irq_init(void)
+{
+	struct gpioevent_request req;
+	int chip_fd;
+
+	if(!cur->pins)
+		return irq_start(irq_poll_loop);
+
+	if((chip_fd = open(GPIO_CHIP_PATH, O_RDONLY))<0){
+		perror("IRQ: Can't open GPIO chip.");
 		return -1;
 	}
-	if(ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed)==-1){
-		perror("SPI: Can't set max speed HZ");
+
+	memset(&req, 0, sizeof(req));
+	req.lineoffset = cur->irq_line;
+	req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+	strncpy(req.consumer_label, "dw1000-irq", sizeof(req.consumer_label) - 1);
+
+	if(ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req)==-1){
+		perror("IRQ: Can't request IRQ line events.");
+		close(chip_fd);
 		return -1;
 	}
-	if(ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed)==-1){
-		perror("SPI: Can't get max speed HZ.");
+	close(chip_fd);
+	cur->irq_fd = req.fd;
+
+	if(irq_start(irq_loop) != 0){
+		close(cur->irq_fd);
+		cur->irq_fd = -1;
 		return -1;
 	}
+
 	return 0;
 }
 
-int reset_DW1000(void)
+void irq_get_stats(irq_stats_t *stats)
 {
-	digitalWrite(RSTPin, LOW);
-	usleep(2000);
-	digitalWrite(RSTPin, HIGH);
-    return 0;
+	stats->irqs = __atomic_load_n(&cur->irq_stats.irqs, __ATOMIC_RELAXED);
+	stats->missed = __atomic_load_n(&cur->irq_stats.missed, __ATOMIC_RELAXED);
+	stats->max_us = __atomic_load_n(&cur->irq_stats.max_us, __ATOMIC_RELAXED);
 }
 
-decaIrqStatus_t decamutexon(void) 
+void irq_event_signal(void)
 {
-	decaIrqStatus_t s = 0;
+	pthread_mutex_lock(&cur->event_lock);
+	cur->event_count++;
+	pthread_cond_signal(&cur->event_cond);
+	pthread_mutex_unlock(&cur->event_lock);
+}
 
-	if(s) {
-		// no interrupt lines
-	}
-	return s ;   // return state before disable, value is used to re-enable in decamutexoff call
+void irq_event_clear(void)
+{
+	pthread_mutex_lock(&cur->event_lock);
+	cur->event_count = 0;
+	pthread_mutex_unlock(&cur->event_lock);
 }
 
-void decamutexoff(decaIrqStatus_t s)        // put a function here that re-enables the interrupt at the end of the critical section
+int irq_event_wait(unsigned int timeout_ms)
 {
-	if(s) { //need to check the port state as we can't use level sensitive interrupt on the STM ARM
-		// no interrupt lines
+	struct timespec deadline;
+	int ret = 0;
+
+	if(timeout_ms)
+	{
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
 	}
+
+	pthread_mutex_lock(&cur->event_lock);
+	while(cur->event_count == 0 && ret == 0)
+	{
+		if(timeout_ms)
+			ret = pthread_cond_timedwait(&cur->event_cond, &cur->event_lock, &deadline);
+		else
+			ret = pthread_cond_wait(&cur->event_cond, &cur->event_lock);
+	}
+	if(cur->event_count)
+	{
+		cur->event_count--;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&cur->event_lock);
+
+	return ret ? -1 : 0;
 }
 
 void dwt_readtx_sys_count(uint8 * timestamp)
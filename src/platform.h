@@ -17,21 +17,93 @@
  * Peter Hillyard <peterhillyard@gmail.com>
  */
 
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
 #include "deca_types.h"
 #include "deca_device_api.h"
 #include <stdint.h>
+#include <stdio.h>
 #include <fcntl.h>
 
 #define DECA_MAX_SPI_HEADER_LENGTH      (3)                     // max number of bytes in header (for formating & sizing)
 
+#define DW1000_SPI_PATH_MAX             (64)
+
+// How one DW1000 board is connected to the Pi
+typedef struct
+{
+	const char *spi_path;	// spidev node, selects the bus and chip select, e.g. "/dev/spidev1.1", or another SPI
+							// backend: "bcm2835:<cs>" or "replay:<file>" (see spi_backend.h)
+	int rst_pin;			// wiringPi pin driving RSTn
+	int irq_pin;			// wiringPi pin of the IRQ output
+	int irq_line;			// gpiochip0 line offset (BCM number) of irq_pin
+} dw1000_wiring_t;
+
+// One DW1000: its spidev, pins, IRQ thread and driver local data (see dwt_setlocaldataptr())
+typedef struct dw1000_dev dw1000_dev_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dw1000_dev_init()
+ *
+ * @brief Set up the pins and spidev of one DW1000 and select it for the calling thread. Up to DWT_NUM_DW_DEV devices
+ *        can be used, each one is then initialised with reset_DW1000(), dwt_initialise(), etc. as in the single device
+ *        case, with the device selected.
+ *
+ *        When DW1000_SPI_RECORD is set in the environment, the SPI traffic of device <index> is recorded to
+ *        $DW1000_SPI_RECORD.<index>, which "replay:" paths read back. The pins are left alone by backends that don't
+ *        drive a real DW1000 (replay).
+ *
+ * @param <index>  device number, below DWT_NUM_DW_DEV
+ * @param <wiring> how the device is connected, NULL for the single board wiring used by hardware_init()
+ *
+ * @return the device, NULL on error
+ */
+dw1000_dev_t *dw1000_dev_init(unsigned int index, const dw1000_wiring_t *wiring);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dw1000_dev_select()
+ *
+ * @brief Select the device the calling thread talks to. The selection is per thread: the driver (through
+ *        dwt_setlocaldataptr()), the SPI functions, decamutexon() and irq_event_*() all apply to the selected device.
+ *        The IRQ thread of each device has it selected, so the callbacks run with their own device selected.
+ *
+ * @param <dev> device from dw1000_dev_init()
+ *
+ * @return none
+ */
+void dw1000_dev_select(dw1000_dev_t *dev);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dw1000_dev_current()
+ *
+ * @brief Get the device selected by the calling thread, e.g. to find out from a callback which device it is for.
+ *
+ * @param none
+ *
+ * @return the selected device
+ */
+dw1000_dev_t *dw1000_dev_current(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dw1000_dev_index()
+ *
+ * @brief Get the number a device was initialised with.
+ *
+ * @param <dev> device from dw1000_dev_init()
+ *
+ * @return the device number
+ */
+unsigned int dw1000_dev_index(const dw1000_dev_t *dev);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn hardware_init()
  *
- * @brief Initialise all peripherals at once.
+ * @brief Initialise all peripherals at once, for a single DW1000 on /dev/spidev1.0. The same as dw1000_dev_init(0, NULL).
  *
  * @param none
  *
- * @return none
+ * @return 0 on success, -1 on error
  */
 int hardware_init();
 
@@ -46,6 +118,21 @@ int hardware_init();
  */
 int reset_DW1000();
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dw1000_wakeup()
+ *
+ * @brief Wake the DW1000 up from SLEEP or DEEPSLEEP with its chip select (see dwt_configuresleep() with DWT_WAKE_CS),
+ *        and get it back to the SPI rate of spi_set_rate_high(). Returns as soon as the device is in INIT, a few ms
+ *        after DEEPSLEEP for the crystal to start, less if it was kept running (DWT_XTAL_EN). With DWT_CONFIG, the
+ *        configuration saved by dwt_entersleep() is restored, but not the TX buffer nor the antenna delays, which
+ *        have to be written again. Call it with decamutexon() held once irq_init() has been called.
+ *
+ * @param none
+ *
+ * @return 0 on success, -1 if the device did not wake up
+ */
+int dw1000_wakeup(void);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn spi_set_rate_low()
  *
@@ -60,7 +147,8 @@ int spi_set_rate_low();
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn spi_set_rate_high()
  *
- * @brief Set SPI rate as close to 20 MHz as possible for optimum performances.
+ * @brief Set SPI rate as close to 20 MHz as possible for optimum performances: 10 MHz, or the rate found by
+ *        spi_autotune() and lowered by later integrity errors.
  *
  * @param none
  *
@@ -68,6 +156,187 @@ int spi_set_rate_low();
  */
 int spi_set_rate_high();
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_autotune()
+ *
+ * @brief Find the fastest reliable SPI rate for the wiring, to be called instead of spi_set_rate_high() once
+ *        dwt_initialise() has locked the DW1000 PLL, and before anything is written to the TX buffer. The rate is
+ *        stepped up from 10 MHz to 20 MHz (the DW1000 limit), each step checked with DEV_ID reads and write/readbacks
+ *        of test patterns over the whole TX buffer. If a step fails, the rate settles one step below the last good
+ *        one to keep some margin; the result is what spi_set_rate_high() sets from then on. Each 2x in rate halves
+ *        the accumulator readout time. Call it before irq_init(), or with decamutexon() held.
+ *
+ * @param none
+ *
+ * @return the SPI rate in Hz, -1 on error
+ */
+int spi_autotune(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_check()
+ *
+ * @brief Check the SPI link with a DEV_ID read, e.g. once a second with decamutexon() held. On a mismatch, the rate
+ *        of spi_set_rate_high() is stepped down until DEV_ID reads pass again.
+ *
+ * @param none
+ *
+ * @return 0 if the link is fine, -1 if the rate had to be lowered
+ */
+int spi_check(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_check_frame()
+ *
+ * @brief Check the FCS of a frame the DW1000 has received with a good CRC (RXFCG), as read by the host. A mismatch
+ *        can only come from the SPI bus, and lowers the rate as in spi_check(). Meant for the RX good callback.
+ *
+ * @param <frame>  the whole frame, FCS included (length as reported to the callback)
+ * @param <length> frame length
+ *
+ * @return 0 if the frame is intact, -1 if the rate had to be lowered
+ */
+int spi_check_frame(const uint8 *frame, uint16 length);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_set_delay()
+ *
+ * @brief Set the delay inserted after each SPI transaction (0 by default). Only needed when a bus analyser or a level
+ *        shifter needs the chip select to be released for some time between accesses.
+ *
+ * @param <delay_usecs> delay in microseconds
+ *
+ * @return 0
+ */
+int spi_set_delay(uint16_t delay_usecs);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_set_max_transfer()
+ *
+ * @brief Lower the largest transaction the driver is offered (see spimaxtransfer()), e.g. to measure accumulator reads
+ *        against the chunk size. Limits above what the backend can move have no effect.
+ *
+ * @param <bytes> largest transaction in bytes, header included, 0 to go back to the backend limit
+ *
+ * @return none
+ */
+void spi_set_max_transfer(uint32_t bytes);
+
+// SPI traffic of the selected device since dw1000_dev_init() or spi_reset_stats()
+typedef struct
+{
+	uint64_t messages;		// backend calls, e.g. spidev ioctls
+	uint64_t transactions;	// chip select assertions
+	uint64_t header_bytes;
+	uint64_t write_bytes;
+	uint64_t read_bytes;	// discarded bytes included
+	uint64_t wire_ns;		// time spent clocking bytes at the selected SPI rate
+	uint64_t integrity_errors;	// failed spi_check() and spi_check_frame() calls
+	uint64_t fallbacks;		// rate steps given up after integrity errors
+} spi_stats_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_get_stats()
+ *
+ * @brief Get the SPI traffic counters of the selected device. They are kept whatever the backend.
+ *
+ * @param <stats> where to copy the counters
+ *
+ * @return none
+ */
+void spi_get_stats(spi_stats_t *stats);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_reset_stats()
+ *
+ * @brief Clear the SPI traffic counters of the selected device.
+ *
+ * @param none
+ *
+ * @return none
+ */
+void spi_reset_stats(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_print_stats()
+ *
+ * @brief Print the SPI traffic counters of the selected device, followed by those of its backend (e.g. the replay
+ *        match counts).
+ *
+ * @param <f> where to print
+ *
+ * @return none
+ */
+void spi_print_stats(FILE *f);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn irq_init()
+ *
+ * @brief Request rising edge events on the DW1000 IRQ line and start the thread that services them by calling
+ *        dwt_isr(). The callbacks registered with dwt_setcallbacks() therefore run on that thread. The events to be
+ *        reported must also be enabled in the DW1000 with dwt_setinterrupt(). Each device has its own IRQ thread.
+ *        Backends without a DW1000 (replay) have no IRQ line, dwt_isr() is then called every millisecond.
+ *        After rt_init(), the thread runs at the real-time priority and on the CPU of the device, see rt.h.
+ *
+ * @param none
+ *
+ * @return 0 on success, -1 on error
+ */
+int irq_init(void);
+
+// IRQ service times of the selected device, see irq_get_stats()
+typedef struct
+{
+	uint32_t irqs;			// IRQ line events serviced
+	uint32_t missed;		// serviced later than the real-time deadline after the edge, see rt_init()
+	uint32_t max_us;		// longest time from an edge to the end of dwt_isr()
+} irq_stats_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn irq_get_stats()
+ *
+ * @brief Get the IRQ counters of the selected device. Without an IRQ line (replay) nothing is counted.
+ *
+ * @param <stats> where to copy the counters
+ *
+ * @return none
+ */
+void irq_get_stats(irq_stats_t *stats);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn irq_event_signal()
+ *
+ * @brief Wake up a thread blocked in irq_event_wait(). Meant to be called from the dwt_isr() callbacks. Events are per
+ *        device: the waiting thread must have the same device selected.
+ *
+ * @param none
+ *
+ * @return none
+ */
+void irq_event_signal(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn irq_event_clear()
+ *
+ * @brief Drop the events signalled and not waited for yet, e.g. before starting an operation whose own event is then
+ *        waited for. Call it with decamutexon() held, before the operation is started.
+ *
+ * @param none
+ *
+ * @return none
+ */
+void irq_event_clear(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn irq_event_wait()
+ *
+ * @brief Block until irq_event_signal() is called. Signals are counted, so one sent before the wait is not lost.
+ *
+ * @param <timeout_ms> maximum time to wait in milliseconds, 0 to wait forever
+ *
+ * @return 0 if an event was received, -1 on timeout
+ */
+int irq_event_wait(unsigned int timeout_ms);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn sleep_ms()
  *
@@ -170,4 +439,6 @@ void dwt_readtx_sys_count(uint8 * timestamp);
  *
  * no return value
  */
-void dwt_readrx_sys_count(uint8 * timestamp);
\ No newline at end of file
+void dwt_readrx_sys_count(uint8 * timestamp);
+
+#endif /* _PLATFORM_H_ */
@@ -0,0 +1,610 @@
+/*
+ * profiles.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "deca_regs.h"
+#include "profiles.h"
+
+#define PROFILES_MAX					(32)	// profiles per file
+#define PROFILE_LINE_MAX				(256)
+#define PROFILE_SPEC_MAX				(256)
+
+// Symbol and bit durations, in ps
+#define PROFILE_SYMBOL_PS_PRF16			(993590)
+#define PROFILE_SYMBOL_PS_PRF64			(1017630)
+#define PROFILE_PHR_BITS				(21)
+#define PROFILE_RS_BLOCK_BITS			(330)	// Reed-Solomon: 48 parity bits per block of up to 330 data bits
+#define PROFILE_RS_PARITY_BITS			(48)
+
+typedef struct
+{
+	uint16	value;
+	uint8	code;
+} profile_code_t;
+
+static const profile_code_t plens[] = {
+	{64, DWT_PLEN_64}, {128, DWT_PLEN_128}, {256, DWT_PLEN_256}, {512, DWT_PLEN_512},
+	{1024, DWT_PLEN_1024}, {1536, DWT_PLEN_1536}, {2048, DWT_PLEN_2048}, {4096, DWT_PLEN_4096},
+};
+
+static const profile_code_t pacs[] = {
+	{8, DWT_PAC8}, {16, DWT_PAC16}, {32, DWT_PAC32}, {64, DWT_PAC64},
+};
+
+static const char *rate_names[] = {"110k", "850k", "6m8"};						// indexed by DWT_BR_*
+static const uint32 bit_ps[] = {8205130, 1025640, 128210};						// indexed by DWT_BR_*
+
+// Per channel settings, indexed by channel_index()
+static const uint8 channels[] = {1, 2, 3, 4, 5, 7};
+static const uint8 pg_delays[] = {0xC9, 0xC2, 0xC5, 0x95, 0xC0, 0x93};
+static const uint32 tx_power_smart[2][6] = {									// [PRF 64][channel]
+	{0x15355575, 0x15355575, 0x0F2F4F6F, 0x1F1F3F5F, 0x0E082848, 0x32527292},
+	{0x07274767, 0x07274767, 0x2B4B6B8B, 0x3A5A7A9A, 0x25456585, 0x5171B1D1},
+};
+static const uint32 tx_power_manual[2][6] = {
+	{0x75757575, 0x75757575, 0x6F6F6F6F, 0x5F5F5F5F, 0x48484848, 0x92929292},
+	{0x67676767, 0x67676767, 0x8B8B8B8B, 0x9A9A9A9A, 0x85858585, 0xD1D1D1D1},
+};
+static const uint8 prf16_codes[6][2] = {{1, 2}, {3, 4}, {5, 6}, {7, 8}, {3, 4}, {7, 8}};
+
+static const profile_t builtin_profiles[] = {
+	// The configuration the applications were built with: EVK1000 mode 3, long range
+	{PROFILE_DEFAULT_NAME, {2, DWT_PRF_64M, DWT_PLEN_1024, DWT_PAC32, 9, 9, 1, DWT_BR_110K, DWT_PHRMODE_STD, 0}, {0, 0}, 0, 1, 1, 1},
+	{"ch2_850k_256", {2, DWT_PRF_64M, DWT_PLEN_256, DWT_PAC16, 9, 9, 1, DWT_BR_850K, DWT_PHRMODE_STD, 0}, {0, 0}, 0, 1, 1, 1},
+	// Short preamble 6.8 Mb/s: over 10 times less airtime per frame than "default", for shorter range
+	{"ch2_6m8_128", {2, DWT_PRF_64M, DWT_PLEN_128, DWT_PAC8, 9, 9, 0, DWT_BR_6M8, DWT_PHRMODE_STD, 0}, {0, 0}, 0, 1, 1, 1},
+	{"ch5_6m8_128", {5, DWT_PRF_64M, DWT_PLEN_128, DWT_PAC8, 9, 9, 0, DWT_BR_6M8, DWT_PHRMODE_STD, 0}, {0, 0}, 0, 1, 1, 1},
+};
+
+#define NUM_BUILTIN_PROFILES			(sizeof(builtin_profiles) / sizeof(builtin_profiles[0]))
+
+static profile_t file_profiles[PROFILES_MAX];
+static int num_file_profiles = 0;
+
+static int channel_index(uint8 chan)
+{
+	unsigned int i;
+
+	for(i = 0; i < sizeof(channels); i++)
+	{
+		if(channels[i] == chan)
+			return i;
+	}
+	return -1;
+}
+
+static uint16 code_value(const profile_code_t *table, unsigned int n, uint8 code)
+{
+	unsigned int i;
+
+	for(i = 0; i < n; i++)
+	{
+		if(table[i].code == code)
+			return table[i].value;
+	}
+	return 0;
+}
+
+static int value_code(const profile_code_t *table, unsigned int n, unsigned long value)
+{
+	unsigned int i;
+
+	for(i = 0; i < n; i++)
+	{
+		if(table[i].value == value)
+			return table[i].code;
+	}
+	return -1;
+}
+
+static uint16 plen_symbols(const dwt_config_t *config)
+{
+	return code_value(plens, sizeof(plens) / sizeof(plens[0]), config->txPreambLength);
+}
+
+static uint16 pac_symbols(const dwt_config_t *config)
+{
+	return code_value(pacs, sizeof(pacs) / sizeof(pacs[0]), config->rxPAC);
+}
+
+static uint16 sfd_symbols(const dwt_config_t *config)
+{
+	static const uint8 ns_sfd_len[] = {DW_NS_SFD_LEN_110K, DW_NS_SFD_LEN_850K, DW_NS_SFD_LEN_6M8};
+
+	if(config->nsSFD)
+		return ns_sfd_len[config->dataRate];
+	return (config->dataRate == DWT_BR_110K) ? 64 : 8;
+}
+
+// PAC size recommended in the DW1000 user manual for a preamble length
+static uint8 recommended_pac(uint16 plen)
+{
+	if(plen <= 128)
+		return DWT_PAC8;
+	if(plen <= 512)
+		return DWT_PAC16;
+	if(plen <= 1024)
+		return DWT_PAC32;
+	return DWT_PAC64;
+}
+
+static int code_valid(uint8 chan, uint8 prf, uint8 code)
+{
+	int ch = channel_index(chan);
+
+	if(prf == DWT_PRF_16M)
+		return code == prf16_codes[ch][0] || code == prf16_codes[ch][1];
+	if(chan == 4 || chan == 7)
+		return code >= 17 && code <= 20;
+	return code >= 9 && code <= 12;
+}
+
+#ifdef DW1000_FIXED_CONFIG
+static int same_config(const dwt_config_t *a, const dwt_config_t *b)
+{
+	return a->chan == b->chan && a->prf == b->prf && a->txPreambLength == b->txPreambLength && a->rxPAC == b->rxPAC &&
+		   a->txCode == b->txCode && a->rxCode == b->rxCode && a->nsSFD == b->nsSFD && a->dataRate == b->dataRate &&
+		   a->phrMode == b->phrMode && a->sfdTO == b->sfdTO;
+}
+#endif
+
+static int parse_number(const char *value, unsigned long max, unsigned long *number)
+{
+	char *end;
+
+	*number = strtoul(value, &end, 0);
+	return (*value == '\0' || *end != '\0' || *number > max) ? -1 : 0;
+}
+
+static const profile_t *find_profile(const char *name)
+{
+	unsigned int i;
+
+	for(i = 0; i < (unsigned int)num_file_profiles; i++)
+	{
+		if(strcmp(file_profiles[i].name, name) == 0)
+			return &file_profiles[i];
+	}
+	for(i = 0; i < NUM_BUILTIN_PROFILES; i++)
+	{
+		if(strcmp(builtin_profiles[i].name, name) == 0)
+			return &builtin_profiles[i];
+	}
+	return NULL;
+}
+
+// Set one key of a profile; "base" is handled by the callers
+static int profile_set(profile_t *p, const char *key, const char *value)
+{
+	dwt_config_t *c = &p->config;
+	unsigned long n;
+	int code;
+
+	if(strcmp(key, "channel") == 0)
+	{
+		if(parse_number(value, 255, &n) != 0 || channel_index(n) < 0)
+			return -1;
+		c->chan = n;
+	}
+	else if(strcmp(key, "prf") == 0)
+	{
+		if(strcmp(value, "16") == 0)
+			c->prf = DWT_PRF_16M;
+		else if(strcmp(value, "64") == 0)
+			c->prf = DWT_PRF_64M;
+		else
+			return -1;
+	}
+	else if(strcmp(key, "preamble") == 0)
+	{
+		if(parse_number(value, 4096, &n) != 0 || (code = value_code(plens, sizeof(plens) / sizeof(plens[0]), n)) < 0)
+			return -1;
+		c->txPreambLength = code;
+	}
+	else if(strcmp(key, "pac") == 0)
+	{
+		if(parse_number(value, 64, &n) != 0 || (code = value_code(pacs, sizeof(pacs) / sizeof(pacs[0]), n)) < 0)
+			return -1;
+		c->rxPAC = code;
+		p->auto_pac = 0;
+	}
+	else if(strcmp(key, "code") == 0 || strcmp(key, "tx_code") == 0 || strcmp(key, "rx_code") == 0)
+	{
+		if(parse_number(value, 24, &n) != 0 || n == 0)
+			return -1;
+		if(strcmp(key, "rx_code") != 0)
+			c->txCode = n;
+		if(strcmp(key, "tx_code") != 0)
+			c->rxCode = n;
+	}
+	else if(strcmp(key, "sfd") == 0)
+	{
+		if(strcmp(value, "std") == 0)
+			c->nsSFD = 0;
+		else if(strcmp(value, "ns") == 0)
+			c->nsSFD = 1;
+		else
+			return -1;
+	}
+	else if(strcmp(key, "rate") == 0)
+	{
+		for(n = 0; n < sizeof(rate_names) / sizeof(rate_names[0]); n++)
+		{
+			if(strcmp(value, rate_names[n]) == 0)
+				break;
+		}
+		if(n == sizeof(rate_names) / sizeof(rate_names[0]))
+			return -1;
+		c->dataRate = n;
+	}
+	else if(strcmp(key, "phr") == 0)
+	{
+		if(strcmp(value, "std") == 0)
+			c->phrMode = DWT_PHRMODE_STD;
+		else if(strcmp(value, "ext") == 0)
+			c->phrMode = DWT_PHRMODE_EXT;
+		else
+			return -1;
+	}
+	else if(strcmp(key, "sfd_timeout") == 0)
+	{
+		if(strcmp(value, "auto") == 0)
+		{
+			p->auto_sfd_to = 1;
+			return 0;
+		}
+		if(parse_number(value, 0xFFFF, &n) != 0 || n == 0)
+			return -1;
+		c->sfdTO = n;
+		p->auto_sfd_to = 0;
+	}
+	else if(strcmp(key, "pg_delay") == 0)
+	{
+		if(parse_number(value, 0xFF, &n) != 0)
+			return -1;
+		p->txconfig.PGdly = n;
+		p->auto_tx = 0;
+	}
+	else if(strcmp(key, "tx_power") == 0)
+	{
+		if(parse_number(value, 0xFFFFFFFF, &n) != 0)
+			return -1;
+		p->txconfig.power = n;
+		p->auto_tx = 0;
+	}
+	else if(strcmp(key, "smart_power") == 0)
+	{
+		if(parse_number(value, 1, &n) != 0)
+			return -1;
+		p->smart_power = n;
+		p->auto_tx = 0;
+	}
+	else
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+// Derive the settings left to auto and check the whole profile. Settings that work but are not the recommended
+// ones are only warned about.
+static int profile_finish(profile_t *p, const char *where)
+{
+	dwt_config_t *c = &p->config;
+	uint16 plen = plen_symbols(c);
+	uint16 min_sfd_to;
+	int ch = channel_index(c->chan);
+
+	if(!code_valid(c->chan, c->prf, c->txCode) || !code_valid(c->chan, c->prf, c->rxCode))
+	{
+		fprintf(stderr, "%s: preamble codes %u/%u not valid on channel %u at PRF %s\n", where, c->txCode, c->rxCode,
+				c->chan, (c->prf == DWT_PRF_16M) ? "16" : "64");
+		return -1;
+	}
+
+	if(p->auto_pac)
+		c->rxPAC = recommended_pac(plen);
+	else if(c->rxPAC != recommended_pac(plen))
+		fprintf(stderr, "%s: warning: PAC %u is not the one recommended for a preamble of %u\n", where, pac_symbols(c), plen);
+
+	if(c->dataRate == DWT_BR_110K && plen < 1024)
+		fprintf(stderr, "%s: warning: a preamble of %u is short for 110 kb/s, 1024 or more is recommended\n", where, plen);
+
+	// The SFD timeout must cover the whole preamble and SFD. The receiver may start acquiring on any PAC.
+	min_sfd_to = plen + 1 + sfd_symbols(c) - pac_symbols(c);
+	if(p->auto_sfd_to)
+	{
+		c->sfdTO = min_sfd_to;
+	}
+	else if(c->sfdTO < min_sfd_to)
+	{
+		fprintf(stderr, "%s: SFD timeout %u is shorter than the preamble and SFD, %u at least\n", where, c->sfdTO, min_sfd_to);
+		return -1;
+	}
+
+	// Smart TX power only makes sense for the short frames of 6.8 Mb/s
+	if(p->auto_tx)
+	{
+		p->smart_power = (c->dataRate == DWT_BR_6M8);
+		p->txconfig.PGdly = pg_delays[ch];
+		p->txconfig.power = p->smart_power ? tx_power_smart[c->prf == DWT_PRF_64M][ch] :
+							tx_power_manual[c->prf == DWT_PRF_64M][ch];
+	}
+
+	return 0;
+}
+
+static char *trim(char *s)
+{
+	char *end;
+
+	while(isspace((unsigned char)*s))
+		s++;
+	end = s + strlen(s);
+	while(end > s && isspace((unsigned char)end[-1]))
+		end--;
+	*end = '\0';
+	return s;
+}
+
+// Check the section just read from a profile file
+static int finish_section(profile_t *p, const char *path, int line)
+{
+	char where[PROFILE_LINE_MAX];
+
+	snprintf(where, sizeof(where), "%s:%d: [%s]", path, line, p->name);
+	return profile_finish(p, where);
+}
+
+int profile_load(const char *path)
+{
+	static profile_t profiles[PROFILES_MAX];
+	char name[PROFILE_NAME_MAX];
+	char buf[PROFILE_LINE_MAX];
+	char *s, *key, *value;
+	const profile_t *base;
+	profile_t *p = NULL;
+	int num = 0;
+	int section_line = 0;
+	int line = 0;
+	int first_key = 0;
+	int i;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if(file == NULL)
+	{
+		perror("Can't open the profile file");
+		return -1;
+	}
+
+	while(fgets(buf, sizeof(buf), file) != NULL)
+	{
+		line++;
+		s = buf + strcspn(buf, ";#\r\n");
+		*s = '\0';
+		s = trim(buf);
+		if(*s == '\0')
+			continue;
+
+		if(*s == '[')
+		{
+			if(p != NULL && finish_section(p, path, section_line) != 0)
+				break;
+
+			value = strchr(s, ']');
+			if(value == NULL || value[1] != '\0' || value - s - 1 <= 0 || value - s - 1 >= PROFILE_NAME_MAX ||
+			   strchr(s, ',') != NULL)
+			{
+				fprintf(stderr, "%s:%d: bad section name\n", path, line);
+				break;
+			}
+			if(num == PROFILES_MAX)
+			{
+				fprintf(stderr, "%s:%d: more than %d profiles\n", path, line, PROFILES_MAX);
+				break;
+			}
+
+			// Sections start from the default profile
+			p = &profiles[num++];
+			*p = builtin_profiles[0];
+			*value = '\0';
+			snprintf(p->name, sizeof(p->name), "%s", s + 1);
+			section_line = line;
+			first_key = 1;
+			continue;
+		}
+
+		value = strchr(s, '=');
+		if(p == NULL || value == NULL)
+		{
+			fprintf(stderr, "%s:%d: expected [profile] or key = value\n", path, line);
+			break;
+		}
+		*value++ = '\0';
+		key = trim(s);
+		value = trim(value);
+
+		if(strcmp(key, "base") == 0)
+		{
+			// Earlier sections of the same file can be used as a base
+			base = NULL;
+			for(i = 0; i < num - 1 && base == NULL; i++)
+			{
+				if(strcmp(profiles[i].name, value) == 0)
+					base = &profiles[i];
+			}
+			if(base == NULL)
+				base = find_profile(value);
+			if(!first_key || base == NULL)
+			{
+				fprintf(stderr, "%s:%d: base must be the first key and an existing profile\n", path, line);
+				break;
+			}
+			memcpy(name, p->name, sizeof(name));
+			*p = *base;
+			memcpy(p->name, name, sizeof(name));
+		}
+		else if(profile_set(p, key, value) != 0)
+		{
+			fprintf(stderr, "%s:%d: bad value or unknown key\n", path, line);
+			break;
+		}
+		first_key = 0;
+	}
+
+	if(ferror(file) || !feof(file) || (p != NULL && finish_section(p, path, section_line) != 0))
+	{
+		fprintf(stderr, "%s: profiles not loaded\n", path);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	memcpy(file_profiles, profiles, num * sizeof(profiles[0]));
+	num_file_profiles = num;
+	return num;
+}
+
+int profile_get(const char *spec, profile_t *profile)
+{
+	char buf[PROFILE_SPEC_MAX];
+	const profile_t *base;
+	char *name, *item, *value;
+
+	if(strlen(spec) >= sizeof(buf))
+	{
+		fprintf(stderr, "%s: profile specification too long\n", spec);
+		return -1;
+	}
+	strcpy(buf, spec);
+
+	name = strtok(buf, ",");
+	base = (name != NULL) ? find_profile(name) : NULL;
+	if(base == NULL)
+	{
+		fprintf(stderr, "%s: unknown profile\n", spec);
+		return -1;
+	}
+	*profile = *base;
+
+	while((item = strtok(NULL, ",")) != NULL)
+	{
+		value = strchr(item, '=');
+		if(value == NULL)
+		{
+			fprintf(stderr, "%s: expected key=value, got %s\n", spec, item);
+			return -1;
+		}
+		*value++ = '\0';
+		if(profile_set(profile, item, value) != 0)
+		{
+			fprintf(stderr, "%s: bad value or unknown key %s\n", spec, item);
+			return -1;
+		}
+	}
+
+	if(profile_finish(profile, spec) != 0)
+		return -1;
+
+#ifdef DW1000_FIXED_CONFIG
+	if(!same_config(&profile->config, &dw1000_fixed_config.config))
+	{
+		fprintf(stderr, "%s: this build only has the radio configuration of %s\n", spec, dw1000_fixed_profile);
+		return -1;
+	}
+#endif
+
+	return 0;
+}
+
+void profile_apply(const profile_t *profile)
+{
+	dwt_txconfig_t txconfig = profile->txconfig;
+#ifdef DW1000_FIXED_CONFIG
+	// Same configuration as checked by profile_get(), without dwt_configure() and its tables
+	dwt_configurefixed(&dw1000_fixed_config);
+#else
+	dwt_config_t config = profile->config;
+
+	// dwt_configure() sets the smart TX power by data rate, override it afterwards
+	dwt_configure(&config);
+#endif
+	dwt_setsmarttxpower(profile->smart_power);
+	dwt_configuretxrf(&txconfig);
+}
+
+void profile_switch(const profile_t *profile)
+{
+	// dwt_configure() rewrites every register that depends on the configuration, the rest of dwt_initialise() and of
+	// the application setup (LDE microcode, interrupt mask, RX modes) is left as it is
+	dwt_forcetrxoff();
+	profile_apply(profile);
+}
+
+uint32 profile_frame_us(const dwt_config_t *config, uint16 length)
+{
+	uint64_t symbol_ps = (config->prf == DWT_PRF_16M) ? PROFILE_SYMBOL_PS_PRF16 : PROFILE_SYMBOL_PS_PRF64;
+	uint64_t data_bits = (uint64_t)length * 8;
+	uint64_t ps;
+
+	data_bits += PROFILE_RS_PARITY_BITS * ((data_bits + PROFILE_RS_BLOCK_BITS - 1) / PROFILE_RS_BLOCK_BITS);
+
+	// The PHR goes at 850 kb/s, except in 110 kb/s mode
+	ps = symbol_ps * (plen_symbols(config) + sfd_symbols(config));
+	ps += PROFILE_PHR_BITS * (uint64_t)bit_ps[(config->dataRate == DWT_BR_110K) ? DWT_BR_110K : DWT_BR_850K];
+	ps += data_bits * bit_ps[config->dataRate];
+
+	return (ps + 500000) / 1000000;
+}
+
+uint32 profile_preamble_us(const dwt_config_t *config)
+{
+	uint64_t symbol_ps = (config->prf == DWT_PRF_16M) ? PROFILE_SYMBOL_PS_PRF16 : PROFILE_SYMBOL_PS_PRF64;
+
+	return (symbol_ps * (plen_symbols(config) + sfd_symbols(config)) + 999999) / 1000000;
+}
+
+void profile_print(FILE *f, const profile_t *profile)
+{
+	const dwt_config_t *c = &profile->config;
+
+	fprintf(f, "%s: channel %u, prf %s, preamble %u, pac %u, code %u/%u, sfd %s, rate %s, phr %s, sfd_timeout %u, "
+			"pg_delay 0x%02X, tx_power 0x%08lX%s, %lu us per 12 byte frame\n", profile->name, c->chan,
+			(c->prf == DWT_PRF_16M) ? "16" : "64", plen_symbols(c), pac_symbols(c), c->txCode, c->rxCode,
+			c->nsSFD ? "ns" : "std", rate_names[c->dataRate], (c->phrMode == DWT_PHRMODE_EXT) ? "ext" : "std", c->sfdTO,
+			profile->txconfig.PGdly, profile->txconfig.power, profile->smart_power ? " smart" : "",
+			profile_frame_us(c, 12));
+}
+
+void profile_list(FILE *f)
+{
+	unsigned int i;
+
+	for(i = 0; i < NUM_BUILTIN_PROFILES; i++)
+	{
+		if(find_profile(builtin_profiles[i].name) == &builtin_profiles[i])
+			fprintf(f, " %s", builtin_profiles[i].name);
+	}
+	for(i = 0; i < (unsigned int)num_file_profiles; i++)
+		fprintf(f, " %s", file_profiles[i].name);
+	fprintf(f, "\n");
+}
@@ -0,0 +1,167 @@
+/*
+ * profiles.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Named radio profiles: a dwt_config_t and the matching TX RF settings, selected at run time instead of being compiled
+ * into the applications. Profiles come from a built-in table and from INI style files, one section per profile:
+ *
+ *   [fast]
+ *   channel = 5            ; 1, 2, 3, 4, 5 or 7
+ *   prf = 64               ; 16 or 64 MHz
+ *   preamble = 128         ; 64, 128, 256, 512, 1024, 1536, 2048 or 4096 symbols
+ *   pac = 8                ; 8, 16, 32 or 64, the recommended one for the preamble length by default
+ *   code = 9               ; TX and RX preamble code, or tx_code / rx_code
+ *   sfd = std              ; std or ns (Decawave non-standard SFD)
+ *   rate = 6m8             ; 110k, 850k or 6m8
+ *   phr = std              ; std or ext
+ *   sfd_timeout = auto     ; preamble + 1 + SFD length - PAC by default
+ *   base = default         ; start from another profile, only the keys given are changed
+ *   pg_delay = 0xC0        ; TX pulse generator delay, and tx_power / smart_power, per channel and PRF by default
+ *
+ * The same keys can be given on the command line after the profile name, e.g. "default,rate=6m8,preamble=128".
+ *
+ * Nodes that always run one profile can be built for it (make fixed-<profile>, DW1000_FIXED_CONFIG): the register
+ * writes of dwt_configure() for that profile are generated at build time by dw1000_cfggen and sent in one SPI message
+ * by dwt_configurefixed(), the table driven code being left out of the link. Such a build only accepts profiles with
+ * the same dwt_config_t, the TX RF settings can still be changed, and defaults to its profile.
+ */
+
+#ifndef _PROFILES_H_
+#define _PROFILES_H_
+
+#include <stdio.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+
+#define PROFILE_NAME_MAX		(32)
+#define PROFILE_DEFAULT_NAME	"default"	// channel 2, PRF 64, preamble 1024, 110 kb/s: the EVK1000 mode 3
+
+#ifdef DW1000_FIXED_CONFIG
+// Generated by dw1000_cfggen, see above
+extern const char dw1000_fixed_profile[];
+extern const dwt_fixedconfig_t dw1000_fixed_config;
+#define PROFILE_DEFAULT			dw1000_fixed_profile
+#else
+#define PROFILE_DEFAULT			PROFILE_DEFAULT_NAME
+#endif
+
+typedef struct
+{
+	char			name[PROFILE_NAME_MAX];
+	dwt_config_t	config;
+	dwt_txconfig_t	txconfig;
+	uint8			smart_power;		// dwt_setsmarttxpower()
+	uint8			auto_pac;			// the keys below were not given: derived by profile_get()
+	uint8			auto_sfd_to;
+	uint8			auto_tx;
+} profile_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn profile_load()
+ *
+ * @brief Load the profiles of a file, replacing those of any file loaded before. A profile with the name of a built-in
+ *        one overrides it. The file is checked as a whole: on any error, the profiles loaded before are kept.
+ *
+ * @param path - profile file
+ *
+ * @return number of profiles loaded, -1 on error (reported on stderr)
+ */
+int profile_load(const char *path);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn profile_get()
+ *
+ * @brief Resolve a profile specification to a validated profile.
+ *
+ * @param spec    - profile name, optionally followed by key=value overrides separated by commas
+ * @param profile - where to store the profile
+ *
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int profile_get(const char *spec, profile_t *profile);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn profile_apply()
+ *
+ * @brief Configure the selected DW1000 with a profile: dwt_configure() (dwt_configurefixed() in a fixed profile build),
+ *        dwt_configuretxrf() and smart TX power.
+ *        The receiver and transmitter must be off.
+ *
+ * @param profile - profile from profile_get()
+ *
+ * @return none
+ */
+void profile_apply(const profile_t *profile);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn profile_switch()
+ *
+ * @brief Switch the selected DW1000 to another profile while it is running, without dwt_initialise(): the
+ *        transceiver is turned off and the profile applied. The caller holds decamutexon() and turns the receiver
+ *        back on. Antenna delays, interrupts, double buffering and the SPI rate are kept.
+ *
+ * @param profile - profile from profile_get()
+ *
+ * @return none
+ */
+void profile_switch(const profile_t *profile);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn profile_frame_us()
+ *
+ * @brief Estimate the airtime of a frame: preamble, SFD, PHR and the Reed-Solomon coded payload.
+ *
+ * @param config - radio configuration
+ * @param length - frame length in bytes, FCS included
+ *
+ * @return airtime in microseconds
+ */
+uint32 profile_frame_us(const dwt_config_t *config, uint16 length);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn profile_preamble_us()
+ *
+ * @brief Get the duration of the preamble and SFD, i.e. from the start of a frame to its RMARKER, where it is
+ *        timestamped.
+ *
+ * @param config - radio configuration
+ *
+ * @return duration in microseconds, rounded up
+ */
+uint32 profile_preamble_us(const dwt_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn profile_print()
+ *
+ * @brief Print a profile on one line, with the airtime of a 12 byte frame.
+ *
+ * @param f       - where to print
+ * @param profile - profile
+ *
+ * @return none
+ */
+void profile_print(FILE *f, const profile_t *profile);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn profile_list()
+ *
+ * @brief Print the names of the profiles available, built-in and loaded.
+ *
+ * @param f - where to print
+ *
+ * @return none
+ */
+void profile_list(FILE *f);
+
+#endif /* _PROFILES_H_ */
@@ -0,0 +1,192 @@
+/*
+ * rt.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _GNU_SOURCE		// CPU affinity and mallopt()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <malloc.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+#define RT_STACK_PREFAULT		(256 * 1024)	// stack touched by rt_init(), for the main thread
+#define RT_STACK_SIZE			(256 * 1024)	// stack of the real-time threads, locked as a whole by mlockall()
+
+static rt_config_t rt;
+static int rt_on = 0;
+
+int rt_parse(const char *arg, rt_config_t *config)
+{
+	char buf[128];
+	char *item, *end;
+	long value;
+
+	if(strlen(arg) >= sizeof(buf))
+		return -1;
+	strcpy(buf, arg);
+
+	memset(config, 0, sizeof(*config));
+	config->deadline_us = RT_DEADLINE_US_DEF;
+
+	item = strtok(buf, ",");
+	if(item == NULL)
+		return -1;
+	config->priority = strtol(item, &end, 0);
+	if(*end != '\0' || config->priority < sched_get_priority_min(SCHED_FIFO) ||
+	   config->priority > sched_get_priority_max(SCHED_FIFO))
+		return -1;
+
+	while((item = strtok(NULL, ",")) != NULL)
+	{
+		if(strncmp(item, "cpu=", 4) == 0)
+		{
+			value = strtol(item + 4, &end, 0);
+			if(*end != '\0' || value < 0 || value >= CPU_SETSIZE || config->num_cpus == RT_CPUS_MAX)
+				return -1;
+			config->cpus[config->num_cpus++] = value;
+		}
+		else if(strncmp(item, "deadline=", 9) == 0)
+		{
+			value = strtol(item + 9, &end, 0);
+			if(*end != '\0' || value <= 0)
+				return -1;
+			config->deadline_us = value;
+		}
+		else
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Touch the stack below the caller, so that growing into it later does not fault
+static void prefault_stack(void)
+{
+	volatile unsigned char stack[RT_STACK_PREFAULT];
+	unsigned int i;
+
+	for(i = 0; i < sizeof(stack); i += 64)
+		stack[i] = 0;
+}
+
+int rt_init(const rt_config_t *config)
+{
+	if(config->priority == 0)
+		return 0;
+
+	// Freed memory stays in the heap and large blocks come from it too, so nothing is mapped or unmapped later
+	if(mallopt(M_TRIM_THRESHOLD, -1) == 0 || mallopt(M_MMAP_MAX, 0) == 0)
+	{
+		fprintf(stderr, "RT: Can't configure malloc\n");
+		return -1;
+	}
+
+	if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	{
+		perror("RT: Can't lock memory");
+		return -1;
+	}
+	prefault_stack();
+
+	rt = *config;
+	rt_on = 1;
+	return 0;
+}
+
+int rt_enabled(void)
+{
+	return rt_on;
+}
+
+uint64_t rt_deadline_ns(void)
+{
+	return rt_on ? (uint64_t)rt.deadline_us * 1000 : 0;
+}
+
+static void rt_cpuset(cpu_set_t *set, unsigned int index)
+{
+	CPU_ZERO(set);
+	CPU_SET(rt.cpus[index % rt.num_cpus], set);
+}
+
+int rt_thread_attr(pthread_attr_t *attr, unsigned int index)
+{
+	struct sched_param param;
+	cpu_set_t set;
+
+	if(pthread_attr_init(attr) != 0)
+		return -1;
+	if(!rt_on)
+		return 0;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = rt.priority;
+	if(pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED) != 0 ||
+	   pthread_attr_setschedpolicy(attr, SCHED_FIFO) != 0 || pthread_attr_setschedparam(attr, &param) != 0 ||
+	   pthread_attr_setstacksize(attr, RT_STACK_SIZE) != 0)
+	{
+		pthread_attr_destroy(attr);
+		return -1;
+	}
+
+	if(rt.num_cpus)
+	{
+		rt_cpuset(&set, index);
+		if(pthread_attr_setaffinity_np(attr, sizeof(set), &set) != 0)
+		{
+			pthread_attr_destroy(attr);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int rt_thread_enter(unsigned int index)
+{
+	struct sched_param param;
+	cpu_set_t set;
+	int err;
+
+	if(!rt_on)
+		return 0;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = rt.priority;
+	err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if(err != 0)
+	{
+		fprintf(stderr, "RT: Can't set the priority: %s\n", strerror(err));
+		return -1;
+	}
+
+	if(rt.num_cpus)
+	{
+		rt_cpuset(&set, index);
+		err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if(err != 0)
+		{
+			fprintf(stderr, "RT: Can't set the CPU: %s\n", strerror(err));
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * rt.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Opt-in real-time mode for the capture path. rt_init() locks the whole process in memory and keeps the C library
+ * from ever giving memory back, so that the IRQ threads never take a page fault; the IRQ thread of each device
+ * (see irq_init()) then runs at a SCHED_FIFO priority, pinned to its own CPU, ideally one kept away from the rest of
+ * the system with isolcpus=. Each IRQ is timed from the edge of the IRQ line to the end of dwt_isr() and counted as a
+ * missed deadline when that takes longer than the deadline set, see irq_get_stats().
+ *
+ * Needs CAP_SYS_NICE and CAP_IPC_LOCK (or root, or matching RLIMIT_RTPRIO and RLIMIT_MEMLOCK).
+ */
+
+#ifndef _RT_H_
+#define _RT_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define RT_CPUS_MAX				(8)
+#define RT_DEADLINE_US_DEF		(1000)	// IRQ edge to end of dwt_isr(), e.g. the CIR readout
+
+typedef struct
+{
+	int			priority;			// SCHED_FIFO priority, 0 when the real-time mode is off
+	int			cpus[RT_CPUS_MAX];	// CPU of the IRQ thread of device N: cpus[N % num_cpus]
+	int			num_cpus;			// 0 to leave the threads on any CPU
+	uint32_t	deadline_us;
+} rt_config_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rt_parse()
+ *
+ * @brief Parse a real-time mode specification: priority[,cpu=N]...[,deadline=us], e.g. "80,cpu=2,cpu=3". The n-th
+ *        cpu is used by the n-th device.
+ *
+ * @param <arg>    specification
+ * @param <config> where to store the settings
+ *
+ * @return 0 on success, -1 on error
+ */
+int rt_parse(const char *arg, rt_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rt_init()
+ *
+ * @brief Enter the real-time mode: lock all current and future memory with mlockall(), turn off heap trimming and
+ *        mmap() allocations and prefault some stack. To be called once, before dw1000_dev_init() and any thread is
+ *        started. The threads started afterwards with rt_thread_attr() get the priority and CPU.
+ *
+ * @param <config> settings, the mode stays off if the priority is 0
+ *
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int rt_init(const rt_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rt_enabled()
+ *
+ * @brief Tell whether rt_init() has entered the real-time mode.
+ *
+ * @return 1 if it has, 0 otherwise
+ */
+int rt_enabled(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rt_deadline_ns()
+ *
+ * @brief Get the IRQ deadline.
+ *
+ * @return deadline in ns, 0 when the real-time mode is off
+ */
+uint64_t rt_deadline_ns(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rt_thread_attr()
+ *
+ * @brief Initialise the attributes of a thread to be run in real time: explicit SCHED_FIFO scheduling at the priority
+ *        set and the CPU of a device. Without the real-time mode, plain default attributes. The caller destroys them
+ *        with pthread_attr_destroy().
+ *
+ * @param <attr>  attributes to initialise
+ * @param <index> device number, selects the CPU
+ *
+ * @return 0 on success, -1 on error
+ */
+int rt_thread_attr(pthread_attr_t *attr, unsigned int index);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rt_thread_enter()
+ *
+ * @brief Move the calling thread to the real-time priority and the CPU of a device, e.g. a main thread that does SPI
+ *        transfers on a schedule. Nothing is done without the real-time mode.
+ *
+ * @param <index> device number, selects the CPU
+ *
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int rt_thread_enter(unsigned int index);
+
+#endif /* _RT_H_ */
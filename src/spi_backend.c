@@ -0,0 +1,166 @@
+/*
+ * spi_backend.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Backend selection and the record backend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spi_backend.h"
+
+#define BCM2835_PREFIX			"bcm2835:"
+#define REPLAY_PREFIX			"replay:"
+
+#define RECORD_BUFSIZ			(256 * 1024)
+
+typedef struct
+{
+	spi_backend_t	base;
+	spi_ops_t		ops;		// record_ops, with the hardware flag of inner
+	spi_backend_t	*inner;
+	FILE			*file;
+	char			*buf;		// stdio buffer of file
+	int				error;		// a write to the file failed, reported once at close
+} record_t;
+
+spi_backend_t *spi_backend_open(const char *path)
+{
+	if(strncmp(path, BCM2835_PREFIX, strlen(BCM2835_PREFIX)) == 0)
+		return spi_bcm2835_open(path + strlen(BCM2835_PREFIX));
+	if(strncmp(path, REPLAY_PREFIX, strlen(REPLAY_PREFIX)) == 0)
+		return spi_replay_open(path + strlen(REPLAY_PREFIX));
+
+	return spi_spidev_open(path);
+}
+
+static void record_close(spi_backend_t *spi)
+{
+	record_t *rec = (record_t *)spi;
+
+	if(fclose(rec->file) != 0 || rec->error)
+		fprintf(stderr, "SPI record: write error, the record file is incomplete\n");
+	rec->inner->ops->close(rec->inner);
+	free(rec->buf);
+	free(rec);
+}
+
+static int record_set_speed(spi_backend_t *spi, uint32_t hz)
+{
+	record_t *rec = (record_t *)spi;
+
+	return rec->inner->ops->set_speed(rec->inner, hz);
+}
+
+static void record_set_delay(spi_backend_t *spi, uint16_t usecs)
+{
+	record_t *rec = (record_t *)spi;
+
+	rec->inner->ops->set_delay(rec->inner, usecs);
+}
+
+static int record_transfer(spi_backend_t *spi, const spi_xfer_t *xfers, unsigned int count)
+{
+	record_t *rec = (record_t *)spi;
+	spi_rec_t hdr;
+	unsigned int i;
+
+	if(rec->inner->ops->transfer(rec->inner, xfers, count) != 0)
+		return -1;
+
+	// Only completed transactions are recorded, with the data actually read
+	for(i = 0; i < count; i++)
+	{
+		hdr.header_len = xfers[i].header_len;
+		hdr.dir = xfers[i].tx ? SPI_REC_WRITE : SPI_REC_READ;
+		hdr.discard = xfers[i].discard;
+		hdr.len = xfers[i].len;
+
+		if(fwrite(&hdr, sizeof(hdr), 1, rec->file) != 1 ||
+		   fwrite(xfers[i].header, 1, hdr.header_len, rec->file) != hdr.header_len ||
+		   fwrite(xfers[i].tx ? xfers[i].tx : xfers[i].rx, 1, hdr.len, rec->file) != hdr.len)
+			rec->error = 1;
+	}
+
+	return 0;
+}
+
+static uint32_t record_max_transfer(spi_backend_t *spi)
+{
+	record_t *rec = (record_t *)spi;
+
+	return rec->inner->ops->max_transfer(rec->inner);
+}
+
+static void record_print_stats(spi_backend_t *spi, FILE *f)
+{
+	record_t *rec = (record_t *)spi;
+
+	fprintf(f, "SPI record: %ld bytes recorded\n", ftell(rec->file));
+	if(rec->inner->ops->print_stats)
+		rec->inner->ops->print_stats(rec->inner, f);
+}
+
+static const spi_ops_t record_ops = {
+	.name = "record",
+	.close = record_close,
+	.set_speed = record_set_speed,
+	.set_delay = record_set_delay,
+	.transfer = record_transfer,
+	.max_transfer = record_max_transfer,
+	.print_stats = record_print_stats,
+};
+
+spi_backend_t *spi_record_open(spi_backend_t *inner, const char *path)
+{
+	spi_rec_file_t file_hdr;
+	record_t *rec;
+
+	rec = calloc(1, sizeof(*rec));
+	if(rec == NULL)
+		return NULL;
+
+	rec->file = fopen(path, "wb");
+	if(rec->file == NULL)
+	{
+		perror("SPI record: Can't create the record file");
+		free(rec);
+		return NULL;
+	}
+
+	// Recording runs on the capture path, so writes are buffered in large blocks
+	rec->buf = malloc(RECORD_BUFSIZ);
+	if(rec->buf != NULL)
+		setvbuf(rec->file, rec->buf, _IOFBF, RECORD_BUFSIZ);
+
+	memset(&file_hdr, 0, sizeof(file_hdr));
+	file_hdr.magic = SPI_REC_MAGIC;
+	file_hdr.version = SPI_REC_VERSION;
+	file_hdr.max_transfer = inner->ops->max_transfer(inner);
+	if(fwrite(&file_hdr, sizeof(file_hdr), 1, rec->file) != 1)
+	{
+		perror("SPI record: Can't write the record file");
+		fclose(rec->file);
+		free(rec->buf);
+		free(rec);
+		return NULL;
+	}
+
+	rec->ops = record_ops;
+	rec->ops.hardware = inner->ops->hardware;
+	rec->base.ops = &rec->ops;
+	rec->inner = inner;
+	return &rec->base;
+}
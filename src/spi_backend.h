@@ -0,0 +1,115 @@
+/*
+ * spi_backend.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * SPI transports behind writetospi() and friends (see platform.c). Each DW1000 gets the backend named by its SPI path:
+ *   /dev/spidevB.C     the kernel spidev driver (default)
+ *   bcm2835:<cs>       the BCM283x SPI0 controller driven directly from user space through /dev/mem, chip select 0 or 1
+ *   replay:<file>      no hardware, read data served from a file recorded with the record backend
+ * Any backend can be wrapped by the record backend, which appends every transaction to a file (see spi_record_open()).
+ */
+
+#ifndef _SPI_BACKEND_H_
+#define _SPI_BACKEND_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+// One DW1000 transaction, i.e. one chip select assertion: a header, then a body either written or read
+typedef struct
+{
+	const uint8_t	*header;
+	uint16_t		header_len;
+	const uint8_t	*tx;			// body to write, NULL for a read
+	uint8_t			*rx;			// where to read the body, NULL for a write
+	uint16_t		discard;		// bytes clocked in and dropped between the header and rx (reads only)
+	uint32_t		len;			// body length, discarded bytes not included
+} spi_xfer_t;
+
+typedef struct spi_backend spi_backend_t;
+
+typedef struct
+{
+	const char	*name;
+	int			hardware;			// drives a real DW1000, whose RSTn and IRQ pins are then used as well
+	void		(*close)(spi_backend_t *spi);
+	int			(*set_speed)(spi_backend_t *spi, uint32_t hz);		// returns 0 or -1
+	void		(*set_delay)(spi_backend_t *spi, uint16_t usecs);	// chip select idle time after each message
+	int			(*transfer)(spi_backend_t *spi, const spi_xfer_t *xfers, unsigned int count);	// 0 or -1
+	uint32_t	(*max_transfer)(spi_backend_t *spi);				// see spimaxtransfer()
+	void		(*print_stats)(spi_backend_t *spi, FILE *f);		// backend specific statistics, may be NULL
+} spi_ops_t;
+
+// Backends embed this as their first member
+struct spi_backend
+{
+	const spi_ops_t	*ops;
+};
+
+// Most transactions in one transfer() call, see readfromspibatch()
+#define SPI_XFER_MAX			(32)
+
+// Record file: an spi_rec_file_t header, then for each transaction an spi_rec_t, the header bytes and the body bytes
+// (written data, or the data read without the discarded bytes). All fields are little endian.
+#define SPI_REC_MAGIC			(0x31495053UL)	// "SPI1"
+#define SPI_REC_VERSION			(1)
+#define SPI_REC_WRITE			('W')
+#define SPI_REC_READ			('R')
+
+typedef struct
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	reserved0;
+	uint32_t	max_transfer;		// spimaxtransfer() of the recorded backend, served again on replay
+	uint32_t	reserved1;
+} spi_rec_file_t;
+
+typedef struct
+{
+	uint8_t		header_len;
+	uint8_t		dir;				// SPI_REC_WRITE or SPI_REC_READ
+	uint16_t	discard;
+	uint32_t	len;
+} spi_rec_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_backend_open()
+ *
+ * @brief Open the backend named by an SPI path, see the list above. The SPI rate is left to the backend default until
+ *        set_speed() is called.
+ *
+ * @param path - SPI path, e.g. "/dev/spidev1.0", "bcm2835:0" or "replay:capture.spi"
+ *
+ * @return the backend, NULL on error
+ */
+spi_backend_t *spi_backend_open(const char *path);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn spi_record_open()
+ *
+ * @brief Wrap a backend so that every transaction it completes is appended to a record file, for later replay with
+ *        the replay backend. Closing the returned backend closes the wrapped one.
+ *
+ * @param inner - backend to record
+ * @param path  - record file to create
+ *
+ * @return the recording backend, NULL on error (inner is then left open)
+ */
+spi_backend_t *spi_record_open(spi_backend_t *inner, const char *path);
+
+spi_backend_t *spi_spidev_open(const char *path);
+spi_backend_t *spi_bcm2835_open(const char *arg);
+spi_backend_t *spi_replay_open(const char *path);
+
+#endif /* _SPI_BACKEND_H_ */
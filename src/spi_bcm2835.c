@@ -0,0 +1,323 @@
+/*
+ * spi_bcm2835.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * BCM283x SPI0 backend: the controller registers are mapped from /dev/mem and transactions are clocked by polling the
+ * FIFOs from user space, without any system call or interrupt. This needs root, SPI0 wiring (GPIO 7-11, CE0 or CE1)
+ * and the kernel SPI0 driver not to use the controller (no dtparam=spi=on). The pins are switched to SPI0 here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "spi_backend.h"
+
+#define BCM2835_RANGES_PATH				"/proc/device-tree/soc/ranges"
+#define BCM2835_PERI_BASE_DEF			(0x3F000000UL)	// Pi 2 and 3, when the device tree can't be read
+#define BCM2835_GPIO_OFFSET				(0x200000)
+#define BCM2835_SPI0_OFFSET				(0x204000)
+#define BCM2835_BLOCK_SIZE				(4096)
+
+// The divider applies to the core clock, which depends on the board (250 MHz on the Pi 1 and 2, 400 MHz on the Pi 3,
+// 500 MHz on the Pi 4 by default) and on config.txt, and may be scaled at run time: its highest rate is read from the
+// firmware through the mailbox property interface so that SCLK never exceeds the rate asked for
+#define BCM2835_MBOX_PATH				"/dev/vcio"
+#define BCM2835_MBOX_PROPERTY			_IOWR(100, 0, char *)
+#define BCM2835_MBOX_REQUEST			(0x00000000)
+#define BCM2835_MBOX_SUCCESS			(0x80000000)
+#define BCM2835_MBOX_GET_MAX_CLOCK		(0x00030004)
+#define BCM2835_MBOX_CLOCK_CORE			(4)
+
+// SPI0 registers, in 32-bit words
+#define SPI0_CS							(0)
+#define SPI0_FIFO						(1)
+#define SPI0_CLK						(2)
+
+#define SPI0_CS_CS						(0x00000003)	// chip select
+#define SPI0_CS_CLEAR					(0x00000030)	// clear both FIFOs
+#define SPI0_CS_TA						(0x00000080)	// transfer active
+#define SPI0_CS_DONE					(0x00010000)
+#define SPI0_CS_RXD						(0x00020000)	// RX FIFO not empty
+#define SPI0_CS_TXD						(0x00040000)	// TX FIFO not full
+
+// Bytes in flight, kept under the 64 byte RX FIFO so that it can't overflow
+#define SPI0_FIFO_INFLIGHT				(32)
+
+// Largest transfer reported to the driver, the controller itself has no limit in this mode
+#define BCM2835_MAX_TRANSFER			(65536)
+
+typedef struct
+{
+	spi_backend_t		base;
+	volatile uint32_t	*spi0;
+	volatile uint32_t	*gpio;
+	uint32_t			cs;			// chip select bits of SPI0_CS
+	uint32_t			core_hz;	// core clock, highest rate
+	uint16_t			delay_us;
+} bcm2835_t;
+
+static uint32_t reg_read(volatile uint32_t *reg)
+{
+	uint32_t value;
+
+	// The peripheral bus does not keep accesses to different peripherals ordered
+	__sync_synchronize();
+	value = *reg;
+	__sync_synchronize();
+	return value;
+}
+
+static void reg_write(volatile uint32_t *reg, uint32_t value)
+{
+	__sync_synchronize();
+	*reg = value;
+	__sync_synchronize();
+}
+
+static uint32_t peri_base(void)
+{
+	FILE *ranges;
+	uint8_t buf[12];
+	size_t n;
+	uint32_t base;
+
+	// The second cell of the first range is the peripheral base, the third one on the Pi 4 (64-bit addresses)
+	ranges = fopen(BCM2835_RANGES_PATH, "rb");
+	if(ranges == NULL)
+		return BCM2835_PERI_BASE_DEF;
+
+	n = fread(buf, 1, sizeof(buf), ranges);
+	fclose(ranges);
+	if(n < 8)
+		return BCM2835_PERI_BASE_DEF;
+
+	base = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) | ((uint32_t)buf[6] << 8) | buf[7];
+	if(base == 0 && n == 12)
+		base = ((uint32_t)buf[8] << 24) | ((uint32_t)buf[9] << 16) | ((uint32_t)buf[10] << 8) | buf[11];
+
+	return base ? base : BCM2835_PERI_BASE_DEF;
+}
+
+static uint32_t core_clock(void)
+{
+	uint32_t msg[8] __attribute__((aligned(16)));
+	int fd, ret;
+
+	fd = open(BCM2835_MBOX_PATH, 0);
+	if(fd < 0)
+		return 0;
+
+	msg[0] = sizeof(msg);
+	msg[1] = BCM2835_MBOX_REQUEST;
+	msg[2] = BCM2835_MBOX_GET_MAX_CLOCK;
+	msg[3] = 8;						// value buffer size
+	msg[4] = 0;						// request
+	msg[5] = BCM2835_MBOX_CLOCK_CORE;
+	msg[6] = 0;						// rate in Hz, returned
+	msg[7] = 0;						// end tag
+
+	ret = ioctl(fd, BCM2835_MBOX_PROPERTY, msg);
+	close(fd);
+	if(ret < 0 || msg[1] != BCM2835_MBOX_SUCCESS || msg[5] != BCM2835_MBOX_CLOCK_CORE)
+		return 0;
+
+	return msg[6];
+}
+
+static void gpio_set_alt0(volatile uint32_t *gpio, unsigned int pin)
+{
+	volatile uint32_t *fsel = gpio + pin / 10;
+	unsigned int shift = (pin % 10) * 3;
+
+	reg_write(fsel, (reg_read(fsel) & ~(7U << shift)) | (4U << shift));
+}
+
+static void bcm2835_close(spi_backend_t *spi)
+{
+	bcm2835_t *dev = (bcm2835_t *)spi;
+
+	reg_write(&dev->spi0[SPI0_CS], SPI0_CS_CLEAR);
+	munmap((void *)dev->spi0, BCM2835_BLOCK_SIZE);
+	munmap((void *)dev->gpio, BCM2835_BLOCK_SIZE);
+	free(dev);
+}
+
+static int bcm2835_set_speed(spi_backend_t *spi, uint32_t hz)
+{
+	bcm2835_t *dev = (bcm2835_t *)spi;
+	uint32_t cdiv;
+
+	if(hz == 0)
+		return -1;
+
+	// The divider must be even, round it up so that the rate never exceeds the one asked for. 0 means 65536.
+	cdiv = (dev->core_hz + hz - 1) / hz;
+	cdiv = (cdiv + 1) & ~1U;
+	if(cdiv < 2)
+		cdiv = 2;
+	if(cdiv >= 65536)
+		cdiv = 0;
+
+	reg_write(&dev->spi0[SPI0_CLK], cdiv);
+	return 0;
+}
+
+static void bcm2835_set_delay(spi_backend_t *spi, uint16_t usecs)
+{
+	bcm2835_t *dev = (bcm2835_t *)spi;
+
+	dev->delay_us = usecs;
+}
+
+// Byte clocked out at position pos of a transaction: header, then zeros while reading, or the data to write
+static uint8_t xfer_tx_byte(const spi_xfer_t *xfer, uint32_t pos)
+{
+	if(pos < xfer->header_len)
+		return xfer->header[pos];
+
+	pos -= xfer->header_len;
+	if(xfer->tx == NULL || pos < xfer->discard)
+		return 0;
+
+	return xfer->tx[pos - xfer->discard];
+}
+
+static void xfer_rx_byte(const spi_xfer_t *xfer, uint32_t pos, uint8_t byte)
+{
+	if(xfer->rx == NULL || pos < (uint32_t)xfer->header_len + xfer->discard)
+		return;
+
+	xfer->rx[pos - xfer->header_len - xfer->discard] = byte;
+}
+
+static int bcm2835_transfer(spi_backend_t *spi, const spi_xfer_t *xfers, unsigned int count)
+{
+	bcm2835_t *dev = (bcm2835_t *)spi;
+	volatile uint32_t *cs = &dev->spi0[SPI0_CS];
+	volatile uint32_t *fifo = &dev->spi0[SPI0_FIFO];
+	uint32_t total, tx_pos, rx_pos;
+	unsigned int i;
+
+	for(i = 0; i < count; i++)
+	{
+		total = (uint32_t)xfers[i].header_len + xfers[i].discard + xfers[i].len;
+
+		// Setting TA asserts chip select, clearing it releases chip select, which ends the DW1000 transaction
+		reg_write(cs, dev->cs | SPI0_CS_CLEAR | SPI0_CS_TA);
+
+		tx_pos = 0;
+		rx_pos = 0;
+		while(rx_pos < total)
+		{
+			while(tx_pos < total && tx_pos - rx_pos < SPI0_FIFO_INFLIGHT && (reg_read(cs) & SPI0_CS_TXD))
+				reg_write(fifo, xfer_tx_byte(&xfers[i], tx_pos++));
+
+			while(rx_pos < tx_pos && (reg_read(cs) & SPI0_CS_RXD))
+				xfer_rx_byte(&xfers[i], rx_pos++, (uint8_t)reg_read(fifo));
+		}
+
+		while(!(reg_read(cs) & SPI0_CS_DONE))
+			;
+		reg_write(cs, dev->cs);
+	}
+
+	if(dev->delay_us)
+		usleep(dev->delay_us);
+
+	return 0;
+}
+
+static uint32_t bcm2835_max_transfer(spi_backend_t *spi)
+{
+	(void) spi;
+	return BCM2835_MAX_TRANSFER;
+}
+
+static const spi_ops_t bcm2835_ops = {
+	.name = "bcm2835",
+	.hardware = 1,
+	.close = bcm2835_close,
+	.set_speed = bcm2835_set_speed,
+	.set_delay = bcm2835_set_delay,
+	.transfer = bcm2835_transfer,
+	.max_transfer = bcm2835_max_transfer,
+};
+
+spi_backend_t *spi_bcm2835_open(const char *arg)
+{
+	bcm2835_t *dev;
+	uint32_t base;
+	void *map;
+	int fd;
+
+	if(strcmp(arg, "0") != 0 && strcmp(arg, "1") != 0){
+		fprintf(stderr, "SPI bcm2835: chip select must be 0 or 1, not \"%s\"\n", arg);
+		return NULL;
+	}
+
+	dev = calloc(1, sizeof(*dev));
+	if(dev == NULL)
+		return NULL;
+	dev->base.ops = &bcm2835_ops;
+	dev->cs = (arg[0] == '1') ? 1 : 0;
+
+	// Without the core clock the SPI clock could be up to twice the one asked for, beyond the 20 MHz of the DW1000
+	dev->core_hz = core_clock();
+	if(dev->core_hz == 0){
+		fprintf(stderr, "SPI bcm2835: Can't read the core clock from %s\n", BCM2835_MBOX_PATH);
+		free(dev);
+		return NULL;
+	}
+
+	if((fd = open("/dev/mem", O_RDWR | O_SYNC))<0){
+		perror("SPI bcm2835: Can't open /dev/mem");
+		free(dev);
+		return NULL;
+	}
+
+	base = peri_base();
+	map = mmap(NULL, BCM2835_BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, base + BCM2835_SPI0_OFFSET);
+	if(map == MAP_FAILED){
+		perror("SPI bcm2835: Can't map SPI0");
+		close(fd);
+		free(dev);
+		return NULL;
+	}
+	dev->spi0 = map;
+
+	map = mmap(NULL, BCM2835_BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, base + BCM2835_GPIO_OFFSET);
+	close(fd);
+	if(map == MAP_FAILED){
+		perror("SPI bcm2835: Can't map GPIO");
+		munmap((void *)dev->spi0, BCM2835_BLOCK_SIZE);
+		free(dev);
+		return NULL;
+	}
+	dev->gpio = map;
+
+	// CE1, CE0, MISO, MOSI and SCLK
+	gpio_set_alt0(dev->gpio, 7);
+	gpio_set_alt0(dev->gpio, 8);
+	gpio_set_alt0(dev->gpio, 9);
+	gpio_set_alt0(dev->gpio, 10);
+	gpio_set_alt0(dev->gpio, 11);
+
+	// Mode 0, chip select active low, FIFOs cleared
+	reg_write(&dev->spi0[SPI0_CS], SPI0_CS_CLEAR);
+	return &dev->base;
+}
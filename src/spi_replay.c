@@ -0,0 +1,270 @@
+/*
+ * spi_replay.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Replay backend: serves the register and accumulator reads of a record file (see spi_record_open()) without any
+ * hardware, so that the driver and the applications can be run and profiled anywhere.
+ *
+ * Transactions are matched in order against the recording: a transaction matches the next record with the same
+ * direction, header bytes and length. When the code being run no longer issues the recorded sequence (e.g. an
+ * optimisation dropped a read), the next RESYNC_WINDOW records are searched for a match and replay resumes from
+ * there. Reads that match nothing return zeros. Matches, resyncs and misses are counted along with the transactions
+ * and bytes of each direction, see print_stats().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "spi_backend.h"
+
+#define RESYNC_WINDOW					(256)
+
+typedef struct
+{
+	spi_rec_t		rec;			// copied out, records are not aligned in the file
+	const uint8_t	*header;
+	const uint8_t	*body;
+} replay_rec_t;
+
+typedef struct
+{
+	spi_backend_t	base;
+	uint8_t			*data;			// the whole record file
+	replay_rec_t	*recs;
+	uint32_t		num_recs;
+	uint32_t		next;			// record expected next
+	uint32_t		max_transfer;
+
+	uint64_t		messages;
+	uint64_t		reads, writes;
+	uint64_t		read_bytes, write_bytes;
+	uint64_t		matched, resyncs, skipped, missed;
+} replay_t;
+
+static void replay_close(spi_backend_t *spi)
+{
+	replay_t *rp = (replay_t *)spi;
+
+	free(rp->recs);
+	free(rp->data);
+	free(rp);
+}
+
+static int replay_set_speed(spi_backend_t *spi, uint32_t hz)
+{
+	(void) spi;
+	(void) hz;
+	return 0;
+}
+
+static void replay_set_delay(spi_backend_t *spi, uint16_t usecs)
+{
+	(void) spi;
+	(void) usecs;
+}
+
+static int rec_match(const replay_rec_t *r, const spi_xfer_t *xfer)
+{
+	return r->rec.dir == (xfer->tx ? SPI_REC_WRITE : SPI_REC_READ) && r->rec.header_len == xfer->header_len &&
+		   r->rec.len == xfer->len && memcmp(r->header, xfer->header, xfer->header_len) == 0;
+}
+
+static void replay_xfer(replay_t *rp, const spi_xfer_t *xfer)
+{
+	uint32_t end = (rp->next + RESYNC_WINDOW < rp->num_recs) ? rp->next + RESYNC_WINDOW : rp->num_recs;
+	uint32_t i;
+
+	for(i = rp->next; i < end; i++)
+	{
+		if(rec_match(&rp->recs[i], xfer))
+			break;
+	}
+
+	if(i == end)
+	{
+		rp->missed++;
+		if(xfer->rx)
+			memset(xfer->rx, 0, xfer->len);
+		return;
+	}
+
+	if(i == rp->next)
+	{
+		rp->matched++;
+	}
+	else
+	{
+		rp->resyncs++;
+		rp->skipped += i - rp->next;
+	}
+
+	if(xfer->rx)
+		memcpy(xfer->rx, rp->recs[i].body, xfer->len);
+	rp->next = i + 1;
+}
+
+static int replay_transfer(spi_backend_t *spi, const spi_xfer_t *xfers, unsigned int count)
+{
+	replay_t *rp = (replay_t *)spi;
+	unsigned int i;
+
+	rp->messages++;
+	for(i = 0; i < count; i++)
+	{
+		if(xfers[i].tx)
+		{
+			rp->writes++;
+			rp->write_bytes += xfers[i].header_len + xfers[i].len;
+		}
+		else
+		{
+			rp->reads++;
+			rp->read_bytes += xfers[i].header_len + xfers[i].discard + xfers[i].len;
+		}
+
+		replay_xfer(rp, &xfers[i]);
+	}
+
+	return 0;
+}
+
+static uint32_t replay_max_transfer(spi_backend_t *spi)
+{
+	replay_t *rp = (replay_t *)spi;
+
+	return rp->max_transfer;
+}
+
+static void replay_print_stats(spi_backend_t *spi, FILE *f)
+{
+	replay_t *rp = (replay_t *)spi;
+
+	fprintf(f, "SPI replay: %" PRIu64 " messages, %" PRIu64 " reads (%" PRIu64 " bytes), %" PRIu64 " writes (%" PRIu64
+			" bytes)\n", rp->messages, rp->reads, rp->read_bytes, rp->writes, rp->write_bytes);
+	fprintf(f, "SPI replay: %" PRIu64 " matched, %" PRIu64 " resyncs (%" PRIu64 " records skipped), %" PRIu64
+			" missed, %" PRIu32 " of %" PRIu32 " records replayed\n", rp->matched, rp->resyncs, rp->skipped, rp->missed,
+			rp->next, rp->num_recs);
+}
+
+static const spi_ops_t replay_ops = {
+	.name = "replay",
+	.hardware = 0,
+	.close = replay_close,
+	.set_speed = replay_set_speed,
+	.set_delay = replay_set_delay,
+	.transfer = replay_transfer,
+	.max_transfer = replay_max_transfer,
+	.print_stats = replay_print_stats,
+};
+
+static int load_file(const char *path, uint8_t **data, long *size)
+{
+	FILE *file;
+
+	file = fopen(path, "rb");
+	if(file == NULL)
+	{
+		perror("SPI replay: Can't open the record file");
+		return -1;
+	}
+
+	if(fseek(file, 0, SEEK_END) != 0 || (*size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0)
+	{
+		perror("SPI replay: Can't read the record file");
+		fclose(file);
+		return -1;
+	}
+
+	*data = malloc(*size ? *size : 1);
+	if(*data == NULL || fread(*data, 1, *size, file) != (size_t)*size)
+	{
+		perror("SPI replay: Can't read the record file");
+		free(*data);
+		fclose(file);
+		return -1;
+	}
+
+	fclose(file);
+	return 0;
+}
+
+// Build the record index. A truncated last record, e.g. from an interrupted recording, is ignored.
+static int index_records(replay_t *rp, long size)
+{
+	const spi_rec_file_t *file_hdr = (const spi_rec_file_t *)rp->data;
+	spi_rec_t rec;
+	uint32_t cap = 0;
+	long pos;
+
+	if(size < (long)sizeof(*file_hdr) || file_hdr->magic != SPI_REC_MAGIC || file_hdr->version != SPI_REC_VERSION)
+	{
+		fprintf(stderr, "SPI replay: not a record file\n");
+		return -1;
+	}
+	rp->max_transfer = file_hdr->max_transfer;
+
+	pos = sizeof(*file_hdr);
+	while(pos + (long)sizeof(rec) <= size)
+	{
+		memcpy(&rec, rp->data + pos, sizeof(rec));
+		if(pos + (long)sizeof(rec) + rec.header_len + (long)rec.len > size)
+			break;
+
+		if(rp->num_recs == cap)
+		{
+			replay_rec_t *recs;
+
+			cap = cap ? 2 * cap : 1024;
+			recs = realloc(rp->recs, cap * sizeof(*recs));
+			if(recs == NULL)
+				return -1;
+			rp->recs = recs;
+		}
+
+		rp->recs[rp->num_recs].rec = rec;
+		rp->recs[rp->num_recs].header = rp->data + pos + sizeof(rec);
+		rp->recs[rp->num_recs].body = rp->data + pos + sizeof(rec) + rec.header_len;
+		rp->num_recs++;
+
+		pos += sizeof(rec) + rec.header_len + rec.len;
+	}
+
+	return 0;
+}
+
+spi_backend_t *spi_replay_open(const char *path)
+{
+	replay_t *rp;
+	long size;
+
+	rp = calloc(1, sizeof(*rp));
+	if(rp == NULL)
+		return NULL;
+	rp->base.ops = &replay_ops;
+
+	if(load_file(path, &rp->data, &size) != 0)
+	{
+		free(rp);
+		return NULL;
+	}
+
+	if(index_records(rp, size) != 0)
+	{
+		replay_close(&rp->base);
+		return NULL;
+	}
+
+	return &rp->base;
+}
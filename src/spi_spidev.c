@@ -0,0 +1,212 @@
+/*
+ * spi_spidev.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * spidev backend: each transfer() is a single SPI_IOC_MESSAGE ioctl, i.e. one system call, with chip select released
+ * between the transactions by cs_change.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "spi_backend.h"
+
+#define SPIDEV_BUFSIZ_PATH 				"/sys/module/spidev/parameters/bufsiz"
+#define SPIDEV_BUFSIZ_DEF 				(4096) // spidev default when the module parameter can't be read
+
+typedef struct
+{
+	spi_backend_t	base;
+	int				fd;
+	uint32_t		speed;
+	uint16_t		delay_us;
+	uint32_t		max_transfer;	// spidev bounce buffer size
+} spidev_t;
+
+static uint32_t mode 	= 0;
+static uint8_t bits 	= 8;
+
+static void spidev_close(spi_backend_t *spi)
+{
+	spidev_t *dev = (spidev_t *)spi;
+
+	close(dev->fd);
+	free(dev);
+}
+
+static int spidev_set_speed(spi_backend_t *spi, uint32_t hz)
+{
+	spidev_t *dev = (spidev_t *)spi;
+
+	dev->speed = hz;
+	if(ioctl(dev->fd, SPI_IOC_WR_MAX_SPEED_HZ, &dev->speed)==-1){
+		perror("SPI: Can't set max speed HZ");
+		return -1;
+	}
+	if(ioctl(dev->fd, SPI_IOC_RD_MAX_SPEED_HZ, &dev->speed)==-1){
+		perror("SPI: Can't get max speed HZ.");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void spidev_set_delay(spi_backend_t *spi, uint16_t usecs)
+{
+	spidev_t *dev = (spidev_t *)spi;
+
+	dev->delay_us = usecs;
+}
+
+static int spidev_transfer(spi_backend_t *spi, const spi_xfer_t *xfers, unsigned int count)
+{
+	// Up to three segments per transaction: header, discarded bytes and body. Nothing is copied: the header and body
+	// are clocked from and into the caller's buffers, and the driver sends zeros while reading when tx_buf is not set.
+	spidev_t *dev = (spidev_t *)spi;
+	struct spi_ioc_transfer transfer[3 * SPI_XFER_MAX];
+	uint8_t discard[4];
+	unsigned int i, n = 0;
+
+	if(count == 0 || count > SPI_XFER_MAX)
+		return -1;
+
+	memset(transfer, 0, sizeof(transfer));
+
+	for(i = 0; i < count; i++)
+	{
+		if(xfers[i].discard > sizeof(discard))
+			return -1;
+
+		transfer[n].tx_buf = (unsigned long)xfers[i].header;
+		transfer[n].len = xfers[i].header_len;
+		transfer[n].speed_hz = dev->speed;
+		transfer[n].bits_per_word = bits;
+		n++;
+
+		if(xfers[i].discard)
+		{
+			transfer[n].rx_buf = (unsigned long)discard;
+			transfer[n].len = xfers[i].discard;
+			transfer[n].speed_hz = dev->speed;
+			transfer[n].bits_per_word = bits;
+			n++;
+		}
+
+		if(xfers[i].len)
+		{
+			transfer[n].tx_buf = (unsigned long)xfers[i].tx;
+			transfer[n].rx_buf = (unsigned long)xfers[i].rx;
+			transfer[n].len = xfers[i].len;
+			transfer[n].speed_hz = dev->speed;
+			transfer[n].bits_per_word = bits;
+			n++;
+		}
+
+		// cs_change on the last segment of a transaction releases chip select before the next one starts
+		transfer[n-1].cs_change = (i < count - 1);
+	}
+	// The inter-message delay is only paid once, after the last segment
+	transfer[n-1].delay_usecs = dev->delay_us;
+
+	if(ioctl(dev->fd, SPI_IOC_MESSAGE(n), transfer) < 0)
+		return -1;
+
+	return 0;
+}
+
+static uint32_t spidev_max_transfer(spi_backend_t *spi)
+{
+	spidev_t *dev = (spidev_t *)spi;
+
+	return dev->max_transfer;
+}
+
+static uint32_t spidev_read_bufsiz(void)
+{
+	FILE *bufsiz_file;
+	unsigned long bufsiz;
+	uint32_t max_transfer = SPIDEV_BUFSIZ_DEF;
+
+	// spidev refuses messages larger than its bounce buffer, which is a module parameter
+	bufsiz_file = fopen(SPIDEV_BUFSIZ_PATH, "r");
+	if(bufsiz_file == NULL)
+		return max_transfer;
+
+	if(fscanf(bufsiz_file, "%lu", &bufsiz) == 1 && bufsiz > 0)
+		max_transfer = bufsiz;
+
+	fclose(bufsiz_file);
+	return max_transfer;
+}
+
+static int spidev_setup(int fd)
+{
+	if(ioctl(fd, SPI_IOC_WR_MODE, &mode)==-1){
+		perror("SPI: Can't set SPI mode.");
+		return -1;
+	}
+	if(ioctl(fd, SPI_IOC_RD_MODE, &mode)==-1){
+		perror("SPI: Can't get SPI mode.");
+		return -1;
+	}
+	if(ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits)==-1){
+		perror("SPI: Can't set bits per word.");
+		return -1;
+	}
+	if(ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &bits)==-1){
+		perror("SPI: Can't get bits per word.");
+		return -1;
+	}
+
+	return 0;
+}
+
+static const spi_ops_t spidev_ops = {
+	.name = "spidev",
+	.hardware = 1,
+	.close = spidev_close,
+	.set_speed = spidev_set_speed,
+	.set_delay = spidev_set_delay,
+	.transfer = spidev_transfer,
+	.max_transfer = spidev_max_transfer,
+};
+
+spi_backend_t *spi_spidev_open(const char *path)
+{
+	spidev_t *dev;
+
+	dev = calloc(1, sizeof(*dev));
+	if(dev == NULL)
+		return NULL;
+	dev->base.ops = &spidev_ops;
+
+	// The following calls set up the SPI bus properties
+	if((dev->fd = open(path, O_RDWR))<0){
+		perror("SPI Error: Can't open device.");
+		free(dev);
+		return NULL;
+	}
+	if(spidev_setup(dev->fd) != 0){
+		close(dev->fd);
+		free(dev);
+		return NULL;
+	}
+
+	dev->max_transfer = spidev_read_bufsiz();
+	return &dev->base;
+}
@@ -0,0 +1,180 @@
+/*
+ * tdma.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tdma.h"
+#include "clock_sync.h"
+#include "profiles.h"
+
+#define TDMA_RX_ON_US			(16)		// receiver start up, before it can detect a preamble
+#define TDMA_SYMBOL_NS			(993)		// shortest preamble symbol (16 MHz PRF), PAC timeouts come out longer
+#define TDMA_RX_UNIT_NS			(1026)		// dwt_setrxtimeout() units, 512 / 499.2 MHz
+
+// 1 us = 499.2 * 128 = 63897.6 device time units
+#define TDMA_US_TO_DWT(us)		(((uint64_t)(us) * 638976) / 10)
+
+static int parse_u16(const char *value, unsigned long max, uint16 *out)
+{
+	char *end;
+	unsigned long n = strtoul(value, &end, 0);
+
+	if(end == value || *end != '\0' || n > max)
+		return -1;
+	*out = n;
+	return 0;
+}
+
+int tdma_parse(const char *arg, tdma_config_t *config, int *slot)
+{
+	char buf[128];
+	char *item, *end;
+	unsigned long n;
+	int ret = 0;
+
+	memset(config, 0, sizeof(*config));
+	config->num_slots = TDMA_SLOTS_DEF;
+	config->gap_us = TDMA_GAP_US_DEF;
+	config->guard_us = TDMA_GUARD_US_DEF;
+
+	if(strncmp(arg, "coord", 5) != 0)
+	{
+		n = strtoul(arg, &end, 0);
+		if(end == arg || *end != '\0' || n >= TDMA_SLOTS_MAX)
+			return -1;
+		*slot = n;
+		return 0;
+	}
+
+	if(strlen(arg) >= sizeof(buf) || (arg[5] != '\0' && arg[5] != ','))
+		return -1;
+	strcpy(buf, arg);
+	*slot = -1;
+
+	strtok(buf, ",");
+	while(ret == 0 && (item = strtok(NULL, ",")) != NULL)
+	{
+		if(strncmp(item, "slots=", 6) == 0)
+			ret = parse_u16(item + 6, TDMA_SLOTS_MAX, &config->num_slots);
+		else if(strncmp(item, "slot=", 5) == 0)
+			ret = parse_u16(item + 5, 0xFFFF, &config->slot_us);
+		else if(strncmp(item, "gap=", 4) == 0)
+			ret = parse_u16(item + 4, 0xFFFF, &config->gap_us);
+		else if(strncmp(item, "guard=", 6) == 0)
+			ret = parse_u16(item + 6, 0xFFFF, &config->guard_us);
+		else
+			ret = -1;
+	}
+
+	return (ret != 0 || config->num_slots == 0) ? -1 : 0;
+}
+
+int tdma_derive(tdma_config_t *config, const dwt_config_t *radio, uint16 length)
+{
+	uint32 frame_us = profile_frame_us(radio, length);
+	uint32 beacon_us = profile_frame_us(radio, TDMA_BEACON_LEN);
+
+	if(config->slot_us == 0)
+	{
+		if(frame_us + config->guard_us > 0xFFFF)
+		{
+			fprintf(stderr, "TDMA: frames too long for a slot\n");
+			return -1;
+		}
+		config->slot_us = frame_us + config->guard_us;
+	}
+
+	if(config->slot_us < frame_us + config->guard_us)
+	{
+		fprintf(stderr, "TDMA: %u us slots are too short, %lu us of frame and %u us of guard\n", config->slot_us, frame_us,
+				config->guard_us);
+		return -1;
+	}
+
+	// The beacon ends before slot 0 starts
+	if(config->gap_us < beacon_us + config->guard_us)
+	{
+		fprintf(stderr, "TDMA: a %u us gap is too short for the %lu us beacon\n", config->gap_us, beacon_us);
+		return -1;
+	}
+
+	if(tdma_superframe_us(config) > TDMA_SUPERFRAME_US_MAX)
+	{
+		fprintf(stderr, "TDMA: the superframe is longer than %d us\n", TDMA_SUPERFRAME_US_MAX);
+		return -1;
+	}
+
+	return 0;
+}
+
+uint32 tdma_superframe_us(const tdma_config_t *config)
+{
+	return config->gap_us + (uint32)config->num_slots * config->slot_us;
+}
+
+uint64_t tdma_slot_offset(const tdma_config_t *config, unsigned int slot)
+{
+	return TDMA_US_TO_DWT(config->gap_us + (uint32)slot * config->slot_us);
+}
+
+void tdma_rx_window(const tdma_config_t *config, const dwt_config_t *radio, uint16 length, uint64_t *lead, uint16 *rx_timeout,
+					uint16 *pre_timeout)
+{
+	// The preamble and SFD come before the RMARKER, the frame can be early or late by the guard time
+	uint32 preamble_us = profile_preamble_us(radio);
+	uint32 lead_us = TDMA_RX_ON_US + preamble_us + config->guard_us;
+	uint32 on_us = lead_us + config->guard_us + profile_frame_us(radio, length) - preamble_us;
+	uint32 pac_ns = (8 << radio->rxPAC) * TDMA_SYMBOL_NS;
+	uint32 n;
+
+	*lead = TDMA_US_TO_DWT(lead_us);
+
+	n = on_us * 1000 / TDMA_RX_UNIT_NS + 1;
+	*rx_timeout = (n > 0xFFFF) ? 0xFFFF : n;
+
+	// Turn off early unless a preamble starts within the window, and give its detection a couple of PACs
+	n = (TDMA_RX_ON_US + 2 * config->guard_us) * 1000 / pac_ns + 3;
+	*pre_timeout = (n > 0xFFFF) ? 0xFFFF : n;
+}
+
+void tdma_beacon_pack(uint8 *msg, const tdma_config_t *config)
+{
+	uint8 *p = msg + TDMA_IDX;
+
+	msg[0] = CLOCK_SYNC_BEACON_TYPE;
+	p[0] = config->num_slots;
+	p[1] = config->slot_us & 0xFF;
+	p[2] = config->slot_us >> 8;
+	p[3] = config->gap_us & 0xFF;
+	p[4] = config->gap_us >> 8;
+	p[5] = config->guard_us & 0xFF;
+	p[6] = config->guard_us >> 8;
+}
+
+int tdma_beacon_parse(const uint8 *data, uint16 length, tdma_config_t *config)
+{
+	const uint8 *p = data + TDMA_IDX;
+
+	if(length != TDMA_BEACON_LEN || data[0] != CLOCK_SYNC_BEACON_TYPE || p[0] == 0)
+		return -1;
+
+	config->num_slots = p[0];
+	config->slot_us = p[1] | (p[2] << 8);
+	config->gap_us = p[3] | (p[4] << 8);
+	config->guard_us = p[5] | (p[6] << 8);
+	return 0;
+}
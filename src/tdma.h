@@ -0,0 +1,150 @@
+/*
+ * tdma.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * TDMA superframes for many transmitters sharing one channel. A coordinator (dw1000_tx -T coord) sends a beacon at the
+ * start of every superframe; the beacon is also a clock sync beacon (see clock_sync.h) and carries the layout of the
+ * superframe, so the members only need to know their slot number. A superframe is:
+ *
+ *   | beacon | gap | slot 0 | slot 1 | ... | slot N-1 |
+ *
+ * All times are between RMARKERs (the start of the PHR, where the DW1000 timestamps frames): the RMARKER of the frame of
+ * slot k comes gap + k * slot after the one of the beacon. The gap gives the members the time to get the beacon and
+ * write their frame; a slot holds the airtime of one frame plus the guard time, which absorbs the clock drift between
+ * the beacon and the slot and the propagation delays.
+ *
+ * Beacon: byte 0 CLOCK_SYNC_BEACON_TYPE, byte 1 sequence number, bytes 2-9 TX timestamp, then the layout at TDMA_IDX
+ * (little endian): number of slots (1 byte), slot, gap and guard in us (2 bytes each), then the FCS.
+ */
+
+#ifndef _TDMA_H_
+#define _TDMA_H_
+
+#include <stdint.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+
+#define TDMA_SLOTS_MAX			(250)
+#define TDMA_SLOTS_DEF			(8)
+#define TDMA_GUARD_US_DEF		(20)
+#define TDMA_GAP_US_DEF			(3000)		// beacon to slot 0, covers the IRQ latency and the frame write of a member
+#define TDMA_SUPERFRAME_US_MAX	(1000000)
+#define TDMA_MISSED_MAX			(8)			// beacons a member can miss in a row and still send in its slot
+
+#define TDMA_IDX				(10)		// layout in a beacon, after the TX timestamp
+#define TDMA_BEACON_LEN			(TDMA_IDX + 7 + 2)	// FCS included
+
+typedef struct
+{
+	uint16	num_slots;
+	uint16	slot_us;		// 0 to derive it from the airtime of a frame, see tdma_derive()
+	uint16	gap_us;
+	uint16	guard_us;
+} tdma_config_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tdma_parse()
+ *
+ * @brief Parse a TDMA specification: "coord[,slots=N][,slot=us][,gap=us][,guard=us]" for the coordinator, or the slot
+ *        number of a member.
+ *
+ * @param arg    - specification
+ * @param config - where to store the layout, for the coordinator
+ * @param slot   - where to store the slot number, -1 for the coordinator
+ *
+ * @return 0 on success, -1 on error
+ */
+int tdma_parse(const char *arg, tdma_config_t *config, int *slot);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tdma_derive()
+ *
+ * @brief Fill in the slot length if not given and check the layout: the slots must hold a frame and the guard time, and
+ *        the superframe must be at most TDMA_SUPERFRAME_US_MAX.
+ *
+ * @param config - layout to complete
+ * @param radio  - radio configuration of the frames
+ * @param length - length of the frames sent in the slots, FCS included
+ *
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int tdma_derive(tdma_config_t *config, const dwt_config_t *radio, uint16 length);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tdma_superframe_us()
+ *
+ * @brief Get the length of a superframe, which is also the beacon period.
+ *
+ * @param config - layout
+ *
+ * @return superframe length in us
+ */
+uint32 tdma_superframe_us(const tdma_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tdma_slot_offset()
+ *
+ * @brief Get the time from the RMARKER of the beacon to the one of a slot.
+ *
+ * @param config - layout
+ * @param slot   - slot number
+ *
+ * @return offset in device time units
+ */
+uint64_t tdma_slot_offset(const tdma_config_t *config, unsigned int slot);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tdma_rx_window()
+ *
+ * @brief Get the receiver settings to catch a frame whose RMARKER is expected at a given time, within the guard time:
+ *        when to turn the receiver on, and the timeouts that turn it off again if nothing comes.
+ *
+ * @param config      - layout
+ * @param radio       - radio configuration
+ * @param length      - length of the frame expected, FCS included
+ * @param lead        - where to return the time from turning the receiver on to the RMARKER, device time units
+ * @param rx_timeout  - where to return the frame wait timeout, for dwt_setrxtimeout()
+ * @param pre_timeout - where to return the preamble detection timeout, for dwt_setpreambledetecttimeout()
+ *
+ * @return none
+ */
+void tdma_rx_window(const tdma_config_t *config, const dwt_config_t *radio, uint16 length, uint64_t *lead, uint16 *rx_timeout,
+					uint16 *pre_timeout);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tdma_beacon_pack()
+ *
+ * @brief Write the layout into a beacon.
+ *
+ * @param msg    - beacon, at least TDMA_BEACON_LEN bytes
+ * @param config - layout
+ *
+ * @return none
+ */
+void tdma_beacon_pack(uint8 *msg, const tdma_config_t *config);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tdma_beacon_parse()
+ *
+ * @brief Read the layout from a received frame, if it is a TDMA beacon.
+ *
+ * @param data   - frame
+ * @param length - length of the frame, FCS included
+ * @param config - where to store the layout
+ *
+ * @return 0 for a TDMA beacon, -1 otherwise
+ */
+int tdma_beacon_parse(const uint8 *data, uint16 length, tdma_config_t *config);
+
+#endif /* _TDMA_H_ */
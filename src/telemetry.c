@@ -0,0 +1,411 @@
+/*
+ * telemetry.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "deca_device_api.h"
+#include "telemetry.h"
+
+#ifdef DW1000_TELEMETRY
+
+#define UNIX_PREFIX				"unix:"
+
+// Log-linear buckets: values below 2 * SUB are exact, then SUB buckets per power of two
+#define SUB_BITS				(3)
+#define SUB						(1 << SUB_BITS)
+#define VALUE_BITS				(36)		// durations are clamped to 2^36 ns, about 69 s
+#define NUM_BUCKETS				((VALUE_BITS - SUB_BITS + 1) * SUB)
+
+// The histograms are only ever written by one thread, so plain relaxed stores are enough: no read-modify-write, and
+// no 64-bit atomics, which 32-bit ARM may lack
+typedef struct
+{
+	uint32_t	counts[NUM_BUCKETS];
+	uint32_t	max_ns;					// saturates at 2^32 - 1
+} telem_hist_t;
+
+typedef struct
+{
+	dw1000_dev_t		*dev;			// NULL for unused slots
+	telem_hist_t		hists[TELEM_NUM_HISTS];
+	dwt_deviceentcnts_t	counters;		// last snapshot, exporter thread only
+	uint64_t			counters_time;	// telem_now() of the snapshot
+} telem_dev_t;
+
+typedef struct
+{
+	char	*buf;
+	size_t	len;
+	size_t	size;
+} telem_buf_t;
+
+static const char * const hist_names[TELEM_NUM_HISTS] = {
+	"total", "status_clear", "frame_read", "diag_read", "cir_read", "enqueue", "write"
+};
+
+static telem_dev_t telem_devs[DWT_NUM_DW_DEV];
+
+// Frame being handled by this thread, 0 outside a frame
+static __thread uint64_t frame_start;
+static __thread uint64_t frame_last;
+
+static char *export_path;
+static int export_listen_fd = -1;
+static unsigned int export_period_ms;
+static pthread_t export_thread;
+
+uint64_t telem_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int bucket_index(uint64_t ns)
+{
+	unsigned int msb;
+
+	if(ns >= (1ULL << VALUE_BITS))
+		ns = (1ULL << VALUE_BITS) - 1;
+	if(ns < 2 * SUB)
+		return ns;
+
+	msb = 63 - __builtin_clzll(ns);
+	return (msb - SUB_BITS + 1) * SUB + ((ns >> (msb - SUB_BITS)) & (SUB - 1));
+}
+
+// Smallest value falling in bucket i
+static uint64_t bucket_lower(unsigned int i)
+{
+	unsigned int msb;
+
+	if(i < 2 * SUB)
+		return i;
+
+	msb = i / SUB + SUB_BITS - 1;
+	return (uint64_t)(SUB + i % SUB) << (msb - SUB_BITS);
+}
+
+static void hist_add(telem_hist_t *h, uint64_t ns)
+{
+	unsigned int i = bucket_index(ns);
+	uint32_t v = (ns > UINT32_MAX) ? UINT32_MAX : ns;
+
+	__atomic_store_n(&h->counts[i], __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+	if(v > __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED))
+		__atomic_store_n(&h->max_ns, v, __ATOMIC_RELAXED);
+}
+
+static telem_dev_t *current_dev(void)
+{
+	return &telem_devs[dw1000_dev_index(dw1000_dev_current())];
+}
+
+void telem_mark(telem_hist_id_t mark)
+{
+	uint64_t now = telem_now();
+	telem_dev_t *td;
+
+	if(mark == TELEM_DETECT)
+	{
+		frame_start = now;
+		frame_last = now;
+		return;
+	}
+	if(frame_last == 0)
+		return;
+
+	td = current_dev();
+	hist_add(&td->hists[mark], now - frame_last);
+	frame_last = now;
+
+	if(mark == TELEM_ENQUEUE)
+	{
+		hist_add(&td->hists[TELEM_DETECT], now - frame_start);
+		frame_last = 0;
+	}
+}
+
+void telem_record(telem_hist_id_t hist, uint64_t ns)
+{
+	hist_add(&current_dev()->hists[hist], ns);
+}
+
+void telem_add_device(dw1000_dev_t *dev)
+{
+	telem_devs[dw1000_dev_index(dev)].dev = dev;
+}
+
+static void buf_printf(telem_buf_t *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	while(1)
+	{
+		va_start(ap, fmt);
+		n = vsnprintf(b->buf + b->len, b->size - b->len, fmt, ap);
+		va_end(ap);
+		if(n < 0)
+			return;
+		if(b->len + n < b->size)
+			break;
+
+		// Grow and print again, the buffer is kept from one snapshot to the next
+		b->size = 2 * (b->len + n + 1);
+		b->buf = realloc(b->buf, b->size);
+		if(b->buf == NULL)
+		{
+			b->size = 0;
+			b->len = 0;
+			return;
+		}
+	}
+	b->len += n;
+}
+
+static void snapshot_hist(telem_buf_t *b, const telem_hist_t *h)
+{
+	static const double pcts[] = { 50, 90, 99, 99.9 };
+	static const char * const pct_names[] = { "p50_ns", "p90_ns", "p99_ns", "p999_ns" };
+	uint32_t counts[NUM_BUCKETS];
+	uint64_t total = 0, cum = 0;
+	unsigned int i, p = 0;
+	int first = 1;
+
+	// One consistent copy, the writer keeps going meanwhile
+	for(i = 0; i < NUM_BUCKETS; i++)
+	{
+		counts[i] = __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+		total += counts[i];
+	}
+
+	buf_printf(b, "{\"count\": %llu", (unsigned long long)total);
+	for(i = 0; i < NUM_BUCKETS && total && p < 4; i++)
+	{
+		cum += counts[i];
+		while(p < 4 && cum >= pcts[p] / 100.0 * total)
+			buf_printf(b, ", \"%s\": %llu", pct_names[p++], (unsigned long long)bucket_lower(i));
+	}
+	buf_printf(b, ", \"max_ns\": %lu, \"buckets\": [", (unsigned long)__atomic_load_n(&h->max_ns, __ATOMIC_RELAXED));
+
+	// Only the buckets in use, as [lower bound in ns, count]
+	for(i = 0; i < NUM_BUCKETS; i++)
+	{
+		if(counts[i] == 0)
+			continue;
+		buf_printf(b, "%s[%llu, %lu]", first ? "" : ", ", (unsigned long long)bucket_lower(i), (unsigned long)counts[i]);
+		first = 0;
+	}
+	buf_printf(b, "]}");
+}
+
+static void snapshot(telem_buf_t *b)
+{
+	const dwt_deviceentcnts_t *c;
+	unsigned int i, h;
+	int first = 1;
+
+	b->len = 0;
+	buf_printf(b, "{\"time\": %ld, \"devices\": [", (long)time(NULL));
+
+	for(i = 0; i < DWT_NUM_DW_DEV; i++)
+	{
+		if(telem_devs[i].dev == NULL)
+			continue;
+
+		c = &telem_devs[i].counters;
+		buf_printf(b, "%s\n  {\"device\": %u, \"counters_age_ms\": %llu, \"counters\": {\"PHE\": %u, \"RSL\": %u, \"CRCG\": %u, "
+				   "\"CRCB\": %u, \"ARFE\": %u, \"OVER\": %u, \"SFDTO\": %u, \"PTO\": %u, \"RTO\": %u, \"TXF\": %u, \"HPW\": %u, "
+				   "\"TXW\": %u},\n   \"phases\": {", first ? "" : ",", i,
+				   (unsigned long long)((telem_now() - telem_devs[i].counters_time) / 1000000), c->PHE, c->RSL, c->CRCG,
+				   c->CRCB, c->ARFE, c->OVER, c->SFDTO, c->PTO, c->RTO, c->TXF, c->HPW, c->TXW);
+		first = 0;
+
+		for(h = 0; h < TELEM_NUM_HISTS; h++)
+		{
+			buf_printf(b, "%s\n    \"%s\": ", h ? "," : "", hist_names[h]);
+			snapshot_hist(b, &telem_devs[i].hists[h]);
+		}
+		buf_printf(b, "}}");
+	}
+	buf_printf(b, "\n]}\n");
+}
+
+static void read_counters(void)
+{
+	decaIrqStatus_t s;
+	unsigned int i;
+
+	for(i = 0; i < DWT_NUM_DW_DEV; i++)
+	{
+		if(telem_devs[i].dev == NULL)
+			continue;
+
+		// The only SPI access of this thread: one counters read per period, between two frames
+		dw1000_dev_select(telem_devs[i].dev);
+		s = decamutexon();
+		dwt_readeventcounters(&telem_devs[i].counters);
+		decamutexoff(s);
+		telem_devs[i].counters_time = telem_now();
+	}
+}
+
+static void write_file(const telem_buf_t *b)
+{
+	char tmp[256];
+	FILE *f;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", export_path);
+	f = fopen(tmp, "w");
+	if(f == NULL)
+		return;
+
+	if(fwrite(b->buf, 1, b->len, f) != b->len)
+	{
+		fclose(f);
+		remove(tmp);
+		return;
+	}
+	fclose(f);
+	rename(tmp, export_path);
+}
+
+static void serve_client(const telem_buf_t *b)
+{
+	int fd;
+	size_t sent = 0;
+	ssize_t n;
+
+	fd = accept(export_listen_fd, NULL, NULL);
+	if(fd < 0)
+		return;
+
+	// A client going away must not kill the process with SIGPIPE
+	while(sent < b->len)
+	{
+		n = send(fd, b->buf + sent, b->len - sent, MSG_NOSIGNAL);
+		if(n <= 0)
+			break;
+		sent += n;
+	}
+	close(fd);
+}
+
+static void *export_loop(void *arg)
+{
+	telem_buf_t b = { NULL, 0, 0 };
+	struct pollfd pfd;
+	uint64_t next = 0, now;
+	int timeout;
+
+	(void) arg;
+
+	pfd.fd = export_listen_fd;
+	pfd.events = POLLIN;
+
+	while(1)
+	{
+		now = telem_now();
+		if(now >= next)
+		{
+			read_counters();
+			if(export_listen_fd < 0)
+			{
+				snapshot(&b);
+				write_file(&b);
+			}
+			next = now + export_period_ms * 1000000ULL;
+		}
+
+		timeout = (int)((next - now) / 1000000) + 1;
+		if(export_listen_fd < 0)
+		{
+			usleep(timeout * 1000);
+			continue;
+		}
+
+		if(poll(&pfd, 1, timeout) > 0)
+		{
+			// Each client gets the histograms as they are now, with the last counters snapshot
+			snapshot(&b);
+			serve_client(&b);
+		}
+	}
+
+	return NULL;
+}
+
+int telem_start(const char *dest, unsigned int period_ms)
+{
+	struct sockaddr_un addr;
+
+	export_period_ms = period_ms ? period_ms : TELEM_EXPORT_PERIOD_MS;
+
+	if(strncmp(dest, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, dest + strlen(UNIX_PREFIX), sizeof(addr.sun_path) - 1);
+
+		if((export_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0))<0){
+			perror("Telemetry: Can't create the stats socket");
+			return -1;
+		}
+		unlink(addr.sun_path);
+		if(bind(export_listen_fd, (struct sockaddr *)&addr, sizeof(addr))<0 || listen(export_listen_fd, 4)<0){
+			perror("Telemetry: Can't listen on the stats socket");
+			close(export_listen_fd);
+			export_listen_fd = -1;
+			return -1;
+		}
+	}
+	else
+	{
+		export_path = strdup(dest);
+		if(export_path == NULL)
+			return -1;
+	}
+
+	if(pthread_create(&export_thread, NULL, export_loop, NULL) != 0){
+		fprintf(stderr, "Telemetry: Can't start the exporter thread\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+#else
+
+int telem_start(const char *dest, unsigned int period_ms)
+{
+	(void) dest;
+	(void) period_ms;
+	fprintf(stderr, "Telemetry: built without DW1000_TELEMETRY (make TELEMETRY=1)\n");
+	return -1;
+}
+
+#endif /* DW1000_TELEMETRY */
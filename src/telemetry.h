@@ -0,0 +1,127 @@
+/*
+ * telemetry.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Capture path instrumentation. The IRQ thread of each device marks the phases of a frame (TELEM_MARK()) with
+ * CLOCK_MONOTONIC_RAW timestamps, and the time between two consecutive marks goes to the histogram of the later one.
+ * Histograms are log-linear (8 buckets per power of two, i.e. within 12.5%) and lock-free: each one has a single
+ * writer thread and is read with relaxed atomic loads. An exporter thread started by telem_start() periodically
+ * snapshots the DW1000 event counters and publishes everything as JSON, to a file or to a UNIX socket.
+ *
+ * Built with DW1000_TELEMETRY (make TELEMETRY=1, the default). Without it the TELEM_* macros compile to nothing.
+ */
+
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdint.h>
+
+#include "platform.h"
+
+// Phases of a received frame, in order. Each histogram holds the time from the previous mark, see telem_mark().
+typedef enum
+{
+	TELEM_DETECT = 0,		// IRQ line edge (or poll) seen, dwt_isr() about to run. Its histogram holds detect to enqueue.
+	TELEM_STATUS_CLEAR,		// SYS_STATUS read and the RX good events cleared by dwt_isr()
+	TELEM_FRAME_READ,		// dwt_readrxframe() done, diagnostics and timestamps included
+	TELEM_DIAG_READ,		// dwt_readdiagnostics() done, when the diagnostics are read on their own
+	TELEM_CIR_READ,			// dwt_readcir() or dwt_readcirwindow() done
+	TELEM_ENQUEUE,			// frame published to the capture ring, ends the frame
+	TELEM_WRITE,			// not a mark: time to write one frame out on the writer thread, see telem_record()
+	TELEM_NUM_HISTS
+} telem_hist_id_t;
+
+#define TELEM_EXPORT_PERIOD_MS	(1000)	// default telem_start() period
+
+#ifdef DW1000_TELEMETRY
+
+#define TELEM_MARK(mark)		telem_mark(mark)
+#define TELEM_RECORD(hist, ns)	telem_record(hist, ns)
+#define TELEM_NOW()				telem_now()
+#define TELEM_DEVICE(dev)		telem_add_device(dev)
+
+#else
+
+#define TELEM_MARK(mark)		((void)0)
+#define TELEM_RECORD(hist, ns)	((void)(ns))
+#define TELEM_NOW()				((uint64_t)0)
+#define TELEM_DEVICE(dev)		((void)0)
+
+#endif
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn telem_now()
+ *
+ * @brief CLOCK_MONOTONIC_RAW time, the clock of all the telemetry timestamps.
+ *
+ * @return time in ns
+ */
+uint64_t telem_now(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn telem_mark()
+ *
+ * @brief Mark a phase of the frame being handled by the calling thread, for the selected device. TELEM_DETECT starts
+ *        a frame and TELEM_ENQUEUE ends it; marks outside a frame (e.g. dwt_readcir() called from the main thread)
+ *        are ignored.
+ *
+ * @param <mark> phase reached
+ *
+ * @return none
+ */
+void telem_mark(telem_hist_id_t mark);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn telem_record()
+ *
+ * @brief Add a duration to a histogram of the selected device. There must be a single thread recording to each
+ *        histogram of a device (e.g. TELEM_WRITE from its writer thread).
+ *
+ * @param <hist> histogram
+ * @param <ns>   duration in ns
+ *
+ * @return none
+ */
+void telem_record(telem_hist_id_t hist, uint64_t ns);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn telem_add_device()
+ *
+ * @brief Include a device in the exported telemetry, done by dw1000_dev_init().
+ *
+ * @param <dev> device
+ *
+ * @return none
+ */
+void telem_add_device(dw1000_dev_t *dev);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn telem_start()
+ *
+ * @brief Start the exporter thread. Every <period_ms> it reads the event counters of each device with dwt_readeventcounters(),
+ *        which holds the driver mutex for one short SPI read, then:
+ *          - <dest> is a file: rewrites it with the current snapshot (written aside and renamed, so readers always get
+ *            a whole snapshot)
+ *          - <dest> is unix:<path>: serves the current snapshot to each client connecting to that socket, e.g.
+ *            socat - UNIX-CONNECT:<path>
+ *        The histograms are read without any lock, the capture threads are never held up. The event counters must
+ *        be enabled with dwt_configeventcounters().
+ *
+ * @param <dest>      file or unix:<socket path>
+ * @param <period_ms> counter snapshot period, e.g. TELEM_EXPORT_PERIOD_MS
+ *
+ * @return 0 on success, -1 on error or when built without DW1000_TELEMETRY
+ */
+int telem_start(const char *dest, unsigned int period_ms);
+
+#endif /* _TELEMETRY_H_ */
@@ -0,0 +1,198 @@
+/*
+ * tempcomp.c
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tempcomp.h"
+
+#define TEMPCOMP_REF_SAMPLES	(10)		// PG count samples averaged for the reference, as dwt_calcpgcount()
+#define TEMPCOMP_DELTA_MAX		(300)		// farthest count from the target accepted by the bisection
+
+enum
+{
+	TC_IDLE,		// waiting for the next measurement
+	TC_SAR,			// measurement running
+	TC_REF,			// measuring the reference PG count
+	TC_BANDWIDTH	// bisection of PG_DELAY
+};
+
+static long elapsed_us(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000L + (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+// SAR readings to degrees C and V, against the 23 C and 3.3 V readings of the OTP if it has them (DW1000 User Manual)
+static void convert(tempcomp_t *tc, uint16 raw)
+{
+	uint8 vbat_raw = raw & 0xFF, temp_raw = raw >> 8;
+	uint8 vbat_ref = dwt_geticrefvolt(), temp_ref = dwt_geticreftemp();
+
+	tc->temp = temp_ref ? (temp_raw - temp_ref) * 1.14 + 23 : temp_raw * 1.13 - 113;
+	tc->vbat = vbat_ref ? (vbat_raw - vbat_ref) / 173.0 + 3.3 : vbat_raw * 0.0057 + 2.3;
+}
+
+static int apply(tempcomp_t *tc)
+{
+	dwt_txconfig_t txconfig = tc->ref;
+
+	if(tc->flags & TEMPCOMP_POWER)
+		txconfig.power = dwt_calcpowertempadj(tc->chan, tc->ref.power, tc->target_temp, tc->ref_temp);
+	if((tc->flags & TEMPCOMP_BANDWIDTH) && tc->best_bw != 0)
+		txconfig.PGdly = tc->best_bw;
+
+	tc->comp_temp = tc->target_temp;
+	if(txconfig.PGdly == tc->txconfig.PGdly && txconfig.power == tc->txconfig.power)
+		return 0;
+
+	tc->txconfig = txconfig;
+	dwt_configuretxrf(&txconfig);
+	tc->updates++;
+	return TEMPCOMP_UPDATED;
+}
+
+// One step of dwt_calcbandwidthtempadj()
+static int bandwidth_step(tempcomp_t *tc)
+{
+	uint16 count;
+	int32 delta;
+
+	tc->bit >>= 1;
+	tc->curr_bw |= tc->bit;
+	if(dwt_pgcountsample(tc->curr_bw, &count) != DWT_SUCCESS)
+	{
+		// Settle for power, if any, and try again at the next reading
+		tc->errors++;
+		tc->best_bw = 0;
+		tc->state = TC_IDLE;
+		return apply(tc);
+	}
+
+	delta = abs((int)count - (int)tc->ref_count);
+	if(delta < tc->delta_lowest)
+	{
+		tc->delta_lowest = delta;
+		tc->best_bw = tc->curr_bw;
+	}
+
+	// A higher count means a lower bandwidth, so a lower PG_DELAY
+	if(count <= tc->ref_count)
+		tc->curr_bw &= ~tc->bit;
+
+	if(tc->bit > 1)
+		return 0;
+
+	tc->state = TC_IDLE;
+	return apply(tc);
+}
+
+static int reference_step(tempcomp_t *tc)
+{
+	uint16 count;
+
+	if(dwt_pgcountsample(tc->ref.PGdly, &count) != DWT_SUCCESS)
+	{
+		tc->errors++;
+		tc->state = TC_IDLE;
+		return 0;
+	}
+
+	tc->count_sum += count;
+	if(++tc->samples == TEMPCOMP_REF_SAMPLES)
+	{
+		tc->ref_count = tc->count_sum / TEMPCOMP_REF_SAMPLES;
+		tc->state = TC_IDLE;
+	}
+	return 0;
+}
+
+static int reading(tempcomp_t *tc)
+{
+	convert(tc, dwt_sarread());
+	tc->readings++;
+	tc->state = TC_IDLE;
+
+	if(!tc->valid)
+	{
+		tc->valid = 1;
+		tc->ref_temp = tc->temp;
+		tc->comp_temp = tc->temp;
+	}
+
+	if(tc->flags & TEMPCOMP_BANDWIDTH)
+	{
+		if(tc->ref_count == 0)
+		{
+			tc->count_sum = 0;
+			tc->samples = 0;
+			tc->state = TC_REF;
+			return TEMPCOMP_NEW_READING;
+		}
+	}
+
+	if(tc->flags == 0 || fabs(tc->temp - tc->comp_temp) < tc->threshold)
+		return TEMPCOMP_NEW_READING;
+
+	tc->target_temp = tc->temp;
+	if(!(tc->flags & TEMPCOMP_BANDWIDTH))
+		return TEMPCOMP_NEW_READING | apply(tc);
+
+	// Same start as dwt_calcbandwidthtempadj(): 0x80 set, then the bits from 0x40 down
+	tc->bit = 0x80;
+	tc->curr_bw = 0x80;
+	tc->best_bw = 0;
+	tc->delta_lowest = TEMPCOMP_DELTA_MAX;
+	tc->state = TC_BANDWIDTH;
+	return TEMPCOMP_NEW_READING;
+}
+
+void tempcomp_init(tempcomp_t *tc, const dwt_config_t *config, const dwt_txconfig_t *txconfig, uint32 flags)
+{
+	memset(tc, 0, sizeof(*tc));
+	tc->flags = flags;
+	tc->sample_ms = TEMPCOMP_SAMPLE_MS_DEF;
+	tc->threshold = TEMPCOMP_THRESHOLD_DEF;
+	tc->chan = config->chan;
+	tc->ref = *txconfig;
+	tc->txconfig = *txconfig;
+	tc->state = TC_IDLE;
+}
+
+int tempcomp_poll(tempcomp_t *tc, int idle)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	switch(tc->state)
+	{
+	case TC_SAR:
+		if(elapsed_us(&tc->started, &now) < TEMPCOMP_SAR_US)
+			return 0;
+		return reading(tc);
+	case TC_REF:
+		return idle ? reference_step(tc) : 0;
+	case TC_BANDWIDTH:
+		return idle ? bandwidth_step(tc) : 0;
+	default:
+		if(tc->readings != 0 && elapsed_us(&tc->started, &now) < tc->sample_ms * 1000L)
+			return 0;
+		dwt_sarstart();
+		tc->started = now;
+		tc->state = TC_SAR;
+		return 0;
+	}
+}
@@ -0,0 +1,115 @@
+/*
+ * tempcomp.h
+ *
+ * Copyright (C) 2016 University of Utah
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Background temperature and battery voltage measurement, and temperature compensation of the TX power and pulse
+ * generator delay (PG_DELAY). dwt_readtempvbat(), dwt_calcbandwidthtempadj() and dwt_calcpgcount() block for 1 ms to
+ * several hundred ms; here the same work is split into short steps, each a handful of SPI transactions, and run from
+ * the main loop of the application with tempcomp_poll(), which never sleeps:
+ *
+ *   - a measurement is started with dwt_sarstart() every sample period and read back with dwt_sarread() by a later
+ *     poll, at least TEMPCOMP_SAR_US after;
+ *   - with TEMPCOMP_BANDWIDTH, the PG count of the reference PG_DELAY is measured once at the first reading, then a
+ *     change of temperature beyond the threshold runs the bisection of dwt_calcbandwidthtempadj() to get back to that
+ *     count, one dwt_pgcountsample() per poll. These switch the clocks of the DW1000, so they only run in polls made
+ *     with the transceiver idle;
+ *   - with TEMPCOMP_POWER, the TX power of the reference is corrected with dwt_calcpowertempadj();
+ *   - the new TX RF settings are written with dwt_configuretxrf() once the temperature is threshold away from the one
+ *     of the settings in use, not at every reading.
+ *
+ * The reference is the TX RF configuration given to tempcomp_init() (e.g. that of the profile), at the temperature of
+ * the first reading.
+ */
+
+#ifndef _TEMPCOMP_H_
+#define _TEMPCOMP_H_
+
+#include <time.h>
+
+#include "deca_types.h"
+#include "deca_device_api.h"
+
+#define TEMPCOMP_POWER			(1)			// compensate the TX power
+#define TEMPCOMP_BANDWIDTH		(2)			// compensate PG_DELAY, the transceiver must be idle in some polls
+
+#define TEMPCOMP_SAMPLE_MS_DEF	(1000)		// time between the starts of two measurements
+#define TEMPCOMP_THRESHOLD_DEF	(3.0)		// temperature change that triggers a compensation, degrees C
+#define TEMPCOMP_SAR_US			(1000)		// measurement time of the SAR ADC, see dwt_readtempvbat()
+#define TEMPCOMP_POLL_MS		(10)		// longest time between two polls for the SAR timing to hold
+
+#define TEMPCOMP_NEW_READING	(1)			// tempcomp_poll() results
+#define TEMPCOMP_UPDATED		(2)
+
+typedef struct
+{
+	uint32			flags;			// TEMPCOMP_POWER | TEMPCOMP_BANDWIDTH, 0 to only measure
+	uint32			sample_ms;
+	double			threshold;
+	uint8			chan;
+	dwt_txconfig_t	ref;			// reference TX RF settings
+	double			ref_temp;		// temperature of the reference, set by the first reading
+	uint16			ref_count;		// PG count of the reference PG_DELAY, 0 until measured
+	dwt_txconfig_t	txconfig;		// settings in use
+	double			comp_temp;		// temperature they were computed for
+
+	// Latest reading
+	int				valid;			// 0 until the first reading
+	double			temp;			// degrees C
+	double			vbat;			// V
+	uint32			readings;
+	uint32			updates;		// TX RF settings written
+	uint32			errors;			// PG count measurements that did not complete
+
+	// State machine
+	int				state;
+	struct timespec	started;		// start of the last measurement
+	uint32			count_sum;		// reference PG count samples
+	int				samples;
+	uint8			bit;			// bisection of PG_DELAY
+	uint8			curr_bw;
+	uint8			best_bw;
+	int32			delta_lowest;
+	double			target_temp;	// temperature of the compensation in progress
+} tempcomp_t;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tempcomp_init()
+ *
+ * @brief Set up the compensation of a device, with the default sample period and threshold. The first measurement
+ *        starts at the first poll.
+ *
+ * @param tc       - state to initialise
+ * @param config   - radio configuration, for the channel
+ * @param txconfig - reference TX RF settings, as configured on the device
+ * @param flags    - TEMPCOMP_POWER | TEMPCOMP_BANDWIDTH, 0 to only measure the temperature and voltage
+ *
+ * @return none
+ */
+void tempcomp_init(tempcomp_t *tc, const dwt_config_t *config, const dwt_txconfig_t *txconfig, uint32 flags);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn tempcomp_poll()
+ *
+ * @brief Run the next step of the compensation of the device selected, if one is due. It takes a few SPI transactions
+ *        at most and never sleeps; it must be called with decamutexon() held, at least every TEMPCOMP_POLL_MS for the
+ *        readings to be timely.
+ *
+ * @param tc   - compensation state of the device
+ * @param idle - 1 if nothing is being sent or received and nothing is scheduled until the call returns
+ *
+ * @return TEMPCOMP_NEW_READING if the temperature and voltage were just read, TEMPCOMP_UPDATED if the TX RF settings
+ *         were just written, or 0
+ */
+int tempcomp_poll(tempcomp_t *tc, int idle);
+
+#endif /* _TEMPCOMP_H_ */